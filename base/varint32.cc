@@ -20,7 +20,6 @@ inline uint32 GetByte(FILE* input) {
 // http://code.google.com/apis/protocolbuffers/docs/encoding.html
 bool ReadVarint32(FILE* input, uint32* value) {
   static const int kMaxVarintBytes = 10;
-  static const int kMaxVarint32Bytes = 5;
 
   if (ferror(input) || feof(input))
     return false;
@@ -67,9 +66,27 @@ bool ReadVarint32(FILE* input, uint32* value) {
 
 bool WriteVarint32(FILE* output, uint32 value) {
   using google::protobuf::io::CodedOutputStream;
-  uint8 buffer[4];
+  uint8 buffer[kMaxVarint32Bytes];
   uint8* end = CodedOutputStream::WriteVarint32ToArray(value, buffer);
   return fwrite(buffer, 1, end - buffer, output) == (end - buffer);
 }
 
+int EncodeVarint32(uint32 value, char* buffer) {
+  using google::protobuf::io::CodedOutputStream;
+  uint8* begin = reinterpret_cast<uint8*>(buffer);
+  return CodedOutputStream::WriteVarint32ToArray(value, begin) - begin;
+}
 
+bool DecodeVarint32(const char** p, const char* limit, uint32* value) {
+  uint32 result = 0;
+  for (int shift = 0; shift < 7 * kMaxVarint32Bytes && *p < limit;
+       shift += 7) {
+    uint32 b = static_cast<uint8>(*((*p)++));
+    result |= (b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
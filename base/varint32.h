@@ -11,4 +11,13 @@
 bool ReadVarint32(FILE* input, uint32* value);
 bool WriteVarint32(FILE* output, uint32 value);
 
+// In-memory codec of varint32.  EncodeVarint32 writes at most
+// kMaxVarint32Bytes bytes into |buffer| and returns the number of
+// bytes written.  DecodeVarint32 reads from *|p| (but not beyond
+// |limit|), advances *|p| and returns false on truncated or corrupted
+// input.
+static const int kMaxVarint32Bytes = 5;
+int EncodeVarint32(uint32 value, char* buffer);
+bool DecodeVarint32(const char** p, const char* limit, uint32* value);
+
 #endif  // BASE_VARINT32_H_
@@ -32,3 +32,27 @@ TEST(Varint32Test, WriteAndReadVarint32) {
   }
   fclose(input);
 }
+
+TEST(Varint32Test, EncodeAndDecodeVarint32) {
+  uint32 kTestValues[] = { 0, 1, 0xff, 0xffff, 0xffffffff };
+  static const int kNumTestValues = sizeof(kTestValues)/sizeof(kTestValues[0]);
+
+  char buffer[kNumTestValues * kMaxVarint32Bytes];
+  char* end = buffer;
+  for (int i = 0; i < kNumTestValues; ++i) {
+    end += EncodeVarint32(kTestValues[i], end);
+  }
+
+  const char* p = buffer;
+  for (int i = 0; i < kNumTestValues; ++i) {
+    uint32 value;
+    EXPECT_TRUE(DecodeVarint32(&p, end, &value));
+    EXPECT_EQ(kTestValues[i], value);
+  }
+  EXPECT_TRUE(p == end);
+
+  uint32 value;
+  const char* truncated = buffer + EncodeVarint32(0xffff, buffer) - 1;
+  p = buffer;
+  EXPECT_FALSE(DecodeVarint32(&p, truncated, &value));
+}
@@ -0,0 +1,67 @@
+
+
+//
+// A table-driven slicing-by-8 implementation of CRC32C, which
+// processes eight bytes per iteration.
+//
+#include "hash/crc32c.h"
+
+#include <string.h>
+
+namespace {
+
+static const uint32 kCRC32CPolynomial = 0x82f63b78;  // Reversed 0x1EDC6F41.
+
+class CRC32CTables {
+ public:
+  CRC32CTables() {
+    for (uint32 i = 0; i < 256; ++i) {
+      uint32 crc = i;
+      for (int k = 0; k < 8; ++k) {
+        crc = (crc >> 1) ^ ((crc & 1) ? kCRC32CPolynomial : 0);
+      }
+      table_[0][i] = crc;
+    }
+    for (uint32 i = 0; i < 256; ++i) {
+      for (int t = 1; t < 8; ++t) {
+        table_[t][i] = (table_[t - 1][i] >> 8) ^
+            table_[0][table_[t - 1][i] & 0xff];
+      }
+    }
+  }
+
+  uint32 table_[8][256];
+};
+
+// Initialized before main(), so CRC32CExtend is thread-safe.
+static const CRC32CTables kTables;
+
+}  // namespace
+
+uint32 CRC32CExtend(uint32 crc, const char* data, size_t size) {
+  const uint32 (*t)[256] = kTables.table_;
+  const uint8* p = reinterpret_cast<const uint8*>(data);
+  crc = ~crc;
+
+  while (size >= 8) {
+    uint32 low, high;
+    memcpy(&low, p, 4);
+    memcpy(&high, p + 4, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    low = __builtin_bswap32(low);
+    high = __builtin_bswap32(high);
+#endif
+    low ^= crc;
+    crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^
+        t[5][(low >> 16) & 0xff] ^ t[4][low >> 24] ^
+        t[3][high & 0xff] ^ t[2][(high >> 8) & 0xff] ^
+        t[1][(high >> 16) & 0xff] ^ t[0][high >> 24];
+    p += 8;
+    size -= 8;
+  }
+  while (size > 0) {
+    crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    --size;
+  }
+  return ~crc;
+}
@@ -0,0 +1,29 @@
+
+
+//
+// This file exports CRC32C, the CRC-32 using the Castagnoli polynomial
+// (0x1EDC6F41), which has better error detection than the CRC-32 of
+// zlib and is the checksum used in RecordIO files.
+//
+#ifndef HASH_CRC32C_H_
+#define HASH_CRC32C_H_
+
+#include <stddef.h>
+
+#include <string>
+
+#include "base/common.h"
+
+// Returns the CRC32C of |data| appended to data whose CRC32C is
+// |crc|.  Use crc = 0 for the checksum of |data| alone.
+uint32 CRC32CExtend(uint32 crc, const char* data, size_t size);
+
+inline uint32 CRC32C(const char* data, size_t size) {
+  return CRC32CExtend(0, data, size);
+}
+
+inline uint32 CRC32C(const std::string& s) {
+  return CRC32CExtend(0, s.data(), s.size());
+}
+
+#endif  // HASH_CRC32C_H_
@@ -0,0 +1,33 @@
+
+
+//
+// This unittest uses check values of CRC32C from RFC 3720 (iSCSI),
+// Section B.4.
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "base/common.h"
+#include "hash/crc32c.h"
+
+TEST(CRC32CTest, AsCheckValuesInRFC3720) {
+  EXPECT_EQ(0xe3069283, CRC32C("123456789", 9));
+  EXPECT_EQ(0x8a9136aa, CRC32C(std::string(32, '\0')));
+  EXPECT_EQ(0x62a8ab43, CRC32C(std::string(32, '\xff')));
+
+  std::string ascending;
+  for (int i = 0; i < 32; ++i) {
+    ascending.push_back(static_cast<char>(i));
+  }
+  EXPECT_EQ(0x46dd794e, CRC32C(ascending));
+}
+
+TEST(CRC32CTest, Extend) {
+  std::string s("The quick brown fox jumps over the lazy dog");
+  for (size_t split = 0; split <= s.size(); ++split) {
+    EXPECT_EQ(CRC32C(s),
+              CRC32CExtend(CRC32C(s.data(), split),
+                           s.data() + split, s.size() - split));
+  }
+}
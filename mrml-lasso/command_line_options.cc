@@ -12,6 +12,7 @@
 #include "mrml/mrml_recordio.h"
 
 #include "mrml-lasso/command_line_options.h"
+#include "mrml-lasso/feature_hashing.h"
 
 namespace logistic_regression {
 
@@ -50,7 +51,20 @@ void CommandLineOptions::Parse(const std::vector<string>& cmdline) {
        "# lr.convergence_tolerance")
       ("max_feature_number",
        po::value<int>(&max_feature_number)->default_value(0),
-       "# features, required when learning a dense model");
+       "# features, required when learning a dense model")
+      ("learner_threads",
+       po::value<int>(&learner_threads)->default_value(1),
+       "# threads running vector operations of the learner; results "
+       "are reproducible with the same number of threads")
+      ("single_precision_history",
+       po::value<bool>(&single_precision_history)->default_value(false),
+       "store the L-BFGS history of the dense learner in single "
+       "precision, which halves its memory")
+      ("feature_hash_bits",
+       po::value<int>(&feature_hash_bits)->default_value(0),
+       "if positive, features of training data are names rather than "
+       "ids, and are hashed into 2^feature_hash_bits dims, so neither "
+       "AssignFeatureID nor ConvertDataFormat needs to run");
   po::parsed_options parsed =
       po::command_line_parser(cmdline).options(desc).allow_unregistered().
       run();
@@ -68,12 +82,24 @@ void CommandLineOptions::Parse(const std::vector<string>& cmdline) {
             << "\tmax_line_search_steps:" << max_line_search_steps         \
             << "\tmax_iterations:" << max_iterations                       \
             << "\tconvergence_tolerance:" << convergence_tolerance         \
-            << "\tmax_feature_number:" << max_feature_number;
+            << "\tmax_feature_number:" << max_feature_number          \
+            << "\tlearner_threads:" << learner_threads                   \
+            << "\tsingle_precision_history:" << single_precision_history \
+            << "\tfeature_hash_bits:" << feature_hash_bits;
 
   CHECK_LT(0, memory_size);
   CHECK_LE(0, l1weight);
   CHECK_LT(1, max_line_search_steps);
   CHECK_LT(1, max_iterations);
   CHECK_LT(0, convergence_tolerance);
+  CHECK_LT(0, learner_threads);
+  CHECK_LE(0, feature_hash_bits);
+  if (feature_hash_bits > 0) {
+    // Models of hashed features have exactly 2^feature_hash_bits dims.
+    CHECK_LE(feature_hash_bits, FeatureHasher::kMaxBits);
+    int dim = 1 << feature_hash_bits;
+    CHECK(max_feature_number == 0 || max_feature_number == dim);
+    max_feature_number = dim;
+  }
 }
 }
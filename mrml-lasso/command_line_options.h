@@ -24,6 +24,9 @@ class CommandLineOptions {
   int max_iterations;
   double convergence_tolerance;
   int max_feature_number;  // only valid in "leanrer==dense" situation
+  int learner_threads;     // threads running vector operations of learner
+  bool single_precision_history;  // only valid with "learner==dense"
+  int feature_hash_bits;   // if > 0, hash feature names into 2^bits dims
 
   void Parse(const std::vector<std::string>& cmdline);
 };
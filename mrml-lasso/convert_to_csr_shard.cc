@@ -0,0 +1,56 @@
+
+
+//
+// Converts training data in text or InstancePB RecordIO into a CSR
+// shard (c.f. csr_shard.h), which can be loaded by train and used as
+// map inputs by --mrml_input_format=csr.
+//
+#include <iostream>
+#include <string>
+
+#include "boost/program_options/option.hpp"
+#include "boost/program_options/options_description.hpp"
+#include "boost/program_options/variables_map.hpp"
+#include "boost/program_options/parsers.hpp"
+
+#include "base/common.h"
+#include "mrml-lasso/csr_shard.h"
+
+using std::string;
+
+int main(int argc, char** argv) {
+  using logistic_regression::ConvertRecordIOToCSRShard;
+  using logistic_regression::ConvertTextToCSRShard;
+  namespace po = boost::program_options;
+
+  po::options_description desc("Supported options");
+  desc.add_options()
+      ("help", "Produce help message.")
+      ("input", po::value<string>(), "the training data file name")
+      ("input_format", po::value<string>()->default_value("text"),
+       "text or recordio")
+      ("output", po::value<string>(), "the CSR shard file name")
+      ("if_feature_binary", po::value<bool>()->default_value(false),
+       "if true, feature values are not stored");
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help") || !vm.count("input") || !vm.count("output")) {
+    std::cout << desc << "\n";
+    return 1;
+  }
+
+  const string& input = vm["input"].as<string>();
+  const string& output = vm["output"].as<string>();
+  bool binary = vm["if_feature_binary"].as<bool>();
+  bool succeeded = false;
+  if (vm["input_format"].as<string>() == "text") {
+    succeeded = ConvertTextToCSRShard(input, output, binary);
+  } else if (vm["input_format"].as<string>() == "recordio") {
+    succeeded = ConvertRecordIOToCSRShard(input, output, binary);
+  } else {
+    LOG(ERROR) << "Unknown input_format: " << vm["input_format"].as<string>();
+  }
+  return succeeded ? 0 : 1;
+}
@@ -0,0 +1,367 @@
+
+
+//
+#include "mrml-lasso/csr_shard.h"
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "base/varint32.h"
+#include "mrml/mrml_reader.h"
+#include "mrml/mrml_recordio.h"
+#include "mrml-lasso/logistic_regression.pb.h"
+
+namespace logistic_regression {
+
+using std::pair;
+using std::string;
+using std::vector;
+
+// Sizes of the fields of the header.
+static const size_t kCSRShardHeaderSize =
+    sizeof(uint32) * 2 + sizeof(uint64) * 4;
+
+static size_t AlignTo8(size_t size) {
+  return (size + 7) & ~static_cast<size_t>(7);
+}
+
+static bool LessId(const pair<uint32, float>& a,
+                   const pair<uint32, float>& b) {
+  return a.first < b.first;
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of CSRShardWriter
+//-----------------------------------------------------------------------------
+
+CSRShardWriter::CSRShardWriter(bool binary_features)
+    : binary_features_(binary_features),
+      dim_(0) {
+  feature_offsets_.push_back(0);
+  id_offsets_.push_back(0);
+}
+
+void CSRShardWriter::Add(float num_positive, float num_appearance,
+                         vector<pair<uint32, float> >* features) {
+  std::stable_sort(features->begin(), features->end(), LessId);
+  num_positive_.push_back(num_positive);
+  num_appearance_.push_back(num_appearance);
+
+  uint32 previous_id = 0;
+  char varint[kMaxVarint32Bytes];
+  for (size_t i = 0; i < features->size(); ++i) {
+    uint32 id = (*features)[i].first;
+    ids_.append(varint, EncodeVarint32(id - previous_id, varint));
+    previous_id = id;
+    if (!binary_features_) {
+      values_.push_back((*features)[i].second);
+    }
+  }
+  if (!features->empty()) {
+    dim_ = std::max(dim_, static_cast<uint64>(features->back().first) + 1);
+  }
+  feature_offsets_.push_back(feature_offsets_.back() + features->size());
+  id_offsets_.push_back(ids_.size());
+}
+
+static bool WriteSection(const void* data, size_t size, FILE* output) {
+  static const char kPadding[8] = { 0 };
+  size_t padding = AlignTo8(size) - size;
+  return (size == 0 || fwrite(data, size, 1, output) == 1) &&
+      (padding == 0 || fwrite(kPadding, padding, 1, output) == 1);
+}
+
+bool CSRShardWriter::Write(const string& filename) const {
+  FILE* output = fopen(filename.c_str(), "w");
+  if (output == NULL) {
+    LOG(ERROR) << "Cannot open " << filename;
+    return false;
+  }
+
+  uint32 flags = binary_features_ ? kCSRBinaryFeatures : 0;
+  uint64 num_instances = num_positive_.size();
+  uint64 num_features = feature_offsets_.back();
+  uint64 ids_size = ids_.size();
+  string header;
+  header.append(reinterpret_cast<const char*>(&kCSRShardMagic),
+                sizeof(kCSRShardMagic));
+  header.append(reinterpret_cast<const char*>(&flags), sizeof(flags));
+  header.append(reinterpret_cast<const char*>(&num_instances),
+                sizeof(num_instances));
+  header.append(reinterpret_cast<const char*>(&num_features),
+                sizeof(num_features));
+  header.append(reinterpret_cast<const char*>(&dim_), sizeof(dim_));
+  header.append(reinterpret_cast<const char*>(&ids_size), sizeof(ids_size));
+  CHECK_EQ(header.size(), kCSRShardHeaderSize);
+
+  bool succeeded =
+      WriteSection(header.data(), header.size(), output) &&
+      WriteSection(num_positive_.empty() ? NULL : &num_positive_[0],
+                   num_instances * sizeof(float), output) &&
+      WriteSection(num_appearance_.empty() ? NULL : &num_appearance_[0],
+                   num_instances * sizeof(float), output) &&
+      WriteSection(&feature_offsets_[0], (num_instances + 1) * sizeof(uint64),
+                   output) &&
+      WriteSection(&id_offsets_[0], (num_instances + 1) * sizeof(uint64),
+                   output) &&
+      WriteSection(ids_.data(), ids_.size(), output) &&
+      (binary_features_ ||
+       WriteSection(values_.empty() ? NULL : &values_[0],
+                    values_.size() * sizeof(float), output));
+  if (fclose(output) != 0) {
+    succeeded = false;
+  }
+  if (!succeeded) {
+    LOG(ERROR) << "Failed in writing " << filename;
+  }
+  return succeeded;
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of CSRShard
+//-----------------------------------------------------------------------------
+
+CSRShard::CSRShard()
+    : mapped_(NULL),
+      mapped_size_(0),
+      num_instances_(0),
+      num_features_(0),
+      dim_(0),
+      binary_features_(false) {}
+
+CSRShard::~CSRShard() {
+  Close();
+}
+
+bool CSRShard::IsCSRShard(const string& filename) {
+  FILE* input = fopen(filename.c_str(), "r");
+  if (input == NULL) {
+    return false;
+  }
+  uint32 magic = 0;
+  bool is_shard = fread(&magic, sizeof(magic), 1, input) == 1 &&
+      magic == kCSRShardMagic;
+  fclose(input);
+  return is_shard;
+}
+
+bool CSRShard::Open(const string& filename) {
+  Close();
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG(ERROR) << "Cannot open " << filename;
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 ||
+      file_stat.st_size < static_cast<off_t>(kCSRShardHeaderSize)) {
+    LOG(ERROR) << "Not a CSR shard: " << filename;
+    close(fd);
+    return false;
+  }
+  void* mapped = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    LOG(ERROR) << "Cannot mmap " << filename;
+    return false;
+  }
+  mapped_ = static_cast<char*>(mapped);
+  mapped_size_ = file_stat.st_size;
+
+  uint32 magic, flags;
+  uint64 num_instances, num_features, dim, ids_size;
+  const char* p = mapped_;
+  memcpy(&magic, p, sizeof(magic));
+  p += sizeof(magic);
+  memcpy(&flags, p, sizeof(flags));
+  p += sizeof(flags);
+  memcpy(&num_instances, p, sizeof(num_instances));
+  p += sizeof(num_instances);
+  memcpy(&num_features, p, sizeof(num_features));
+  p += sizeof(num_features);
+  memcpy(&dim, p, sizeof(dim));
+  p += sizeof(dim);
+  memcpy(&ids_size, p, sizeof(ids_size));
+
+  binary_features_ = (flags & kCSRBinaryFeatures) != 0;
+  size_t offset = AlignTo8(kCSRShardHeaderSize);
+  size_t num_positive_offset = offset;
+  offset += AlignTo8(num_instances * sizeof(float));
+  size_t num_appearance_offset = offset;
+  offset += AlignTo8(num_instances * sizeof(float));
+  size_t feature_offsets_offset = offset;
+  offset += AlignTo8((num_instances + 1) * sizeof(uint64));
+  size_t id_offsets_offset = offset;
+  offset += AlignTo8((num_instances + 1) * sizeof(uint64));
+  size_t ids_offset = offset;
+  offset += AlignTo8(ids_size);
+  size_t values_offset = offset;
+  if (!binary_features_) {
+    offset += AlignTo8(num_features * sizeof(float));
+  }
+  if (magic != kCSRShardMagic || offset != mapped_size_) {
+    LOG(ERROR) << "Not a CSR shard or truncated: " << filename;
+    Close();
+    return false;
+  }
+
+  num_instances_ = num_instances;
+  num_features_ = num_features;
+  dim_ = dim;
+  num_positive_ = reinterpret_cast<const float*>(mapped_ + num_positive_offset);
+  num_appearance_ =
+      reinterpret_cast<const float*>(mapped_ + num_appearance_offset);
+  feature_offsets_ =
+      reinterpret_cast<const uint64*>(mapped_ + feature_offsets_offset);
+  id_offsets_ = reinterpret_cast<const uint64*>(mapped_ + id_offsets_offset);
+  ids_ = mapped_ + ids_offset;
+  values_ = binary_features_ ? NULL :
+      reinterpret_cast<const float*>(mapped_ + values_offset);
+  madvise(mapped_, mapped_size_, MADV_SEQUENTIAL);
+  return true;
+}
+
+void CSRShard::Close() {
+  if (mapped_ != NULL) {
+    munmap(mapped_, mapped_size_);
+    mapped_ = NULL;
+    mapped_size_ = 0;
+  }
+  num_instances_ = num_features_ = dim_ = 0;
+}
+
+void CSRShard::ReadRow(int64 i, CSRRow* row) const {
+  CHECK_LE(0, i);
+  CHECK_LT(i, num_instances_);
+  row->num_positive = num_positive_[i];
+  row->num_appearance = num_appearance_[i];
+
+  int size = num_row_features(i);
+  row->ids.resize(size);
+  const char* p = ids_ + id_offsets_[i];
+  const char* limit = ids_ + id_offsets_[i + 1];
+  uint32 id = 0;
+  for (int j = 0; j < size; ++j) {
+    uint32 delta;
+    CHECK(DecodeVarint32(&p, limit, &delta));
+    id += delta;
+    row->ids[j] = id;
+  }
+
+  if (binary_features_) {
+    row->values.clear();
+  } else {
+    const float* values = values_ + feature_offsets_[i];
+    row->values.assign(values, values + size);
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Converters
+//-----------------------------------------------------------------------------
+
+bool ConvertTextToCSRShard(const string& input,
+                           const string& output,
+                           bool binary_features) {
+  MRML_TextReader reader(input, false);
+  CSRShardWriter writer(binary_features);
+  StringPiece piece;
+  int64 offset;
+  string line;
+  vector<pair<uint32, float> > features;
+  int64 num_malformed_lines = 0;
+  while (reader.ReadLine(&piece, &offset)) {
+    line.assign(piece.data(), piece.size());
+    const char* p = line.c_str();
+    char* end;
+    float num_positive = strtof(p, &end);
+    if (end == p) {
+      continue;  // Skip lines without labels, e.g., empty lines.
+    }
+    p = end;
+    float num_appearance = strtof(p, &end);
+    if (end == p) {
+      continue;
+    }
+    p = end;
+
+    features.clear();
+    bool malformed = false;
+    while (true) {
+      long long id = strtoll(p, &end, 10);  // NOLINT
+      if (end == p) {
+        break;
+      }
+      p = end;
+      float value = strtof(p, &end);
+      if (end == p || id < 0 || id > 0xffffffffLL) {
+        malformed = true;
+        break;
+      }
+      p = end;
+      features.push_back(std::make_pair(static_cast<uint32>(id), value));
+    }
+    while (isspace(static_cast<unsigned char>(*p))) {
+      ++p;
+    }
+    // Rather than keeping the features before an unparsable one, which
+    // would silently train on a truncated instance, reject the line.
+    if (malformed || *p != '\0') {
+      if (num_malformed_lines < 10) {
+        LOG(ERROR) << "Malformed line at offset " << offset << " of "
+                   << input << ": " << line;
+      }
+      ++num_malformed_lines;
+      continue;
+    }
+    writer.Add(num_positive, num_appearance, &features);
+  }
+  if (num_malformed_lines > 0) {
+    LOG(ERROR) << "Failed in converting " << input << ": "
+               << num_malformed_lines << " malformed lines.";
+    return false;
+  }
+  LOG(INFO) << "Converted " << writer.num_instances() << " instances from "
+            << input;
+  return writer.Write(output);
+}
+
+bool ConvertRecordIOToCSRShard(const string& input,
+                               const string& output,
+                               bool binary_features) {
+  FILE* input_stream = fopen(input.c_str(), "r");
+  if (input_stream == NULL) {
+    LOG(ERROR) << "Cannot open " << input;
+    return false;
+  }
+  CSRShardWriter writer(binary_features);
+  {
+    MRML_RecordStreamReader reader(input_stream);
+    string key;
+    InstancePB instance;
+    vector<pair<uint32, float> > features;
+    while (reader.Read(&key, &instance)) {
+      features.clear();
+      for (int i = 0; i < instance.feature_size(); ++i) {
+        features.push_back(std::make_pair(instance.feature(i).id(),
+                                          instance.feature(i).value()));
+      }
+      writer.Add(instance.num_positive(), instance.num_appearance(),
+                 &features);
+    }
+  }
+  fclose(input_stream);
+  LOG(INFO) << "Converted " << writer.num_instances() << " instances from "
+            << input;
+  return writer.Write(output);
+}
+
+}  // namespace logistic_regression
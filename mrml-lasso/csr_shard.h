@@ -0,0 +1,134 @@
+
+
+//
+// A CSR shard is a compact binary file of training instances, which is
+// mmapped rather than parsed when loaded.  Compared with text lines
+// and InstancePB records, it keeps no feature names, and compresses
+// feature ids of an instance into varint32 deltas of sorted ids.
+//
+// A shard consists of a header:
+//
+//   uint32 kCSRShardMagic, uint32 flags      -- kCSRBinaryFeatures
+//   uint64 num_instances, uint64 num_features, uint64 dim,
+//   uint64 ids_size
+//
+// followed by sections, each aligned to 8 bytes:
+//
+//   float  num_positive[num_instances]
+//   float  num_appearance[num_instances]
+//   uint64 feature_offsets[num_instances + 1]  -- first feature of a row
+//   uint64 id_offsets[num_instances + 1]       -- first byte of a row in ids
+//   uint8  ids[ids_size]                       -- varint32 deltas
+//   float  values[num_features]                -- absent if binary features
+//
+// where num_features counts non-zero features of all instances, and
+// dim is the max feature id plus one.
+//
+#ifndef MRML_LASSO_CSR_SHARD_H_
+#define MRML_LASSO_CSR_SHARD_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/common.h"
+
+namespace logistic_regression {
+
+static const uint32 kCSRShardMagic = 0x31525343;  // "CSR1"
+static const uint32 kCSRBinaryFeatures = 0x1;
+
+// A decoded instance.  values is empty if features are binary.
+struct CSRRow {
+  float num_positive;
+  float num_appearance;
+  std::vector<uint32> ids;
+  std::vector<float> values;
+};
+
+// Accumulates instances in memory and writes them into a shard.
+class CSRShardWriter {
+ public:
+  explicit CSRShardWriter(bool binary_features);
+
+  // Appends an instance.  |features| are pairs of id and value, which
+  // are sorted by id in place.  Values are ignored if features are
+  // binary.
+  void Add(float num_positive, float num_appearance,
+           std::vector<std::pair<uint32, float> >* features);
+
+  bool Write(const std::string& filename) const;
+
+  int64 num_instances() const { return num_positive_.size(); }
+
+ private:
+  bool binary_features_;
+  uint64 dim_;
+  std::vector<float> num_positive_;
+  std::vector<float> num_appearance_;
+  std::vector<uint64> feature_offsets_;
+  std::vector<uint64> id_offsets_;
+  std::string ids_;
+  std::vector<float> values_;
+
+  DISALLOW_COPY_AND_ASSIGN(CSRShardWriter);
+};
+
+// Maps a shard into memory.  Decoding an instance touches only its
+// own bytes, so instances can be read in any order.
+class CSRShard {
+ public:
+  CSRShard();
+  ~CSRShard();
+
+  // Returns false if |filename| cannot be mapped or is not a shard.
+  bool Open(const std::string& filename);
+  void Close();
+
+  static bool IsCSRShard(const std::string& filename);
+
+  int64 num_instances() const { return num_instances_; }
+  int64 num_features() const { return num_features_; }
+  int64 dim() const { return dim_; }
+  bool binary_features() const { return binary_features_; }
+
+  float num_positive(int64 i) const { return num_positive_[i]; }
+  float num_appearance(int64 i) const { return num_appearance_[i]; }
+  int num_row_features(int64 i) const {
+    return feature_offsets_[i + 1] - feature_offsets_[i];
+  }
+
+  // Decodes instance |i| into |row|, reusing its buffers.
+  void ReadRow(int64 i, CSRRow* row) const;
+
+ private:
+  char* mapped_;
+  size_t mapped_size_;
+  int64 num_instances_;
+  int64 num_features_;
+  int64 dim_;
+  bool binary_features_;
+  const float* num_positive_;
+  const float* num_appearance_;
+  const uint64* feature_offsets_;
+  const uint64* id_offsets_;
+  const char* ids_;
+  const float* values_;
+
+  DISALLOW_COPY_AND_ASSIGN(CSRShard);
+};
+
+// Converts training data in text lines ("num_positive num_appearance
+// id value id value ...") or InstancePB records into a shard.  Text
+// lines without labels are skipped, but a line with features that
+// cannot be parsed fails the conversion.
+bool ConvertTextToCSRShard(const std::string& input,
+                           const std::string& output,
+                           bool binary_features);
+bool ConvertRecordIOToCSRShard(const std::string& input,
+                               const std::string& output,
+                               bool binary_features);
+
+}  // namespace logistic_regression
+
+#endif  // MRML_LASSO_CSR_SHARD_H_
@@ -0,0 +1,167 @@
+
+
+//
+#include <stdio.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/common.h"
+#include "mrml/mrml_recordio.h"
+#include "mrml-lasso/csr_shard.h"
+#include "mrml-lasso/logistic_regression.pb.h"
+
+using logistic_regression::CSRRow;
+using logistic_regression::CSRShard;
+using logistic_regression::CSRShardWriter;
+using logistic_regression::ConvertRecordIOToCSRShard;
+using logistic_regression::ConvertTextToCSRShard;
+using logistic_regression::InstancePB;
+using std::make_pair;
+using std::pair;
+using std::string;
+using std::vector;
+
+static const char* kShardFilename = "/tmp/testCSRShard";
+static const char* kInputFilename = "/tmp/testCSRShardInput";
+
+static void WriteFile(const string& filename, const string& content) {
+  FILE* output = fopen(filename.c_str(), "w");
+  CHECK(output != NULL);
+  fwrite(content.data(), 1, content.size(), output);
+  fclose(output);
+}
+
+TEST(CSRShardTest, WriteAndRead) {
+  for (int binary = 0; binary < 2; ++binary) {
+    CSRShardWriter writer(binary);
+    vector<pair<uint32, float> > features;
+    features.push_back(make_pair(4000000000U, 0.5f));
+    features.push_back(make_pair(7U, 2.0f));
+    features.push_back(make_pair(300U, -1.0f));
+    writer.Add(1, 3, &features);
+    features.clear();
+    writer.Add(-1, 1, &features);  // An instance without features.
+    features.push_back(make_pair(0U, 3.0f));
+    writer.Add(0, 2, &features);
+    ASSERT_TRUE(writer.Write(kShardFilename));
+
+    ASSERT_TRUE(CSRShard::IsCSRShard(kShardFilename));
+    CSRShard shard;
+    ASSERT_TRUE(shard.Open(kShardFilename));
+    EXPECT_EQ(3, shard.num_instances());
+    EXPECT_EQ(4, shard.num_features());
+    EXPECT_EQ(4000000001LL, shard.dim());
+    EXPECT_EQ(binary != 0, shard.binary_features());
+
+    CSRRow row;
+    shard.ReadRow(0, &row);
+    EXPECT_EQ(1, row.num_positive);
+    EXPECT_EQ(3, row.num_appearance);
+    ASSERT_EQ(3, row.ids.size());
+    EXPECT_EQ(7, row.ids[0]);
+    EXPECT_EQ(300, row.ids[1]);
+    EXPECT_EQ(4000000000U, row.ids[2]);
+    if (binary) {
+      EXPECT_TRUE(row.values.empty());
+    } else {
+      ASSERT_EQ(3, row.values.size());
+      EXPECT_EQ(2.0f, row.values[0]);
+      EXPECT_EQ(-1.0f, row.values[1]);
+      EXPECT_EQ(0.5f, row.values[2]);
+    }
+
+    shard.ReadRow(1, &row);
+    EXPECT_EQ(-1, row.num_positive);
+    EXPECT_TRUE(row.ids.empty());
+
+    shard.ReadRow(2, &row);
+    EXPECT_EQ(2, row.num_appearance);
+    ASSERT_EQ(1, row.ids.size());
+    EXPECT_EQ(0, row.ids[0]);
+  }
+}
+
+TEST(CSRShardTest, RejectOtherFiles) {
+  WriteFile(kInputFilename, "1 2 3 4.0\n");
+  EXPECT_FALSE(CSRShard::IsCSRShard(kInputFilename));
+  CSRShard shard;
+  EXPECT_FALSE(shard.Open(kInputFilename));
+}
+
+TEST(CSRShardTest, ConvertText) {
+  WriteFile(kInputFilename, "10 10   2 1 5 0.5\n"
+                            "\n"
+                            "0  10   5 1 2 1\n"
+                            "1 2");
+  ASSERT_TRUE(ConvertTextToCSRShard(kInputFilename, kShardFilename, false));
+  CSRShard shard;
+  ASSERT_TRUE(shard.Open(kShardFilename));
+  ASSERT_EQ(3, shard.num_instances());
+  EXPECT_EQ(6, shard.dim());
+
+  CSRRow row;
+  shard.ReadRow(0, &row);
+  EXPECT_EQ(10, row.num_positive);
+  ASSERT_EQ(2, row.ids.size());
+  EXPECT_EQ(2, row.ids[0]);
+  EXPECT_EQ(1.0f, row.values[0]);
+  EXPECT_EQ(5, row.ids[1]);
+  EXPECT_EQ(0.5f, row.values[1]);
+
+  shard.ReadRow(1, &row);
+  EXPECT_EQ(0, row.num_positive);
+  ASSERT_EQ(2, row.ids.size());
+  EXPECT_EQ(2, row.ids[0]);
+  EXPECT_EQ(5, row.ids[1]);
+
+  shard.ReadRow(2, &row);
+  EXPECT_EQ(1, row.num_positive);
+  EXPECT_EQ(2, row.num_appearance);
+  EXPECT_TRUE(row.ids.empty());
+}
+
+TEST(CSRShardTest, ConvertTextRejectsMalformedLines) {
+  static const char* kMalformedLines[] = {
+    "1 2  3 1 5\n",           // A feature without value.
+    "1 2  3 1 5:1\n",         // An unparsable feature.
+    "1 2  -3 1\n",            // A negative id.
+    "1 2  4294967296 1\n",    // An id beyond uint32.
+  };
+  for (size_t i = 0; i < sizeof(kMalformedLines) / sizeof(*kMalformedLines);
+       ++i) {
+    WriteFile(kInputFilename, string("0 1  2 1\n") + kMalformedLines[i]);
+    EXPECT_FALSE(ConvertTextToCSRShard(kInputFilename, kShardFilename, false));
+  }
+  WriteFile(kInputFilename, "0 1  2 1 \t\n1 2  4294967295 1\n");
+  EXPECT_TRUE(ConvertTextToCSRShard(kInputFilename, kShardFilename, false));
+}
+
+TEST(CSRShardTest, ConvertRecordIO) {
+  FILE* output = fopen(kInputFilename, "w");
+  ASSERT_TRUE(output != NULL);
+  InstancePB instance;
+  instance.set_num_positive(1);
+  instance.set_num_appearance(4);
+  InstancePB::Feature* feature = instance.add_feature();
+  feature->set_name("group:name");
+  feature->set_id(9);
+  feature->set_value(0.25);
+  MRML_WriteRecord(output, "", instance);
+  fclose(output);
+
+  ASSERT_TRUE(ConvertRecordIOToCSRShard(kInputFilename, kShardFilename, true));
+  CSRShard shard;
+  ASSERT_TRUE(shard.Open(kShardFilename));
+  ASSERT_EQ(1, shard.num_instances());
+  EXPECT_TRUE(shard.binary_features());
+  CSRRow row;
+  shard.ReadRow(0, &row);
+  EXPECT_EQ(4, row.num_appearance);
+  ASSERT_EQ(1, row.ids.size());
+  EXPECT_EQ(9, row.ids[0]);
+  EXPECT_TRUE(row.values.empty());
+}
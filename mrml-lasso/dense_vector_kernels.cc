@@ -0,0 +1,1550 @@
+
+
+//
+#include "mrml-lasso/dense_vector_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DENSE_KERNELS_X86
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "mrml-lasso/vector_thread_pool.h"
+
+namespace logistic_regression {
+
+namespace {
+
+// Kernels of an instruction set.
+struct DenseKernels {
+  const char* name;
+  void (*scale)(double* v, size_t n, double c);
+  void (*scale_into)(double* u, const double* v, size_t n, double c);
+  void (*add_scaled)(double* u, const double* v, size_t n, double c);
+  void (*add_scaled_into)(double* w, const double* u, const double* v,
+                          size_t n, double c);
+  double (*dot_product)(const double* u, const double* v, size_t n);
+  void (*steepest_desc_dir)(double* dir, double* steepest, const double* x,
+                            const double* grad, size_t n, double l1weight);
+  double (*fix_dir_signs)(double* dir, const double* steepest, size_t n);
+  void (*projected_step)(double* new_x, const double* x, const double* dir,
+                         size_t n, double alpha);
+  void (*to_double)(double* u, const float* v, size_t n);
+  void (*to_float)(float* u, const double* v, size_t n);
+  double (*logistic_loss)(const double* margins, const double* positives,
+                          const double* negatives, size_t n, double* coefs);
+};
+
+//-----------------------------------------------------------------------------
+// The logistic loss kernels evaluate exp(-a) for a >= 0 as 2^k * exp(r),
+// where k = round(-a / ln2) and |r| <= ln2 / 2, by the Taylor polynomial
+// of exp(r) of degree 13, and log1p(e) for e in [0, 1] as
+// k * ln2 + 2 * atanh(s), where k is 0 or 1 and |s| <= 0.172, by the
+// first 11 terms of the series of atanh.  Truncation errors of both are
+// below 1e-17, so results are accurate to a few ulps.
+//-----------------------------------------------------------------------------
+
+// ln2 split so that k * kLn2Hi is exact for |k| < 2^11.
+const double kLn2Hi = 6.93147180369123816490e-01;
+const double kLn2Lo = 1.90821492927058770002e-10;
+const double kLog2E = 1.44269504088896338700e+00;
+// Adding 1.5 * 2^52 rounds a double of magnitude below 2^51 to an
+// integer, which is also left in the low bits of the sum.
+const double kRoundMagic = 6755399441055744.0;
+// exp(-a) is evaluated at min(a, kMaxExpArg), so that 2^k stays a
+// normal number.  exp(-708) is negligible next to 1 anyway.
+const double kMaxExpArg = 708;
+const double kSqrt2Minus1 = 0.41421356237309504880;
+// 1 / j! for j in [0, 13].
+const double kExpCoefs[] = {
+  1.0, 1.0, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720,
+  1.0 / 5040, 1.0 / 40320, 1.0 / 362880, 1.0 / 3628800,
+  1.0 / 39916800, 1.0 / 479001600, 1.0 / 6227020800.0
+};
+const int kExpDegree = 13;
+// 2 / (2j + 1) for j in [0, 10].
+const double kAtanhCoefs[] = {
+  2.0, 2.0 / 3, 2.0 / 5, 2.0 / 7, 2.0 / 9, 2.0 / 11, 2.0 / 13, 2.0 / 15,
+  2.0 / 17, 2.0 / 19, 2.0 / 21
+};
+const int kAtanhDegree = 10;
+
+//-----------------------------------------------------------------------------
+// Scalar kernels, which also process the tails of arrays not filling a
+// whole SIMD loop.
+//-----------------------------------------------------------------------------
+void ScaleScalar(double* v, size_t n, double c) {
+  for (size_t i = 0; i < n; ++i) {
+    v[i] *= c;
+  }
+}
+
+void ScaleIntoScalar(double* u, const double* v, size_t n, double c) {
+  for (size_t i = 0; i < n; ++i) {
+    u[i] = v[i] * c;
+  }
+}
+
+void AddScaledScalar(double* u, const double* v, size_t n, double c) {
+  for (size_t i = 0; i < n; ++i) {
+    u[i] += v[i] * c;
+  }
+}
+
+void AddScaledIntoScalar(double* w, const double* u, const double* v,
+                         size_t n, double c) {
+  for (size_t i = 0; i < n; ++i) {
+    w[i] = u[i] + v[i] * c;
+  }
+}
+
+double DotProductScalar(const double* u, const double* v, size_t n) {
+  double ret = 0;
+  for (size_t i = 0; i < n; ++i) {
+    ret += u[i] * v[i];
+  }
+  return ret;
+}
+
+void SteepestDescDirScalar(double* dir, double* steepest, const double* x,
+                           const double* grad, size_t n, double l1weight) {
+  if (l1weight == 0) {
+    for (size_t i = 0; i < n; ++i) {
+      dir[i] = steepest[i] = -grad[i];
+    }
+    return;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    double d;
+    if (x[i] < 0) {
+      d = -grad[i] + l1weight;
+    } else if (x[i] > 0) {
+      d = -grad[i] - l1weight;
+    } else if (grad[i] < -l1weight) {
+      d = -grad[i] - l1weight;
+    } else if (grad[i] > l1weight) {
+      d = -grad[i] + l1weight;
+    } else {
+      d = 0;
+    }
+    dir[i] = steepest[i] = d;
+  }
+}
+
+double FixDirSignsScalar(double* dir, const double* steepest, size_t n) {
+  double ret = 0;
+  for (size_t i = 0; i < n; ++i) {
+    double product = dir[i] * steepest[i];
+    if (product <= 0) {
+      dir[i] = 0;
+    } else {
+      ret -= product;
+    }
+  }
+  return ret;
+}
+
+void ProjectedStepScalar(double* new_x, const double* x, const double* dir,
+                         size_t n, double alpha) {
+  for (size_t i = 0; i < n; ++i) {
+    double value = x[i] + dir[i] * alpha;
+    new_x[i] = (x[i] * value < 0) ? 0 : value;
+  }
+}
+
+void ToDoubleScalar(double* u, const float* v, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    u[i] = v[i];
+  }
+}
+
+void ToFloatScalar(float* u, const double* v, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    u[i] = static_cast<float>(v[i]);
+  }
+}
+
+// Returns exp(-a) for a >= 0, or NaN for NaN.
+inline double ExpNegScalar(double a) {
+  if (a != a) {
+    return a;  // Rather than converting NaN into an int exponent.
+  }
+  double x = -std::min(a, kMaxExpArg);
+  double k = (x * kLog2E + kRoundMagic) - kRoundMagic;
+  double r = (x - k * kLn2Hi) - k * kLn2Lo;
+  double p = kExpCoefs[kExpDegree];
+  for (int j = kExpDegree - 1; j >= 0; --j) {
+    p = p * r + kExpCoefs[j];
+  }
+  return ldexp(p, static_cast<int>(k));
+}
+
+// Returns log(1 + e) for e in [0, 1].
+inline double Log1pScalar(double e) {
+  double k = (e > kSqrt2Minus1) ? 1 : 0;
+  double s = (e - k) / (e + 2 + k);
+  double z = s * s;
+  double p = kAtanhCoefs[kAtanhDegree];
+  for (int j = kAtanhDegree - 1; j >= 0; --j) {
+    p = p * z + kAtanhCoefs[j];
+  }
+  return k * kLn2Hi + (s * p + k * kLn2Lo);
+}
+
+// Both log(1 + exp(-m)) and log(1 + exp(m)) are log1p(exp(-|m|)) plus
+// max(-m, 0) and max(m, 0) respectively, and sigmoid(|m|) and
+// sigmoid(-|m|) are 1 / (1 + exp(-|m|)) and exp(-|m|) / (1 + exp(-|m|)),
+// so each instance needs only one exp and one log1p.  The terms of
+// positives and negatives are masked out unless the counts are
+// positive, so that a zero count times an infinite loss is not NaN.
+double LogisticLossScalar(const double* margins, const double* positives,
+                          const double* negatives, size_t n, double* coefs) {
+  double ret = 0;
+  for (size_t i = 0; i < n; ++i) {
+    double m = margins[i];
+    double e = ExpNegScalar(fabs(m));
+    double log1p_e = Log1pScalar(e);
+    double sigmoid_abs = 1 / (1 + e);
+    double sigmoid_neg_abs = e * sigmoid_abs;
+    double sigmoid = (m >= 0) ? sigmoid_abs : sigmoid_neg_abs;
+    double sigmoid_neg = (m >= 0) ? sigmoid_neg_abs : sigmoid_abs;
+    double coef = 0;
+    if (positives[i] > 0) {
+      ret += positives[i] * (log1p_e + std::max(-m, 0.0));
+      coef -= positives[i] * sigmoid_neg;
+    }
+    if (negatives[i] > 0) {
+      ret += negatives[i] * (log1p_e + std::max(m, 0.0));
+      coef += negatives[i] * sigmoid;
+    }
+    coefs[i] = coef;
+  }
+  return ret;
+}
+
+const DenseKernels kScalarKernels = {
+  "scalar", ScaleScalar, ScaleIntoScalar, AddScaledScalar,
+  AddScaledIntoScalar, DotProductScalar, SteepestDescDirScalar,
+  FixDirSignsScalar, ProjectedStepScalar, ToDoubleScalar, ToFloatScalar,
+  LogisticLossScalar
+};
+
+#ifdef DENSE_KERNELS_X86
+
+//-----------------------------------------------------------------------------
+// SSE2 kernels, 2 doubles per register.
+//-----------------------------------------------------------------------------
+__attribute__((target("sse2")))
+void ScaleSSE2(double* v, size_t n, double c) {
+  __m128d vc = _mm_set1_pd(c);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_pd(v + i, _mm_mul_pd(_mm_loadu_pd(v + i), vc));
+    _mm_storeu_pd(v + i + 2, _mm_mul_pd(_mm_loadu_pd(v + i + 2), vc));
+  }
+  ScaleScalar(v + i, n - i, c);
+}
+
+__attribute__((target("sse2")))
+void ScaleIntoSSE2(double* u, const double* v, size_t n, double c) {
+  __m128d vc = _mm_set1_pd(c);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_pd(u + i, _mm_mul_pd(_mm_loadu_pd(v + i), vc));
+    _mm_storeu_pd(u + i + 2, _mm_mul_pd(_mm_loadu_pd(v + i + 2), vc));
+  }
+  ScaleIntoScalar(u + i, v + i, n - i, c);
+}
+
+__attribute__((target("sse2")))
+void AddScaledSSE2(double* u, const double* v, size_t n, double c) {
+  __m128d vc = _mm_set1_pd(c);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_pd(u + i, _mm_add_pd(_mm_loadu_pd(u + i),
+                                    _mm_mul_pd(_mm_loadu_pd(v + i), vc)));
+    _mm_storeu_pd(u + i + 2,
+                  _mm_add_pd(_mm_loadu_pd(u + i + 2),
+                             _mm_mul_pd(_mm_loadu_pd(v + i + 2), vc)));
+  }
+  AddScaledScalar(u + i, v + i, n - i, c);
+}
+
+__attribute__((target("sse2")))
+void AddScaledIntoSSE2(double* w, const double* u, const double* v,
+                       size_t n, double c) {
+  __m128d vc = _mm_set1_pd(c);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_pd(w + i, _mm_add_pd(_mm_loadu_pd(u + i),
+                                    _mm_mul_pd(_mm_loadu_pd(v + i), vc)));
+    _mm_storeu_pd(w + i + 2,
+                  _mm_add_pd(_mm_loadu_pd(u + i + 2),
+                             _mm_mul_pd(_mm_loadu_pd(v + i + 2), vc)));
+  }
+  AddScaledIntoScalar(w + i, u + i, v + i, n - i, c);
+}
+
+__attribute__((target("sse2")))
+double DotProductSSE2(const double* u, const double* v, size_t n) {
+  __m128d sum0 = _mm_setzero_pd();
+  __m128d sum1 = _mm_setzero_pd();
+  __m128d sum2 = _mm_setzero_pd();
+  __m128d sum3 = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    sum0 = _mm_add_pd(sum0, _mm_mul_pd(_mm_loadu_pd(u + i),
+                                       _mm_loadu_pd(v + i)));
+    sum1 = _mm_add_pd(sum1, _mm_mul_pd(_mm_loadu_pd(u + i + 2),
+                                       _mm_loadu_pd(v + i + 2)));
+    sum2 = _mm_add_pd(sum2, _mm_mul_pd(_mm_loadu_pd(u + i + 4),
+                                       _mm_loadu_pd(v + i + 4)));
+    sum3 = _mm_add_pd(sum3, _mm_mul_pd(_mm_loadu_pd(u + i + 6),
+                                       _mm_loadu_pd(v + i + 6)));
+  }
+  __m128d sum = _mm_add_pd(_mm_add_pd(sum0, sum1), _mm_add_pd(sum2, sum3));
+  double lanes[2];
+  _mm_storeu_pd(lanes, sum);
+  return lanes[0] + lanes[1] + DotProductScalar(u + i, v + i, n - i);
+}
+
+// Without blend instructions, SSE2 selects between values by masks of
+// comparisons: (mask & a) | (~mask & b).
+__attribute__((target("sse2")))
+void SteepestDescDirSSE2(double* dir, double* steepest, const double* x,
+                         const double* grad, size_t n, double l1weight) {
+  const __m128d zero = _mm_setzero_pd();
+  const __m128d minus_one = _mm_set1_pd(-1);
+  const __m128d l1 = _mm_set1_pd(l1weight);
+  const __m128d minus_l1 = _mm_set1_pd(-l1weight);
+  size_t i = 0;
+  if (l1weight == 0) {
+    for (; i + 2 <= n; i += 2) {
+      __m128d d = _mm_mul_pd(_mm_loadu_pd(grad + i), minus_one);
+      _mm_storeu_pd(dir + i, d);
+      _mm_storeu_pd(steepest + i, d);
+    }
+  } else {
+    for (; i + 2 <= n; i += 2) {
+      __m128d g = _mm_loadu_pd(grad + i);
+      __m128d xv = _mm_loadu_pd(x + i);
+      __m128d neg_g = _mm_mul_pd(g, minus_one);
+      __m128d x_neg = _mm_cmplt_pd(xv, zero);
+      __m128d x_pos = _mm_cmpgt_pd(xv, zero);
+      __m128d x_nonzero = _mm_or_pd(x_neg, x_pos);
+      // Where to take -g + l1 and -g - l1, respectively.
+      __m128d plus = _mm_or_pd(x_neg,
+                               _mm_andnot_pd(x_nonzero, _mm_cmpgt_pd(g, l1)));
+      __m128d minus = _mm_or_pd(
+          x_pos, _mm_andnot_pd(x_nonzero, _mm_cmplt_pd(g, minus_l1)));
+      __m128d d = _mm_or_pd(_mm_and_pd(plus, _mm_add_pd(neg_g, l1)),
+                            _mm_and_pd(minus, _mm_sub_pd(neg_g, l1)));
+      _mm_storeu_pd(dir + i, d);
+      _mm_storeu_pd(steepest + i, d);
+    }
+  }
+  SteepestDescDirScalar(dir + i, steepest + i, x + i, grad + i, n - i,
+                        l1weight);
+}
+
+__attribute__((target("sse2")))
+double FixDirSignsSSE2(double* dir, const double* steepest, size_t n) {
+  const __m128d zero = _mm_setzero_pd();
+  __m128d sum0 = _mm_setzero_pd();
+  __m128d sum1 = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128d d0 = _mm_loadu_pd(dir + i);
+    __m128d d1 = _mm_loadu_pd(dir + i + 2);
+    __m128d p0 = _mm_mul_pd(d0, _mm_loadu_pd(steepest + i));
+    __m128d p1 = _mm_mul_pd(d1, _mm_loadu_pd(steepest + i + 2));
+    __m128d drop0 = _mm_cmple_pd(p0, zero);
+    __m128d drop1 = _mm_cmple_pd(p1, zero);
+    _mm_storeu_pd(dir + i, _mm_andnot_pd(drop0, d0));
+    _mm_storeu_pd(dir + i + 2, _mm_andnot_pd(drop1, d1));
+    sum0 = _mm_sub_pd(sum0, _mm_andnot_pd(drop0, p0));
+    sum1 = _mm_sub_pd(sum1, _mm_andnot_pd(drop1, p1));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, _mm_add_pd(sum0, sum1));
+  return lanes[0] + lanes[1] + FixDirSignsScalar(dir + i, steepest + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void ProjectedStepSSE2(double* new_x, const double* x, const double* dir,
+                       size_t n, double alpha) {
+  const __m128d zero = _mm_setzero_pd();
+  const __m128d va = _mm_set1_pd(alpha);
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d xv = _mm_loadu_pd(x + i);
+    __m128d value = _mm_add_pd(xv, _mm_mul_pd(_mm_loadu_pd(dir + i), va));
+    __m128d cross = _mm_cmplt_pd(_mm_mul_pd(xv, value), zero);
+    _mm_storeu_pd(new_x + i, _mm_andnot_pd(cross, value));
+  }
+  ProjectedStepScalar(new_x + i, x + i, dir + i, n - i, alpha);
+}
+
+__attribute__((target("sse2")))
+void ToDoubleSSE2(double* u, const float* v, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 fv = _mm_loadu_ps(v + i);
+    _mm_storeu_pd(u + i, _mm_cvtps_pd(fv));
+    _mm_storeu_pd(u + i + 2, _mm_cvtps_pd(_mm_movehl_ps(fv, fv)));
+  }
+  ToDoubleScalar(u + i, v + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void ToFloatSSE2(float* u, const double* v, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 low = _mm_cvtpd_ps(_mm_loadu_pd(v + i));
+    __m128 high = _mm_cvtpd_ps(_mm_loadu_pd(v + i + 2));
+    _mm_storeu_ps(u + i, _mm_movelh_ps(low, high));
+  }
+  ToFloatScalar(u + i, v + i, n - i);
+}
+
+// minpd and maxpd return their second operand if either operand is
+// NaN, so margins go second, and NaN margins propagate into results as
+// they do in LogisticLossScalar.
+__attribute__((target("sse2")))
+inline __m128d ExpNegSSE2(__m128d a) {
+  const __m128d magic = _mm_set1_pd(kRoundMagic);
+  __m128d x = _mm_sub_pd(_mm_setzero_pd(),
+                         _mm_min_pd(_mm_set1_pd(kMaxExpArg), a));
+  __m128d t = _mm_add_pd(_mm_mul_pd(x, _mm_set1_pd(kLog2E)), magic);
+  __m128d k = _mm_sub_pd(t, magic);
+  __m128d r = _mm_sub_pd(_mm_sub_pd(x, _mm_mul_pd(k, _mm_set1_pd(kLn2Hi))),
+                         _mm_mul_pd(k, _mm_set1_pd(kLn2Lo)));
+  __m128d p = _mm_set1_pd(kExpCoefs[kExpDegree]);
+  for (int j = kExpDegree - 1; j >= 0; --j) {
+    p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(kExpCoefs[j]));
+  }
+  // 2^k has k + 1023 in its exponent bits.
+  __m128i bits = _mm_sub_epi64(_mm_castpd_si128(t), _mm_castpd_si128(magic));
+  __m128i scale = _mm_slli_epi64(
+      _mm_add_epi64(bits, _mm_set1_epi64x(1023)), 52);
+  return _mm_mul_pd(p, _mm_castsi128_pd(scale));
+}
+
+__attribute__((target("sse2")))
+inline __m128d Log1pSSE2(__m128d e) {
+  const __m128d one = _mm_set1_pd(1);
+  __m128d k = _mm_and_pd(_mm_cmpgt_pd(e, _mm_set1_pd(kSqrt2Minus1)), one);
+  __m128d s = _mm_div_pd(_mm_sub_pd(e, k),
+                         _mm_add_pd(_mm_add_pd(e, _mm_set1_pd(2)), k));
+  __m128d z = _mm_mul_pd(s, s);
+  __m128d p = _mm_set1_pd(kAtanhCoefs[kAtanhDegree]);
+  for (int j = kAtanhDegree - 1; j >= 0; --j) {
+    p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(kAtanhCoefs[j]));
+  }
+  return _mm_add_pd(_mm_mul_pd(k, _mm_set1_pd(kLn2Hi)),
+                    _mm_add_pd(_mm_mul_pd(s, p),
+                               _mm_mul_pd(k, _mm_set1_pd(kLn2Lo))));
+}
+
+__attribute__((target("sse2")))
+double LogisticLossSSE2(const double* margins, const double* positives,
+                        const double* negatives, size_t n, double* coefs) {
+  const __m128d zero = _mm_setzero_pd();
+  const __m128d one = _mm_set1_pd(1);
+  const __m128d sign_bit = _mm_set1_pd(-0.0);
+  __m128d sum = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d m = _mm_loadu_pd(margins + i);
+    __m128d e = ExpNegSSE2(_mm_andnot_pd(sign_bit, m));
+    __m128d log1p_e = Log1pSSE2(e);
+    __m128d sigmoid_abs = _mm_div_pd(one, _mm_add_pd(one, e));
+    __m128d sigmoid_neg_abs = _mm_mul_pd(e, sigmoid_abs);
+    __m128d nonneg = _mm_cmpge_pd(m, zero);
+    __m128d sigmoid = _mm_or_pd(_mm_and_pd(nonneg, sigmoid_abs),
+                                _mm_andnot_pd(nonneg, sigmoid_neg_abs));
+    __m128d sigmoid_neg = _mm_or_pd(_mm_and_pd(nonneg, sigmoid_neg_abs),
+                                    _mm_andnot_pd(nonneg, sigmoid_abs));
+    __m128d pos = _mm_loadu_pd(positives + i);
+    __m128d neg = _mm_loadu_pd(negatives + i);
+    __m128d has_pos = _mm_cmpgt_pd(pos, zero);
+    __m128d has_neg = _mm_cmpgt_pd(neg, zero);
+    __m128d pos_loss = _mm_add_pd(log1p_e,
+                                  _mm_max_pd(zero, _mm_sub_pd(zero, m)));
+    __m128d neg_loss = _mm_add_pd(log1p_e, _mm_max_pd(zero, m));
+    sum = _mm_add_pd(sum, _mm_add_pd(
+        _mm_and_pd(has_pos, _mm_mul_pd(pos, pos_loss)),
+        _mm_and_pd(has_neg, _mm_mul_pd(neg, neg_loss))));
+    _mm_storeu_pd(coefs + i, _mm_sub_pd(
+        _mm_and_pd(has_neg, _mm_mul_pd(neg, sigmoid)),
+        _mm_and_pd(has_pos, _mm_mul_pd(pos, sigmoid_neg))));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, sum);
+  return lanes[0] + lanes[1] +
+      LogisticLossScalar(margins + i, positives + i, negatives + i, n - i,
+                         coefs + i);
+}
+
+const DenseKernels kSSE2Kernels = {
+  "sse2", ScaleSSE2, ScaleIntoSSE2, AddScaledSSE2,
+  AddScaledIntoSSE2, DotProductSSE2, SteepestDescDirSSE2,
+  FixDirSignsSSE2, ProjectedStepSSE2, ToDoubleSSE2, ToFloatSSE2,
+  LogisticLossSSE2
+};
+
+//-----------------------------------------------------------------------------
+// AVX2 kernels, 4 doubles per register, using fused multiply-adds.
+//-----------------------------------------------------------------------------
+__attribute__((target("avx2,fma")))
+void ScaleAVX2(double* v, size_t n, double c) {
+  __m256d vc = _mm256_set1_pd(c);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_pd(v + i, _mm256_mul_pd(_mm256_loadu_pd(v + i), vc));
+    _mm256_storeu_pd(v + i + 4,
+                     _mm256_mul_pd(_mm256_loadu_pd(v + i + 4), vc));
+  }
+  ScaleScalar(v + i, n - i, c);
+}
+
+__attribute__((target("avx2,fma")))
+void ScaleIntoAVX2(double* u, const double* v, size_t n, double c) {
+  __m256d vc = _mm256_set1_pd(c);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_pd(u + i, _mm256_mul_pd(_mm256_loadu_pd(v + i), vc));
+    _mm256_storeu_pd(u + i + 4,
+                     _mm256_mul_pd(_mm256_loadu_pd(v + i + 4), vc));
+  }
+  ScaleIntoScalar(u + i, v + i, n - i, c);
+}
+
+__attribute__((target("avx2,fma")))
+void AddScaledAVX2(double* u, const double* v, size_t n, double c) {
+  __m256d vc = _mm256_set1_pd(c);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_pd(u + i, _mm256_fmadd_pd(_mm256_loadu_pd(v + i), vc,
+                                            _mm256_loadu_pd(u + i)));
+    _mm256_storeu_pd(u + i + 4,
+                     _mm256_fmadd_pd(_mm256_loadu_pd(v + i + 4), vc,
+                                     _mm256_loadu_pd(u + i + 4)));
+  }
+  AddScaledScalar(u + i, v + i, n - i, c);
+}
+
+__attribute__((target("avx2,fma")))
+void AddScaledIntoAVX2(double* w, const double* u, const double* v,
+                       size_t n, double c) {
+  __m256d vc = _mm256_set1_pd(c);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_pd(w + i, _mm256_fmadd_pd(_mm256_loadu_pd(v + i), vc,
+                                            _mm256_loadu_pd(u + i)));
+    _mm256_storeu_pd(w + i + 4,
+                     _mm256_fmadd_pd(_mm256_loadu_pd(v + i + 4), vc,
+                                     _mm256_loadu_pd(u + i + 4)));
+  }
+  AddScaledIntoScalar(w + i, u + i, v + i, n - i, c);
+}
+
+__attribute__((target("avx2,fma")))
+double DotProductAVX2(const double* u, const double* v, size_t n) {
+  __m256d sum0 = _mm256_setzero_pd();
+  __m256d sum1 = _mm256_setzero_pd();
+  __m256d sum2 = _mm256_setzero_pd();
+  __m256d sum3 = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    sum0 = _mm256_fmadd_pd(_mm256_loadu_pd(u + i),
+                           _mm256_loadu_pd(v + i), sum0);
+    sum1 = _mm256_fmadd_pd(_mm256_loadu_pd(u + i + 4),
+                           _mm256_loadu_pd(v + i + 4), sum1);
+    sum2 = _mm256_fmadd_pd(_mm256_loadu_pd(u + i + 8),
+                           _mm256_loadu_pd(v + i + 8), sum2);
+    sum3 = _mm256_fmadd_pd(_mm256_loadu_pd(u + i + 12),
+                           _mm256_loadu_pd(v + i + 12), sum3);
+  }
+  __m256d sum = _mm256_add_pd(_mm256_add_pd(sum0, sum1),
+                              _mm256_add_pd(sum2, sum3));
+  double lanes[4];
+  _mm256_storeu_pd(lanes, sum);
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) +
+      DotProductScalar(u + i, v + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+void SteepestDescDirAVX2(double* dir, double* steepest, const double* x,
+                         const double* grad, size_t n, double l1weight) {
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d minus_one = _mm256_set1_pd(-1);
+  const __m256d l1 = _mm256_set1_pd(l1weight);
+  const __m256d minus_l1 = _mm256_set1_pd(-l1weight);
+  size_t i = 0;
+  if (l1weight == 0) {
+    for (; i + 4 <= n; i += 4) {
+      __m256d d = _mm256_mul_pd(_mm256_loadu_pd(grad + i), minus_one);
+      _mm256_storeu_pd(dir + i, d);
+      _mm256_storeu_pd(steepest + i, d);
+    }
+  } else {
+    for (; i + 4 <= n; i += 4) {
+      __m256d g = _mm256_loadu_pd(grad + i);
+      __m256d xv = _mm256_loadu_pd(x + i);
+      __m256d neg_g = _mm256_mul_pd(g, minus_one);
+      __m256d x_neg = _mm256_cmp_pd(xv, zero, _CMP_LT_OQ);
+      __m256d x_pos = _mm256_cmp_pd(xv, zero, _CMP_GT_OQ);
+      __m256d x_nonzero = _mm256_or_pd(x_neg, x_pos);
+      // Where to take -g + l1 and -g - l1, respectively.
+      __m256d plus = _mm256_or_pd(
+          x_neg, _mm256_andnot_pd(x_nonzero,
+                                  _mm256_cmp_pd(g, l1, _CMP_GT_OQ)));
+      __m256d minus = _mm256_or_pd(
+          x_pos, _mm256_andnot_pd(x_nonzero,
+                                  _mm256_cmp_pd(g, minus_l1, _CMP_LT_OQ)));
+      __m256d d = _mm256_blendv_pd(
+          _mm256_and_pd(minus, _mm256_sub_pd(neg_g, l1)),
+          _mm256_add_pd(neg_g, l1), plus);
+      _mm256_storeu_pd(dir + i, d);
+      _mm256_storeu_pd(steepest + i, d);
+    }
+  }
+  SteepestDescDirScalar(dir + i, steepest + i, x + i, grad + i, n - i,
+                        l1weight);
+}
+
+__attribute__((target("avx2,fma")))
+double FixDirSignsAVX2(double* dir, const double* steepest, size_t n) {
+  const __m256d zero = _mm256_setzero_pd();
+  __m256d sum0 = _mm256_setzero_pd();
+  __m256d sum1 = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256d d0 = _mm256_loadu_pd(dir + i);
+    __m256d d1 = _mm256_loadu_pd(dir + i + 4);
+    __m256d p0 = _mm256_mul_pd(d0, _mm256_loadu_pd(steepest + i));
+    __m256d p1 = _mm256_mul_pd(d1, _mm256_loadu_pd(steepest + i + 4));
+    __m256d drop0 = _mm256_cmp_pd(p0, zero, _CMP_LE_OQ);
+    __m256d drop1 = _mm256_cmp_pd(p1, zero, _CMP_LE_OQ);
+    _mm256_storeu_pd(dir + i, _mm256_andnot_pd(drop0, d0));
+    _mm256_storeu_pd(dir + i + 4, _mm256_andnot_pd(drop1, d1));
+    sum0 = _mm256_sub_pd(sum0, _mm256_andnot_pd(drop0, p0));
+    sum1 = _mm256_sub_pd(sum1, _mm256_andnot_pd(drop1, p1));
+  }
+  double lanes[4];
+  _mm256_storeu_pd(lanes, _mm256_add_pd(sum0, sum1));
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) +
+      FixDirSignsScalar(dir + i, steepest + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+void ProjectedStepAVX2(double* new_x, const double* x, const double* dir,
+                       size_t n, double alpha) {
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d va = _mm256_set1_pd(alpha);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d xv = _mm256_loadu_pd(x + i);
+    __m256d value = _mm256_fmadd_pd(_mm256_loadu_pd(dir + i), va, xv);
+    __m256d cross = _mm256_cmp_pd(_mm256_mul_pd(xv, value), zero,
+                                  _CMP_LT_OQ);
+    _mm256_storeu_pd(new_x + i, _mm256_andnot_pd(cross, value));
+  }
+  ProjectedStepScalar(new_x + i, x + i, dir + i, n - i, alpha);
+}
+
+__attribute__((target("avx2,fma")))
+void ToDoubleAVX2(double* u, const float* v, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_pd(u + i, _mm256_cvtps_pd(_mm_loadu_ps(v + i)));
+    _mm256_storeu_pd(u + i + 4, _mm256_cvtps_pd(_mm_loadu_ps(v + i + 4)));
+  }
+  ToDoubleScalar(u + i, v + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+void ToFloatAVX2(float* u, const double* v, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm_storeu_ps(u + i, _mm256_cvtpd_ps(_mm256_loadu_pd(v + i)));
+    _mm_storeu_ps(u + i + 4, _mm256_cvtpd_ps(_mm256_loadu_pd(v + i + 4)));
+  }
+  ToFloatScalar(u + i, v + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256d ExpNegAVX2(__m256d a) {
+  const __m256d magic = _mm256_set1_pd(kRoundMagic);
+  __m256d x = _mm256_sub_pd(_mm256_setzero_pd(),
+                            _mm256_min_pd(_mm256_set1_pd(kMaxExpArg), a));
+  __m256d t = _mm256_fmadd_pd(x, _mm256_set1_pd(kLog2E), magic);
+  __m256d k = _mm256_sub_pd(t, magic);
+  __m256d r = _mm256_fnmadd_pd(k, _mm256_set1_pd(kLn2Hi), x);
+  r = _mm256_fnmadd_pd(k, _mm256_set1_pd(kLn2Lo), r);
+  __m256d p = _mm256_set1_pd(kExpCoefs[kExpDegree]);
+  for (int j = kExpDegree - 1; j >= 0; --j) {
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(kExpCoefs[j]));
+  }
+  __m256i bits = _mm256_sub_epi64(_mm256_castpd_si256(t),
+                                  _mm256_castpd_si256(magic));
+  __m256i scale = _mm256_slli_epi64(
+      _mm256_add_epi64(bits, _mm256_set1_epi64x(1023)), 52);
+  return _mm256_mul_pd(p, _mm256_castsi256_pd(scale));
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256d Log1pAVX2(__m256d e) {
+  __m256d k = _mm256_and_pd(
+      _mm256_cmp_pd(e, _mm256_set1_pd(kSqrt2Minus1), _CMP_GT_OQ),
+      _mm256_set1_pd(1));
+  __m256d s = _mm256_div_pd(_mm256_sub_pd(e, k),
+                            _mm256_add_pd(_mm256_add_pd(e,
+                                                        _mm256_set1_pd(2)),
+                                          k));
+  __m256d z = _mm256_mul_pd(s, s);
+  __m256d p = _mm256_set1_pd(kAtanhCoefs[kAtanhDegree]);
+  for (int j = kAtanhDegree - 1; j >= 0; --j) {
+    p = _mm256_fmadd_pd(p, z, _mm256_set1_pd(kAtanhCoefs[j]));
+  }
+  return _mm256_fmadd_pd(k, _mm256_set1_pd(kLn2Hi),
+                         _mm256_fmadd_pd(s, p, _mm256_mul_pd(
+                             k, _mm256_set1_pd(kLn2Lo))));
+}
+
+__attribute__((target("avx2,fma")))
+double LogisticLossAVX2(const double* margins, const double* positives,
+                        const double* negatives, size_t n, double* coefs) {
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d one = _mm256_set1_pd(1);
+  const __m256d sign_bit = _mm256_set1_pd(-0.0);
+  __m256d sum = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d m = _mm256_loadu_pd(margins + i);
+    __m256d e = ExpNegAVX2(_mm256_andnot_pd(sign_bit, m));
+    __m256d log1p_e = Log1pAVX2(e);
+    __m256d sigmoid_abs = _mm256_div_pd(one, _mm256_add_pd(one, e));
+    __m256d sigmoid_neg_abs = _mm256_mul_pd(e, sigmoid_abs);
+    __m256d nonneg = _mm256_cmp_pd(m, zero, _CMP_GE_OQ);
+    __m256d sigmoid = _mm256_blendv_pd(sigmoid_neg_abs, sigmoid_abs, nonneg);
+    __m256d sigmoid_neg = _mm256_blendv_pd(sigmoid_abs, sigmoid_neg_abs,
+                                           nonneg);
+    __m256d pos = _mm256_loadu_pd(positives + i);
+    __m256d neg = _mm256_loadu_pd(negatives + i);
+    __m256d has_pos = _mm256_cmp_pd(pos, zero, _CMP_GT_OQ);
+    __m256d has_neg = _mm256_cmp_pd(neg, zero, _CMP_GT_OQ);
+    __m256d pos_loss = _mm256_add_pd(
+        log1p_e, _mm256_max_pd(zero, _mm256_sub_pd(zero, m)));
+    __m256d neg_loss = _mm256_add_pd(log1p_e, _mm256_max_pd(zero, m));
+    sum = _mm256_add_pd(sum, _mm256_and_pd(has_pos,
+                                           _mm256_mul_pd(pos, pos_loss)));
+    sum = _mm256_add_pd(sum, _mm256_and_pd(has_neg,
+                                           _mm256_mul_pd(neg, neg_loss)));
+    _mm256_storeu_pd(coefs + i, _mm256_sub_pd(
+        _mm256_and_pd(has_neg, _mm256_mul_pd(neg, sigmoid)),
+        _mm256_and_pd(has_pos, _mm256_mul_pd(pos, sigmoid_neg))));
+  }
+  double lanes[4];
+  _mm256_storeu_pd(lanes, sum);
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) +
+      LogisticLossScalar(margins + i, positives + i, negatives + i, n - i,
+                         coefs + i);
+}
+
+const DenseKernels kAVX2Kernels = {
+  "avx2", ScaleAVX2, ScaleIntoAVX2, AddScaledAVX2,
+  AddScaledIntoAVX2, DotProductAVX2, SteepestDescDirAVX2,
+  FixDirSignsAVX2, ProjectedStepAVX2, ToDoubleAVX2, ToFloatAVX2,
+  LogisticLossAVX2
+};
+
+//-----------------------------------------------------------------------------
+// AVX-512 kernels, 8 doubles per register.
+//-----------------------------------------------------------------------------
+__attribute__((target("avx512f")))
+void ScaleAVX512(double* v, size_t n, double c) {
+  __m512d vc = _mm512_set1_pd(c);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_pd(v + i, _mm512_mul_pd(_mm512_loadu_pd(v + i), vc));
+    _mm512_storeu_pd(v + i + 8,
+                     _mm512_mul_pd(_mm512_loadu_pd(v + i + 8), vc));
+  }
+  ScaleScalar(v + i, n - i, c);
+}
+
+__attribute__((target("avx512f")))
+void ScaleIntoAVX512(double* u, const double* v, size_t n, double c) {
+  __m512d vc = _mm512_set1_pd(c);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_pd(u + i, _mm512_mul_pd(_mm512_loadu_pd(v + i), vc));
+    _mm512_storeu_pd(u + i + 8,
+                     _mm512_mul_pd(_mm512_loadu_pd(v + i + 8), vc));
+  }
+  ScaleIntoScalar(u + i, v + i, n - i, c);
+}
+
+__attribute__((target("avx512f")))
+void AddScaledAVX512(double* u, const double* v, size_t n, double c) {
+  __m512d vc = _mm512_set1_pd(c);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_pd(u + i, _mm512_fmadd_pd(_mm512_loadu_pd(v + i), vc,
+                                            _mm512_loadu_pd(u + i)));
+    _mm512_storeu_pd(u + i + 8,
+                     _mm512_fmadd_pd(_mm512_loadu_pd(v + i + 8), vc,
+                                     _mm512_loadu_pd(u + i + 8)));
+  }
+  AddScaledScalar(u + i, v + i, n - i, c);
+}
+
+__attribute__((target("avx512f")))
+void AddScaledIntoAVX512(double* w, const double* u, const double* v,
+                         size_t n, double c) {
+  __m512d vc = _mm512_set1_pd(c);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_pd(w + i, _mm512_fmadd_pd(_mm512_loadu_pd(v + i), vc,
+                                            _mm512_loadu_pd(u + i)));
+    _mm512_storeu_pd(w + i + 8,
+                     _mm512_fmadd_pd(_mm512_loadu_pd(v + i + 8), vc,
+                                     _mm512_loadu_pd(u + i + 8)));
+  }
+  AddScaledIntoScalar(w + i, u + i, v + i, n - i, c);
+}
+
+__attribute__((target("avx512f")))
+double DotProductAVX512(const double* u, const double* v, size_t n) {
+  __m512d sum0 = _mm512_setzero_pd();
+  __m512d sum1 = _mm512_setzero_pd();
+  __m512d sum2 = _mm512_setzero_pd();
+  __m512d sum3 = _mm512_setzero_pd();
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    sum0 = _mm512_fmadd_pd(_mm512_loadu_pd(u + i),
+                           _mm512_loadu_pd(v + i), sum0);
+    sum1 = _mm512_fmadd_pd(_mm512_loadu_pd(u + i + 8),
+                           _mm512_loadu_pd(v + i + 8), sum1);
+    sum2 = _mm512_fmadd_pd(_mm512_loadu_pd(u + i + 16),
+                           _mm512_loadu_pd(v + i + 16), sum2);
+    sum3 = _mm512_fmadd_pd(_mm512_loadu_pd(u + i + 24),
+                           _mm512_loadu_pd(v + i + 24), sum3);
+  }
+  __m512d sum = _mm512_add_pd(_mm512_add_pd(sum0, sum1),
+                              _mm512_add_pd(sum2, sum3));
+  double lanes[8];
+  _mm512_storeu_pd(lanes, sum);
+  return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+      ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7])) +
+      DotProductScalar(u + i, v + i, n - i);
+}
+
+// AVX-512 comparisons give bit masks, which select values directly.
+__attribute__((target("avx512f")))
+void SteepestDescDirAVX512(double* dir, double* steepest, const double* x,
+                           const double* grad, size_t n, double l1weight) {
+  const __m512d zero = _mm512_setzero_pd();
+  const __m512d minus_one = _mm512_set1_pd(-1);
+  const __m512d l1 = _mm512_set1_pd(l1weight);
+  const __m512d minus_l1 = _mm512_set1_pd(-l1weight);
+  size_t i = 0;
+  if (l1weight == 0) {
+    for (; i + 8 <= n; i += 8) {
+      __m512d d = _mm512_mul_pd(_mm512_loadu_pd(grad + i), minus_one);
+      _mm512_storeu_pd(dir + i, d);
+      _mm512_storeu_pd(steepest + i, d);
+    }
+  } else {
+    for (; i + 8 <= n; i += 8) {
+      __m512d g = _mm512_loadu_pd(grad + i);
+      __m512d xv = _mm512_loadu_pd(x + i);
+      __m512d neg_g = _mm512_mul_pd(g, minus_one);
+      __mmask8 x_neg = _mm512_cmp_pd_mask(xv, zero, _CMP_LT_OQ);
+      __mmask8 x_pos = _mm512_cmp_pd_mask(xv, zero, _CMP_GT_OQ);
+      __mmask8 x_zero = ~(x_neg | x_pos);
+      // Where to take -g + l1 and -g - l1, respectively.
+      __mmask8 plus = x_neg |
+          (x_zero & _mm512_cmp_pd_mask(g, l1, _CMP_GT_OQ));
+      __mmask8 minus = x_pos |
+          (x_zero & _mm512_cmp_pd_mask(g, minus_l1, _CMP_LT_OQ));
+      __m512d d = _mm512_maskz_sub_pd(minus, neg_g, l1);
+      d = _mm512_mask_add_pd(d, plus, neg_g, l1);
+      _mm512_storeu_pd(dir + i, d);
+      _mm512_storeu_pd(steepest + i, d);
+    }
+  }
+  SteepestDescDirScalar(dir + i, steepest + i, x + i, grad + i, n - i,
+                        l1weight);
+}
+
+__attribute__((target("avx512f")))
+double FixDirSignsAVX512(double* dir, const double* steepest, size_t n) {
+  const __m512d zero = _mm512_setzero_pd();
+  __m512d sum0 = _mm512_setzero_pd();
+  __m512d sum1 = _mm512_setzero_pd();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512d d0 = _mm512_loadu_pd(dir + i);
+    __m512d d1 = _mm512_loadu_pd(dir + i + 8);
+    __m512d p0 = _mm512_mul_pd(d0, _mm512_loadu_pd(steepest + i));
+    __m512d p1 = _mm512_mul_pd(d1, _mm512_loadu_pd(steepest + i + 8));
+    __mmask8 keep0 = ~_mm512_cmp_pd_mask(p0, zero, _CMP_LE_OQ);
+    __mmask8 keep1 = ~_mm512_cmp_pd_mask(p1, zero, _CMP_LE_OQ);
+    _mm512_storeu_pd(dir + i, _mm512_maskz_mov_pd(keep0, d0));
+    _mm512_storeu_pd(dir + i + 8, _mm512_maskz_mov_pd(keep1, d1));
+    sum0 = _mm512_mask_sub_pd(sum0, keep0, sum0, p0);
+    sum1 = _mm512_mask_sub_pd(sum1, keep1, sum1, p1);
+  }
+  double lanes[8];
+  _mm512_storeu_pd(lanes, _mm512_add_pd(sum0, sum1));
+  return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+      ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7])) +
+      FixDirSignsScalar(dir + i, steepest + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+void ProjectedStepAVX512(double* new_x, const double* x, const double* dir,
+                         size_t n, double alpha) {
+  const __m512d zero = _mm512_setzero_pd();
+  const __m512d va = _mm512_set1_pd(alpha);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512d xv = _mm512_loadu_pd(x + i);
+    __m512d value = _mm512_fmadd_pd(_mm512_loadu_pd(dir + i), va, xv);
+    __mmask8 keep = ~_mm512_cmp_pd_mask(_mm512_mul_pd(xv, value), zero,
+                                        _CMP_LT_OQ);
+    _mm512_storeu_pd(new_x + i, _mm512_maskz_mov_pd(keep, value));
+  }
+  ProjectedStepScalar(new_x + i, x + i, dir + i, n - i, alpha);
+}
+
+// Conversions are masked with all lanes enabled, which compute the same
+// as unmasked ones, but do not read an undefined source register.
+__attribute__((target("avx512f")))
+void ToDoubleAVX512(double* u, const float* v, size_t n) {
+  const __mmask8 all = 0xff;
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_pd(u + i,
+                     _mm512_maskz_cvtps_pd(all, _mm256_loadu_ps(v + i)));
+    _mm512_storeu_pd(u + i + 8,
+                     _mm512_maskz_cvtps_pd(all, _mm256_loadu_ps(v + i + 8)));
+  }
+  ToDoubleScalar(u + i, v + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+void ToFloatAVX512(float* u, const double* v, size_t n) {
+  const __mmask8 all = 0xff;
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm256_storeu_ps(u + i,
+                     _mm512_maskz_cvtpd_ps(all, _mm512_loadu_pd(v + i)));
+    _mm256_storeu_ps(u + i + 8,
+                     _mm512_maskz_cvtpd_ps(all, _mm512_loadu_pd(v + i + 8)));
+  }
+  ToFloatScalar(u + i, v + i, n - i);
+}
+
+// As conversions, min, max and shifts are masked with all lanes
+// enabled.
+__attribute__((target("avx512f")))
+inline __m512d ExpNegAVX512(__m512d a) {
+  const __mmask8 all = 0xff;
+  const __m512d magic = _mm512_set1_pd(kRoundMagic);
+  __m512d x = _mm512_sub_pd(_mm512_setzero_pd(),
+                            _mm512_maskz_min_pd(all,
+                                                _mm512_set1_pd(kMaxExpArg),
+                                                a));
+  __m512d t = _mm512_fmadd_pd(x, _mm512_set1_pd(kLog2E), magic);
+  __m512d k = _mm512_sub_pd(t, magic);
+  __m512d r = _mm512_fnmadd_pd(k, _mm512_set1_pd(kLn2Hi), x);
+  r = _mm512_fnmadd_pd(k, _mm512_set1_pd(kLn2Lo), r);
+  __m512d p = _mm512_set1_pd(kExpCoefs[kExpDegree]);
+  for (int j = kExpDegree - 1; j >= 0; --j) {
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(kExpCoefs[j]));
+  }
+  __m512i bits = _mm512_sub_epi64(_mm512_castpd_si512(t),
+                                  _mm512_castpd_si512(magic));
+  __m512i scale = _mm512_maskz_slli_epi64(
+      all, _mm512_add_epi64(bits, _mm512_set1_epi64(1023)), 52);
+  return _mm512_mul_pd(p, _mm512_castsi512_pd(scale));
+}
+
+__attribute__((target("avx512f")))
+inline __m512d Log1pAVX512(__m512d e) {
+  __m512d k = _mm512_mask_blend_pd(
+      _mm512_cmp_pd_mask(e, _mm512_set1_pd(kSqrt2Minus1), _CMP_GT_OQ),
+      _mm512_setzero_pd(), _mm512_set1_pd(1));
+  __m512d s = _mm512_div_pd(_mm512_sub_pd(e, k),
+                            _mm512_add_pd(_mm512_add_pd(e,
+                                                        _mm512_set1_pd(2)),
+                                          k));
+  __m512d z = _mm512_mul_pd(s, s);
+  __m512d p = _mm512_set1_pd(kAtanhCoefs[kAtanhDegree]);
+  for (int j = kAtanhDegree - 1; j >= 0; --j) {
+    p = _mm512_fmadd_pd(p, z, _mm512_set1_pd(kAtanhCoefs[j]));
+  }
+  return _mm512_fmadd_pd(k, _mm512_set1_pd(kLn2Hi),
+                         _mm512_fmadd_pd(s, p, _mm512_mul_pd(
+                             k, _mm512_set1_pd(kLn2Lo))));
+}
+
+__attribute__((target("avx512f")))
+double LogisticLossAVX512(const double* margins, const double* positives,
+                          const double* negatives, size_t n, double* coefs) {
+  const __m512d zero = _mm512_setzero_pd();
+  const __m512d one = _mm512_set1_pd(1);
+  const __mmask8 all = 0xff;
+  __m512d sum = _mm512_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512d m = _mm512_loadu_pd(margins + i);
+    __m512d e = ExpNegAVX512(_mm512_abs_pd(m));
+    __m512d log1p_e = Log1pAVX512(e);
+    __m512d sigmoid_abs = _mm512_div_pd(one, _mm512_add_pd(one, e));
+    __m512d sigmoid_neg_abs = _mm512_mul_pd(e, sigmoid_abs);
+    __mmask8 nonneg = _mm512_cmp_pd_mask(m, zero, _CMP_GE_OQ);
+    __m512d sigmoid = _mm512_mask_blend_pd(nonneg, sigmoid_neg_abs,
+                                           sigmoid_abs);
+    __m512d sigmoid_neg = _mm512_mask_blend_pd(nonneg, sigmoid_abs,
+                                               sigmoid_neg_abs);
+    __m512d pos = _mm512_loadu_pd(positives + i);
+    __m512d neg = _mm512_loadu_pd(negatives + i);
+    __mmask8 has_pos = _mm512_cmp_pd_mask(pos, zero, _CMP_GT_OQ);
+    __mmask8 has_neg = _mm512_cmp_pd_mask(neg, zero, _CMP_GT_OQ);
+    __m512d pos_loss = _mm512_add_pd(
+        log1p_e, _mm512_maskz_max_pd(all, zero, _mm512_sub_pd(zero, m)));
+    __m512d neg_loss = _mm512_add_pd(log1p_e,
+                                     _mm512_maskz_max_pd(all, zero, m));
+    sum = _mm512_mask3_fmadd_pd(pos, pos_loss, sum, has_pos);
+    sum = _mm512_mask3_fmadd_pd(neg, neg_loss, sum, has_neg);
+    _mm512_storeu_pd(coefs + i, _mm512_sub_pd(
+        _mm512_maskz_mul_pd(has_neg, neg, sigmoid),
+        _mm512_maskz_mul_pd(has_pos, pos, sigmoid_neg)));
+  }
+  double lanes[8];
+  _mm512_storeu_pd(lanes, sum);
+  return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+      ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7])) +
+      LogisticLossScalar(margins + i, positives + i, negatives + i, n - i,
+                         coefs + i);
+}
+
+const DenseKernels kAVX512Kernels = {
+  "avx512", ScaleAVX512, ScaleIntoAVX512, AddScaledAVX512,
+  AddScaledIntoAVX512, DotProductAVX512, SteepestDescDirAVX512,
+  FixDirSignsAVX512, ProjectedStepAVX512, ToDoubleAVX512, ToFloatAVX512,
+  LogisticLossAVX512
+};
+
+#endif  // DENSE_KERNELS_X86
+
+// Returns the kernels of |name| if the CPU supports them, or NULL.
+const DenseKernels* FindKernels(const std::string& name) {
+  if (name == kScalarKernels.name) {
+    return &kScalarKernels;
+  }
+#ifdef DENSE_KERNELS_X86
+  __builtin_cpu_init();
+  if (name == kAVX512Kernels.name && __builtin_cpu_supports("avx512f")) {
+    return &kAVX512Kernels;
+  }
+  if (name == kAVX2Kernels.name && __builtin_cpu_supports("avx2") &&
+      __builtin_cpu_supports("fma")) {
+    return &kAVX2Kernels;
+  }
+  if (name == kSSE2Kernels.name && __builtin_cpu_supports("sse2")) {
+    return &kSSE2Kernels;
+  }
+#endif  // DENSE_KERNELS_X86
+  return NULL;
+}
+
+const DenseKernels* DetectKernels() {
+  static const char* kPreferences[] = { "avx512", "avx2", "sse2" };
+  for (size_t i = 0; i < sizeof(kPreferences) / sizeof(kPreferences[0]);
+       ++i) {
+    const DenseKernels* kernels = FindKernels(kPreferences[i]);
+    if (kernels != NULL) {
+      return kernels;
+    }
+  }
+  return &kScalarKernels;
+}
+
+const DenseKernels** Kernels() {
+  static const DenseKernels* kernels = DetectKernels();
+  return &kernels;
+}
+
+//-----------------------------------------------------------------------------
+// Long vectors are split into blocks run by the vector thread pool.
+// Results of reductions are summed up in the order of blocks, so they
+// depend on the number of threads, but not on the scheduling.
+//-----------------------------------------------------------------------------
+
+// The arguments of a kernel, in the order of the kernel's parameters.
+struct KernelCall {
+  explicit KernelCall(size_t size)
+      : kernels(*Kernels()),
+        n(size),
+        num_blocks(NumVectorBlocks(size)),
+        out(NULL),
+        out2(NULL),
+        float_out(NULL),
+        in(NULL),
+        in2(NULL),
+        c(0),
+        partials(num_blocks, 0) {}
+
+  size_t Begin(int block) const {
+    return VectorBlockBegin(n, num_blocks, block);
+  }
+  size_t Size(int block) const { return Begin(block + 1) - Begin(block); }
+
+  double Sum() const {
+    double sum = 0;
+    for (int b = 0; b < num_blocks; ++b) {
+      sum += partials[b];
+    }
+    return sum;
+  }
+
+  const DenseKernels* kernels;
+  size_t n;
+  int num_blocks;
+  double* out;
+  double* out2;
+  float* float_out;
+  const double* in;
+  const double* in2;
+  double c;
+  std::vector<double> partials;  // Results of blocks of a reduction.
+};
+
+void ScaleBlock(void* arg, int block) {
+  KernelCall* call = static_cast<KernelCall*>(arg);
+  size_t i = call->Begin(block);
+  call->kernels->scale(call->out + i, call->Size(block), call->c);
+}
+
+void ScaleIntoBlock(void* arg, int block) {
+  KernelCall* call = static_cast<KernelCall*>(arg);
+  size_t i = call->Begin(block);
+  call->kernels->scale_into(call->out + i, call->in + i, call->Size(block),
+                            call->c);
+}
+
+void AddScaledBlock(void* arg, int block) {
+  KernelCall* call = static_cast<KernelCall*>(arg);
+  size_t i = call->Begin(block);
+  call->kernels->add_scaled(call->out + i, call->in + i, call->Size(block),
+                            call->c);
+}
+
+void AddScaledIntoBlock(void* arg, int block) {
+  KernelCall* call = static_cast<KernelCall*>(arg);
+  size_t i = call->Begin(block);
+  call->kernels->add_scaled_into(call->out + i, call->in + i, call->in2 + i,
+                                 call->Size(block), call->c);
+}
+
+void DotProductBlock(void* arg, int block) {
+  KernelCall* call = static_cast<KernelCall*>(arg);
+  size_t i = call->Begin(block);
+  call->partials[block] =
+      call->kernels->dot_product(call->in + i, call->in2 + i,
+                                 call->Size(block));
+}
+
+void SteepestDescDirBlock(void* arg, int block) {
+  KernelCall* call = static_cast<KernelCall*>(arg);
+  size_t i = call->Begin(block);
+  call->kernels->steepest_desc_dir(call->out + i, call->out2 + i,
+                                   call->in + i, call->in2 + i,
+                                   call->Size(block), call->c);
+}
+
+void FixDirSignsBlock(void* arg, int block) {
+  KernelCall* call = static_cast<KernelCall*>(arg);
+  size_t i = call->Begin(block);
+  call->partials[block] =
+      call->kernels->fix_dir_signs(call->out + i, call->in + i,
+                                   call->Size(block));
+}
+
+void ProjectedStepBlock(void* arg, int block) {
+  KernelCall* call = static_cast<KernelCall*>(arg);
+  size_t i = call->Begin(block);
+  call->kernels->projected_step(call->out + i, call->in + i, call->in2 + i,
+                                call->Size(block), call->c);
+}
+
+//-----------------------------------------------------------------------------
+// Kernels on many vectors walk through blocks of kCacheBlockSize
+// elements, so that blocks of all the vectors, e.g., 2 x 10 of the
+// L-BFGS history, fit in the L2 cache together, and each vector is
+// read from the memory once.  Vectors stored in single precision are
+// converted to double block by block, and each block is processed by
+// the kernels of the instruction set in use.
+//-----------------------------------------------------------------------------
+
+const size_t kCacheBlockSize = 1024;
+
+// Returns elements [i, i + len) of |row| as doubles, converted into
+// |buffer| if |row| is stored in single precision.
+inline const double* DoubleBlock(const DenseKernels* kernels,
+                                 const double* row, size_t i, size_t len,
+                                 double* buffer) {
+  return row + i;
+}
+
+inline const double* DoubleBlock(const DenseKernels* kernels,
+                                 const float* row, size_t i, size_t len,
+                                 double* buffer) {
+  kernels->to_double(buffer, row + i, len);
+  return buffer;
+}
+
+// products[a * num_b + b] <- dot(a_rows[a] + begin, b_rows[b] + begin)
+// over elements [begin, end).
+template <class A, class B>
+void BlockedDotProductsRange(const DenseKernels* kernels,
+                             const A* const* a_rows, int num_a,
+                             const B* const* b_rows, int num_b,
+                             size_t begin, size_t end, double* products) {
+  std::vector<double> buffers((num_a + 1) * kCacheBlockSize);
+  std::vector<const double*> a_blocks(num_a);
+  std::fill(products, products + num_a * num_b, 0.0);
+  for (size_t i = begin; i < end; i += kCacheBlockSize) {
+    size_t len = std::min(kCacheBlockSize, end - i);
+    for (int a = 0; a < num_a; ++a) {
+      a_blocks[a] = DoubleBlock(kernels, a_rows[a], i, len,
+                                &buffers[a * kCacheBlockSize]);
+    }
+    for (int b = 0; b < num_b; ++b) {
+      const double* b_block = DoubleBlock(kernels, b_rows[b], i, len,
+                                          &buffers[num_a * kCacheBlockSize]);
+      for (int a = 0; a < num_a; ++a) {
+        products[a * num_b + b] +=
+            kernels->dot_product(a_blocks[a], b_block, len);
+      }
+    }
+  }
+}
+
+// w <- v * v_coef + the linear combination of rows, over elements
+// [begin, end).  Each block is summed up in a buffer before it is
+// written to |w|, so |w| may alias |v| or any row.
+template <class Row>
+void LinearCombinationRange(const DenseKernels* kernels, double* w,
+                            const double* v, double v_coef,
+                            const Row* const* rows, const double* coefs,
+                            int num_rows, size_t begin, size_t end) {
+  double buffer[kCacheBlockSize];
+  double row_buffer[kCacheBlockSize];
+  for (size_t i = begin; i < end; i += kCacheBlockSize) {
+    size_t len = std::min(kCacheBlockSize, end - i);
+    kernels->scale_into(buffer, v + i, len, v_coef);
+    for (int r = 0; r < num_rows; ++r) {
+      kernels->add_scaled(buffer,
+                          DoubleBlock(kernels, rows[r], i, len, row_buffer),
+                          len, coefs[r]);
+    }
+    memcpy(w + i, buffer, len * sizeof(double));
+  }
+}
+
+// w <- u + v * c rounded to single precision, over elements [begin,
+// end).
+void AddScaledIntoFloatRange(const DenseKernels* kernels, float* w,
+                             const double* u, const double* v, double c,
+                             size_t begin, size_t end) {
+  double buffer[kCacheBlockSize];
+  for (size_t i = begin; i < end; i += kCacheBlockSize) {
+    size_t len = std::min(kCacheBlockSize, end - i);
+    kernels->add_scaled_into(buffer, u + i, v + i, len, c);
+    kernels->to_float(w + i, buffer, len);
+  }
+}
+
+// The arguments of a kernel on many vectors.
+template <class A, class B>
+struct MultiVectorCall {
+  explicit MultiVectorCall(size_t size)
+      : kernels(*Kernels()),
+        n(size),
+        num_blocks(NumVectorBlocks(size)),
+        a_rows(NULL),
+        num_a(0),
+        b_rows(NULL),
+        num_b(0),
+        w(NULL),
+        v(NULL),
+        v_coef(0),
+        coefs(NULL) {}
+
+  size_t Begin(int block) const {
+    return VectorBlockBegin(n, num_blocks, block);
+  }
+
+  const DenseKernels* kernels;
+  size_t n;
+  int num_blocks;
+  const A* const* a_rows;
+  int num_a;
+  const B* const* b_rows;
+  int num_b;
+  double* w;
+  const double* v;
+  double v_coef;
+  const double* coefs;
+  std::vector<double> partials;  // num_a x num_b products of each block.
+};
+
+template <class A, class B>
+void BlockedDotProductsBlock(void* arg, int block) {
+  MultiVectorCall<A, B>* call = static_cast<MultiVectorCall<A, B>*>(arg);
+  BlockedDotProductsRange(
+      call->kernels, call->a_rows, call->num_a, call->b_rows, call->num_b,
+      call->Begin(block), call->Begin(block + 1),
+      &call->partials[block * call->num_a * call->num_b]);
+}
+
+template <class Row>
+void LinearCombinationBlock(void* arg, int block) {
+  MultiVectorCall<double, Row>* call =
+      static_cast<MultiVectorCall<double, Row>*>(arg);
+  LinearCombinationRange(call->kernels, call->w, call->v, call->v_coef,
+                         call->b_rows, call->coefs, call->num_b,
+                         call->Begin(block), call->Begin(block + 1));
+}
+
+void AddScaledIntoFloatBlock(void* arg, int block) {
+  KernelCall* call = static_cast<KernelCall*>(arg);
+  AddScaledIntoFloatRange(call->kernels, call->float_out, call->in,
+                          call->in2, call->c, call->Begin(block),
+                          call->Begin(block + 1));
+}
+
+template <class A, class B>
+void BlockedDotProducts(const A* const* a_rows, int num_a,
+                        const B* const* b_rows, int num_b,
+                        size_t n, double* products) {
+  MultiVectorCall<A, B> call(n);
+  if (call.num_blocks == 1) {
+    BlockedDotProductsRange(call.kernels, a_rows, num_a, b_rows, num_b, 0, n,
+                            products);
+    return;
+  }
+  call.a_rows = a_rows;
+  call.num_a = num_a;
+  call.b_rows = b_rows;
+  call.num_b = num_b;
+  call.partials.resize(call.num_blocks * num_a * num_b);
+  RunVectorBlocks(&BlockedDotProductsBlock<A, B>, &call, call.num_blocks);
+
+  int num_products = num_a * num_b;
+  std::fill(products, products + num_products, 0.0);
+  for (int b = 0; b < call.num_blocks; ++b) {
+    for (int p = 0; p < num_products; ++p) {
+      products[p] += call.partials[b * num_products + p];
+    }
+  }
+}
+
+template <class Row>
+void LinearCombination(double* w, const double* v, double v_coef,
+                       const Row* const* rows, const double* coefs,
+                       int num_rows, size_t n) {
+  MultiVectorCall<double, Row> call(n);
+  if (call.num_blocks == 1) {
+    LinearCombinationRange(call.kernels, w, v, v_coef, rows, coefs,
+                           num_rows, 0, n);
+    return;
+  }
+  call.w = w;
+  call.v = v;
+  call.v_coef = v_coef;
+  call.b_rows = rows;
+  call.num_b = num_rows;
+  call.coefs = coefs;
+  RunVectorBlocks(&LinearCombinationBlock<Row>, &call, call.num_blocks);
+}
+
+}  // namespace
+
+void ScaleKernel(double* v, size_t n, double c) {
+  KernelCall call(n);
+  if (call.num_blocks == 1) {
+    call.kernels->scale(v, n, c);
+    return;
+  }
+  call.out = v;
+  call.c = c;
+  RunVectorBlocks(&ScaleBlock, &call, call.num_blocks);
+}
+
+void ScaleIntoKernel(double* u, const double* v, size_t n, double c) {
+  KernelCall call(n);
+  if (call.num_blocks == 1) {
+    call.kernels->scale_into(u, v, n, c);
+    return;
+  }
+  call.out = u;
+  call.in = v;
+  call.c = c;
+  RunVectorBlocks(&ScaleIntoBlock, &call, call.num_blocks);
+}
+
+void AddScaledKernel(double* u, const double* v, size_t n, double c) {
+  KernelCall call(n);
+  if (call.num_blocks == 1) {
+    call.kernels->add_scaled(u, v, n, c);
+    return;
+  }
+  call.out = u;
+  call.in = v;
+  call.c = c;
+  RunVectorBlocks(&AddScaledBlock, &call, call.num_blocks);
+}
+
+void AddScaledIntoKernel(double* w, const double* u, const double* v,
+                         size_t n, double c) {
+  KernelCall call(n);
+  if (call.num_blocks == 1) {
+    call.kernels->add_scaled_into(w, u, v, n, c);
+    return;
+  }
+  call.out = w;
+  call.in = u;
+  call.in2 = v;
+  call.c = c;
+  RunVectorBlocks(&AddScaledIntoBlock, &call, call.num_blocks);
+}
+
+double DotProductKernel(const double* u, const double* v, size_t n) {
+  KernelCall call(n);
+  if (call.num_blocks == 1) {
+    return call.kernels->dot_product(u, v, n);
+  }
+  call.in = u;
+  call.in2 = v;
+  RunVectorBlocks(&DotProductBlock, &call, call.num_blocks);
+  return call.Sum();
+}
+
+void SteepestDescDirKernel(double* dir, double* steepest, const double* x,
+                           const double* grad, size_t n, double l1weight) {
+  KernelCall call(n);
+  if (call.num_blocks == 1) {
+    call.kernels->steepest_desc_dir(dir, steepest, x, grad, n, l1weight);
+    return;
+  }
+  call.out = dir;
+  call.out2 = steepest;
+  call.in = x;
+  call.in2 = grad;
+  call.c = l1weight;
+  RunVectorBlocks(&SteepestDescDirBlock, &call, call.num_blocks);
+}
+
+double FixDirSignsKernel(double* dir, const double* steepest, size_t n) {
+  KernelCall call(n);
+  if (call.num_blocks == 1) {
+    return call.kernels->fix_dir_signs(dir, steepest, n);
+  }
+  call.out = dir;
+  call.in = steepest;
+  RunVectorBlocks(&FixDirSignsBlock, &call, call.num_blocks);
+  return call.Sum();
+}
+
+void ProjectedStepKernel(double* new_x, const double* x, const double* dir,
+                         size_t n, double alpha) {
+  KernelCall call(n);
+  if (call.num_blocks == 1) {
+    call.kernels->projected_step(new_x, x, dir, n, alpha);
+    return;
+  }
+  call.out = new_x;
+  call.in = x;
+  call.in2 = dir;
+  call.c = alpha;
+  RunVectorBlocks(&ProjectedStepBlock, &call, call.num_blocks);
+}
+
+void AddScaledIntoKernel(float* w, const double* u, const double* v,
+                         size_t n, double c) {
+  KernelCall call(n);
+  if (call.num_blocks == 1) {
+    AddScaledIntoFloatRange(call.kernels, w, u, v, c, 0, n);
+    return;
+  }
+  call.float_out = w;
+  call.in = u;
+  call.in2 = v;
+  call.c = c;
+  RunVectorBlocks(&AddScaledIntoFloatBlock, &call, call.num_blocks);
+}
+
+void BlockedDotProductsKernel(const double* const* a_rows, int num_a,
+                              const double* const* b_rows, int num_b,
+                              size_t n, double* products) {
+  BlockedDotProducts(a_rows, num_a, b_rows, num_b, n, products);
+}
+
+void BlockedDotProductsKernel(const double* const* a_rows, int num_a,
+                              const float* const* b_rows, int num_b,
+                              size_t n, double* products) {
+  BlockedDotProducts(a_rows, num_a, b_rows, num_b, n, products);
+}
+
+void BlockedDotProductsKernel(const float* const* a_rows, int num_a,
+                              const float* const* b_rows, int num_b,
+                              size_t n, double* products) {
+  BlockedDotProducts(a_rows, num_a, b_rows, num_b, n, products);
+}
+
+void LinearCombinationKernel(double* w, const double* v, double v_coef,
+                             const double* const* rows, const double* coefs,
+                             int num_rows, size_t n) {
+  LinearCombination(w, v, v_coef, rows, coefs, num_rows, n);
+}
+
+void LinearCombinationKernel(double* w, const double* v, double v_coef,
+                             const float* const* rows, const double* coefs,
+                             int num_rows, size_t n) {
+  LinearCombination(w, v, v_coef, rows, coefs, num_rows, n);
+}
+
+// Batches of instances are short, so they are not split among threads.
+double LogisticLossKernel(const double* margins, const double* positives,
+                          const double* negatives, size_t n, double* coefs) {
+  return (*Kernels())->logistic_loss(margins, positives, negatives, n, coefs);
+}
+
+const char* DenseKernelInstructionSet() {
+  return (*Kernels())->name;
+}
+
+bool UseDenseKernels(const std::string& instruction_set) {
+  const DenseKernels* kernels = FindKernels(instruction_set);
+  if (kernels == NULL) {
+    return false;
+  }
+  *Kernels() = kernels;
+  return true;
+}
+
+}  // namespace logistic_regression
@@ -0,0 +1,129 @@
+
+
+//
+// Kernels of dense vector operations on arrays of doubles, used by
+// DenseVectorTmpl<double>.  Each kernel has SSE2, AVX2 and AVX-512
+// implementations, and the best one supported by the CPU is chosen at
+// runtime, so a binary built for generic x86-64 machines runs fast on
+// new ones.  Reductions keep several independent accumulators to hide
+// the latency of floating-point adds, so their results may differ from
+// a sequential sum in the last bits.
+//
+// LogisticLossKernel, shared by ComputeGradientMapper and train.cc,
+// evaluates the loss of batches of training instances with the same
+// runtime dispatch.
+//
+// Kernels on long arrays are split into blocks run by the vector
+// thread pool (c.f. vector_thread_pool.h), and reductions give the same
+// result in every run with the same number of threads.
+//
+#ifndef MRML_LASSO_DENSE_VECTOR_KERNELS_H_
+#define MRML_LASSO_DENSE_VECTOR_KERNELS_H_
+
+#include <stddef.h>
+
+#include <string>
+
+namespace logistic_regression {
+
+// v <- v * c
+void ScaleKernel(double* v, size_t n, double c);
+
+// u <- v * c
+void ScaleIntoKernel(double* u, const double* v, size_t n, double c);
+
+// u <- u + v * c
+void AddScaledKernel(double* u, const double* v, size_t n, double c);
+
+// w <- u + v * c
+void AddScaledIntoKernel(double* w, const double* u, const double* v,
+                         size_t n, double c);
+
+// Returns dot(u, v).
+double DotProductKernel(const double* u, const double* v, size_t n);
+
+// The following kernels fuse the element-wise steps of OWL-QN, so that
+// Learner<DenseRealVector> streams each vector through the memory
+// once rather than once per step.
+
+// Writes the steepest descent direction of the L1-regularized loss at
+// |x|, i.e., the negative pseudo-gradient derived from |grad|, into
+// both |dir| and |steepest|.
+void SteepestDescDirKernel(double* dir, double* steepest, const double* x,
+                           const double* grad, size_t n, double l1weight);
+
+// Zeros dir[i] whose sign differs from steepest[i], and returns the
+// directional derivative of the L1-regularized loss along the fixed
+// |dir|, which equals -dot(dir, steepest) since |steepest| is the
+// negative pseudo-gradient.
+double FixDirSignsKernel(double* dir, const double* steepest, size_t n);
+
+// new_x <- x + dir * alpha, with elements that cross zero, i.e., leave
+// the orthant of |x|, projected to zero.
+void ProjectedStepKernel(double* new_x, const double* x, const double* dir,
+                         size_t n, double alpha);
+
+// The following kernels work on many vectors at once, like the
+// history of L-BFGS, and read each vector once however many products
+// or terms involve it.  The vectors may be stored in single precision
+// to save memory and bandwidth; they are converted to double as they
+// are read, and all arithmetic is in double.
+
+// products[a * num_b + b] <- dot(a_rows[a], b_rows[b]) for every pair
+// of the num_a vectors in |a_rows| and the num_b ones in |b_rows|, all
+// of |n| elements.  Vectors are read block by block, so that each block
+// of a_rows stays in the cache while it meets all b_rows.
+void BlockedDotProductsKernel(const double* const* a_rows, int num_a,
+                              const double* const* b_rows, int num_b,
+                              size_t n, double* products);
+void BlockedDotProductsKernel(const double* const* a_rows, int num_a,
+                              const float* const* b_rows, int num_b,
+                              size_t n, double* products);
+void BlockedDotProductsKernel(const float* const* a_rows, int num_a,
+                              const float* const* b_rows, int num_b,
+                              size_t n, double* products);
+
+// w <- v * v_coef + sum of rows[r] * coefs[r] for r in [0, num_rows).
+// |w| may be |v|.
+void LinearCombinationKernel(double* w, const double* v, double v_coef,
+                             const double* const* rows, const double* coefs,
+                             int num_rows, size_t n);
+void LinearCombinationKernel(double* w, const double* v, double v_coef,
+                             const float* const* rows, const double* coefs,
+                             int num_rows, size_t n);
+
+// w <- u + v * c, rounded to single precision.
+void AddScaledIntoKernel(float* w, const double* u, const double* v,
+                         size_t n, double c);
+
+// Evaluates the logistic loss of a batch of |n| instances, where
+// instance i has margin margins[i], i.e., the dot-product of its
+// features and the model, and appears positives[i] times as a positive
+// and negatives[i] times as a negative.  Returns the sum of
+//   positives[i] * log(1 + exp(-margins[i])) +
+//   negatives[i] * log(1 + exp(margins[i])),
+// and sets coefs[i] to the derivative of the loss of instance i with
+// respect to its margin, so the gradient of the loss of instance i is
+// its features scaled by coefs[i].  exp and log1p are evaluated by
+// polynomials accurate to a few ulps, and no margin is clamped.
+//
+// A count that is not positive, e.g., the negative positives[i] of an
+// instance without label, contributes nothing to the loss or coefs[i],
+// as if the instance had not appeared as a positive (or a negative);
+// so an infinite margin with a zero count does not give NaN.  A NaN
+// margin with a positive count gives a NaN loss and coefs[i].
+double LogisticLossKernel(const double* margins, const double* positives,
+                          const double* negatives, size_t n, double* coefs);
+
+// Returns the instruction set of kernels in use: "avx512", "avx2",
+// "sse2" or "scalar".
+const char* DenseKernelInstructionSet();
+
+// Switches to kernels of |instruction_set|, one of the names returned
+// by DenseKernelInstructionSet.  Returns false if the CPU does not
+// support it.  This is mainly for testing and benchmarking.
+bool UseDenseKernels(const std::string& instruction_set);
+
+}  // namespace logistic_regression
+
+#endif  // MRML_LASSO_DENSE_VECTOR_KERNELS_H_
@@ -0,0 +1,536 @@
+
+
+//
+#include <math.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/common.h"
+#include "mrml-lasso/dense_vector_kernels.h"
+#include "mrml-lasso/vector_thread_pool.h"
+
+using logistic_regression::AddScaledIntoKernel;
+using logistic_regression::AddScaledKernel;
+using logistic_regression::BlockedDotProductsKernel;
+using logistic_regression::DenseKernelInstructionSet;
+using logistic_regression::DotProductKernel;
+using logistic_regression::FixDirSignsKernel;
+using logistic_regression::LinearCombinationKernel;
+using logistic_regression::LogisticLossKernel;
+using logistic_regression::ProjectedStepKernel;
+using logistic_regression::ScaleIntoKernel;
+using logistic_regression::ScaleKernel;
+using logistic_regression::SetVectorThreads;
+using logistic_regression::SteepestDescDirKernel;
+using logistic_regression::UseDenseKernels;
+using std::string;
+using std::vector;
+
+static void RandomVector(size_t n, vector<double>* v) {
+  v->resize(n + 1);    // Plus one so that &(*v)[0] is valid.
+  for (size_t i = 0; i < v->size(); ++i) {
+    (*v)[i] = static_cast<double>(rand()) / RAND_MAX - 0.5;
+  }
+}
+
+// Compares kernels of every instruction set supported by the CPU with
+// the scalar ones, on lengths covering SIMD loops and their tails.
+TEST(DenseVectorKernelsTest, CompareWithScalar) {
+  static const char* kInstructionSets[] = { "sse2", "avx2", "avx512" };
+  static const size_t kLengths[] = { 0, 1, 3, 7, 8, 15, 16, 31, 33, 1000 };
+  static const double kScale = -0.75;
+  const string detected = DenseKernelInstructionSet();
+
+  for (size_t k = 0; k < sizeof(kInstructionSets) / sizeof(char*); ++k) {
+    if (!UseDenseKernels(kInstructionSets[k])) {
+      continue;
+    }
+    for (size_t l = 0; l < sizeof(kLengths) / sizeof(size_t); ++l) {
+      size_t n = kLengths[l];
+      vector<double> u, v, w;
+      RandomVector(n, &u);
+      RandomVector(n, &v);
+      RandomVector(n, &w);
+
+      ASSERT_TRUE(UseDenseKernels("scalar"));
+      vector<double> scaled = u, scaled_into = w, added = u, added_into = w;
+      ScaleKernel(&scaled[0], n, kScale);
+      ScaleIntoKernel(&scaled_into[0], &v[0], n, kScale);
+      AddScaledKernel(&added[0], &v[0], n, kScale);
+      AddScaledIntoKernel(&added_into[0], &u[0], &v[0], n, kScale);
+      double dot = DotProductKernel(&u[0], &v[0], n);
+
+      ASSERT_TRUE(UseDenseKernels(kInstructionSets[k]));
+      vector<double> simd_scaled = u, simd_scaled_into = w;
+      vector<double> simd_added = u, simd_added_into = w;
+      ScaleKernel(&simd_scaled[0], n, kScale);
+      ScaleIntoKernel(&simd_scaled_into[0], &v[0], n, kScale);
+      AddScaledKernel(&simd_added[0], &v[0], n, kScale);
+      AddScaledIntoKernel(&simd_added_into[0], &u[0], &v[0], n, kScale);
+      EXPECT_NEAR(dot, DotProductKernel(&u[0], &v[0], n), 1e-12);
+
+      // Elements beyond n are untouched.
+      for (size_t i = 0; i <= n; ++i) {
+        EXPECT_EQ(scaled[i], simd_scaled[i]);
+        EXPECT_EQ(scaled_into[i], simd_scaled_into[i]);
+        // Fused multiply-adds round once instead of twice.
+        EXPECT_NEAR(added[i], simd_added[i], 1e-15);
+        EXPECT_NEAR(added_into[i], simd_added_into[i], 1e-15);
+      }
+    }
+  }
+  EXPECT_FALSE(UseDenseKernels("unknown"));
+  ASSERT_TRUE(UseDenseKernels(detected));
+}
+
+// Like RandomVector, but about a third of elements are zeros, as in
+// the model learned with L1 regularization.
+static void RandomSparseVector(size_t n, vector<double>* v) {
+  RandomVector(n, v);
+  for (size_t i = 0; i < v->size(); ++i) {
+    if (rand() % 3 == 0) {
+      (*v)[i] = 0;
+    }
+  }
+}
+
+// The directional derivative of the L1-regularized loss, computed as
+// Learner<SparseRealVector>::DirDeriv does.
+static double DirDeriv(const vector<double>& dir, const vector<double>& x,
+                       const vector<double>& grad, size_t n,
+                       double l1weight) {
+  double ret = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (x[i] < 0 || (x[i] == 0 && dir[i] < 0)) {
+      ret += dir[i] * (grad[i] - l1weight);
+    } else if (x[i] > 0 || (x[i] == 0 && dir[i] > 0)) {
+      ret += dir[i] * (grad[i] + l1weight);
+    }
+  }
+  return ret;
+}
+
+// Checks the fused OWL-QN kernels against the step-by-step definition,
+// on every instruction set supported by the CPU.
+TEST(DenseVectorKernelsTest, OWLQNKernels) {
+  static const char* kInstructionSets[] = {
+    "scalar", "sse2", "avx2", "avx512"
+  };
+  static const size_t kLengths[] = { 1, 3, 7, 8, 15, 16, 31, 33, 1000 };
+  static const double kL1Weights[] = { 0, 0.1 };
+  static const double kAlpha = 2.5;
+  const string detected = DenseKernelInstructionSet();
+
+  for (size_t k = 0; k < sizeof(kInstructionSets) / sizeof(char*); ++k) {
+    if (!UseDenseKernels(kInstructionSets[k])) {
+      continue;
+    }
+    for (size_t l = 0; l < sizeof(kLengths) / sizeof(size_t); ++l) {
+      for (size_t w = 0; w < sizeof(kL1Weights) / sizeof(double); ++w) {
+        size_t n = kLengths[l];
+        double l1weight = kL1Weights[w];
+        vector<double> x, grad, hessian_dir;
+        RandomSparseVector(n, &x);
+        RandomVector(n, &grad);
+        RandomVector(n, &hessian_dir);
+
+        vector<double> dir(n + 1, 7), steepest(n + 1, 7);
+        SteepestDescDirKernel(&dir[0], &steepest[0], &x[0], &grad[0], n,
+                              l1weight);
+        for (size_t i = 0; i < n; ++i) {
+          double expected = -grad[i];
+          if (x[i] < 0 || (x[i] == 0 && grad[i] > l1weight)) {
+            expected += l1weight;
+          } else if (x[i] > 0 || (x[i] == 0 && grad[i] < -l1weight)) {
+            expected -= l1weight;
+          } else {
+            expected = 0;
+          }
+          EXPECT_EQ(expected, dir[i]);
+          EXPECT_EQ(expected, steepest[i]);
+        }
+        EXPECT_EQ(7, dir[n]);
+        EXPECT_EQ(7, steepest[n]);
+
+        // Pretend that dir was mapped by the inverse Hessian, which may
+        // flip some signs.
+        for (size_t i = 0; i < n; ++i) {
+          dir[i] += hessian_dir[i] * 0.5;
+        }
+        vector<double> fixed = dir;
+        for (size_t i = 0; i < n; ++i) {
+          if (fixed[i] * steepest[i] <= 0) {
+            fixed[i] = 0;
+          }
+        }
+        double deriv = FixDirSignsKernel(&dir[0], &steepest[0], n);
+        for (size_t i = 0; i <= n; ++i) {
+          EXPECT_EQ(fixed[i], dir[i]);
+        }
+        EXPECT_NEAR(DirDeriv(dir, x, grad, n, l1weight), deriv, 1e-12);
+
+        vector<double> new_x(n + 1, 7);
+        ProjectedStepKernel(&new_x[0], &x[0], &dir[0], n, kAlpha);
+        for (size_t i = 0; i < n; ++i) {
+          double expected = x[i] + dir[i] * kAlpha;
+          if (x[i] * expected < 0) {
+            EXPECT_EQ(0, new_x[i]);
+          } else {
+            // Fused multiply-adds round once instead of twice.
+            EXPECT_NEAR(expected, new_x[i], 1e-15);
+          }
+        }
+        EXPECT_EQ(7, new_x[n]);
+      }
+    }
+  }
+  ASSERT_TRUE(UseDenseKernels(detected));
+}
+
+// Checks kernels on many vectors against products and sums of pairs,
+// on lengths covering cache blocks and their tails.  Kernels on
+// vectors stored in single precision give the same results as those
+// on the rounded vectors stored in double.
+TEST(DenseVectorKernelsTest, ManyVectorKernels) {
+  static const size_t kLengths[] = { 1, 7, 1023, 1024, 1025, 5000 };
+  static const int kNumA = 2;
+  static const int kNumB = 5;
+
+  for (size_t l = 0; l < sizeof(kLengths) / sizeof(size_t); ++l) {
+    size_t n = kLengths[l];
+    vector<vector<double> > vectors(kNumA + kNumB);
+    vector<vector<double> > rounded(kNumA + kNumB);
+    vector<vector<float> > floats(kNumA + kNumB);
+    vector<const double*> rows(kNumA + kNumB);
+    vector<const double*> rounded_rows(kNumA + kNumB);
+    vector<const float*> float_rows(kNumA + kNumB);
+    for (size_t r = 0; r < vectors.size(); ++r) {
+      RandomVector(n, &vectors[r]);
+      floats[r].assign(vectors[r].begin(), vectors[r].end());
+      rounded[r].assign(floats[r].begin(), floats[r].end());
+      rows[r] = &vectors[r][0];
+      rounded_rows[r] = &rounded[r][0];
+      float_rows[r] = &floats[r][0];
+    }
+
+    vector<double> products(kNumA * kNumB);
+    BlockedDotProductsKernel(&rows[0], kNumA, &rows[kNumA], kNumB, n,
+                             &products[0]);
+    for (int a = 0; a < kNumA; ++a) {
+      for (int b = 0; b < kNumB; ++b) {
+        EXPECT_NEAR(DotProductKernel(rows[a], rows[kNumA + b], n),
+                    products[a * kNumB + b], 1e-12);
+      }
+    }
+
+    vector<double> float_products(kNumA * kNumB);
+    vector<double> mixed_products(kNumA * kNumB);
+    BlockedDotProductsKernel(&rounded_rows[0], kNumA, &rounded_rows[kNumA],
+                             kNumB, n, &products[0]);
+    BlockedDotProductsKernel(&float_rows[0], kNumA, &float_rows[kNumA],
+                             kNumB, n, &float_products[0]);
+    BlockedDotProductsKernel(&rounded_rows[0], kNumA, &float_rows[kNumA],
+                             kNumB, n, &mixed_products[0]);
+    EXPECT_TRUE(products == float_products);
+    EXPECT_TRUE(products == mixed_products);
+
+    vector<double> coefs(rows.size());
+    RandomVector(rows.size(), &coefs);
+    vector<double> expected = vectors[0];
+    ScaleKernel(&expected[0], n, coefs[0]);
+    for (size_t r = 1; r < rows.size(); ++r) {
+      AddScaledKernel(&expected[0], rows[r], n, coefs[r]);
+    }
+    // The result may overwrite v.
+    vector<double> combination = vectors[0];
+    LinearCombinationKernel(&combination[0], &combination[0], coefs[0],
+                            &rows[1], &coefs[1], rows.size() - 1, n);
+    for (size_t i = 0; i < n; ++i) {
+      EXPECT_NEAR(expected[i], combination[i], 1e-14);
+    }
+    EXPECT_EQ(vectors[0][n], combination[n]);
+
+    vector<double> float_combination = vectors[0];
+    combination = vectors[0];
+    LinearCombinationKernel(&combination[0], &combination[0], coefs[0],
+                            &rounded_rows[1], &coefs[1], rows.size() - 1, n);
+    LinearCombinationKernel(&float_combination[0], &float_combination[0],
+                            coefs[0], &float_rows[1], &coefs[1],
+                            rows.size() - 1, n);
+    EXPECT_TRUE(combination == float_combination);
+
+    vector<double> added_into(n + 1);
+    vector<float> float_added_into(n + 1, 7);
+    AddScaledIntoKernel(&added_into[0], rows[0], rows[1], n, -1);
+    AddScaledIntoKernel(&float_added_into[0], rows[0], rows[1], n, -1);
+    for (size_t i = 0; i < n; ++i) {
+      EXPECT_EQ(static_cast<float>(added_into[i]), float_added_into[i]);
+    }
+    EXPECT_EQ(7, float_added_into[n]);
+  }
+}
+
+// The loss and the gradient coefficient of an instance, computed as
+// ComputeGradientMapper and train.cc did before LogisticLossKernel,
+// i.e., with libm and margins clamped to [-30, 30].
+static void ClampedLogisticLoss(double margin, double positives,
+                                double negatives, double* loss,
+                                double* coef) {
+  *loss = 0;
+  *coef = 0;
+  double score = margin;
+  double inc_loss, inc_prob;
+  if (positives > 0) {
+    if (score < -30) {
+      inc_loss = -score;
+      inc_prob = 0;
+    } else if (score > 30) {
+      inc_loss = 0;
+      inc_prob = 1;
+    } else {
+      double temp = 1.0 + exp(-score);
+      inc_loss = log(temp);
+      inc_prob = 1.0/temp;
+    }
+    *loss += inc_loss * positives;
+    *coef += -1 * positives * (1.0 - inc_prob);
+  }
+  if (negatives > 0) {
+    score *= -1;
+    if (score < -30) {
+      inc_loss = -score;
+      inc_prob = 0;
+    } else if (score > 30) {
+      inc_loss = 0;
+      inc_prob = 1;
+    } else {
+      double temp = 1.0 + exp(-score);
+      inc_loss = log(temp);
+      inc_prob = 1.0/temp;
+    }
+    *loss += inc_loss * negatives;
+    *coef += negatives * (1.0 - inc_prob);
+  }
+}
+
+// The loss and the gradient coefficient of an instance in long double.
+// The coefficient is the difference of two terms, whose sum of
+// magnitudes is *coef_scale.
+static void ExactLogisticLoss(double margin, double positives,
+                              double negatives, double* loss,
+                              double* coef, double* coef_scale) {
+  long double m = margin;
+  long double positive_term = positives / (1 + expl(m));
+  long double negative_term = negatives / (1 + expl(-m));
+  *loss = positives * log1pl(expl(-m)) + negatives * log1pl(expl(m));
+  *coef = negative_term - positive_term;
+  *coef_scale = negative_term + positive_term;
+}
+
+// Checks the logistic loss kernels of every instruction set supported
+// by the CPU, on batches covering SIMD loops and their tails, against
+//   1. the exact values: the relative error of losses is below
+//      kRelativeError, and so is the error of coefficients relative to
+//      the terms they are the difference of, except that terms below
+//      1e-300 may underflow;
+//   2. the scalar code it replaces: they differ by less than
+//      log(1 + exp(-30)) < 1e-13 per count, the error of clamping, plus
+//      rounding errors of libm.
+TEST(DenseVectorKernelsTest, LogisticLoss) {
+  static const char* kInstructionSets[] = {
+    "scalar", "sse2", "avx2", "avx512"
+  };
+  static const size_t kLengths[] = { 1, 3, 7, 8, 15, 16, 31, 33, 1000 };
+  static const double kSpecialMargins[] = {
+    0, 1e-300, -1e-300, 1e-10, -1e-10, 0.3465, -0.3466, 0.881374, -0.881374,
+    1, -1, 29.99, -29.99, 30.01, -30.01, 40, -40, 707, -707, 709, -709,
+    800, -800
+  };
+  static const double kRelativeError = 2e-15;
+  const size_t num_special = sizeof(kSpecialMargins) / sizeof(double);
+  const string detected = DenseKernelInstructionSet();
+
+  for (size_t k = 0; k < sizeof(kInstructionSets) / sizeof(char*); ++k) {
+    if (!UseDenseKernels(kInstructionSets[k])) {
+      continue;
+    }
+    for (size_t l = 0; l < sizeof(kLengths) / sizeof(size_t); ++l) {
+      size_t n = kLengths[l];
+      vector<double> margins(n + 1), positives(n + 1), negatives(n + 1);
+      for (size_t i = 0; i < n; ++i) {
+        double r = static_cast<double>(rand()) / RAND_MAX;
+        margins[i] = (i < num_special) ? kSpecialMargins[i] : 80 * r - 40;
+        positives[i] = rand() % 3;
+        negatives[i] = (rand() % 3) * 0.5;
+      }
+      vector<double> coefs(n + 1, 7);
+
+      double loss = LogisticLossKernel(&margins[0], &positives[0],
+                                       &negatives[0], n, &coefs[0]);
+      double exact_loss = 0, clamped_loss = 0, total_count = 0;
+      for (size_t i = 0; i < n; ++i) {
+        double exact_instance_loss, exact_coef, coef_scale;
+        ExactLogisticLoss(margins[i], positives[i], negatives[i],
+                          &exact_instance_loss, &exact_coef, &coef_scale);
+        EXPECT_NEAR(exact_coef, coefs[i], kRelativeError * coef_scale + 1e-300)
+            << kInstructionSets[k] << " margin " << margins[i];
+        exact_loss += exact_instance_loss;
+
+        double clamped_instance_loss, clamped_coef;
+        ClampedLogisticLoss(margins[i], positives[i], negatives[i],
+                            &clamped_instance_loss, &clamped_coef);
+        double count = positives[i] + negatives[i];
+        EXPECT_NEAR(clamped_coef, coefs[i],
+                    1e-13 * count + 1e-15 * fabs(clamped_coef));
+        clamped_loss += clamped_instance_loss;
+        total_count += count;
+      }
+      EXPECT_NEAR(exact_loss, loss, kRelativeError * exact_loss);
+      EXPECT_NEAR(clamped_loss, loss,
+                  1e-13 * total_count + 1e-15 * clamped_loss);
+      EXPECT_EQ(7, coefs[n]);
+    }
+
+    // The loss of each instance, summed over a batch of copies that
+    // covers SIMD lanes and tails.
+    for (size_t i = 0; i < num_special; ++i) {
+      static const size_t kCopies = 19;
+      vector<double> margins(kCopies, kSpecialMargins[i]);
+      vector<double> positives(kCopies, 1), negatives(kCopies, 2);
+      vector<double> coefs(kCopies);
+      double loss = LogisticLossKernel(&margins[0], &positives[0],
+                                       &negatives[0], kCopies, &coefs[0]);
+      double exact_loss, exact_coef, coef_scale;
+      ExactLogisticLoss(kSpecialMargins[i], 1, 2, &exact_loss, &exact_coef,
+                        &coef_scale);
+      EXPECT_NEAR(exact_loss, loss / kCopies, kRelativeError * exact_loss)
+          << kInstructionSets[k] << " margin " << kSpecialMargins[i];
+    }
+  }
+  ASSERT_TRUE(UseDenseKernels(detected));
+}
+
+// NaN margins propagate into losses and coefficients, infinite margins
+// give infinite or zero losses, and counts that are not positive, e.g.,
+// of instances without labels, contribute nothing, in SIMD lanes and
+// tails of every instruction set.
+TEST(DenseVectorKernelsTest, LogisticLossSpecialValues) {
+  static const char* kInstructionSets[] = {
+    "scalar", "sse2", "avx2", "avx512"
+  };
+  static const size_t kCopies = 19;
+  const double nan = NAN;
+  const double inf = HUGE_VAL;
+  const double sigmoid_1 = 1 / (1 + exp(-1.0));
+  const double sigmoid_2 = 1 / (1 + exp(-2.0));
+  struct Case {
+    double margin, positives, negatives, loss, coef;
+  };
+  const Case kCases[] = {
+    { nan, 1, 0, nan, nan },
+    { nan, 0, 1, nan, nan },
+    { nan, 0, 0, 0, 0 },
+    { inf, 1, 0, 0, 0 },
+    { inf, 0, 1, inf, 1 },
+    { inf, 2, 1, inf, 1 },
+    { -inf, 1, 0, inf, -1 },
+    { -inf, 0, 1, 0, 0 },
+    { -inf, 0, 0, 0, 0 },
+    { 1, -1, 2, 2 * log1p(exp(1.0)), 2 * sigmoid_1 },
+    { -2, 3, -1, 3 * log1p(exp(2.0)), -3 * sigmoid_2 },
+  };
+  const string detected = DenseKernelInstructionSet();
+
+  for (size_t k = 0; k < sizeof(kInstructionSets) / sizeof(char*); ++k) {
+    if (!UseDenseKernels(kInstructionSets[k])) {
+      continue;
+    }
+    for (size_t c = 0; c < sizeof(kCases) / sizeof(kCases[0]); ++c) {
+      const Case& t = kCases[c];
+      vector<double> margins(kCopies, t.margin);
+      vector<double> positives(kCopies, t.positives);
+      vector<double> negatives(kCopies, t.negatives);
+      vector<double> coefs(kCopies);
+      double loss = LogisticLossKernel(&margins[0], &positives[0],
+                                       &negatives[0], kCopies, &coefs[0]);
+      if (isnan(t.loss)) {
+        EXPECT_TRUE(isnan(loss)) << kInstructionSets[k] << " case " << c;
+      } else if (isinf(t.loss)) {
+        EXPECT_EQ(t.loss, loss) << kInstructionSets[k] << " case " << c;
+      } else {
+        EXPECT_NEAR(t.loss, loss / kCopies, 1e-14 * t.loss + 1e-300)
+            << kInstructionSets[k] << " case " << c;
+      }
+      for (size_t i = 0; i < kCopies; ++i) {
+        if (isnan(t.coef)) {
+          EXPECT_TRUE(isnan(coefs[i])) << kInstructionSets[k] << " case " << c;
+        } else {
+          EXPECT_NEAR(t.coef, coefs[i], 1e-14 * fabs(t.coef) + 1e-300)
+              << kInstructionSets[k] << " case " << c;
+        }
+      }
+    }
+  }
+  ASSERT_TRUE(UseDenseKernels(detected));
+}
+
+// Kernels on long arrays run in multiple threads, and give the same
+// results in every run with the same number of threads.
+TEST(DenseVectorKernelsTest, MultipleThreads) {
+  static const size_t kLength = 300001;
+  static const double kScale = -0.75;
+  vector<double> u, v, x;
+  RandomVector(kLength, &u);
+  RandomVector(kLength, &v);
+  RandomSparseVector(kLength, &x);
+
+  vector<double> added = u, dir(kLength + 1), steepest(kLength + 1);
+  AddScaledKernel(&added[0], &v[0], kLength, kScale);
+  double dot = DotProductKernel(&u[0], &v[0], kLength);
+  SteepestDescDirKernel(&dir[0], &steepest[0], &x[0], &u[0], kLength, 0.1);
+  AddScaledKernel(&dir[0], &v[0], kLength, kScale);
+  double deriv = FixDirSignsKernel(&dir[0], &steepest[0], kLength);
+
+  SetVectorThreads(4);
+  for (int run = 0; run < 3; ++run) {
+    vector<double> threaded_added = u;
+    vector<double> threaded_dir(kLength + 1), threaded_steepest(kLength + 1);
+    AddScaledKernel(&threaded_added[0], &v[0], kLength, kScale);
+    SteepestDescDirKernel(&threaded_dir[0], &threaded_steepest[0], &x[0],
+                          &u[0], kLength, 0.1);
+    AddScaledKernel(&threaded_dir[0], &v[0], kLength, kScale);
+    double threaded_deriv =
+        FixDirSignsKernel(&threaded_dir[0], &threaded_steepest[0], kLength);
+    EXPECT_TRUE(added == threaded_added);
+    EXPECT_TRUE(dir == threaded_dir);
+    EXPECT_TRUE(steepest == threaded_steepest);
+    EXPECT_NEAR(deriv, threaded_deriv, 1e-9);
+
+    // Sums of blocks are in a fixed order.
+    double threaded_dot = DotProductKernel(&u[0], &v[0], kLength);
+    EXPECT_NEAR(dot, threaded_dot, 1e-9);
+    EXPECT_EQ(threaded_dot, DotProductKernel(&u[0], &v[0], kLength));
+
+    const double* rows[] = { &u[0], &v[0], &dir[0] };
+    double products[3], threaded_products[3];
+    BlockedDotProductsKernel(rows, 1, rows, 3, kLength, threaded_products);
+    BlockedDotProductsKernel(rows, 1, rows, 3, kLength, products);
+    for (int i = 0; i < 3; ++i) {
+      EXPECT_EQ(products[i], threaded_products[i]);
+    }
+    EXPECT_NEAR(dot, products[1], 1e-9);
+
+    vector<float> float_added(kLength + 1), threaded_float_added(kLength + 1);
+    AddScaledIntoKernel(&float_added[0], &u[0], &v[0], kLength, kScale);
+    SetVectorThreads(1);
+    AddScaledIntoKernel(&threaded_float_added[0], &u[0], &v[0], kLength,
+                        kScale);
+    SetVectorThreads(4);
+    EXPECT_TRUE(float_added == threaded_float_added);
+  }
+  SetVectorThreads(1);
+}
@@ -0,0 +1,132 @@
+
+
+//
+#include "mrml-lasso/dense_vector_ring.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include "mrml/mrml_filesystem.h"
+#include "mrml/mrml_recordio.h"
+#include "mrml-lasso/logistic_regression.pb.h"
+#include "mrml-lasso/vector_types.h"
+
+namespace logistic_regression {
+
+void DenseVectorRing::SetCapacity(size_t capacity, size_t dim) {
+  if (capacity == capacity_ && dim == dim_) {
+    return;
+  }
+  // Move the newest vectors to the first rows, in the same order.
+  size_t size = (dim == dim_) ? std::min(size_, capacity) : 0;
+  if (single_precision_) {
+    std::vector<float> data(capacity * dim);
+    for (size_t i = 0; i < size; ++i) {
+      memcpy(&data[i * dim], Row<float>(size_ - size + i),
+             dim * sizeof(float));
+    }
+    float_data_.swap(data);
+  } else {
+    std::vector<double> data(capacity * dim);
+    for (size_t i = 0; i < size; ++i) {
+      memcpy(&data[i * dim], Row<double>(size_ - size + i),
+             dim * sizeof(double));
+    }
+    data_.swap(data);
+  }
+  capacity_ = capacity;
+  dim_ = dim;
+  head_ = 0;
+  size_ = size;
+}
+
+void DenseVectorRing::SetSinglePrecision(bool single_precision) {
+  if (single_precision == single_precision_) {
+    return;
+  }
+  if (single_precision) {
+    std::vector<float>(data_.begin(), data_.end()).swap(float_data_);
+    std::vector<double>().swap(data_);
+  } else {
+    std::vector<double>(float_data_.begin(), float_data_.end()).swap(data_);
+    std::vector<float>().swap(float_data_);
+  }
+  single_precision_ = single_precision;
+}
+
+void DenseVectorRing::PushBackSlot() {
+  CHECK_LT(0, capacity_ * dim_);
+  if (size_ == capacity_) {
+    PopFront();
+  }
+  ++size_;
+}
+
+void DenseVectorRing::PopFront() {
+  CHECK_LT(0, size_);
+  head_ = (head_ + 1) % capacity_;
+  --size_;
+}
+
+void DenseVectorRing::WriteAsRecords(MRMLFS_File* file,
+                                     const std::string& key_base) const {
+  Int32PB int_pb;
+  int_pb.set_value(size_);
+  MRML_WriteRecord(file, key_base + ".size", int_pb);
+
+  DenseRealVector vector(dim_, 0);
+  for (size_t i = 0; i < size_; ++i) {
+    for (size_t j = 0; j < dim_; ++j) {
+      vector[j] = Get(i, j);
+    }
+    std::ostringstream oss;
+    oss << key_base << i;
+    vector.SerializeToRecordIO(file, oss.str());
+  }
+}
+
+void DenseVectorRing::ReadAsRecords(MRMLFS_File* file,
+                                    const std::string& key_base) {
+  clear();
+
+  std::string key;
+  Int32PB int_pb;
+  MRML_ReadRecord(file, &key, &int_pb);
+  CHECK_EQ(key, key_base + ".size");
+  int ring_size = int_pb.value();
+  CHECK_LE(0, ring_size);
+
+  DenseRealVector vector;
+  for (int i = 0; i < ring_size; ++i) {
+    int32 vec_size = 0;
+    std::ostringstream oss;
+    oss << key_base << i;
+    vector.ParseFromRecordIO(file, oss.str(), vec_size);
+    if (i == 0) {
+      SetCapacity(std::max<size_t>(capacity_, ring_size), vector.size());
+    }
+    CHECK_EQ(vector.size(), dim_);
+    if (single_precision_) {
+      std::copy(vector.begin(), vector.end(), PushBack<float>());
+    } else {
+      std::copy(vector.begin(), vector.end(), PushBack<double>());
+    }
+  }
+}
+
+std::ostream& operator<<(std::ostream& out, const DenseVectorRing& ring) {
+  for (size_t s = 0; s < ring.size(); ++s) {
+    out << s << ":[ ";
+    for (size_t i = 0; i < ring.dim(); ++i) {
+      if (ring.Get(s, i) != 0) {
+        out << i << ":" << ring.Get(s, i) << " ";
+      }
+    }
+    out << "]\t";
+  }
+  return out;
+}
+
+}  // namespace logistic_regression
@@ -0,0 +1,122 @@
+
+
+//
+// DenseVectorRing saves the S-list and Y-list of
+// LearnerStates<DenseRealVector>.  Rather than separately allocated
+// vectors, it keeps up to capacity() vectors as rows of one contiguous
+// (capacity x dim) matrix, which is allocated once, so the memory
+// footprint of the history is known when learning starts, and a
+// blocked kernel (c.f. BlockedDotProductsKernel) can stream all rows
+// in one pass.  Rows are used as a ring: pushing a vector into a full
+// ring overwrites the oldest one.
+//
+// Rows may be stored in single precision, which halves the memory and
+// bandwidth of the history.  The records written by DenseVectorRing
+// are the same as those of RealVectorPtrDeque<DenseRealVector> in
+// either precision.
+//
+#ifndef MRML_LASSO_DENSE_VECTOR_RING_H_
+#define MRML_LASSO_DENSE_VECTOR_RING_H_
+
+#include <stddef.h>
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "base/common.h"
+
+class MRMLFS_File;
+
+namespace logistic_regression {
+
+class DenseVectorRing {
+ public:
+  DenseVectorRing()
+      : capacity_(0), dim_(0), head_(0), size_(0), single_precision_(false) {}
+
+  size_t size() const     { return size_; }
+  size_t capacity() const { return capacity_; }
+  size_t dim() const      { return dim_; }
+  bool empty() const      { return size_ == 0; }
+  bool single_precision() const { return single_precision_; }
+
+  // Returns the i-th vector, where the 0-th is the oldest one.  Scalar
+  // must be float if single_precision(), or double otherwise.
+  template <class Scalar> Scalar* Row(size_t i);
+  template <class Scalar> const Scalar* Row(size_t i) const;
+
+  // Returns element j of the i-th vector in either precision.
+  double Get(size_t i, size_t j) const {
+    size_t k = Slot(i) * dim_ + j;
+    return single_precision_ ? float_data_[k] : data_[k];
+  }
+
+  // Makes room for |capacity| vectors of |dim| elements.  If dim is
+  // unchanged, the newest vectors that fit are kept; otherwise all
+  // vectors are dropped.  Does nothing if neither capacity nor dim
+  // changes.
+  void SetCapacity(size_t capacity, size_t dim);
+
+  // Switches the storage of vectors, and rounds or extends the vectors
+  // kept.
+  void SetSinglePrecision(bool single_precision);
+
+  // Appends a vector and returns it for the caller to fill in.  If the
+  // ring is full, the oldest vector is dropped and its row is reused.
+  template <class Scalar> Scalar* PushBack() {
+    PushBackSlot();
+    return Row<Scalar>(size_ - 1);
+  }
+  void PopFront();
+  void clear() { head_ = size_ = 0; }
+
+  void WriteAsRecords(MRMLFS_File* file, const std::string& key_base) const;
+  void ReadAsRecords(MRMLFS_File* file, const std::string& key_base);
+
+ private:
+  size_t Slot(size_t i) const { return (head_ + i) % capacity_; }
+  void PushBackSlot();
+
+  // capacity_ rows of dim_ elements, in data_ or in float_data_ if
+  // single_precision_.
+  std::vector<double> data_;
+  std::vector<float> float_data_;
+  size_t capacity_;
+  size_t dim_;
+  size_t head_;                // The row of the oldest vector.
+  size_t size_;
+  bool single_precision_;
+
+  DISALLOW_COPY_AND_ASSIGN(DenseVectorRing);
+};
+
+template <>
+inline double* DenseVectorRing::Row<double>(size_t i) {
+  CHECK(!single_precision_);
+  return &data_[Slot(i) * dim_];
+}
+
+template <>
+inline const double* DenseVectorRing::Row<double>(size_t i) const {
+  CHECK(!single_precision_);
+  return &data_[Slot(i) * dim_];
+}
+
+template <>
+inline float* DenseVectorRing::Row<float>(size_t i) {
+  CHECK(single_precision_);
+  return &float_data_[Slot(i) * dim_];
+}
+
+template <>
+inline const float* DenseVectorRing::Row<float>(size_t i) const {
+  CHECK(single_precision_);
+  return &float_data_[Slot(i) * dim_];
+}
+
+std::ostream& operator<<(std::ostream& out, const DenseVectorRing& ring);
+
+}  // namespace logistic_regression
+
+#endif  // MRML_LASSO_DENSE_VECTOR_RING_H_
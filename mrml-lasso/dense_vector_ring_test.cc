@@ -0,0 +1,113 @@
+
+
+//
+#include "gtest/gtest.h"
+
+#include "base/common.h"
+#include "mrml/mrml_filesystem.h"
+#include "mrml-lasso/dense_vector_ring.h"
+#include "mrml-lasso/test_utils.h"
+
+using logistic_regression::DenseVectorRing;
+using logistic_regression::DenseVectorRingTestUtil;
+
+TEST(DenseVectorRingTest, PushBackAndPopFront) {
+  DenseVectorRing ring;
+  ring.SetCapacity(2, 4);
+  EXPECT_EQ(2, ring.capacity());
+  EXPECT_EQ(4, ring.dim());
+  EXPECT_TRUE(ring.empty());
+
+  ring.PushBack<double>()[0] = 1;
+  ring.PushBack<double>()[0] = 2;
+  EXPECT_EQ(2, ring.size());
+  EXPECT_EQ(1, ring.Row<double>(0)[0]);
+  EXPECT_EQ(2, ring.Row<double>(1)[0]);
+
+  // The ring is full, and the oldest vector is overwritten.
+  double* row = ring.Row<double>(0);
+  EXPECT_EQ(row, ring.PushBack<double>());
+  row[0] = 3;
+  EXPECT_EQ(2, ring.size());
+  EXPECT_EQ(2, ring.Row<double>(0)[0]);
+  EXPECT_EQ(3, ring.Row<double>(1)[0]);
+
+  ring.PopFront();
+  EXPECT_EQ(1, ring.size());
+  EXPECT_EQ(3, ring.Row<double>(0)[0]);
+}
+
+TEST(DenseVectorRingTest, SetCapacity) {
+  DenseVectorRing ring;
+  ring.SetCapacity(3, 2);
+  for (int i = 0; i < 4; ++i) {
+    ring.PushBack<double>()[1] = i;
+  }
+
+  // Keeps the newest vectors in order.
+  ring.SetCapacity(2, 2);
+  EXPECT_EQ(2, ring.size());
+  EXPECT_EQ(2, ring.Get(0, 1));
+  EXPECT_EQ(3, ring.Get(1, 1));
+
+  ring.SetCapacity(5, 2);
+  EXPECT_EQ(2, ring.size());
+  EXPECT_EQ(2, ring.Get(0, 1));
+  EXPECT_EQ(3, ring.Get(1, 1));
+
+  // Vectors of another dimension are dropped.
+  ring.SetCapacity(5, 3);
+  EXPECT_TRUE(ring.empty());
+}
+
+TEST(DenseVectorRingTest, SinglePrecision) {
+  DenseVectorRing ring;
+  ring.SetCapacity(2, 2);
+  for (int i = 0; i < 3; ++i) {
+    double* v = ring.PushBack<double>();
+    v[0] = 0.1 * i;
+    v[1] = i;
+  }
+
+  // Vectors kept are rounded.
+  ring.SetSinglePrecision(true);
+  EXPECT_TRUE(ring.single_precision());
+  EXPECT_EQ(2, ring.size());
+  EXPECT_EQ(0.1f, ring.Row<float>(0)[0]);
+  EXPECT_EQ(2, ring.Row<float>(1)[1]);
+
+  ring.SetCapacity(3, 2);
+  ring.PushBack<float>()[1] = 3;
+  EXPECT_EQ(static_cast<double>(0.1f), ring.Get(0, 0));
+  EXPECT_EQ(3, ring.Get(2, 1));
+
+  ring.SetSinglePrecision(false);
+  EXPECT_EQ(static_cast<double>(0.1f), ring.Row<double>(0)[0]);
+  EXPECT_EQ(3, ring.Row<double>(2)[1]);
+}
+
+TEST(DenseVectorRingTest, WriteAndRead) {
+  static const char* kTempFile = "/tmp/testDenseVectorRingWriteAndRead";
+  DenseVectorRingTestUtil u;
+  {
+    DenseVectorRing ring;
+    u.Construct(&ring);
+    MRMLFS_File out(kTempFile, false);
+    CHECK(out.IsOpen());
+    ring.WriteAsRecords(&out, "ring_");
+  }
+  {
+    DenseVectorRing ring;
+    MRMLFS_File in(kTempFile, true);
+    ring.ReadAsRecords(&in, "ring_");
+    u.Check(ring);
+  }
+  {
+    // Records are the same in either precision.
+    DenseVectorRing ring;
+    ring.SetSinglePrecision(true);
+    MRMLFS_File in(kTempFile, true);
+    ring.ReadAsRecords(&in, "ring_");
+    u.Check(ring);
+  }
+}
@@ -9,6 +9,8 @@
 
 #include <vector>
 
+#include "mrml-lasso/dense_vector_kernels.h"
+
 namespace logistic_regression {
 using std::ostream;
 using std::vector;
@@ -85,6 +87,55 @@ ValueType DotProduct(const DenseVectorTmpl<ValueType>& v1,
   return ret;
 }
 
+// Operations on vectors of doubles, which the learner runs over the
+// whole feature space many times per iteration, use SIMD kernels.
+// These overloads are more specialized than above templates.
+template <class ScaleType>
+void Scale(DenseVectorTmpl<double>* v,
+           const ScaleType& c) {
+  if (!v->empty()) {
+    ScaleKernel(&(*v)[0], v->size(), c);
+  }
+}
+
+template <class ScaleType>
+void ScaleInto(DenseVectorTmpl<double>* u,
+               const DenseVectorTmpl<double>& v,
+               const ScaleType& c) {
+  CHECK_EQ(v.size(), u->size());
+  CHECK_LT(0, v.size());
+  ScaleIntoKernel(&(*u)[0], &v[0], v.size(), c);
+}
+
+template <class ScaleType>
+void AddScaled(DenseVectorTmpl<double>* u,
+               const DenseVectorTmpl<double>& v,
+               const ScaleType& c) {
+  CHECK_EQ(v.size(), u->size());
+  CHECK_LT(0, v.size());
+  AddScaledKernel(&(*u)[0], &v[0], v.size(), c);
+}
+
+template <class ScaleType>
+void AddScaledInto(DenseVectorTmpl<double>* w,
+                   const DenseVectorTmpl<double>& u,
+                   const DenseVectorTmpl<double>& v,
+                   const ScaleType& c) {
+  CHECK_EQ(u.size(), v.size());
+  CHECK_EQ(u.size(), w->size());
+  CHECK_LT(0, u.size());
+  AddScaledIntoKernel(&(*w)[0], &u[0], &v[0], u.size(), c);
+}
+
+inline double DotProduct(const DenseVectorTmpl<double>& v1,
+                         const DenseVectorTmpl<double>& v2) {
+  CHECK_EQ(v1.size(), v2.size());
+  if (v1.empty()) {
+    return 0;
+  }
+  return DotProductKernel(&v1[0], &v2[0], v1.size());
+}
+
 // Output a sparse vector in human readable format.
 template <class ValueType>
 ostream& operator<< (ostream& output,
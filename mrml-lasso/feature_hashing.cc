@@ -0,0 +1,37 @@
+
+
+//
+#include "mrml-lasso/feature_hashing.h"
+
+namespace logistic_regression {
+
+// A 64-bit FNV-1a hash followed by the finalizer of MurmurHash3, which
+// spreads every byte over all bits, so both the low bits (the index)
+// and the highest bit (the sign) are well mixed.
+static uint64 HashName(const char* name, size_t size) {
+  uint64 h = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < size; ++i) {
+    h ^= static_cast<unsigned char>(name[i]);
+    h *= 0x100000001b3ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+FeatureHasher::FeatureHasher(int bits) : bits_(bits) {
+  CHECK_LE(1, bits);
+  CHECK_LE(bits, kMaxBits);
+}
+
+IndexType FeatureHasher::Hash(const char* name, size_t size,
+                              double* sign) const {
+  uint64 h = HashName(name, size);
+  *sign = (h >> 63) ? -1 : 1;
+  return static_cast<IndexType>(h & (dim() - 1));
+}
+
+}  // namespace logistic_regression
@@ -0,0 +1,52 @@
+
+
+//
+// FeatureHasher maps string feature names to indices in [0, 2^bits)
+// by the hashing trick, so that training data with named features can
+// be learned without building a feature dictionary (c.f.
+// mr_assign_feature_id.h and mr_convert_data_format.h).
+//
+// Each name is also hashed to a sign, by which its value is
+// multiplied.  Features colliding on an index then cancel each other
+// out in expectation, rather than biasing the weight of the index.
+//
+// The hash is a fixed function of the bytes of a name, so the same
+// name gets the same index and sign on all machines and in all runs,
+// as the mappers and the prediction of a trained model require.
+//
+#ifndef MRML_LASSO_FEATURE_HASHING_H_
+#define MRML_LASSO_FEATURE_HASHING_H_
+
+#include <stddef.h>
+
+#include <string>
+
+#include "base/common.h"
+#include "mrml-lasso/vector_types.h"
+
+namespace logistic_regression {
+
+class FeatureHasher {
+ public:
+  // The dim of hashed features is 2^bits, where bits is in
+  // [1, kMaxBits], so that the dim fits max_feature_number.
+  static const int kMaxBits = 30;
+
+  explicit FeatureHasher(int bits);
+
+  int bits() const { return bits_; }
+  IndexType dim() const { return static_cast<IndexType>(1) << bits_; }
+
+  // Returns the index of feature |name|, and sets *sign to +1 or -1.
+  IndexType Hash(const char* name, size_t size, double* sign) const;
+  IndexType Hash(const std::string& name, double* sign) const {
+    return Hash(name.data(), name.size(), sign);
+  }
+
+ private:
+  int bits_;
+};
+
+}  // namespace logistic_regression
+
+#endif  // MRML_LASSO_FEATURE_HASHING_H_
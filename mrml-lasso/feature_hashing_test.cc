@@ -0,0 +1,105 @@
+
+
+//
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/common.h"
+#include "mrml-lasso/feature_hashing.h"
+
+using logistic_regression::FeatureHasher;
+using logistic_regression::IndexType;
+using std::string;
+using std::vector;
+
+TEST(FeatureHashingTest, IndicesAreInDim) {
+  for (int bits = 1; bits <= FeatureHasher::kMaxBits; ++bits) {
+    FeatureHasher hasher(bits);
+    EXPECT_EQ(static_cast<IndexType>(1) << bits, hasher.dim());
+    for (int i = 0; i < 100; ++i) {
+      char name[32];
+      snprintf(name, sizeof(name), "group:%d", i);
+      double sign = 0;
+      EXPECT_GT(hasher.dim(), hasher.Hash(name, &sign));
+      EXPECT_TRUE(sign == 1 || sign == -1);
+    }
+  }
+}
+
+TEST(FeatureHashingTest, IsDeterministic) {
+  FeatureHasher hasher(20);
+  FeatureHasher another_hasher(20);
+  double sign = 0, another_sign = 0;
+  string name("query:apple");
+  EXPECT_EQ(hasher.Hash(name, &sign), another_hasher.Hash(name, &another_sign));
+  EXPECT_EQ(sign, another_sign);
+  EXPECT_EQ(hasher.Hash(name, &sign),
+            hasher.Hash(name.data(), name.size(), &another_sign));
+  EXPECT_EQ(sign, another_sign);
+
+  // Fewer bits keep the low bits of the same hash.
+  FeatureHasher small_hasher(8);
+  EXPECT_EQ(hasher.Hash(name, &sign) & (small_hasher.dim() - 1),
+            small_hasher.Hash(name, &another_sign));
+  EXPECT_EQ(sign, another_sign);
+}
+
+// Models trained on hashed features are only usable if names hash to
+// the same indices and signs forever, so the hash function is pinned
+// down by values computed independently from its definition.
+TEST(FeatureHashingTest, HasGoldenIndicesAndSigns) {
+  static const struct {
+    const char* name;
+    IndexType index_30_bits;
+    double sign;
+  } kGolden[] = {
+    { "query:apple", 679354559, 1 },
+    { "query:banana", 754861355, -1 },
+    { "title:red", 465449839, 1 },
+    { "f0", 156419316, -1 },
+    { "", 983116070, -1 },
+  };
+  static const int kBits[] = { FeatureHasher::kMaxBits, 20, 8 };
+  for (size_t b = 0; b < sizeof(kBits) / sizeof(kBits[0]); ++b) {
+    FeatureHasher hasher(kBits[b]);
+    for (size_t i = 0; i < sizeof(kGolden) / sizeof(kGolden[0]); ++i) {
+      double sign = 0;
+      EXPECT_EQ(kGolden[i].index_30_bits & (hasher.dim() - 1),
+                hasher.Hash(kGolden[i].name, &sign))
+          << kGolden[i].name << " in " << kBits[b] << " bits";
+      EXPECT_EQ(kGolden[i].sign, sign) << kGolden[i].name;
+    }
+  }
+  double sign = 0;
+  EXPECT_EQ(925887, FeatureHasher(20).Hash("query:apple", &sign));
+  EXPECT_EQ(935211, FeatureHasher(20).Hash("query:banana", &sign));
+  EXPECT_EQ(43, FeatureHasher(8).Hash("query:banana", &sign));
+}
+
+TEST(FeatureHashingTest, SpreadsIndicesAndSigns) {
+  const int kBits = 10;
+  const int kNumNames = 64 * 1024;
+  FeatureHasher hasher(kBits);
+  vector<int> counts(hasher.dim(), 0);
+  int num_negatives = 0;
+  for (int i = 0; i < kNumNames; ++i) {
+    char name[32];
+    snprintf(name, sizeof(name), "f%d", i);
+    double sign = 0;
+    ++counts[hasher.Hash(name, &sign)];
+    if (sign < 0) {
+      ++num_negatives;
+    }
+  }
+  // 64 names per index on average; allow generous deviations.
+  for (size_t i = 0; i < counts.size(); ++i) {
+    EXPECT_LT(20, counts[i]);
+    EXPECT_GT(120, counts[i]);
+  }
+  EXPECT_LT(kNumNames * 0.45, num_negatives);
+  EXPECT_GT(kNumNames * 0.55, num_negatives);
+}
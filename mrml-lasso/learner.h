@@ -19,10 +19,11 @@ namespace logistic_regression {
 template <class RealVector> class LearnerTestUtil;
 
 // Learner encapsulate learning / optimization operations on
-// LearnerStates.  There are two specializations of this class
+// LearnerStates.  There are three specializations of this class
 // template: one for dense vector representation, defined in
-// learner-dense-impl.hh, and another for sparse vector
-// representation, defined in learner-sparse-impl.h.
+// learner-dense-impl.hh, another for sparse vector representation,
+// defined in learner-sparse-impl.h, and the last for vectors that
+// switch between them, defined in learner_hybrid_impl.h.
 //
 // After the (MapReduce or local) evaluator finishes computing value
 // and gradient of the loss function, it notifies Learner the result
@@ -46,6 +47,11 @@ class Learner : public LearnerStates<RealVector> {
   // realization of the sparse version.
   Learner();
 
+  // Stores the L-BFGS history in single precision, which is supported
+  // by the dense learner only.  It should be set before states are
+  // loaded, so that the loaded history need not be converted.
+  void SetSinglePrecisionHistory(bool single_precision);
+
   void SetObjectiveValueAndGradient(double value, RealVector* gradient);
   void Initialize(const char* term_flag_filename);
   void GradientDescent(const char* term_flag_filename);
@@ -53,13 +59,19 @@ class Learner : public LearnerStates<RealVector> {
  protected:
   typedef TerminationFlag<LearnerStates<RealVector> > TermFlag;
 
-  void UpdateDir();
+  // Updates dir_ and returns the directional derivative along it.
+  double UpdateDir();
   void MakeSteepestDescDir();
   void MapDirByInverseHessian();
   void FixDirSigns();
 
   void IncreaseMemory(RealVector** next_s, RealVector** next_y);
 
+  // Used by the dense learner only, to keep sy_products_ and
+  // yy_products_ consistent with s_list_ and y_list_.
+  void ResetHistoryProducts();
+  void DropOldestHistoryProducts();
+
   double DirDeriv() const;
   void GetNextPoint(double alpha);
   void Shift();
@@ -123,8 +135,7 @@ void Learner<RealVector>::Initialize(const char* term_flag_filename) {
   this->grad_ = this->new_grad_;
   this->improvement_filter_.GetImprovement(this->value_);
 
-  UpdateDir();
-  this->dir_deriv_ = DirDeriv();
+  this->dir_deriv_ = UpdateDir();
   if (this->dir_deriv_ >= 0) {
     TermFlag::SetLocally(term_flag_filename, kErrorNonDescentDirection,
                          this);
@@ -180,8 +191,7 @@ void Learner<RealVector>::GradientDescent(const char* term_flag_filename) {
       return;
     }
 
-    UpdateDir();
-    this->dir_deriv_ = DirDeriv();
+    this->dir_deriv_ = UpdateDir();
     if (this->dir_deriv_ >= 0) {
       TermFlag::SetLocally(term_flag_filename,
                            kErrorNonDescentDirection,
@@ -212,19 +222,13 @@ void Learner<RealVector>::GradientDescent(const char* term_flag_filename) {
 }
 
 template <class RealVector>
-void Learner<RealVector>::UpdateDir() {
+double Learner<RealVector>::UpdateDir() {
   PRINT_EXECUTION_TRACE;
 
   MakeSteepestDescDir();
   MapDirByInverseHessian();
   FixDirSigns();
-}
-
-template <>
-void Learner<DenseRealVector>::IncreaseMemory(DenseRealVector** next_s,
-                                              DenseRealVector** next_y) {
-  *next_s = new DenseRealVector(x_.size(), 0);
-  *next_y = new DenseRealVector(x_.size(), 0);
+  return DirDeriv();
 }
 
 template <>
@@ -5,13 +5,35 @@
 // vector type (dense or sparse).  Here we specialize these functions
 // with DenseRealVector.
 //
+// Each element-wise step of OWL-QN is a pass over vectors as long as
+// the model, which is too large for caches, so the dense learner runs
+// fused kernels (c.f. dense_vector_kernels.h) that make as few passes
+// as possible: MakeSteepestDescDir writes dir_ and its copy new_grad_
+// in one pass, UpdateDir fixes signs of dir_ and computes the
+// directional derivative in another pass, and GetNextPoint projects
+// the step while taking it.
+//
+// The L-BFGS history is kept in contiguous rings (c.f.
+// dense_vector_ring.h) together with the inner products among its
+// vectors, so MapDirByInverseHessian runs the two-loop recursion on
+// scalars: it reads the history twice, once for the products of dir_
+// with all vectors and once for the linear combination that maps dir_,
+// rather than twice per vector.  Shift updates the products in one
+// more pass over the history.  The history may be stored in single
+// precision (c.f. SetSinglePrecisionHistory), which halves the memory
+// and bandwidth it takes, while all arithmetic remains in double.
+//
 #ifndef MRML_LASSO_LEARNER_DENSE_IMPL_H_
 #define MRML_LASSO_LEARNER_DENSE_IMPL_H_
 
 #include <math.h>
 #include <stdlib.h>
 
+#include <new>
+#include <vector>
+
 #include "base/common.h"
+#include "mrml-lasso/dense_vector_kernels.h"
 #include "mrml-lasso/learner.h"
 #include "mrml-lasso/termination_flag.h"
 #include "mrml-lasso/vector_types.h"
@@ -56,30 +78,14 @@ void Learner<DenseRealVector>::MakeSteepestDescDir() {
             << "l1weight = " << l1weight_ << "\n";
 #endif  // DEBUG_PRINT_VARS
 
-  if (l1weight_ == 0) {
-    ScaleInto(&dir_, grad_, -1);
-  } else {
-    CHECK_EQ(x_.size(), dir_.size());
-    CHECK_EQ(grad_.size(), dir_.size());
-    size_t dim = dir_.size();
-    for (size_t i = 0; i < dim; ++i) {
-      if (x_[i] < 0) {
-        dir_[i] = -grad_[i] + l1weight_;
-      } else if (x_[i] > 0) {
-        dir_[i] = -grad_[i] - l1weight_;
-      } else {
-        if (grad_[i] < -l1weight_) {
-          dir_[i] = -grad_[i] - l1weight_;
-        } else if (grad_[i] > l1weight_) {
-          dir_[i] = -grad_[i] + l1weight_;
-        } else {
-          dir_[i] = 0;
-        }
-      }
-    }
-  }
-
-  new_grad_ = dir_;
+  // new_grad_ keeps a copy of the steepest descent direction for
+  // FixDirSigns, as dir_ will be changed by MapDirByInverseHessian.
+  CHECK_EQ(x_.size(), dir_.size());
+  CHECK_EQ(grad_.size(), dir_.size());
+  CHECK_LT(0, dir_.size());
+  new_grad_.resize(dir_.size());
+  SteepestDescDirKernel(&dir_[0], &new_grad_[0], &x_[0], &grad_[0],
+                        dir_.size(), l1weight_);
 
 #ifdef DEBUG_PRINT_VARS
   std::cout << __FUNCTION__ << "@" << __FILE__ << ":" << __LINE__ << "\n"
@@ -89,27 +95,205 @@ void Learner<DenseRealVector>::MakeSteepestDescDir() {
 }
 
 
+// The vectors of the history, s_list_[0..count) followed by
+// y_list_[0..count), as arguments of kernels on many vectors, which
+// accept vectors stored in either precision.
+class HistoryRows {
+ public:
+  HistoryRows(const DenseVectorRing& s_list, const DenseVectorRing& y_list)
+      : count_(s_list.size()),
+        dim_(s_list.dim()),
+        single_precision_(s_list.single_precision()) {
+    CHECK_EQ(count_, y_list.size());
+    CHECK_EQ(dim_, y_list.dim());
+    CHECK(single_precision_ == y_list.single_precision());
+    for (int i = 0; i < 2 * count_; ++i) {
+      const DenseVectorRing& list = (i < count_) ? s_list : y_list;
+      if (single_precision_) {
+        float_rows_.push_back(list.Row<float>(i % count_));
+      } else {
+        double_rows_.push_back(list.Row<double>(i % count_));
+      }
+    }
+  }
+
+  int size() const { return 2 * count_; }
+
+  // products[r] <- dot(v, rows[r]) for all rows.
+  void DotProducts(const double* v, double* products) const {
+    if (single_precision_) {
+      BlockedDotProductsKernel(&v, 1, &float_rows_[0], size(), dim_,
+                               products);
+    } else {
+      BlockedDotProductsKernel(&v, 1, &double_rows_[0], size(), dim_,
+                               products);
+    }
+  }
+
+  // products[a * size() + r] <- dot(rows[a_rows[a]], rows[r]) for all
+  // rows, where a_rows indexes num_a rows.
+  void InnerProducts(const int* a_rows, int num_a, double* products) const {
+    if (single_precision_) {
+      std::vector<const float*> a(num_a);
+      for (int i = 0; i < num_a; ++i) {
+        a[i] = float_rows_[a_rows[i]];
+      }
+      BlockedDotProductsKernel(&a[0], num_a, &float_rows_[0], size(), dim_,
+                               products);
+    } else {
+      std::vector<const double*> a(num_a);
+      for (int i = 0; i < num_a; ++i) {
+        a[i] = double_rows_[a_rows[i]];
+      }
+      BlockedDotProductsKernel(&a[0], num_a, &double_rows_[0], size(), dim_,
+                               products);
+    }
+  }
+
+  // w <- v * v_coef + sum of rows[r] * coefs[r] for all rows.
+  void Combine(double* w, const double* v, double v_coef,
+               const double* coefs) const {
+    if (single_precision_) {
+      LinearCombinationKernel(w, v, v_coef, &float_rows_[0], coefs, size(),
+                              dim_);
+    } else {
+      LinearCombinationKernel(w, v, v_coef, &double_rows_[0], coefs, size(),
+                              dim_);
+    }
+  }
+
+ private:
+  int count_;
+  size_t dim_;
+  bool single_precision_;
+  std::vector<const double*> double_rows_;
+  std::vector<const float*> float_rows_;
+};
+
+
+// Computes sy_products_, yy_products_ and ro_list_ from the history,
+// which is required if the products were not loaded with the history,
+// or the history was rounded to single precision.
+template <>
+void Learner<DenseRealVector>::ResetHistoryProducts() {
+  PRINT_EXECUTION_TRACE;
+
+  const size_t m = memory_size_;
+  sy_products_.assign(m * m, 0);
+  yy_products_.assign(m * m, 0);
+
+  CHECK_LE(s_list_.size(), m);
+  int count = s_list_.size();
+  if (count == 0) {
+    return;
+  }
+  HistoryRows rows(s_list_, y_list_);
+  std::vector<int> all_rows(2 * count);
+  for (int i = 0; i < 2 * count; ++i) {
+    all_rows[i] = i;
+  }
+  std::vector<double> products(4 * count * count);
+  rows.InnerProducts(&all_rows[0], 2 * count, &products[0]);
+  for (int i = 0; i < count; ++i) {
+    for (int j = 0; j < count; ++j) {
+      sy_products_[i * m + j] = products[i * 2 * count + count + j];
+      yy_products_[i * m + j] = products[(count + i) * 2 * count + count + j];
+    }
+  }
+  ro_list_.resize(count);
+  for (int i = 0; i < count; ++i) {
+    ro_list_[i] = sy_products_[i * m + i];
+  }
+}
+
+
+// Shifts the products as the oldest vectors are dropped from the
+// history.
+template <>
+void Learner<DenseRealVector>::DropOldestHistoryProducts() {
+  const size_t m = memory_size_;
+  for (size_t i = 0; i + 1 < m; ++i) {
+    for (size_t j = 0; j + 1 < m; ++j) {
+      sy_products_[i * m + j] = sy_products_[(i + 1) * m + j + 1];
+      yy_products_[i * m + j] = yy_products_[(i + 1) * m + j + 1];
+    }
+  }
+}
+
+
+template <>
+void Learner<DenseRealVector>::SetSinglePrecisionHistory(
+    bool single_precision) {
+  if (single_precision != s_list_.single_precision()) {
+    s_list_.SetSinglePrecision(single_precision);
+    y_list_.SetSinglePrecision(single_precision);
+    if (!s_list_.empty()) {
+      sy_products_.clear();
+    }
+  }
+}
+
+
+// Equivalent to the two-loop recursion of L-BFGS, which alternately
+// takes the dot-product of dir_ with a vector of the history and adds
+// a multiple of the vector to dir_.  As every update of dir_ is a
+// multiple of s_list_[i] or y_list_[i], its dot-products with the
+// history follow from those of the original dir_ and the inner
+// products among the history, and dir_ is updated once at the end.
 template <>
 void Learner<DenseRealVector>::MapDirByInverseHessian() {
   PRINT_EXECUTION_TRACE;
 
-  size_t count = s_list_.size();
+  int count = s_list_.size();
 
   if (count != 0) {
+    CHECK_EQ(s_list_.dim(), dir_.size());
+    const size_t m = memory_size_;
+    if (sy_products_.size() != m * m) {
+      ResetHistoryProducts();
+    }
+    const double* sy = &sy_products_[0];
+    const double* yy = &yy_products_[0];
+
+    // dir_ will become dir_ * scalar + the linear combination of rows
+    // with coefs.
+    HistoryRows rows(s_list_, y_list_);
+    std::vector<double> coefs(2 * count, 0);
+    double* s_coefs = &coefs[0];
+    double* y_coefs = &coefs[count];
+
+    // dir_products[i] = dot(dir_, s_list_[i]), and
+    // dir_products[count + i] = dot(dir_, y_list_[i]).
+    std::vector<double> dir_products(2 * count);
+    rows.DotProducts(&dir_[0], &dir_products[0]);
+
     for (int i = count - 1; i >= 0; --i) {
-      alphas_[i] = - DotProduct(*s_list_[i], dir_) / ro_list_[i];
-      AddScaled(&dir_, *y_list_[i], alphas_[i]);
+      double s_dot_dir = dir_products[i];
+      for (int j = i + 1; j < count; ++j) {
+        s_dot_dir += y_coefs[j] * sy[i * m + j];
+      }
+      alphas_[i] = - s_dot_dir / ro_list_[i];
+      y_coefs[i] = alphas_[i];
     }
 
-    const DenseRealVector& last_y_ = *y_list_[count - 1];
-    double y_dot_y = DotProduct(last_y_, last_y_);
-    double scalar = ro_list_[count - 1] / y_dot_y;
-    Scale(&dir_, scalar);
+    double scalar = ro_list_[count - 1] / yy[(count - 1) * m + count - 1];
+    for (int i = 0; i < count; ++i) {
+      y_coefs[i] *= scalar;
+    }
 
-    for (uint32 i = 0; i < count; i++) {
-      double beta = DotProduct(*y_list_[i], dir_) / ro_list_[i];
-      AddScaled(&dir_, *s_list_[i], -alphas_[i] - beta);
+    for (int i = 0; i < count; ++i) {
+      double y_dot_dir = scalar * dir_products[count + i];
+      for (int j = 0; j < count; ++j) {
+        y_dot_dir += y_coefs[j] * yy[i * m + j];
+      }
+      for (int j = 0; j < i; ++j) {
+        y_dot_dir += s_coefs[j] * sy[j * m + i];
+      }
+      double beta = y_dot_dir / ro_list_[i];
+      s_coefs[i] = -alphas_[i] - beta;
     }
+
+    rows.Combine(&dir_[0], &dir_[0], scalar, &coefs[0]);
   }
 
 #ifdef DEBUG_PRINT_VARS
@@ -124,11 +308,9 @@ void Learner<DenseRealVector>::FixDirSigns() {
   PRINT_EXECUTION_TRACE;
 
   if (l1weight_ > 0) {
-    for (size_t i = 0; i < dir_.size(); ++i) {
-      if (dir_[i] * new_grad_[i] <= 0) {
-        dir_[i] = 0;
-      }
-    }
+    CHECK_EQ(new_grad_.size(), dir_.size());
+    CHECK_LT(0, dir_.size());
+    FixDirSignsKernel(&dir_[0], &new_grad_[0], dir_.size());
   }
 
 #ifdef DEBUG_PRINT_VARS
@@ -142,6 +324,36 @@ void Learner<DenseRealVector>::FixDirSigns() {
 }
 
 
+// Fuses FixDirSigns and DirDeriv.  As new_grad_ is the steepest descent
+// direction, i.e., the negative pseudo-gradient, the directional
+// derivative along dir_ is -dot(dir_, new_grad_) once signs of dir_
+// are fixed, and we need not read x_ and grad_ again.
+template <>
+double Learner<DenseRealVector>::UpdateDir() {
+  PRINT_EXECUTION_TRACE;
+
+  MakeSteepestDescDir();
+  MapDirByInverseHessian();
+
+  double ret = 0;
+  if (l1weight_ > 0) {
+    CHECK_EQ(new_grad_.size(), dir_.size());
+    CHECK_LT(0, dir_.size());
+    ret = FixDirSignsKernel(&dir_[0], &new_grad_[0], dir_.size());
+  } else {
+    ret = -DotProduct(dir_, new_grad_);
+  }
+
+#ifdef DEBUG_PRINT_VARS
+  std::cout << __FUNCTION__ << "@" << __FILE__ << ":" << __LINE__ << "\n"
+            << "dir = " << dir_ << "\n"
+            << "DirDeriv ret = " << ret << "\n";
+#endif  // DEBUG_PRINT_VARS
+
+  return ret;
+}
+
+
 template <>
 double Learner<DenseRealVector>::DirDeriv() const {
   PRINT_EXECUTION_TRACE;
@@ -186,24 +398,104 @@ void Learner<DenseRealVector>::GetNextPoint(double alpha) {
             << "dir = " << dir_ << "\n"
             << "alpha = " << alpha << "\n";
 #endif  // DEBUG_PRINT_VARS
-  AddScaledInto(&new_x_, x_, dir_, alpha);
+  if (l1weight_ > 0) {
+    // Take the step and project it onto the orthant of x_ in one pass.
+    CHECK_EQ(x_.size(), dir_.size());
+    CHECK_EQ(x_.size(), new_x_.size());
+    CHECK_LT(0, x_.size());
+    ProjectedStepKernel(&new_x_[0], &x_[0], &dir_[0], x_.size(), alpha);
+  } else {
+    AddScaledInto(&new_x_, x_, dir_, alpha);
+  }
+
 #ifdef DEBUG_PRINT_VARS
   std::cout << __FUNCTION__ << "@" << __FILE__ << ":" << __LINE__ << "\n"
             << "new_x = " << new_x_ << "\n"
             << "x = " << x_ << "\n";
 #endif  // DEBUG_PRINT_VARS
-  if (l1weight_ > 0) {
-    for (size_t i = 0; i < x_.size(); i++) {
-      if (x_[i] * new_x_[i] < 0.0) {
-        new_x_[i] = 0.0;
+}
+
+
+template <>
+void Learner<DenseRealVector>::Shift() {
+  PRINT_EXECUTION_TRACE;
+
+  const size_t m = memory_size_;
+  const size_t dim = x_.size();
+  CHECK_EQ(new_x_.size(), dim);
+  CHECK_EQ(grad_.size(), dim);
+  CHECK_EQ(new_grad_.size(), dim);
+
+  // The history is allocated all at once in the first iteration, or
+  // after it is loaded from a file.
+  if (s_list_.capacity() != m || s_list_.dim() != dim) {
+    size_t count = s_list_.size();
+    try {
+      s_list_.SetCapacity(m, dim);
+      y_list_.SetCapacity(m, dim);
+    } catch(std::bad_alloc) {
+      LOG(FATAL) << "Cannot allocate the L-BFGS history of " << m
+                 << " x " << dim << " elements.";
+    }
+    if (s_list_.size() != count) {
+      while (ro_list_.size() > s_list_.size()) {
+        ro_list_.pop_front();
       }
+      sy_products_.clear();
     }
   }
+  if (sy_products_.size() != m * m) {
+    ResetHistoryProducts();
+  }
+
+  if (s_list_.size() == m) {
+    ro_list_.pop_front();
+    DropOldestHistoryProducts();
+  }
+  if (s_list_.single_precision()) {
+    AddScaledIntoKernel(s_list_.PushBack<float>(), &new_x_[0], &x_[0],
+                        dim, -1);
+    AddScaledIntoKernel(y_list_.PushBack<float>(), &new_grad_[0], &grad_[0],
+                        dim, -1);
+  } else {
+    AddScaledIntoKernel(s_list_.PushBack<double>(), &new_x_[0], &x_[0],
+                        dim, -1);
+    AddScaledIntoKernel(y_list_.PushBack<double>(), &new_grad_[0],
+                        &grad_[0], dim, -1);
+  }
+
+  // Products of the new vectors with all vectors in the history, where
+  // those of the new s with s_list_ are not used but are cheaper than
+  // another pass over the history.
+  int count = s_list_.size();
+  int n = count - 1;
+  HistoryRows rows(s_list_, y_list_);
+  int new_rows[] = { n, count + n };
+  std::vector<double> products(2 * 2 * count);
+  rows.InnerProducts(new_rows, 2, &products[0]);
+  const double* s_dot = &products[0];
+  const double* y_dot = &products[2 * count];
+  for (int i = 0; i < count; ++i) {
+    sy_products_[n * m + i] = s_dot[count + i];
+    sy_products_[i * m + n] = y_dot[i];
+    yy_products_[n * m + i] = y_dot[count + i];
+    yy_products_[i * m + n] = y_dot[count + i];
+  }
+  ro_list_.push_back(sy_products_[n * m + n]);
+
+  x_.swap(new_x_);
+  grad_.swap(new_grad_);
+
+  line_search_step_ = 0;
+  ++iteration_;
 
 #ifdef DEBUG_PRINT_VARS
   std::cout << __FUNCTION__ << "@" << __FILE__ << ":" << __LINE__ << "\n"
+            << "x = " << x_ << "\n"
             << "new_x = " << new_x_ << "\n"
-            << "x = " << x_ << "\n";
+            << "dir = " << dir_ << "\n"
+            << "grad = " << grad_ << "\n"
+            << "new_grad = " << new_grad_ << "\n";
 #endif  // DEBUG_PRINT_VARS
 }
 
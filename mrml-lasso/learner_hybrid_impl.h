@@ -0,0 +1,314 @@
+
+
+//
+// Some member functions of class template Learner depends on the
+// vector type.  Here we specialize these functions with
+// HybridRealVector, each of which may be sparse or dense (c.f.
+// vector_types.h).
+//
+// An element-wise step of OWL-QN runs the fused kernel of the dense
+// learner if all its operands are dense, or TransformElements
+// otherwise, which walks through all elements if any operand is dense
+// and merges sparse operands otherwise.  The result of each step is
+// adapted to its density, so x_, which L1 regularization keeps sparse,
+// stays sparse while the gradient stays dense.
+//
+#ifndef MRML_LASSO_LEARNER_HYBRID_IMPL_H_
+#define MRML_LASSO_LEARNER_HYBRID_IMPL_H_
+
+#include <math.h>
+
+#include "base/common.h"
+#include "mrml-lasso/dense_vector_kernels.h"
+#include "mrml-lasso/learner.h"
+#include "mrml-lasso/termination_flag.h"
+#include "mrml-lasso/vector_types.h"
+
+namespace logistic_regression {
+
+namespace hybrid_learner_internal {
+
+// The element of the steepest descent direction, i.e., the negative
+// pseudo-gradient, given elements of x and the gradient.
+struct SteepestDescDir {
+  double l1weight;
+
+  double operator()(double x, double grad) const {
+    if (x < 0) {
+      return - grad + l1weight;
+    } else if (x > 0) {
+      return - grad - l1weight;
+    } else if (grad < - l1weight) {
+      return - grad - l1weight;
+    } else if (grad > l1weight) {
+      return - grad + l1weight;
+    }
+    return 0;
+  }
+};
+
+// Keeps an element of dir only if it has the same sign as that of the
+// steepest descent direction.
+struct FixDirSign {
+  double operator()(double dir, double steepest) const {
+    return (dir * steepest > 0) ? dir : 0;
+  }
+};
+
+// The element of x + dir * alpha, which is set to zero if it has a
+// different sign from x and project is true.
+struct Step {
+  double alpha;
+  bool project;
+
+  double operator()(double x, double dir) const {
+    double new_x = x + dir * alpha;
+    return (project && x * new_x < 0) ? 0 : new_x;
+  }
+};
+
+// Returns true if u and v are dense vectors of the same dim, so they
+// can be passed to dense kernels.
+inline bool BothDense(const HybridRealVector& u, const HybridRealVector& v) {
+  return u.is_dense() && v.is_dense() && u.dim() == v.dim() && u.dim() > 0;
+}
+
+}  // namespace hybrid_learner_internal
+
+
+template <>
+Learner<HybridRealVector>::Learner() : LearnerStates<HybridRealVector>() {}
+
+template <>
+Learner<HybridRealVector>::Learner(const HybridRealVector& initial_x,
+                                   int memory_size,
+                                   double l1_weight,
+                                   int max_line_search_steps,
+                                   int max_iterations,
+                                   double convergence_tolerance,
+                                   int max_feature_number)
+    : LearnerStates<HybridRealVector>(initial_x,
+                                      memory_size,
+                                      l1_weight,
+                                      max_line_search_steps,
+                                      max_iterations,
+                                      convergence_tolerance) {
+  if (max_feature_number > 0) {
+    x_.resize(max_feature_number);
+    new_x_.resize(max_feature_number);
+    grad_.resize(max_feature_number);
+    new_grad_.resize(max_feature_number);
+    dir_.resize(max_feature_number);
+  }
+}
+
+
+// Vectors of the history are kept one by one, each in its own
+// representation, and always in double.
+template <>
+void Learner<HybridRealVector>::SetSinglePrecisionHistory(
+    bool single_precision) {
+  if (single_precision) {
+    LOG(WARNING) << "The hybrid learner stores its history in double.";
+  }
+}
+
+
+template <>
+void Learner<HybridRealVector>::IncreaseMemory(HybridRealVector** next_s,
+                                               HybridRealVector** next_y) {
+  *next_s = new HybridRealVector;
+  *next_y = new HybridRealVector;
+}
+
+
+template <>
+void Learner<HybridRealVector>::MakeSteepestDescDir() {
+  PRINT_EXECUTION_TRACE;
+
+#ifdef DEBUG_PRINT_VARS
+  std::cout << __FUNCTION__ << "@" << __FILE__ << ":" << __LINE__ << "\n"
+            << "x = " << x_ << "\n"
+            << "dir = " << dir_ << "\n"
+            << "grad = " << grad_ << "\n"
+            << "l1weight = " << l1weight_ << "\n";
+#endif  // DEBUG_PRINT_VARS
+
+  if (l1weight_ > 0 && hybrid_learner_internal::BothDense(x_, grad_)) {
+    size_t dim = x_.dim();
+    SteepestDescDirKernel(&(*dir_.ResetDense(dim))[0],
+                          &(*new_grad_.ResetDense(dim))[0],
+                          &x_.dense()[0], &grad_.dense()[0], dim, l1weight_);
+    dir_.Adapt();
+    new_grad_.Adapt();
+  } else {
+    if (l1weight_ == 0) {
+      ScaleInto(&dir_, grad_, -1);
+    } else {
+      hybrid_learner_internal::SteepestDescDir op = { l1weight_ };
+      TransformElements(x_, grad_, op, &dir_);
+    }
+    // Set steepest descent dir to new_grad_.
+    new_grad_ = dir_;
+  }
+
+#ifdef DEBUG_PRINT_VARS
+  std::cout << __FUNCTION__ << "@" << __FILE__ << ":" << __LINE__ << "\n"
+            << "dir = " << dir_ << "\n"
+            << "new_grad = " << new_grad_ << "\n";
+#endif  // DEBUG_PRINT_VARS
+}
+
+
+template <>
+void Learner<HybridRealVector>::MapDirByInverseHessian() {
+  PRINT_EXECUTION_TRACE;
+
+  int count = static_cast<int>(s_list_.size());
+
+  if (count != 0) {
+    for (int i = count - 1; i >= 0; i--) {
+      alphas_[i] = - DotProduct(*s_list_[i], dir_) / ro_list_[i];
+      AddScaled(&dir_, *y_list_[i], alphas_[i]);
+    }
+
+    const HybridRealVector& last_y = *y_list_[count - 1];
+    double y_dot_y = DotProduct(last_y, last_y);
+    double scalar = ro_list_[count - 1] / y_dot_y;
+    Scale(&dir_, scalar);
+
+    for (int i = 0; i < count; i++) {
+      double beta = DotProduct(*y_list_[i], dir_) / ro_list_[i];
+      AddScaled(&dir_, *s_list_[i], -alphas_[i] - beta);
+    }
+  }
+
+#ifdef DEBUG_PRINT_VARS
+  std::cout << __FUNCTION__ << "@" << __FILE__ << ":" << __LINE__ << "\n"
+            << "dir = " << dir_ << "\n";
+#endif  // DEBUG_PRINT_VARS
+}
+
+
+template <>
+void Learner<HybridRealVector>::FixDirSigns() {
+  PRINT_EXECUTION_TRACE;
+
+  if (l1weight_ > 0) {
+    if (hybrid_learner_internal::BothDense(dir_, new_grad_)) {
+      FixDirSignsKernel(&(*dir_.mutable_dense())[0], &new_grad_.dense()[0],
+                        dir_.dim());
+      dir_.Adapt();
+    } else {
+      HybridRealVector fixed_dir;
+      TransformElements(dir_, new_grad_, hybrid_learner_internal::FixDirSign(),
+                        &fixed_dir);
+      dir_.swap(fixed_dir);
+    }
+  }
+
+#ifdef DEBUG_PRINT_VARS
+  std::cout << __FUNCTION__ << "@" << __FILE__ << ":" << __LINE__ << "\n"
+            << "dir = " << dir_ << "\n";
+#endif  // DEBUG_PRINT_VARS
+
+#ifdef DEBUG_PRINT_PROGRESS
+  std::cout << __FUNCTION__ << "\n";
+#endif  // DEBUG_PRINT_PROGRESS
+}
+
+
+// As in the dense learner, the directional derivative along dir_ is
+// -dot(dir_, new_grad_) once signs of dir_ are fixed, which reads
+// neither x_ nor grad_.
+template <>
+double Learner<HybridRealVector>::UpdateDir() {
+  PRINT_EXECUTION_TRACE;
+
+  MakeSteepestDescDir();
+  MapDirByInverseHessian();
+  FixDirSigns();
+  double ret = -DotProduct(dir_, new_grad_);
+
+#ifdef DEBUG_PRINT_VARS
+  std::cout << __FUNCTION__ << "@" << __FILE__ << ":" << __LINE__ << "\n"
+            << "DirDeriv ret = " << ret << "\n";
+#endif  // DEBUG_PRINT_VARS
+
+  return ret;
+}
+
+
+template <>
+double Learner<HybridRealVector>::DirDeriv() const {
+  PRINT_EXECUTION_TRACE;
+
+  double ret = 0;
+
+  if (l1weight_ == 0) {
+    ret = DotProduct(dir_, grad_);
+  } else {
+    HybridRealVector::Reader x_reader(x_);
+    HybridRealVector::Reader grad_reader(grad_);
+    for (HybridRealVector::Iterator it(dir_); !it.Done(); it.Next()) {
+      double x = x_reader.Get(it.index());
+      double grad = grad_reader.Get(it.index());
+      double dir = it.value();
+      // The sign of x[i] if x[i] != 0, or of dir[i] otherwise, chooses
+      // the side of the subgradient of the L1 term.
+      double sign = (x != 0) ? x : dir;
+      if (sign < 0) {
+        ret += dir * (grad - l1weight_);
+      } else if (sign > 0) {
+        ret += dir * (grad + l1weight_);
+      }
+    }
+  }
+
+#ifdef DEBUG_PRINT_VARS
+  std::cout << __FUNCTION__ << "@" << __FILE__ << ":" << __LINE__ << "\n"
+            << "DirDeriv ret = " << ret << "\n";
+#endif  // DEBUG_PRINT_VARS
+
+  return ret;
+}
+
+
+template <>
+void Learner<HybridRealVector>::GetNextPoint(double alpha) {
+  PRINT_EXECUTION_TRACE;
+
+#ifdef DEBUG_PRINT_VARS
+  std::cout << __FUNCTION__ << "@" << __FILE__ << ":" << __LINE__ << "\n"
+            << "new_x = " << new_x_ << "\n"
+            << "x = " << x_ << "\n"
+            << "dir = " << dir_ << "\n"
+            << "alpha = " << alpha << "\n";
+#endif  // DEBUG_PRINT_VARS
+
+  // new_x <- x + dir * alpha, where, if l1weight > 0, new_x[i] is
+  // set to zero if it has a different sign from x[i].
+  if (hybrid_learner_internal::BothDense(x_, dir_)) {
+    size_t dim = x_.dim();
+    double* new_x = &(*new_x_.ResetDense(dim))[0];
+    if (l1weight_ > 0) {
+      ProjectedStepKernel(new_x, &x_.dense()[0], &dir_.dense()[0], dim, alpha);
+    } else {
+      AddScaledIntoKernel(new_x, &x_.dense()[0], &dir_.dense()[0], dim, alpha);
+    }
+    new_x_.Adapt();
+  } else {
+    hybrid_learner_internal::Step op = { alpha, l1weight_ > 0 };
+    TransformElements(x_, dir_, op, &new_x_);
+  }
+
+#ifdef DEBUG_PRINT_VARS
+  std::cout << __FUNCTION__ << "@" << __FILE__ << ":" << __LINE__ << "\n"
+            << "new_x = " << new_x_ << "\n"
+            << "x = " << x_ << "\n";
+#endif  // DEBUG_PRINT_VARS
+}
+
+}  // namespace logistic_regression
+
+#endif  // MRML_LASSO_LEARNER_HYBRID_IMPL_H_
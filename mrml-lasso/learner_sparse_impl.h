@@ -21,6 +21,16 @@ template <>
 Learner<SparseRealVector>::Learner() : LearnerStates<SparseRealVector>() {}
 
 
+// Sparse vectors of the history are always stored in double.
+template <>
+void Learner<SparseRealVector>::SetSinglePrecisionHistory(
+    bool single_precision) {
+  if (single_precision) {
+    LOG(WARNING) << "The sparse learner stores its history in double.";
+  }
+}
+
+
 template <>
 void Learner<SparseRealVector>::MakeSteepestDescDir() {
   PRINT_EXECUTION_TRACE;
@@ -37,57 +47,40 @@ void Learner<SparseRealVector>::MakeSteepestDescDir() {
     ScaleInto(&dir_, grad_, -1);
   } else {
     dir_.clear();
+    dir_.reserve(x_.size() + grad_.size());
 
-    SparseRealVector::const_iterator ix = x_.begin();
-    SparseRealVector::const_iterator ig = grad_.begin();
-
-    while (ix != x_.end() && ig != grad_.end()) {
-      if (ix->first <= ig->first) {
+    size_t ix = 0;
+    size_t ig = 0;
+    while (ix < x_.size() || ig < grad_.size()) {
+      if (ig == grad_.size() ||
+          (ix < x_.size() && x_.index(ix) <= grad_.index(ig))) {
         // x[i] != 0, grad[i] may or may not be 0.
-        const IndexType& index = ix->first;
-        if (ix->second < 0) {
-          dir_.set(index, - grad_[index] + l1weight_);
-        } else if (ix->second > 0) {
-          dir_.set(index, - grad_[index] - l1weight_);
-        }
-        if (ig->first == ix->first)
+        const IndexType& index = x_.index(ix);
+        double grad = 0;
+        if (ig < grad_.size() && grad_.index(ig) == index) {
+          grad = grad_.value(ig);
           ++ig;
+        }
+        if (x_.value(ix) < 0) {
+          dir_.append(index, - grad + l1weight_);
+        } else if (x_.value(ix) > 0) {
+          dir_.append(index, - grad - l1weight_);
+        }
         ++ix;
-      } else if (ig->first < ix->first) {
+      } else {
         // x[i] == 0 && grad_[i] != 0
-        const IndexType& index = ig->first;
-        if (ig->second < - l1weight_) {
-          dir_.set(index, - ig->second - l1weight_);
-        } else if (ig->second > l1weight_) {
-          dir_.set(index, - ig->second + l1weight_);
+        const IndexType& index = grad_.index(ig);
+        const double& grad = grad_.value(ig);
+        if (grad < - l1weight_) {
+          dir_.append(index, - grad - l1weight_);
+        } else if (grad > l1weight_) {
+          dir_.append(index, - grad + l1weight_);
         }
         ++ig;
       }
       // else if (x[i]==0 && grad[i]==0), no change to dir[i] means
       // to keep it zero.
     }
-
-    while (ix != x_.end()) {
-      // x[i] != 0 && grad[i] == 0
-      const IndexType& index = ix->first;
-      if (ix->second < 0) {
-        dir_.set(index, l1weight_);
-      } else if (ix->second > 0) {
-        dir_.set(index, - l1weight_);
-      }
-      ++ix;
-    }
-
-    while (ig != grad_.end()) {
-      // x[i] == 0 && grad[i] != 0
-      const IndexType& index = ig->first;
-      if (ig->second < - l1weight_) {
-        dir_.set(index, - ig->second - l1weight_);
-      } else if (ig->second > l1weight_) {
-        dir_.set(index, - ig->second + l1weight_);
-      }
-      ++ig;
-    }
   }
 
   // Set steepest descent dir to new_grad_.
@@ -136,34 +129,25 @@ void Learner<SparseRealVector>::FixDirSigns() {
   PRINT_EXECUTION_TRACE;
 
   if (l1weight_ > 0) {
-    SparseRealVector::iterator i = dir_.begin();
-    SparseRealVector::const_iterator j = new_grad_.begin();
-
-    while (i != dir_.end() && j != new_grad_.end()) {
-      if (i->first == j->first) {
-        if (i->second * j->second <= 0) {
-          SparseRealVector::iterator t(i);
-          ++i;
-          ++j;
-          dir_.erase(t);
-        } else {
-          ++i;
-          ++j;
+    // Keeps dir[i] only if it has the same sign as new_grad[i].
+    SparseRealVector fixed_dir;
+    fixed_dir.reserve(dir_.size());
+    size_t i = 0;
+    size_t j = 0;
+    while (i < dir_.size() && j < new_grad_.size()) {
+      if (dir_.index(i) == new_grad_.index(j)) {
+        if (dir_.value(i) * new_grad_.value(j) > 0) {
+          fixed_dir.append(dir_.index(i), dir_.value(i));
         }
-      } else if (i->first < j->first) {
-        SparseRealVector::iterator t(i);
         ++i;
-        dir_.erase(t);
-      } else if (i->first > j->first) {
+        ++j;
+      } else if (dir_.index(i) < new_grad_.index(j)) {
+        ++i;
+      } else {
         ++j;
       }
     }
-
-    while (i != dir_.end()) {
-      SparseRealVector::iterator t(i);
-      ++i;
-      dir_.erase(t);
-    }
+    dir_.swap(fixed_dir);
   }
 
 #ifdef DEBUG_PRINT_VARS
@@ -186,43 +170,35 @@ double Learner<SparseRealVector>::DirDeriv() const {
   if (l1weight_ == 0) {
     ret = DotProduct(dir_, grad_);
   } else {
-    SparseRealVector::const_iterator i_dir = dir_.begin();
-    SparseRealVector::const_iterator i_x = x_.begin();
-
-    while (i_dir != dir_.end() && i_x != x_.end()) {
-      const IndexType& index = i_dir->first;
-      if (i_dir->first == i_x->first) {
-        // dir[i] != 0 && x[i] != 0
-        if (i_x->second < 0) {
-          ret += i_dir->second * (grad_[index] - l1weight_);
-        } else if (i_x->second > 0) {
-          ret += i_dir->second * (grad_[index] + l1weight_);
-        }
-        ++i_dir;
-        ++i_x;
-      } else if (i_dir->first < i_x->first) {
-        // dir[i] != 0 && x[i] == 0
-        if (i_dir->second < 0) {
-          ret += i_dir->second *(grad_[index] - l1weight_);
-        } else if (i_dir->second > 0) {
-          ret += i_dir->second *(grad_[index] + l1weight_);
-        }
-        ++i_dir;
-      } else {
-        // dir[i] == 0 && x[i] != 0
+    // Walks through x and grad along with dir, whose indices are
+    // increasing, so each of them is scanned once.
+    size_t i_x = 0;
+    size_t i_grad = 0;
+    for (size_t i_dir = 0; i_dir < dir_.size(); ++i_dir) {
+      const IndexType& index = dir_.index(i_dir);
+      while (i_x < x_.size() && x_.index(i_x) < index) {
         ++i_x;
       }
-    }
-
-    while (i_dir != dir_.end()) {
-      // dir[i] != 0 && x[i] == 0
-      const IndexType& index = i_dir->first;
-      if (i_dir->second < 0) {
-        ret += i_dir->second *(grad_[index] - l1weight_);
-      } else if (i_dir->second > 0) {
-        ret += i_dir->second *(grad_[index] + l1weight_);
+      while (i_grad < grad_.size() && grad_.index(i_grad) < index) {
+        ++i_grad;
+      }
+      double x = 0;
+      if (i_x < x_.size() && x_.index(i_x) == index) {
+        x = x_.value(i_x);
+      }
+      double grad = 0;
+      if (i_grad < grad_.size() && grad_.index(i_grad) == index) {
+        grad = grad_.value(i_grad);
+      }
+      const double& dir = dir_.value(i_dir);
+      // The sign of x[i] if x[i] != 0, or of dir[i] otherwise, chooses
+      // the side of the subgradient of the L1 term.
+      double sign = (x != 0) ? x : dir;
+      if (sign < 0) {
+        ret += dir * (grad - l1weight_);
+      } else if (sign > 0) {
+        ret += dir * (grad + l1weight_);
       }
-      ++i_dir;
     }
   }
 
@@ -247,35 +223,36 @@ void Learner<SparseRealVector>::GetNextPoint(double alpha) {
             << "alpha = " << alpha << "\n";
 #endif  // DEBUG_PRINT_VARS
 
-  AddScaledInto(&new_x_, x_, dir_, alpha);
-#ifdef DEBUG_PRINT_VARS
-  std::cout << __FUNCTION__ << "@" << __FILE__ << ":" << __LINE__ << "\n"
-            << "new_x = " << new_x_ << "\n"
-            << "x = " << x_ << "\n";
-#endif  // DEBUG_PRINT_VARS
-
-  if (l1weight_ > 0) {
-    SparseRealVector::const_iterator i_x = x_.begin();
-    SparseRealVector::const_iterator i_new_x = new_x_.begin();
-
-    while (i_x != x_.end() && i_new_x != new_x_.end()) {
-      if (i_x->first < i_new_x->first) {
-        ++i_x;
-      } else if (i_new_x->first < i_x->first) {
-        ++i_new_x;
-      } else {                // i_x->first == i_new_x->first
-        if (i_x->second * i_new_x->second < 0) {
-          SparseRealVector::const_iterator temp = i_new_x;
-          temp++;
-          new_x_.set(i_new_x->first, 0);
-          i_new_x = temp;
-        } else {
-          ++i_new_x;
-        }
-        ++i_x;
+  // new_x <- x + dir * alpha, where, if l1weight > 0, new_x[i] is
+  // set to zero if it has a different sign from x[i].
+  new_x_.clear();
+  new_x_.reserve(x_.size() + dir_.size());
+  size_t i_x = 0;
+  size_t i_dir = 0;
+  while (i_x < x_.size() && i_dir < dir_.size()) {
+    if (x_.index(i_x) == dir_.index(i_dir)) {
+      double x = x_.value(i_x);
+      double new_x = x + dir_.value(i_dir) * alpha;
+      if (l1weight_ > 0 && x * new_x < 0) {
+        new_x = 0;
       }
+      new_x_.append(x_.index(i_x), new_x);
+      ++i_x;
+      ++i_dir;
+    } else if (x_.index(i_x) < dir_.index(i_dir)) {
+      new_x_.append(x_.index(i_x), x_.value(i_x));
+      ++i_x;
+    } else {
+      new_x_.append(dir_.index(i_dir), dir_.value(i_dir) * alpha);
+      ++i_dir;
     }
   }
+  for (; i_x < x_.size(); ++i_x) {
+    new_x_.append(x_.index(i_x), x_.value(i_x));
+  }
+  for (; i_dir < dir_.size(); ++i_dir) {
+    new_x_.append(dir_.index(i_dir), dir_.value(i_dir) * alpha);
+  }
 
 #ifdef DEBUG_PRINT_VARS
   std::cout << __FUNCTION__ << "@" << __FILE__ << ":" << __LINE__ << "\n"
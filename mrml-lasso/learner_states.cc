@@ -46,6 +46,20 @@ void ParseDequeFromProtoBuf(const DoubleSequencePB& pb,
   }
 }
 
+void SerializeVectorToProtoBuf(const std::vector<double>& vector,
+                               DoubleSequencePB* pb) {
+  pb->Clear();
+  pb->mutable_value()->Reserve(vector.size());
+  for (size_t i = 0; i < vector.size(); ++i) {
+    pb->add_value(vector[i]);
+  }
+}
+
+void ParseVectorFromProtoBuf(const DoubleSequencePB& pb,
+                             std::vector<double>* vector) {
+  vector->assign(pb.value().begin(), pb.value().end());
+}
+
 ostream& operator<<(ostream& out, const deque<double>& double_deque) {
   for (size_t s = 0; s < double_deque.size(); ++s) {
     out << s << ":" << double_deque[s] << " ";
@@ -16,6 +16,7 @@
 #include "base/common.h"
 #include "mrml/mrml_filesystem.h"
 #include "mrml/mrml_recordio.h"
+#include "mrml-lasso/dense_vector_ring.h"
 #include "mrml-lasso/logistic_regression.pb.h"
 #include "mrml-lasso/sparse_vector_tmpl.h"
 
@@ -34,6 +35,7 @@ using std::ostringstream;
 //---------------------------------------------------------------------------
 // Foward declarations:
 //---------------------------------------------------------------------------
+class DenseRealVector;
 class ImprovementFilter;
 class ImprovementFilterTestUtil;
 template <class RealVector> class RealVectorPtrDeque;
@@ -51,8 +53,7 @@ ostream& operator<<(ostream&, const LearnerStates<RealVector>&);
 //---------------------------------------------------------------------------
 // RealVectorPtrDeque is the data structure for saving S-list and
 // Y-list in class LearnerStates.  The template parameter,
-// RealVector, may refer to either DenseRealVector or
-// SparseRealVector.
+// RealVector, may refer to SparseRealVector or HybridRealVector.
 //---------------------------------------------------------------------------
 template <class RealVector>
 class RealVectorPtrDeque : public deque<RealVector*> {
@@ -66,6 +67,21 @@ class RealVectorPtrDeque : public deque<RealVector*> {
   void ReadAsRecords(MRMLFS_File* file, const string& key_base);
 };
 
+//---------------------------------------------------------------------------
+// HistoryList<RealVector>::Type is the type of S-list and Y-list in
+// LearnerStates<RealVector>.  Dense vectors are kept in a contiguous
+// DenseVectorRing.
+//---------------------------------------------------------------------------
+template <class RealVector>
+struct HistoryList {
+  typedef RealVectorPtrDeque<RealVector> Type;
+};
+
+template <>
+struct HistoryList<DenseRealVector> {
+  typedef DenseVectorRing Type;
+};
+
 //---------------------------------------------------------------------------
 // ImprovementFilter is a utility class to check whether an
 // optimization can stop according to the average improvement of the
@@ -92,8 +108,8 @@ class ImprovementFilter {
 // LearnerStates contains all what we need to persist for pausing
 // and resuming of a long-time learning process.  Interface Leaner
 // defines the operations with states defined in this class.  The
-// template parameter, RealVector, may refer to SparseRealVector or
-// DenseRealVector.
+// template parameter, RealVector, may refer to SparseRealVector,
+// DenseRealVector or HybridRealVector.
 //---------------------------------------------------------------------------
 template <class RealVector>
 class LearnerStates {
@@ -135,11 +151,19 @@ class LearnerStates {
   RealVector new_grad_;
   RealVector dir_;            // The update direction of model parameters.
 
-  RealVectorPtrDeque<RealVector> s_list_;
-  RealVectorPtrDeque<RealVector> y_list_;
+  typename HistoryList<RealVector>::Type s_list_;
+  typename HistoryList<RealVector>::Type y_list_;
   std::deque<double> ro_list_;
   std::deque<double> alphas_;  // Has fixed size of memory_size_.
 
+  // Inner products among s_list_ and y_list_, which let the dense
+  // learner run the two-loop recursion of L-BFGS on scalars (c.f.
+  // learner_dense_impl.h).  sy_products_[i * memory_size_ + j] is
+  // dot(s_list_[i], y_list_[j]), and yy_products_ likewise.  Both are
+  // empty if unknown, e.g., for sparse vectors.
+  std::vector<double> sy_products_;
+  std::vector<double> yy_products_;
+
   double value_;               // The value of objective function.
   double old_value_;           // Value before line search in an iteration.
   double dir_deriv_;           // The derivative of dir_ before a line search.
@@ -172,6 +196,11 @@ void SerializeDequeToProtoBuf(const std::deque<double>& deque,
 void ParseDequeFromProtoBuf(const DoubleSequencePB& pb,
                             std::deque<double>* deque);
 
+void SerializeVectorToProtoBuf(const std::vector<double>& vector,
+                               DoubleSequencePB* pb);
+void ParseVectorFromProtoBuf(const DoubleSequencePB& pb,
+                             std::vector<double>* vector);
+
 //---------------------------------------------------------------------------
 // Implementation of class template RealVectorPtrDeque
 //---------------------------------------------------------------------------
@@ -306,6 +335,12 @@ LearnerStates<RealVector>::LearnerStates(const RealVector& initial_x,
     MRML_WriteRecord(file, #variable, pb);              \
   }
 
+#define WriteAsProductsPB(variable) {           \
+    DoubleSequencePB pb;                        \
+    SerializeVectorToProtoBuf(variable, &pb);   \
+    MRML_WriteRecord(file, #variable, pb);      \
+  }
+
 template <class RealVector>
 void LearnerStates<RealVector>::SaveIntoRecordFile(MRMLFS_File* file) const {
   WriteAsRealVectorPB(x_);
@@ -330,6 +365,12 @@ void LearnerStates<RealVector>::SaveIntoRecordFile(MRMLFS_File* file) const {
   WriteAsInt32PB(max_iterations_);
   WriteAsInt32PB(memory_size_);
   WriteFilterAsDoubleSequencePB(improvement_filter_);
+
+  // Written last, so files without them can still be loaded.
+  if (!sy_products_.empty()) {
+    WriteAsProductsPB(sy_products_);
+    WriteAsProductsPB(yy_products_);
+  }
 }
 
 #undef WriteAsRealVectorPB
@@ -337,6 +378,7 @@ void LearnerStates<RealVector>::SaveIntoRecordFile(MRMLFS_File* file) const {
 #undef WriteAsDoublePB
 #undef WriteAsInt32PB
 #undef WriteFilterAsDoubleSequencePB
+#undef WriteAsProductsPB
 
 
 #define ReadAsRealVectorPB(variable) {                      \
@@ -397,6 +439,18 @@ void LearnerStates<RealVector>::LoadFromRecordFile(MRMLFS_File* file) {
   ReadAsInt32PB(max_iterations_);
   ReadAsInt32PB(memory_size_);
   ReadFilterAsDoubleSequencePB(improvement_filter_);
+
+  // Files written before the products were saved end here.
+  sy_products_.clear();
+  yy_products_.clear();
+  DoubleSequencePB pb;
+  if (MRML_ReadRecord(file, &key, &pb)) {
+    CHECK_EQ(key, "sy_products_");
+    ParseVectorFromProtoBuf(pb, &sy_products_);
+    CHECK(MRML_ReadRecord(file, &key, &pb));
+    CHECK_EQ(key, "yy_products_");
+    ParseVectorFromProtoBuf(pb, &yy_products_);
+  }
 }
 
 #undef ReadAsRealVectorPB
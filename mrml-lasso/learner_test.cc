@@ -10,6 +10,7 @@
 #include "base/common.h"
 #include "gtest/gtest.h"
 #include "mrml-lasso/learner.h"
+#include "mrml-lasso/learner_hybrid_impl.h"
 #include "mrml-lasso/learner_sparse_impl.h"
 #include "mrml-lasso/test_utils.h"
 #include "mrml-lasso/vector_types.h"
@@ -29,6 +30,10 @@ class LearnerTestUtil : public LearnerStatesTestUtil<RealVector> {
   void TestGetNextPoint();
   void TestFixDirSigns();
 
+  // Runs steps of the learner on operands in every combination of
+  // sparse and dense representations.
+  void TestMixedRepresentations();
+
  private:
   typedef std::vector<double> DblVec;
 
@@ -50,12 +55,12 @@ class LearnerTestUtil : public LearnerStatesTestUtil<RealVector> {
 };
 
 //---------------------------------------------------------------------------
-// Specialization of LearnerTestUtil<SparseRealVector>.
+// The reference implementation of learner steps on dense std::vectors.
 //---------------------------------------------------------------------------
 
-template <>
-double LearnerTestUtil<SparseRealVector>::dotProduct(const DblVec& a,
-                                                     const DblVec& b) {
+template <class RealVector>
+double LearnerTestUtil<RealVector>::dotProduct(const DblVec& a,
+                                               const DblVec& b) {
   double result = 0;
   for (size_t i = 0; i < a.size(); i++) {
     result += a[i] * b[i];
@@ -63,19 +68,19 @@ double LearnerTestUtil<SparseRealVector>::dotProduct(const DblVec& a,
   return result;
 }
 
-template <>
-void LearnerTestUtil<SparseRealVector>::scaleInto(DblVec& a, const DblVec& b,
-                                                  double c) {
+template <class RealVector>
+void LearnerTestUtil<RealVector>::scaleInto(DblVec& a, const DblVec& b,
+                                            double c) {
   for (size_t i = 0; i < a.size(); i++) {
     a[i] = b[i] * c;
   }
 }
 
-template <>
-void LearnerTestUtil<SparseRealVector>::addMultInto(DblVec& a,
-                                                    const DblVec& b,
-                                                    const DblVec& c,
-                                                    double d) {
+template <class RealVector>
+void LearnerTestUtil<RealVector>::addMultInto(DblVec& a,
+                                              const DblVec& b,
+                                              const DblVec& c,
+                                              double d) {
   for (size_t i = 0; i < a.size(); i++) {
     a[i] = b[i] + c[i] * d;
   }
@@ -83,8 +88,8 @@ void LearnerTestUtil<SparseRealVector>::addMultInto(DblVec& a,
 
 /* Read-only: steepestDescDir (newGrad) */
 /* Write: dir */
-template <>
-void LearnerTestUtil<SparseRealVector>::FixDirSigns() {
+template <class RealVector>
+void LearnerTestUtil<RealVector>::FixDirSigns() {
   if (l1weight > 0) {
     for (size_t i = 0; i < dim; i++) {
       if (dir[i] * new_grad[i] <= 0) {
@@ -96,8 +101,8 @@ void LearnerTestUtil<SparseRealVector>::FixDirSigns() {
 
 /* Read-only: x, dir */
 /* Write: new_x */
-template <>
-void LearnerTestUtil<SparseRealVector>::GetNextPoint(double alpha) {
+template <class RealVector>
+void LearnerTestUtil<RealVector>::GetNextPoint(double alpha) {
   addMultInto(new_x, x, dir, alpha);
   if (l1weight > 0) {
     for (size_t i = 0; i < dim; i++) {
@@ -110,8 +115,8 @@ void LearnerTestUtil<SparseRealVector>::GetNextPoint(double alpha) {
 
 /* Read-only: x, grad, l1weight, dim */
 /* Write: dir, new_grad */
-template <>
-void LearnerTestUtil<SparseRealVector>::MakeSteepestDescDir() {
+template <class RealVector>
+void LearnerTestUtil<RealVector>::MakeSteepestDescDir() {
   if (l1weight == 0) {
     scaleInto(dir, grad, -1);
   } else {
@@ -135,8 +140,8 @@ void LearnerTestUtil<SparseRealVector>::MakeSteepestDescDir() {
 }
 
 /* Read-only: x, dir, grad */
-template <>
-double LearnerTestUtil<SparseRealVector>::DirDeriv() const {
+template <class RealVector>
+double LearnerTestUtil<RealVector>::DirDeriv() const {
   if (l1weight == 0) {
     return dotProduct(dir, grad);
   } else {
@@ -158,6 +163,10 @@ double LearnerTestUtil<SparseRealVector>::DirDeriv() const {
   }
 }
 
+//---------------------------------------------------------------------------
+// Specialization of LearnerTestUtil<SparseRealVector>.
+//---------------------------------------------------------------------------
+
 template <>
 void LearnerTestUtil<SparseRealVector>::TestDirDeriv_XLongerThanDir() {
   Learner<SparseRealVector> lner;
@@ -429,8 +438,56 @@ void LearnerTestUtil<SparseRealVector>::TestFixDirSigns() {
   }
 }
 
+//---------------------------------------------------------------------------
+// Specialization of LearnerTestUtil<HybridRealVector>.
+//---------------------------------------------------------------------------
+
+template <>
+void LearnerTestUtil<HybridRealVector>::TestMixedRepresentations() {
+  static const double kX[] = { 0, 1, 1, -1, -1, 0, 0, 1, -1, 0, 0 };
+  static const double kGrad[] = { 0, 3, -3, 3, -3, 3, -3, 0, 0, 1, 0 };
+  static const double kDir[] = { 0, 3, -3, 3, -3, -2, 2, 3, -3, 0, 1 };
+  this->dim = sizeof(kX) / sizeof(kX[0]);
+  this->l1weight = 2;
+
+  for (int mask = 0; mask < 8; ++mask) {
+    Learner<HybridRealVector> lner;
+    lner.l1weight_ = 2;
+
+    this->x.assign(kX, kX + this->dim);
+    this->grad.assign(kGrad, kGrad + this->dim);
+    this->dir.assign(this->dim, 0);
+    this->new_grad.assign(this->dim, 0);
+    this->new_x.assign(this->dim, 0);
+    AssignHybrid(this->x, mask & 1, &lner.x_);
+    AssignHybrid(this->grad, mask & 2, &lner.grad_);
+
+    this->MakeSteepestDescDir();
+    lner.MakeSteepestDescDir();
+    ExpectHybridEq(this->dir, lner.dir_);
+    ExpectHybridEq(this->new_grad, lner.new_grad_);
+
+    // As if dir_ were mapped by the inverse Hessian.
+    this->dir.assign(kDir, kDir + this->dim);
+    AssignHybrid(this->dir, mask & 4, &lner.dir_);
+    this->FixDirSigns();
+    lner.FixDirSigns();
+    ExpectHybridEq(this->dir, lner.dir_);
+
+    EXPECT_EQ(this->DirDeriv(), lner.DirDeriv());
+    EXPECT_EQ(this->DirDeriv(),
+              -DotProduct(lner.dir_, lner.new_grad_));
+
+    AssignHybrid(this->dir, mask & 4, &lner.dir_);
+    this->GetNextPoint(0.5);
+    lner.GetNextPoint(0.5);
+    ExpectHybridEq(this->new_x, lner.new_x_);
+  }
+}
+
 }  // namespace logistic_regression
 
+using logistic_regression::HybridRealVector;
 using logistic_regression::LearnerTestUtil;
 using logistic_regression::SparseRealVector;
 
@@ -462,3 +519,8 @@ TEST_F(SparseLearnerTest, TestGetNextPoint) {
 TEST_F(SparseLearnerTest, TestFixDirSigns) {
   test_util.TestFixDirSigns();
 }
+
+TEST(HybridLearnerTest, TestMixedRepresentations) {
+  LearnerTestUtil<HybridRealVector> test_util;
+  test_util.TestMixedRepresentations();
+}
@@ -0,0 +1,144 @@
+
+
+//
+#include "mrml-lasso/map_input.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "mrml-lasso/dense_vector_kernels.h"
+
+using std::string;
+
+namespace logistic_regression {
+
+void ParseInstanceFromProtoBufEncode(const string& line,
+                                     const FeatureHasher* hasher,
+                                     float* num_positives,
+                                     float* num_appearances,
+                                     MapInputBatch* batch) {
+  InstancePB* pb = &batch->instance_pb;
+  CHECK(pb->ParseFromString(line));
+  *num_positives = pb->num_positive();
+  *num_appearances = pb->num_appearance();
+  for (int i = 0; i < pb->feature_size(); ++i) {
+    const InstancePB::Feature& feature = pb->feature(i);
+    if (hasher != NULL) {
+      double sign;
+      batch->ids.push_back(hasher->Hash(feature.name(), &sign));
+      batch->values.push_back(feature.value() * sign);
+    } else {
+      batch->ids.push_back(feature.id());
+      batch->values.push_back(feature.value());
+    }
+  }
+}
+
+void ParseInstanceFromText(const string& line,
+                           const FeatureHasher* hasher,
+                           float* num_positives,
+                           float* num_appearances,
+                           MapInputBatch* batch) {
+  const char* p = line.c_str();
+  char* end;
+  *num_positives = strtof(p, &end);
+  if (end == p) {
+    *num_positives = -1;
+    return;
+  }
+  p = end;
+  *num_appearances = strtof(p, &end);
+  if (end == p) {
+    *num_positives = -1;
+    return;
+  }
+  p = end;
+
+  while (true) {
+    IndexType id;
+    double sign = 1;
+    if (hasher != NULL) {
+      while (isspace(static_cast<unsigned char>(*p))) {
+        ++p;
+      }
+      const char* name = p;
+      while (*p != '\0' && !isspace(static_cast<unsigned char>(*p))) {
+        ++p;
+      }
+      if (p == name) {
+        break;
+      }
+      id = hasher->Hash(name, p - name, &sign);
+    } else {
+      long parsed_id = strtol(p, &end, 10);  // NOLINT
+      if (end == p) {
+        break;
+      }
+      p = end;
+      id = parsed_id;
+    }
+    double value = strtod(p, &end);
+    if (end == p) {
+      break;
+    }
+    p = end;
+    batch->ids.push_back(id);
+    batch->values.push_back(value * sign);
+  }
+}
+
+void ParseInstanceFromCSRShard(const CSRShard& shard,
+                               const string& value,
+                               float* num_positives,
+                               float* num_appearances,
+                               MapInputBatch* batch) {
+  int64 ordinal;
+  CHECK_EQ(value.size(), sizeof(ordinal));
+  memcpy(&ordinal, value.data(), sizeof(ordinal));
+  CHECK_LE(0, ordinal);
+  CHECK_LT(ordinal, shard.num_instances());
+  CSRRow* row = &batch->csr_row;
+  shard.ReadRow(ordinal, row);
+  *num_positives = row->num_positive;
+  *num_appearances = row->num_appearance;
+  batch->ids.insert(batch->ids.end(), row->ids.begin(), row->ids.end());
+  if (row->values.empty()) {
+    batch->values.resize(batch->ids.size(), 1.0);
+  } else {
+    batch->values.insert(batch->values.end(),
+                         row->values.begin(), row->values.end());
+  }
+}
+
+void EvaluateMapInputBatch(MapInputBatch* batch,
+                           double* loss,
+                           DenseRealVector* gradient) {
+  size_t n = batch->size();
+  if (n == 0) {
+    return;
+  }
+  batch->coefs.resize(n);
+  *loss += LogisticLossKernel(&batch->margins[0], &batch->positives[0],
+                              &batch->negatives[0], n, &batch->coefs[0]);
+
+  if (!batch->ids.empty()) {
+    if (gradient->size() <= batch->max_id) {
+      gradient->resize(batch->max_id + 1, 0);
+    }
+    double* g = &(*gradient)[0];
+    size_t begin = 0;
+    for (size_t i = 0; i < n; ++i) {
+      double coef = batch->coefs[i];
+      for (size_t j = begin; j < batch->ends[i]; ++j) {
+        g[batch->ids[j]] += batch->values[j] * coef;
+      }
+      begin = batch->ends[i];
+    }
+  }
+  batch->clear();
+}
+
+}  // namespace logistic_regression
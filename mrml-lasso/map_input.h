@@ -0,0 +1,150 @@
+
+
+//
+// Parsers of the map inputs of ComputeGradientMapper, and the batched
+// evaluation of their logistic losses and gradients.  A map input is a
+// text line, an InstancePB record, or an ordinal of an instance in a
+// CSR shard (c.f. csr_shard.h).
+//
+// Each parser sets the counts of an instance, and appends its features
+// to the ids and values of a MapInputBatch.  AddParsedInstance then
+// queues the instance with its margin, or drops it if it has no label,
+// and EvaluateMapInputBatch adds the losses and gradients of queued
+// instances into the totals of a map worker.
+//
+#ifndef MRML_LASSO_MAP_INPUT_H_
+#define MRML_LASSO_MAP_INPUT_H_
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base/common.h"
+#include "mrml-lasso/csr_shard.h"
+#include "mrml-lasso/feature_hashing.h"
+#include "mrml-lasso/logistic_regression.pb.h"
+#include "mrml-lasso/vector_types.h"
+
+namespace logistic_regression {
+
+// Instances parsed from map inputs, whose losses and gradients are
+// evaluated in batches by LogisticLossKernel.  Features of instance i
+// are [ends[i - 1], ends[i]) of ids and values.  Buffers are reused
+// from batch to batch, so parsing allocates no memory once they are
+// large enough.
+struct MapInputBatch {
+  static const size_t kMaxSize = 256;
+
+  MapInputBatch() : max_id(0) {}
+  size_t size() const { return margins.size(); }
+  void clear() {
+    margins.clear();
+    positives.clear();
+    negatives.clear();
+    coefs.clear();
+    ends.clear();
+    ids.clear();
+    values.clear();
+    max_id = 0;
+  }
+
+  std::vector<double> margins;
+  std::vector<double> positives;
+  std::vector<double> negatives;
+  std::vector<double> coefs;     // Gradient coefficients.
+  std::vector<size_t> ends;
+  std::vector<IndexType> ids;    // Features in the order of the input.
+  std::vector<double> values;
+  IndexType max_id;
+
+  // Scratch space of parsers.
+  InstancePB instance_pb;
+  CSRRow csr_row;
+};
+
+// Parses an InstancePB record.  If |hasher| is not NULL, features are
+// identified by their names rather than ids.
+void ParseInstanceFromProtoBufEncode(const std::string& line,
+                                     const FeatureHasher* hasher,
+                                     float* num_positives,
+                                     float* num_appearances,
+                                     MapInputBatch* batch);
+
+// Parses a line of "num_positives num_appearances id value id value
+// ...", or "num_positives num_appearances name value name value ..."
+// if |hasher| is not NULL, where names are separated by white spaces.
+// A line without labels is parsed as an instance without label, i.e.,
+// with negative num_positives.
+void ParseInstanceFromText(const std::string& line,
+                           const FeatureHasher* hasher,
+                           float* num_positives,
+                           float* num_appearances,
+                           MapInputBatch* batch);
+
+// Decodes the instance whose ordinal in |shard| is the map input
+// |value|, as read by CSRShardReader.
+void ParseInstanceFromCSRShard(const CSRShard& shard,
+                               const std::string& value,
+                               float* num_positives,
+                               float* num_appearances,
+                               MapInputBatch* batch);
+
+// Returns the weight of feature |id|, which is 0 if the feature is not
+// in the model.
+inline double FeatureWeight(const DenseRealVector& weights, IndexType id) {
+  return (id < weights.size()) ? weights[id] : 0;
+}
+
+inline double FeatureWeight(const SparseRealVector& weights, IndexType id) {
+  return weights[id];
+}
+
+inline double FeatureWeight(const HybridRealVector& weights, IndexType id) {
+  return weights[id];
+}
+
+// Queues the instance whose features were appended to |batch| from
+// |begin| on, with its margin under |weights|.  Features of an
+// instance with the same id add up.  Returns false, and removes the
+// features, if the instance has no label, i.e., negative
+// |num_positives|, or more positives than appearances.
+template <class RealVector>
+bool AddParsedInstance(const RealVector& weights,
+                       float num_positives,
+                       float num_appearances,
+                       size_t begin,
+                       MapInputBatch* batch) {
+  if (num_positives < 0 || num_positives > num_appearances) {
+    if (num_positives >= 0) {
+      LOG(ERROR) << "Skip instance with invalid "
+                 << "num_positives/num_appearances: "
+                 << num_positives << " / " << num_appearances;
+    }
+    batch->ids.resize(begin);
+    batch->values.resize(begin);
+    return false;
+  }
+
+  double margin = 0;
+  for (size_t i = begin; i < batch->ids.size(); ++i) {
+    margin += FeatureWeight(weights, batch->ids[i]) * batch->values[i];
+    batch->max_id = std::max(batch->max_id, batch->ids[i]);
+  }
+  batch->margins.push_back(margin);
+  batch->positives.push_back(num_positives);
+  batch->negatives.push_back(num_appearances - num_positives);
+  batch->ends.push_back(batch->ids.size());
+  return true;
+}
+
+// Adds losses of |batch| to *loss, and scatter-adds features of each
+// instance, scaled by its gradient coefficient, into *gradient, which
+// grows only if an instance has a feature beyond its size.  Clears
+// |batch| for reuse.
+void EvaluateMapInputBatch(MapInputBatch* batch,
+                           double* loss,
+                           DenseRealVector* gradient);
+
+}  // namespace logistic_regression
+
+#endif  // MRML_LASSO_MAP_INPUT_H_
@@ -0,0 +1,381 @@
+
+
+//
+#include <math.h>
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/common.h"
+#include "mrml-lasso/csr_shard.h"
+#include "mrml-lasso/logistic_regression.pb.h"
+#include "mrml-lasso/map_input.h"
+
+using logistic_regression::AddParsedInstance;
+using logistic_regression::CSRShard;
+using logistic_regression::CSRShardWriter;
+using logistic_regression::DenseRealVector;
+using logistic_regression::EvaluateMapInputBatch;
+using logistic_regression::FeatureHasher;
+using logistic_regression::IndexType;
+using logistic_regression::InstancePB;
+using logistic_regression::MapInputBatch;
+using logistic_regression::ParseInstanceFromCSRShard;
+using logistic_regression::ParseInstanceFromProtoBufEncode;
+using logistic_regression::ParseInstanceFromText;
+using logistic_regression::SparseRealVector;
+using std::make_pair;
+using std::map;
+using std::pair;
+using std::string;
+using std::vector;
+
+static const char* kShardFilename = "/tmp/testMapInputShard";
+
+// An instance as written in all input formats.  Values are exact in
+// float, as CSR shards keep them.
+struct TestInstance {
+  float num_positives;
+  float num_appearances;
+  vector<pair<IndexType, double> > features;
+};
+
+static vector<TestInstance> TestInstances() {
+  static const struct {
+    float num_positives;
+    float num_appearances;
+    int num_features;
+    IndexType ids[3];
+    double values[3];
+  } kInstances[] = {
+    { 1, 3, 3, { 1, 7, 1 }, { 0.5, 2, -1.25 } },   // Duplicate id 1.
+    { 0, 2, 2, { 3, 20, 0 }, { 1, 4, 0 } },        // Beyond the weights.
+    { 2, 2, 1, { 0, 0, 0 }, { -0.75, 0, 0 } },
+    { -1, 1, 1, { 2, 0, 0 }, { 1, 0, 0 } },        // Unlabeled.
+    { 0, 1, 0, { 0, 0, 0 }, { 0, 0, 0 } },         // No features.
+    { 3, 2, 1, { 5, 0, 0 }, { 1, 0, 0 } },         // Invalid counts.
+    { 3, 5, 3, { 6, 6, 2 }, { 1.5, 1.5, -2 } },    // Duplicate id 6.
+  };
+  vector<TestInstance> instances;
+  for (size_t i = 0; i < sizeof(kInstances) / sizeof(kInstances[0]); ++i) {
+    TestInstance instance;
+    instance.num_positives = kInstances[i].num_positives;
+    instance.num_appearances = kInstances[i].num_appearances;
+    for (int j = 0; j < kInstances[i].num_features; ++j) {
+      instance.features.push_back(make_pair(kInstances[i].ids[j],
+                                            kInstances[i].values[j]));
+    }
+    instances.push_back(instance);
+  }
+  return instances;
+}
+
+static DenseRealVector TestWeights() {
+  DenseRealVector weights(8, 0);
+  for (size_t i = 0; i < weights.size(); ++i) {
+    weights[i] = 0.25 * i - 0.8;
+  }
+  return weights;
+}
+
+static string ToText(const TestInstance& instance) {
+  string line;
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%g %g", instance.num_positives,
+           instance.num_appearances);
+  line += buffer;
+  for (size_t i = 0; i < instance.features.size(); ++i) {
+    snprintf(buffer, sizeof(buffer), " %u %g", instance.features[i].first,
+             instance.features[i].second);
+    line += buffer;
+  }
+  return line;
+}
+
+static string ToProtoBufEncode(const TestInstance& instance) {
+  InstancePB pb;
+  pb.set_num_positive(instance.num_positives);
+  pb.set_num_appearance(instance.num_appearances);
+  for (size_t i = 0; i < instance.features.size(); ++i) {
+    InstancePB::Feature* feature = pb.add_feature();
+    feature->set_id(instance.features[i].first);
+    feature->set_value(instance.features[i].second);
+  }
+  string encoded;
+  pb.SerializeToString(&encoded);
+  return encoded;
+}
+
+// Writes |instances| into kShardFilename, and returns the map inputs of
+// CSRShardReader, i.e., the ordinals of instances.
+static vector<string> ToCSRShard(const vector<TestInstance>& instances) {
+  CSRShardWriter writer(false);
+  vector<string> ordinals;
+  for (size_t i = 0; i < instances.size(); ++i) {
+    vector<pair<uint32, float> > features;
+    for (size_t j = 0; j < instances[i].features.size(); ++j) {
+      features.push_back(make_pair(instances[i].features[j].first,
+                                   instances[i].features[j].second));
+    }
+    writer.Add(instances[i].num_positives, instances[i].num_appearances,
+               &features);
+    int64 ordinal = i;
+    ordinals.push_back(string(reinterpret_cast<const char*>(&ordinal),
+                              sizeof(ordinal)));
+  }
+  CHECK(writer.Write(kShardFilename));
+  return ordinals;
+}
+
+// The loss and gradient of instances computed one by one, as
+// ComputeGradientMapper did before batching: features of an instance
+// are summed by id, and positives and negatives are counted only if
+// they are positive.
+static void ReferenceLossAndGradient(const vector<TestInstance>& instances,
+                                     const DenseRealVector& weights,
+                                     double* loss,
+                                     map<IndexType, double>* gradient) {
+  *loss = 0;
+  gradient->clear();
+  for (size_t i = 0; i < instances.size(); ++i) {
+    const TestInstance& instance = instances[i];
+    float num_negatives = instance.num_appearances - instance.num_positives;
+    if (instance.num_positives < 0 || num_negatives < 0) {
+      continue;
+    }
+    map<IndexType, double> features;
+    for (size_t j = 0; j < instance.features.size(); ++j) {
+      features[instance.features[j].first] += instance.features[j].second;
+    }
+    double margin = 0;
+    for (map<IndexType, double>::const_iterator f = features.begin();
+         f != features.end(); ++f) {
+      margin += (f->first < weights.size() ? weights[f->first] : 0) *
+          f->second;
+    }
+    double coef = 0;
+    if (instance.num_positives > 0) {
+      *loss += instance.num_positives * log(1 + exp(-margin));
+      coef -= instance.num_positives * (1 - 1 / (1 + exp(-margin)));
+    }
+    if (num_negatives > 0) {
+      *loss += num_negatives * log(1 + exp(margin));
+      coef += num_negatives * (1 - 1 / (1 + exp(margin)));
+    }
+    for (map<IndexType, double>::const_iterator f = features.begin();
+         f != features.end(); ++f) {
+      (*gradient)[f->first] += f->second * coef;
+    }
+  }
+}
+
+enum InputFormat { kText, kRecordIO, kCSRShard };
+
+// Parses, queues and evaluates |inputs| as ComputeGradientMapper::Map
+// and Flush do, into a gradient presized to |dim|.
+template <class RealVector>
+static void MapInputs(InputFormat format, const vector<string>& inputs,
+                      const CSRShard* shard, const RealVector& weights,
+                      size_t dim, double* loss, DenseRealVector* gradient) {
+  MapInputBatch batch;
+  *loss = 0;
+  *gradient = DenseRealVector(dim, 0);
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    float num_positives;
+    float num_appearances;
+    size_t begin = batch.ids.size();
+    if (format == kRecordIO) {
+      ParseInstanceFromProtoBufEncode(inputs[i], NULL, &num_positives,
+                                      &num_appearances, &batch);
+    } else if (format == kCSRShard) {
+      ParseInstanceFromCSRShard(*shard, inputs[i], &num_positives,
+                                &num_appearances, &batch);
+    } else {
+      ParseInstanceFromText(inputs[i], NULL, &num_positives,
+                            &num_appearances, &batch);
+    }
+    if (AddParsedInstance(weights, num_positives, num_appearances, begin,
+                          &batch) &&
+        batch.size() == MapInputBatch::kMaxSize) {
+      EvaluateMapInputBatch(&batch, loss, gradient);
+    }
+  }
+  EvaluateMapInputBatch(&batch, loss, gradient);
+  EXPECT_EQ(0, batch.size());
+  EXPECT_TRUE(batch.ids.empty());
+}
+
+static void ExpectSameLossAndGradient(double expected_loss,
+                                      const map<IndexType, double>& expected,
+                                      double loss,
+                                      const DenseRealVector& gradient) {
+  EXPECT_NEAR(expected_loss, loss, 1e-12 * expected_loss);
+  ASSERT_EQ(expected.rbegin()->first + 1, gradient.size());
+  for (size_t i = 0; i < gradient.size(); ++i) {
+    map<IndexType, double>::const_iterator e = expected.find(i);
+    double expected_value = (e == expected.end()) ? 0 : e->second;
+    EXPECT_NEAR(expected_value, gradient[i],
+                1e-12 * (fabs(expected_value) + 1)) << "feature " << i;
+  }
+}
+
+// All input formats give the loss and gradient of the one-by-one
+// computation, for batches of any size and models of any type.
+TEST(MapInputTest, MatchesPerInstanceComputation) {
+  static const int kRepeats[] = { 1, MapInputBatch::kMaxSize + 3 };
+  const vector<TestInstance> test_instances = TestInstances();
+  const DenseRealVector weights = TestWeights();
+  SparseRealVector sparse_weights;
+  for (size_t i = 0; i < weights.size(); ++i) {
+    sparse_weights.append(i, weights[i]);
+  }
+
+  for (size_t r = 0; r < sizeof(kRepeats) / sizeof(kRepeats[0]); ++r) {
+    vector<TestInstance> instances;
+    for (int k = 0; k < kRepeats[r]; ++k) {
+      instances.insert(instances.end(), test_instances.begin(),
+                       test_instances.end());
+    }
+    double expected_loss;
+    map<IndexType, double> expected_gradient;
+    ReferenceLossAndGradient(instances, weights, &expected_loss,
+                             &expected_gradient);
+
+    vector<string> text_lines;
+    vector<string> records;
+    for (size_t i = 0; i < instances.size(); ++i) {
+      text_lines.push_back(ToText(instances[i]));
+      records.push_back(ToProtoBufEncode(instances[i]));
+    }
+    vector<string> ordinals = ToCSRShard(instances);
+    CSRShard shard;
+    ASSERT_TRUE(shard.Open(kShardFilename));
+
+    double loss;
+    DenseRealVector gradient;
+    MapInputs(kText, text_lines, NULL, weights, weights.size(),
+              &loss, &gradient);
+    ExpectSameLossAndGradient(expected_loss, expected_gradient,
+                              loss, gradient);
+    MapInputs(kRecordIO, records, NULL, weights, weights.size(),
+              &loss, &gradient);
+    ExpectSameLossAndGradient(expected_loss, expected_gradient,
+                              loss, gradient);
+    MapInputs(kCSRShard, ordinals, &shard, weights, weights.size(),
+              &loss, &gradient);
+    ExpectSameLossAndGradient(expected_loss, expected_gradient,
+                              loss, gradient);
+    // Without max_feature_number, the gradient grows from empty.
+    MapInputs(kText, text_lines, NULL, sparse_weights, 0, &loss, &gradient);
+    ExpectSameLossAndGradient(expected_loss, expected_gradient,
+                              loss, gradient);
+  }
+  remove(kShardFilename);
+}
+
+// The text parser accepts the number syntax of strtod, and stops at
+// the first token that is not a number, as istringstream did.
+TEST(MapInputTest, ParseText) {
+  MapInputBatch batch;
+  float num_positives = 0;
+  float num_appearances = 0;
+  ParseInstanceFromText("+1 3e0\t1 5e-1  7 +2.0 1 -1.25\n", NULL,
+                        &num_positives, &num_appearances, &batch);
+  EXPECT_EQ(1, num_positives);
+  EXPECT_EQ(3, num_appearances);
+  ASSERT_EQ(3, batch.ids.size());
+  ASSERT_EQ(3, batch.values.size());
+  EXPECT_EQ(1, batch.ids[0]);
+  EXPECT_EQ(0.5, batch.values[0]);
+  EXPECT_EQ(7, batch.ids[1]);
+  EXPECT_EQ(2, batch.values[1]);
+  EXPECT_EQ(1, batch.ids[2]);
+  EXPECT_EQ(-1.25, batch.values[2]);
+
+  batch.clear();
+  ParseInstanceFromText("0 2 3 1 4 x 5 1", NULL,
+                        &num_positives, &num_appearances, &batch);
+  EXPECT_EQ(0, num_positives);
+  EXPECT_EQ(2, num_appearances);
+  ASSERT_EQ(1, batch.ids.size());
+  EXPECT_EQ(3, batch.ids[0]);
+  EXPECT_EQ(1, batch.values[0]);
+
+  // Lines without labels have negative num_positives.
+  static const char* kUnlabeled[] = { "", "  \n", "label 1 2 3", "1" };
+  for (size_t i = 0; i < sizeof(kUnlabeled) / sizeof(kUnlabeled[0]); ++i) {
+    batch.clear();
+    num_positives = 0;
+    ParseInstanceFromText(kUnlabeled[i], NULL,
+                          &num_positives, &num_appearances, &batch);
+    EXPECT_GT(0, num_positives) << kUnlabeled[i];
+    EXPECT_FALSE(AddParsedInstance(TestWeights(), num_positives,
+                                   num_appearances, 0, &batch));
+    EXPECT_EQ(0, batch.size());
+    EXPECT_TRUE(batch.ids.empty());
+  }
+}
+
+// With a FeatureHasher, text and RecordIO inputs name their features,
+// which are hashed to indices and signs; InstancePB ids are ignored.
+TEST(MapInputTest, ParseHashedNames) {
+  FeatureHasher hasher(20);
+  double apple_sign;
+  double banana_sign;
+  IndexType apple = hasher.Hash("query:apple", &apple_sign);
+  IndexType banana = hasher.Hash("query:banana", &banana_sign);
+  ASSERT_EQ(1, apple_sign);
+  ASSERT_EQ(-1, banana_sign);
+
+  MapInputBatch batch;
+  float num_positives = 0;
+  float num_appearances = 0;
+  ParseInstanceFromText("1 2 query:apple 0.5\tquery:banana 2  "
+                        "query:apple -1 title:red", &hasher,
+                        &num_positives, &num_appearances, &batch);
+  EXPECT_EQ(1, num_positives);
+  EXPECT_EQ(2, num_appearances);
+  ASSERT_EQ(3, batch.ids.size());
+  EXPECT_EQ(apple, batch.ids[0]);
+  EXPECT_EQ(0.5, batch.values[0]);
+  EXPECT_EQ(banana, batch.ids[1]);
+  EXPECT_EQ(-2, batch.values[1]);
+  EXPECT_EQ(apple, batch.ids[2]);
+  EXPECT_EQ(-1, batch.values[2]);
+
+  InstancePB pb;
+  pb.set_num_positive(0);
+  pb.set_num_appearance(3);
+  InstancePB::Feature* feature = pb.add_feature();
+  feature->set_name("query:banana");
+  feature->set_id(7);
+  feature->set_value(1.5);
+  feature = pb.add_feature();
+  feature->set_name("query:apple");
+  feature->set_value(4);
+  string encoded;
+  pb.SerializeToString(&encoded);
+  batch.clear();
+  ParseInstanceFromProtoBufEncode(encoded, &hasher, &num_positives,
+                                  &num_appearances, &batch);
+  EXPECT_EQ(0, num_positives);
+  EXPECT_EQ(3, num_appearances);
+  ASSERT_EQ(2, batch.ids.size());
+  EXPECT_EQ(banana, batch.ids[0]);
+  EXPECT_EQ(-1.5, batch.values[0]);
+  EXPECT_EQ(apple, batch.ids[1]);
+  EXPECT_EQ(4, batch.values[1]);
+
+  // Without a hasher, the ids of the same record are used.
+  batch.clear();
+  ParseInstanceFromProtoBufEncode(encoded, NULL, &num_positives,
+                                  &num_appearances, &batch);
+  ASSERT_EQ(2, batch.ids.size());
+  EXPECT_EQ(7, batch.ids[0]);
+  EXPECT_EQ(1.5, batch.values[0]);
+}
@@ -16,13 +16,14 @@
 
 #include "base/common.h"
 #include "mrml/mrml_filesystem.h"
+#include "mrml/mrml_reader.h"
 #include "mrml/mrml_recordio.h"
+#include "mrml-lasso/csr_shard.h"
 #include "mrml-lasso/logistic_regression.pb.h"
 #include "mrml-lasso/mrml_mappers_and_reducers.h"
 #include "mrml-lasso/sparse_vector_tmpl.h"
 
 using std::string;
-using std::istringstream;
 using std::ostringstream;
 using std::stringstream;
 using std::setw;
@@ -32,10 +33,49 @@ namespace logistic_regression {
 
 const char* kUniqueKey = "";
 
+const char* kCSRShardInputFormat = "csr";
+
+// Reads instances from a CSR shard as map inputs, whose keys are empty
+// and whose values are the ordinals of instances in the shard.
+// ComputeGradientMapper decodes an instance from its own mapping of the
+// input shard, so instances are not encoded into map input values and
+// parsed back.  Ordinals, unlike pointers to decoded instances, stay
+// valid when MRML_ReadAheadReader reads inputs ahead.
+class CSRShardReader : public MRML_Reader {
+ public:
+  explicit CSRShardReader(const string& filename) : next_(0) {
+    if (!shard_.Open(filename)) {
+      LOG(FATAL) << "Cannot open CSR shard: " << filename;
+    }
+  }
+
+  virtual bool Read(string* key, string* value) {
+    if (next_ >= shard_.num_instances()) {
+      return false;
+    }
+    key->clear();
+    value->assign(reinterpret_cast<const char*>(&next_), sizeof(next_));
+    ++next_;
+    return true;
+  }
+
+ private:
+  CSRShard shard_;
+  int64 next_;
+};
+
+MRML_Reader* NewCSRShardReader(const string& filename) {
+  return new CSRShardReader(filename);
+}
+
+REGISTER_READER(kCSRShardInputFormat, NewCSRShardReader);
+
 REGISTER_MAPPER(ComputeDenseGradientMapper);
 REGISTER_REDUCER(UpdateDenseModelReducer);
 REGISTER_MAPPER(ComputeSparseGradientMapper);
 REGISTER_REDUCER(UpdateSparseModelReducer);
+REGISTER_MAPPER(ComputeHybridGradientMapper);
+REGISTER_REDUCER(UpdateHybridModelReducer);
 
 //---------------------------------------------------------------------------
 // RegularizationFactor computes the value of L1-regularization term.
@@ -43,6 +83,7 @@ REGISTER_REDUCER(UpdateSparseModelReducer);
 
 typedef Learner<SparseRealVector> SparseLearnerStates;
 typedef Learner<DenseRealVector>  DenseLearnerStates;
+typedef Learner<HybridRealVector> HybridLearnerStates;
 
 template <class RealVector>
 double RegularizationFactor(const RealVector* s);
@@ -64,9 +105,19 @@ template <>
 double
 RegularizationFactor<SparseLearnerStates>(const SparseLearnerStates* s) {
   double ret = 0;
-  for (SparseRealVector::const_iterator i = s->new_x().begin();
-       i != s->new_x().end(); ++i) {
-    ret += fabs(i->second);
+  const SparseRealVector& x = s->new_x();
+  for (size_t k = 0; k < x.size(); ++k) {
+    ret += fabs(x.value(k));
+  }
+  return ret * s->l1weight();
+}
+
+template <>
+double
+RegularizationFactor<HybridLearnerStates>(const HybridLearnerStates* s) {
+  double ret = 0;
+  for (HybridRealVector::Iterator it(s->new_x()); !it.Done(); it.Next()) {
+    ret += fabs(it.value());
   }
   return ret * s->l1weight();
 }
@@ -85,6 +136,13 @@ ResizeRealVector<SparseRealVector>(SparseRealVector* s, int size) {
   // pre-operation space allocation.
 }
 
+template <>
+void
+ResizeRealVector<HybridRealVector>(HybridRealVector* s, int size) {
+  if (size > 0)
+    s->resize(size);
+}
+
 static string GetInitialStatesFilename(const CommandLineOptions& options) {
   ostringstream output;
   output << options.base_dir << "/" << options.states_filebase << "-"
@@ -150,112 +208,58 @@ ComputeGradientMapper<RealVector>::ComputeGradientMapper() {
     feature_weights_ = states_.new_x();
   }
   combined_gradient_.clear();
-  partial_gradient_.clear();
-}
-
-static void ParseInstanceFromProtoBufEncode(const string& line,
-                                            float* num_positive,
-                                            float* num_appearance,
-                                            SparseRealVector* features) {
-  InstancePB instance;
-  CHECK(instance.ParseFromString(line));
-  *num_positive = instance.num_positive();
-  *num_appearance = instance.num_appearance();
-  features->clear();
-  for (int i = 0; i < instance.feature_size(); ++i) {
-    features->set(instance.feature(i).id(), instance.feature(i).value());
+  // If features are hashed, max_feature_number is the dim of hashing.
+  if (options_.feature_hash_bits > 0) {
+    feature_hasher_.reset(new FeatureHasher(options_.feature_hash_bits));
   }
-}
-
-static void ParseInstanceFromText(const string& line,
-                                  float* num_positives,
-                                  float* num_appearances,
-                                  SparseRealVector* features) {
-  istringstream line_parser(line);
-  line_parser >> *num_positives >> *num_appearances;
-
-  int    feature_name;
-  double feature_value;
-  while (line_parser >> feature_name >> feature_value) {
-    features->set(feature_name, feature_value);
+  if (options_.max_feature_number > 0) {
+    combined_gradient_.resize(options_.max_feature_number, 0);
   }
 }
+
 template <class RealVector>
 void ComputeGradientMapper<RealVector>::Map(const std::string& key,
                                             const std::string& value) {
   float num_positives;
   float num_appearances;
-  SparseRealVector features;
+  size_t begin = batch_.ids.size();
   if (GetInputFormat() == RecordIO)
-    ParseInstanceFromProtoBufEncode(value,
+    ParseInstanceFromProtoBufEncode(value, feature_hasher_.get(),
                                     &num_positives, &num_appearances,
-                                    &features);
+                                    &batch_);
+  else if (GetInputFormat() == UserDefined &&
+           GetInputFormatName() == kCSRShardInputFormat)
+    ParseInstanceFromCSRShard(*InputCSRShard(), value,
+                              &num_positives, &num_appearances, &batch_);
   else
-    ParseInstanceFromText(value,
-                          &num_positives, &num_appearances,
-                          &features);
-
-  // We have a convention that if num_positive is a negative value,
-  // the map input is considered `no label'.
-  if (num_positives < 0) {
-    return;
-  }
-
-  if (num_positives > num_appearances) {
-    LOG(ERROR) << "Skip instance with invalid num_positives/num_appearances: "
-               << num_positives << " / " << num_appearances;
-    return;
-  }
-
-  double dot_x_b = DotProduct(features, feature_weights_);
-  double partial_loss = 0;
-
-  float num_negatives = num_appearances - num_positives;
-  double inc_loss, inc_prob;
-  double score = dot_x_b;
-  partial_gradient_.clear();
-
-  // process the positives instances
-  if (num_positives > 0) {
-    if (score < -30) {
-      inc_loss = -score;
-      inc_prob = 0;
-    } else if (score > 30) {
-      inc_loss = 0;
-      inc_prob = 1;
-    } else {
-      double temp = 1.0 + exp(-score);
-      inc_loss = log(temp);
-      inc_prob = 1.0/temp;
-    }
-    partial_loss += inc_loss * num_positives;
-    AddScaled(&partial_gradient_, features,
-              -1 * num_positives * (1.0 - inc_prob));
+    ParseInstanceFromText(value, feature_hasher_.get(),
+                          &num_positives, &num_appearances, &batch_);
+
+  // Instances without label, i.e., with negative num_positives, are
+  // dropped by AddParsedInstance.
+  if (AddParsedInstance(feature_weights_, num_positives, num_appearances,
+                        begin, &batch_) &&
+      batch_.size() == MapInputBatch::kMaxSize) {
+    EvaluateMapInputBatch(&batch_, &combined_loss_, &combined_gradient_);
   }
+}
 
-  if (num_negatives > 0) {
-    score *= -1;
-    if (score < -30) {
-      inc_loss = -score;
-      inc_prob = 0;
-    } else if (score > 30) {
-      inc_loss = 0;
-      inc_prob = 1;
-    } else {
-      double temp = 1.0 + exp(-score);
-      inc_loss = log(temp);
-      inc_prob = 1.0/temp;
+// Maps the input shard of this map worker, which CSRShardReader reads,
+// at the first call.
+template <class RealVector>
+const CSRShard* ComputeGradientMapper<RealVector>::InputCSRShard() {
+  if (input_csr_shard_.get() == NULL) {
+    input_csr_shard_.reset(new CSRShard);
+    if (!input_csr_shard_->Open(GetInputFilename())) {
+      LOG(FATAL) << "Cannot open CSR shard: " << GetInputFilename();
     }
-    partial_loss += inc_loss * num_negatives;
-    AddScaled(&partial_gradient_, features, num_negatives * (1.0 - inc_prob));
   }
-
-  AddScaled(&combined_gradient_, partial_gradient_, 1);
-  combined_loss_ += partial_loss;
+  return input_csr_shard_.get();
 }
 
 template <class RealVector>
 void ComputeGradientMapper<RealVector>::Flush() {
+  EvaluateMapInputBatch(&batch_, &combined_loss_, &combined_gradient_);
   int vec_size = combined_gradient_.size();
   int fragment_num = vec_size/kMessageSize +
                      ((vec_size % kMessageSize == 0) ? 0 : 1);
@@ -302,6 +306,7 @@ void* UpdateModelReducer<RealVector>::BeginReduce(const std::string& key,
                                          options_.max_iterations,
                                          options_.convergence_tolerance,
                                          options_.max_feature_number);
+    r->learner->SetSinglePrecisionHistory(options_.single_precision_history);
     r->value = 0;
   } else {
     // If there has been an "most recently updated" states file,
@@ -311,6 +316,7 @@ void* UpdateModelReducer<RealVector>::BeginReduce(const std::string& key,
 
     MRMLFS_File file(options_.base_dir + "/" + recent_states_filename, true);
     r->learner = new Learner<RealVector>;
+    r->learner->SetSinglePrecisionHistory(options_.single_precision_history);
     r->learner->LoadFromRecordFile(&file);
     r->value = 0;
   }
@@ -377,6 +383,10 @@ void UpdateModelReducer<RealVector>::EndReduce(const std::string& key,
   MRMLFS_File file(new_states_filename, false);
   CHECK(file.IsOpen());
   p->learner->SaveIntoRecordFile(&file);
+  if (!file.Close()) {
+    LOG(FATAL) << "Failed in writing LearnerStates into: "
+               << new_states_filename;
+  }
 
   if (p->learner)
     delete p->learner;
@@ -7,6 +7,9 @@
 #define MRML_LASSO_MRML_MAPPERS_AND_REDUCERS_H_
 
 #include <string>
+#include <vector>
+
+#include "boost/scoped_ptr.hpp"
 
 #include "base/common.h"
 #include "strutil/split_string.h"
@@ -14,7 +17,12 @@
 #include "mrml-lasso/learner.h"
 #include "mrml-lasso/learner_sparse_impl.h"
 #include "mrml-lasso/learner_dense_impl.h"
+#include "mrml-lasso/learner_hybrid_impl.h"
 #include "mrml-lasso/command_line_options.h"
+#include "mrml-lasso/csr_shard.h"
+#include "mrml-lasso/feature_hashing.h"
+#include "mrml-lasso/map_input.h"
+#include "mrml-lasso/vector_thread_pool.h"
 
 namespace logistic_regression {
 
@@ -25,19 +33,35 @@ extern const char* kUniqueKey;
 
 // ComputeGradientMapper computes the value and the gradient of the
 // logistic loss function (without the regularization term).
+//
+// The gradient of an instance is its features scaled by one
+// coefficient.  Map computes the margin of each instance and queues it
+// in batch_; EvaluateMapInputBatch computes the losses and coefficients
+// of a batch at once, and adds scaled features right into
+// combined_gradient_, which is presized to max_feature_number if
+// given, so no memory is allocated per instance.
+//
+// If --feature_hash_bits is given, features of text and RecordIO
+// inputs are names, which are hashed by feature_hasher_ as they are
+// parsed.  CSR inputs are instances decoded from input_csr_shard_.
 template <class RealVector>
 class ComputeGradientMapper : public MRML_Mapper {
  public:
   ComputeGradientMapper();
   void Map(const std::string& key, const std::string& value);
   void Flush();
+  bool UsesInputKey() const { return false; }
 
  private:
+  const CSRShard* InputCSRShard();
+
   RealVector feature_weights_;  // The model parameters.
   DenseRealVector combined_gradient_;
   double combined_loss_;
 
-  SparseRealVector partial_gradient_;
+  MapInputBatch batch_;
+  boost::scoped_ptr<FeatureHasher> feature_hasher_;  // NULL if not hashing.
+  boost::scoped_ptr<CSRShard> input_csr_shard_;      // NULL if not CSR.
   LearnerStates<RealVector> states_;
 
   CommandLineOptions options_;
@@ -51,7 +75,10 @@ class ComputeGradientMapper : public MRML_Mapper {
 template <class RealVector>
 class UpdateModelReducer : public MRML_Reducer {
  public:
-  UpdateModelReducer() { options_.Parse(GetConfig()); }
+  UpdateModelReducer() {
+    options_.Parse(GetConfig());
+    SetVectorThreads(options_.learner_threads);
+  }
   void* BeginReduce(const std::string& key, const std::string& value);
   void PartialReduce(const std::string& key, const std::string& value,
                      void* partial_result);
@@ -86,6 +113,17 @@ class UpdateSparseModelReducer
     : public UpdateModelReducer<SparseRealVector> {
 };
 
+// The hybrid mapper and reducer need not be told whether the model is
+// sparse or dense; each vector switches between representations by its
+// density.
+class ComputeHybridGradientMapper
+    : public ComputeGradientMapper<HybridRealVector> {
+};
+
+class UpdateHybridModelReducer
+    : public UpdateModelReducer<HybridRealVector> {
+};
+
 }  // namespace logistic_regression
 
 #endif  // MRML_LASSO_MRML_MAPPERS_AND_REDUCERS_H_
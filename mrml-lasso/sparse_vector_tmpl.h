@@ -1,68 +1,355 @@
 
 
 //
-// Define the class template DenseVectorImpl and operations required
+// Define the class template SparseVectorTmpl and operations required
 // by class template Learner.
 //
 #ifndef MRML_LASSO_SPARSE_VECTOR_TMPL_H_
 #define MRML_LASSO_SPARSE_VECTOR_TMPL_H_
 
-#include <map>
+#include <algorithm>
+#include <vector>
+
+#include "mrml-lasso/vector_thread_pool.h"
 
 namespace logistic_regression {
 
-using std::map;
-using std::pair;
 using std::ostream;
+using std::vector;
 
-// We use std::map as the container of a sparse vector.  Because
-// std::map implements a sorting tree (RB-tree), so its iterator
-// accesses elements in known order of keys.  This is important for
-// sparse vector operations like dot-product and add-multi-into.
+// A sparse vector keeps its non-zero elements in two parallel arrays,
+// keys and values, sorted by keys.  Compared with a std::map, which
+// allocates a tree node for each element, the arrays take about a
+// quarter of the memory, and operations like dot-product and
+// add-multi-into are linear merges over contiguous memory.
+//
+// Elements are accessed in the order of keys by index(k) and value(k)
+// for k in [0, size()).  A vector is best built by append, which
+// costs O(1) if keys come in increasing order; set, which keeps the
+// order by inserting into the middle of the arrays, is O(size()).
+//
+// Operations on long vectors, whose elements are more than
+// kMinVectorBlockSize per thread of the vector thread pool, split the
+// vectors at common keys into blocks and run blocks in parallel.
+//
 // The ValueType must be a numerical type supporting const 0.
 template <class KeyType, class ValueType>
-class SparseVectorTmpl : public map<KeyType, ValueType> {
+class SparseVectorTmpl {
  public:
-  typedef typename map<KeyType, ValueType>::const_iterator const_iterator;
-  typedef typename map<KeyType, ValueType>::iterator iterator;
+  size_t size() const { return keys_.size(); }
+  bool empty() const { return keys_.empty(); }
+
+  void clear() {
+    keys_.clear();
+    values_.clear();
+  }
+
+  void reserve(size_t size) {
+    keys_.reserve(size);
+    values_.reserve(size);
+  }
+
+  void swap(SparseVectorTmpl& other) {
+    keys_.swap(other.keys_);
+    values_.swap(other.values_);
+  }
+
+  // The key and value of the k-th non-zero element.
+  const KeyType& index(size_t k) const { return keys_[k]; }
+  const ValueType& value(size_t k) const { return values_[k]; }
 
   // We constrain operator[] a read-only operation to prevent
   // accidential insert of elements.
   const ValueType& operator[](const KeyType& key) const {
-    const_iterator iter = this->find(key);
-    if (iter == this->end()) {
+    size_t k = Find(key);
+    if (k == keys_.size()) {
       return zero_;
     }
-    return iter->second;
+    return values_[k];
   }
 
   // Set a value at given key.  If value==0, an exisiting key-value
   // pair is removed.  If value!=0, the value is set or inserted.
-  // This function also serves as a convenient form of insert(), no
-  // need to use std::pair.
   void set(const KeyType& key, const ValueType& value) {
-    iterator iter = this->find(key);
-    if (iter != this->end()) {
+    typename vector<KeyType>::iterator iter =
+        std::lower_bound(keys_.begin(), keys_.end(), key);
+    size_t k = iter - keys_.begin();
+    if (iter != keys_.end() && *iter == key) {
       if (IsZero(value)) {
-        this->erase(iter);
+        keys_.erase(iter);
+        values_.erase(values_.begin() + k);
       } else {
-        iter->second = value;
+        values_[k] = value;
       }
     } else {
       if (!IsZero(value)) {
-        this->insert(pair<KeyType, ValueType>(key, value));
+        keys_.insert(iter, key);
+        values_.insert(values_.begin() + k, value);
+      }
+    }
+  }
+
+  // Same as set, but takes O(1) if |key| is larger than all existing
+  // keys, which is the case when building a vector in key order.
+  void append(const KeyType& key, const ValueType& value) {
+    if (keys_.empty() || keys_.back() < key) {
+      if (!IsZero(value)) {
+        keys_.push_back(key);
+        values_.push_back(value);
       }
+    } else {
+      set(key, value);
     }
   }
 
   bool has(const KeyType& key) const {
-    return this->find(key) != this->end();
+    return Find(key) != keys_.size();
+  }
+
+  // Returns the position of the first element whose key is not less
+  // than |key|, or size() if there is no such element.
+  size_t LowerBound(const KeyType& key) const {
+    return std::lower_bound(keys_.begin(), keys_.end(), key) - keys_.begin();
+  }
+
+  // Multiplies all values by |c|.
+  template <class ScaleType>
+  void Scale(const ScaleType& c) {
+    if (IsZero(c)) {
+      clear();
+      return;
+    }
+    int num_blocks = NumVectorBlocks(values_.size());
+    if (num_blocks > 1) {
+      ParallelScale<ScaleType> task = { this, c, num_blocks };
+      RunVectorBlocks(&ParallelScale<ScaleType>::Run, &task, num_blocks);
+      return;
+    }
+    for (size_t k = 0; k < values_.size(); ++k) {
+      values_[k] *= c;
+    }
+  }
+
+  // Sets this vector to |u| + |v| * |c|, merging blocks of |u| and |v|
+  // in parallel.  This vector must not be |u| or |v|.  Used by
+  // AddScaledInto for long vectors.
+  template <class ScaleType>
+  void ParallelAddScaledInto(const SparseVectorTmpl& u,
+                             const SparseVectorTmpl& v,
+                             const ScaleType& c, int num_blocks) {
+    ParallelMerge<ScaleType> task;
+    task.u = &u;
+    task.v = &v;
+    task.c = c;
+    task.w = this;
+    SplitAtCommonKeys(u, v, num_blocks, &task.u_bounds, &task.v_bounds);
+    // Count elements of each block, and then write blocks to their
+    // offsets in this vector.
+    task.offsets.resize(num_blocks + 1, 0);
+    task.counting = true;
+    RunVectorBlocks(&ParallelMerge<ScaleType>::Run, &task, num_blocks);
+    for (int b = 0; b < num_blocks; ++b) {
+      task.offsets[b + 1] += task.offsets[b];
+    }
+    keys_.resize(task.offsets[num_blocks]);
+    values_.resize(task.offsets[num_blocks]);
+    task.counting = false;
+    RunVectorBlocks(&ParallelMerge<ScaleType>::Run, &task, num_blocks);
+  }
+
+  // Splits |u| and |v| into |num_blocks| blocks each, so that the b-th
+  // blocks of them, [(*u_bounds)[b], (*u_bounds)[b+1]) and
+  // [(*v_bounds)[b], (*v_bounds)[b+1]), cover the same range of keys.
+  // Blocks have about the same number of elements of the longer vector.
+  static void SplitAtCommonKeys(const SparseVectorTmpl& u,
+                                const SparseVectorTmpl& v,
+                                int num_blocks,
+                                vector<size_t>* u_bounds,
+                                vector<size_t>* v_bounds) {
+    if (u.size() < v.size()) {
+      SplitAtCommonKeys(v, u, num_blocks, v_bounds, u_bounds);
+      return;
+    }
+    u_bounds->resize(num_blocks + 1);
+    v_bounds->resize(num_blocks + 1);
+    for (int b = 0; b <= num_blocks; ++b) {
+      size_t k = VectorBlockBegin(u.size(), num_blocks, b);
+      (*u_bounds)[b] = k;
+      (*v_bounds)[b] = (k < u.size()) ? v.LowerBound(u.index(k)) : v.size();
+    }
+    // The first blocks start at the first elements, so that they also
+    // cover keys of |v| below the first key of |u|.
+    (*u_bounds)[0] = (*v_bounds)[0] = 0;
+  }
+
+  // Adds |v| * |c| to this vector.  Elements of keys existing in this
+  // vector are updated in place, so adding a short vector into a long
+  // one, e.g., the gradient of an instance into the sum, takes
+  // O(v.size() * log(size())) unless |v| brings new keys, in which
+  // case the two vectors are merged in place from their ends.  Long
+  // vectors are merged in parallel into a new vector instead.
+  template <class ScaleType>
+  void AddScaled(const SparseVectorTmpl& v, const ScaleType& c) {
+    int num_blocks = NumVectorBlocks(size() + v.size());
+    if (num_blocks > 1 && &v != this) {
+      SparseVectorTmpl sum;
+      sum.ParallelAddScaledInto(*this, v, c, num_blocks);
+      swap(sum);
+      return;
+    }
+
+    size_t num_new_keys = 0;
+    typename vector<KeyType>::iterator pos = keys_.begin();
+    for (size_t j = 0; j < v.size(); ++j) {
+      pos = std::lower_bound(pos, keys_.end(), v.index(j));
+      if (pos == keys_.end() || *pos != v.index(j)) {
+        ++num_new_keys;
+      }
+    }
+
+    bool has_zero = false;
+    if (num_new_keys == 0) {
+      pos = keys_.begin();
+      for (size_t j = 0; j < v.size(); ++j) {
+        pos = std::lower_bound(pos, keys_.end(), v.index(j));
+        ValueType& value = values_[pos - keys_.begin()];
+        value += v.value(j) * c;
+        has_zero = has_zero || IsZero(value);
+      }
+    } else {
+      size_t i = keys_.size();
+      size_t j = v.size();
+      size_t k = keys_.size() + num_new_keys;
+      keys_.resize(k);
+      values_.resize(k);
+      // Elements of this vector before position i are in place once
+      // all elements of |v| are merged.
+      while (j > 0) {
+        --k;
+        if (i > 0 && v.index(j - 1) < keys_[i - 1]) {
+          --i;
+          keys_[k] = keys_[i];
+          values_[k] = values_[i];
+        } else if (i > 0 && v.index(j - 1) == keys_[i - 1]) {
+          --i;
+          --j;
+          keys_[k] = keys_[i];
+          values_[k] = values_[i] + v.value(j) * c;
+          has_zero = has_zero || IsZero(values_[k]);
+        } else {
+          --j;
+          keys_[k] = v.index(j);
+          values_[k] = v.value(j) * c;
+          has_zero = has_zero || IsZero(values_[k]);
+        }
+      }
+    }
+    if (has_zero) {
+      RemoveZeros();
+    }
   }
 
  protected:
+  template <class ScaleType>
+  struct ParallelScale {
+    SparseVectorTmpl* v;
+    ScaleType c;
+    int num_blocks;
+
+    static void Run(void* arg, int block) {
+      ParallelScale* t = static_cast<ParallelScale*>(arg);
+      vector<ValueType>& values = t->v->values_;
+      size_t end = VectorBlockBegin(values.size(), t->num_blocks, block + 1);
+      for (size_t k = VectorBlockBegin(values.size(), t->num_blocks, block);
+           k < end; ++k) {
+        values[k] *= t->c;
+      }
+    }
+  };
+
+  // Merges the b-th blocks of u and v into w, c.f. ParallelAddScaledInto.
+  template <class ScaleType>
+  struct ParallelMerge {
+    const SparseVectorTmpl* u;
+    const SparseVectorTmpl* v;
+    ScaleType c;
+    SparseVectorTmpl* w;
+    vector<size_t> u_bounds;
+    vector<size_t> v_bounds;
+    // In the counting pass, offsets[b+1] is set to the number of
+    // elements of block b; then, offsets[b] is where block b starts.
+    vector<size_t> offsets;
+    bool counting;
+
+    static void Run(void* arg, int b) {
+      ParallelMerge* t = static_cast<ParallelMerge*>(arg);
+      const SparseVectorTmpl& u = *t->u;
+      const SparseVectorTmpl& v = *t->v;
+      size_t i = t->u_bounds[b];
+      size_t j = t->v_bounds[b];
+      size_t n = t->counting ? 0 : t->offsets[b];
+      while (i < t->u_bounds[b + 1] || j < t->v_bounds[b + 1]) {
+        KeyType key;
+        ValueType value;
+        if (j == t->v_bounds[b + 1] ||
+            (i < t->u_bounds[b + 1] && u.keys_[i] < v.keys_[j])) {
+          key = u.keys_[i];
+          value = u.values_[i];
+          ++i;
+        } else if (i == t->u_bounds[b + 1] || v.keys_[j] < u.keys_[i]) {
+          key = v.keys_[j];
+          value = v.values_[j] * t->c;
+          ++j;
+        } else {
+          key = u.keys_[i];
+          value = u.values_[i] + v.values_[j] * t->c;
+          ++i;
+          ++j;
+        }
+        if (!IsZero(value)) {
+          if (!t->counting) {
+            t->w->keys_[n] = key;
+            t->w->values_[n] = value;
+          }
+          ++n;
+        }
+      }
+      if (t->counting) {
+        t->offsets[b + 1] = n;
+      }
+    }
+  };
+
   static const ValueType zero_;
 
-  static bool IsZero(const ValueType& value) {
+  vector<KeyType> keys_;
+  vector<ValueType> values_;
+
+  void RemoveZeros() {
+    size_t n = 0;
+    for (size_t k = 0; k < keys_.size(); ++k) {
+      if (!IsZero(values_[k])) {
+        keys_[n] = keys_[k];
+        values_[n] = values_[k];
+        ++n;
+      }
+    }
+    keys_.resize(n);
+    values_.resize(n);
+  }
+
+  // Returns the position of |key|, or size() if there is no |key|.
+  size_t Find(const KeyType& key) const {
+    typename vector<KeyType>::const_iterator iter =
+        std::lower_bound(keys_.begin(), keys_.end(), key);
+    if (iter != keys_.end() && *iter == key) {
+      return iter - keys_.begin();
+    }
+    return keys_.size();
+  }
+
+  template <class ScaleType>
+  static bool IsZero(const ScaleType& value) {
     // Once, we used zero-judgement like:
     //   static double kEpsilon = 1e-12;
     //   return (value - zero_) * (value - zero_) < kEpsilon;
@@ -80,10 +367,7 @@ const ValueType SparseVectorTmpl<KeyType, ValueType>::zero_(0);
 template <class KeyType, class ValueType, class ScaleType>
 void Scale(SparseVectorTmpl<KeyType, ValueType>* v,
            const ScaleType& c) {
-  typedef SparseVectorTmpl<KeyType, ValueType> SV;
-  for (typename SV::iterator i = v->begin(); i != v->end(); ++i) {
-    i->second *= c;
-  }
+  v->Scale(c);
 }
 
 // ScaleInto(u,v,c) : u <- v * c
@@ -91,22 +375,8 @@ template <class KeyType, class ValueType, class ScaleType>
 void ScaleInto(SparseVectorTmpl<KeyType, ValueType>* u,
                const SparseVectorTmpl<KeyType, ValueType>& v,
                const ScaleType& c) {
-  typedef SparseVectorTmpl<KeyType, ValueType> SV;
-  u->clear();
-  for (typename SV::const_iterator i = v.begin(); i != v.end(); ++i) {
-    u->set(i->first, i->second * c);
-  }
-}
-
-// AddScaled(u,v,c) : u <- u + v * c
-template <class KeyType, class ValueType, class ScaleType>
-void AddScaled(SparseVectorTmpl<KeyType, ValueType>* u,
-               const SparseVectorTmpl<KeyType, ValueType>& v,
-               const ScaleType& c) {
-  typedef SparseVectorTmpl<KeyType, ValueType> SV;
-  for (typename SV::const_iterator i = v.begin(); i != v.end(); ++i) {
-    u->set(i->first, (*u)[i->first] + i->second * c);
-  }
+  *u = v;
+  u->Scale(c);
 }
 
 // AddScaledInto(w,u,v,c) : w <- u + v * c
@@ -115,47 +385,59 @@ void AddScaledInto(SparseVectorTmpl<KeyType, ValueType>* w,
                    const SparseVectorTmpl<KeyType, ValueType>& u,
                    const SparseVectorTmpl<KeyType, ValueType>& v,
                    const ScaleType& c) {
-  typedef SparseVectorTmpl<KeyType, ValueType> SV;
+  int num_blocks = NumVectorBlocks(u.size() + v.size());
+  if (num_blocks > 1) {
+    w->ParallelAddScaledInto(u, v, c, num_blocks);
+    return;
+  }
   w->clear();
-  typename SV::const_iterator i = u.begin();
-  typename SV::const_iterator j = v.begin();
-  while (i != u.end() && j != v.end()) {
-    if (i->first == j->first) {
-      w->set(i->first, i->second + j->second * c);
+  w->reserve(u.size() + v.size());
+  size_t i = 0;
+  size_t j = 0;
+  while (i < u.size() && j < v.size()) {
+    if (u.index(i) == v.index(j)) {
+      w->append(u.index(i), u.value(i) + v.value(j) * c);
       ++i;
       ++j;
-    } else if (i->first < j->first) {
-      w->set(i->first, i->second);
+    } else if (u.index(i) < v.index(j)) {
+      w->append(u.index(i), u.value(i));
       ++i;
     } else {
-      w->set(j->first, j->second * c);
+      w->append(v.index(j), v.value(j) * c);
       ++j;
     }
   }
-  while (i != u.end()) {
-    w->set(i->first, i->second);
-    ++i;
+  for (; i < u.size(); ++i) {
+    w->append(u.index(i), u.value(i));
   }
-  while (j != v.end()) {
-    w->set(j->first, j->second * c);
-    ++j;
+  for (; j < v.size(); ++j) {
+    w->append(v.index(j), v.value(j) * c);
   }
 }
 
-// DotProduct(u,v) : r <- dot(u, v)
+// AddScaled(u,v,c) : u <- u + v * c
+template <class KeyType, class ValueType, class ScaleType>
+void AddScaled(SparseVectorTmpl<KeyType, ValueType>* u,
+               const SparseVectorTmpl<KeyType, ValueType>& v,
+               const ScaleType& c) {
+  u->AddScaled(v, c);
+}
+
+namespace sparse_vector_internal {
+
+// Returns the dot-product of v1[i, i_end) and v2[j, j_end).
 template <class KeyType, class ValueType>
 ValueType DotProduct(const SparseVectorTmpl<KeyType, ValueType>& v1,
-                     const SparseVectorTmpl<KeyType, ValueType>& v2) {
-  typedef SparseVectorTmpl<KeyType, ValueType> SV;
-  typename SV::const_iterator i = v1.begin();
-  typename SV::const_iterator j = v2.begin();
+                     size_t i, size_t i_end,
+                     const SparseVectorTmpl<KeyType, ValueType>& v2,
+                     size_t j, size_t j_end) {
   ValueType ret = 0;
-  while (i != v1.end() && j != v2.end()) {
-    if (i->first == j->first) {
-      ret += i->second * j->second;
+  while (i < i_end && j < j_end) {
+    if (v1.index(i) == v2.index(j)) {
+      ret += v1.value(i) * v2.value(j);
       ++i;
       ++j;
-    } else if (i->first < j->first) {
+    } else if (v1.index(i) < v2.index(j)) {
       ++i;
     } else {
       ++j;
@@ -164,14 +446,58 @@ ValueType DotProduct(const SparseVectorTmpl<KeyType, ValueType>& v1,
   return ret;
 }
 
+template <class KeyType, class ValueType>
+struct ParallelDotProduct {
+  typedef SparseVectorTmpl<KeyType, ValueType> Vector;
+  const Vector* v1;
+  const Vector* v2;
+  vector<size_t> v1_bounds;
+  vector<size_t> v2_bounds;
+  vector<ValueType> partials;
+
+  static void Run(void* arg, int b) {
+    ParallelDotProduct* t = static_cast<ParallelDotProduct*>(arg);
+    t->partials[b] = DotProduct(*t->v1, t->v1_bounds[b], t->v1_bounds[b + 1],
+                                *t->v2, t->v2_bounds[b], t->v2_bounds[b + 1]);
+  }
+};
+
+}  // namespace sparse_vector_internal
+
+// DotProduct(u,v) : r <- dot(u, v)
+template <class KeyType, class ValueType>
+ValueType DotProduct(const SparseVectorTmpl<KeyType, ValueType>& v1,
+                     const SparseVectorTmpl<KeyType, ValueType>& v2) {
+  int num_blocks = NumVectorBlocks(v1.size() + v2.size());
+  if (num_blocks > 1) {
+    // Sum up results of blocks in order, so the result does not depend
+    // on the scheduling of threads.
+    sparse_vector_internal::ParallelDotProduct<KeyType, ValueType> task;
+    task.v1 = &v1;
+    task.v2 = &v2;
+    task.partials.resize(num_blocks, 0);
+    SparseVectorTmpl<KeyType, ValueType>::SplitAtCommonKeys(
+        v1, v2, num_blocks, &task.v1_bounds, &task.v2_bounds);
+    RunVectorBlocks(
+        &sparse_vector_internal::ParallelDotProduct<KeyType, ValueType>::Run,
+        &task, num_blocks);
+    ValueType ret = 0;
+    for (int b = 0; b < num_blocks; ++b) {
+      ret += task.partials[b];
+    }
+    return ret;
+  }
+  return sparse_vector_internal::DotProduct(v1, 0, v1.size(),
+                                            v2, 0, v2.size());
+}
+
 // Output a sparse vector in human readable format.
 template <class KeyType, class ValueType>
 ostream& operator<<(ostream& output,
                     const SparseVectorTmpl<KeyType, ValueType>& vec) {
-  typedef SparseVectorTmpl<KeyType, ValueType> SV;
   output << "[ ";
-  for (typename SV::const_iterator i = vec.begin(); i != vec.end(); ++i) {
-    output << i->first << ":" << i->second << " ";
+  for (size_t k = 0; k < vec.size(); ++k) {
+    output << vec.index(k) << ":" << vec.value(k) << " ";
   }
   output << "]";
   return output;
@@ -6,7 +6,9 @@
 #include "base/common.h"
 #include "gtest/gtest.h"
 #include "mrml-lasso/sparse_vector_tmpl.h"
+#include "mrml-lasso/vector_thread_pool.h"
 
+using logistic_regression::SetVectorThreads;
 using logistic_regression::SparseVectorTmpl;
 
 typedef SparseVectorTmpl<uint32, double> RealVector;
@@ -108,3 +110,145 @@ TEST(SparseVectorTmplTest, DotProduct) {
 }
 
 
+
+TEST(SparseVectorTmplTest, Append) {
+  RealVector v;
+  v.append(101, 1);
+  v.append(102, 0);
+  v.append(301, 3);
+  v.append(200, 2);     // Out of order, falls back to set.
+  v.append(301, 0);     // Removes an element.
+  EXPECT_EQ(v.size(), 2);
+  EXPECT_EQ(v.index(0), 101);
+  EXPECT_EQ(v.index(1), 200);
+  EXPECT_EQ(v.value(1), 2);
+  EXPECT_EQ(v.has(102), false);
+}
+
+TEST(SparseVectorTmplTest, AddScaledInPlaceAndMerge) {
+  RealVector u, v, w;
+  u.set(101, 2);
+  u.set(102, 4);
+  u.set(301, 8);
+  v.set(102, 2);
+  v.set(301, 16);
+  AddScaled(&u, v, -0.5);       // Keys of v all exist in u.
+  EXPECT_EQ(u.size(), 2);
+  EXPECT_EQ(u[101], 2);
+  EXPECT_EQ(u[102], 3);
+  EXPECT_EQ(u.has(301), false);
+
+  w.set(100, 1);
+  w.set(102, -6);
+  w.set(400, 4);
+  AddScaled(&u, w, 0.5);        // Brings new keys.
+  EXPECT_EQ(u.size(), 3);
+  EXPECT_EQ(u.index(0), 100);
+  EXPECT_EQ(u.index(1), 101);
+  EXPECT_EQ(u.index(2), 400);
+  EXPECT_EQ(u[100], 0.5);
+  EXPECT_EQ(u[101], 2);
+  EXPECT_EQ(u[400], 2);
+}
+
+// Operations on long vectors run in multiple threads, and give the same
+// results as in a single thread, except for the order of summation in
+// dot-products.
+TEST(SparseVectorTmplTest, MultipleThreads) {
+  static const uint32 kSize = 400000;
+  RealVector u, v;
+  for (uint32 i = 0; i < kSize; ++i) {
+    u.append(2 * i, i % 7 + 1);     // Even keys.
+    v.append(3 * i, -static_cast<double>(i % 5 + 1));  // Multiples of 3.
+  }
+
+  RealVector sum, scaled = u, added = u;
+  AddScaledInto(&sum, u, v, 2);
+  Scale(&scaled, 0.5);
+  AddScaled(&added, v, 1);
+  double dot = DotProduct(u, v);
+
+  SetVectorThreads(3);
+  RealVector threaded_sum, threaded_scaled = u, threaded_added = u;
+  AddScaledInto(&threaded_sum, u, v, 2);
+  Scale(&threaded_scaled, 0.5);
+  AddScaled(&threaded_added, v, 1);
+  double threaded_dot = DotProduct(u, v);
+  SetVectorThreads(1);
+
+  ASSERT_EQ(sum.size(), threaded_sum.size());
+  for (size_t k = 0; k < sum.size(); ++k) {
+    EXPECT_EQ(sum.index(k), threaded_sum.index(k));
+    EXPECT_EQ(sum.value(k), threaded_sum.value(k));
+  }
+  ASSERT_EQ(scaled.size(), threaded_scaled.size());
+  for (size_t k = 0; k < scaled.size(); ++k) {
+    EXPECT_EQ(scaled.value(k), threaded_scaled.value(k));
+  }
+  // Adding v cancels some elements of u, which are removed.
+  EXPECT_GT(sum.size(), added.size());
+  ASSERT_EQ(added.size(), threaded_added.size());
+  for (size_t k = 0; k < added.size(); ++k) {
+    EXPECT_EQ(added.index(k), threaded_added.index(k));
+    EXPECT_EQ(added.value(k), threaded_added.value(k));
+  }
+  // Values are small integers, so sums are exact in any order.
+  EXPECT_EQ(dot, threaded_dot);
+}
+
+// Compares threaded AddScaledInto and AddScaled of |u| and |v| with
+// the single-threaded ones, which keep every key of both vectors.
+static void ExpectSameThreadedAddScaled(const RealVector& u,
+                                        const RealVector& v) {
+  RealVector sum, added = u;
+  AddScaledInto(&sum, u, v, 2);
+  AddScaled(&added, v, 2);
+
+  SetVectorThreads(4);
+  RealVector threaded_sum, threaded_added = u, threaded_reverse_sum;
+  AddScaledInto(&threaded_sum, u, v, 2);
+  AddScaled(&threaded_added, v, 2);
+  AddScaledInto(&threaded_reverse_sum, v, u, 0.5);
+  SetVectorThreads(1);
+
+  ASSERT_EQ(u.size() + v.size(), sum.size());
+  ASSERT_EQ(sum.size(), threaded_sum.size());
+  ASSERT_EQ(sum.size(), threaded_added.size());
+  ASSERT_EQ(sum.size(), threaded_reverse_sum.size());
+  for (size_t k = 0; k < sum.size(); ++k) {
+    EXPECT_EQ(sum.index(k), threaded_sum.index(k));
+    EXPECT_EQ(sum.value(k), threaded_sum.value(k));
+    EXPECT_EQ(added.index(k), threaded_added.index(k));
+    EXPECT_EQ(added.value(k), threaded_added.value(k));
+    EXPECT_EQ(sum.index(k), threaded_reverse_sum.index(k));
+    EXPECT_EQ(sum.value(k) / 2, threaded_reverse_sum.value(k));
+  }
+}
+
+// Threads split vectors at keys of the longer one; keys of the shorter
+// one below or above all of them still go into the first or the last
+// block.
+TEST(SparseVectorTmplTest, MultipleThreadsWithDisjointKeys) {
+  static const uint32 kSize = 400000;
+  RealVector u;
+  for (uint32 i = 0; i < kSize; ++i) {
+    u.append(1000 + 2 * i, i % 7 + 1);  // Even keys from 1000.
+  }
+
+  RealVector below_and_within;
+  below_and_within.append(1, 3);
+  below_and_within.append(2, -1);
+  for (uint32 i = 0; i < 10; ++i) {
+    below_and_within.append(2001 + 2 * i, i + 1);
+  }
+  ExpectSameThreadedAddScaled(u, below_and_within);
+
+  RealVector below, above;
+  for (uint32 i = 0; i < 1000; ++i) {
+    below.append(i, i % 3 + 1);
+    above.append(1000 + 2 * kSize + i, i % 5 + 1);
+  }
+  ExpectSameThreadedAddScaled(u, below);
+  ExpectSameThreadedAddScaled(u, above);
+  ExpectSameThreadedAddScaled(below, u);
+}
@@ -7,6 +7,8 @@
 #ifndef MRML_LASSO_TEST_UTILS_H_
 #define MRML_LASSO_TEST_UTILS_H_
 
+#include <vector>
+
 #include "base/common.h"
 #include "gtest/gtest.h"
 #include "mrml-lasso/learner_states.h"
@@ -16,7 +18,7 @@
 namespace logistic_regression {
 
 //---------------------------------------------------------------------------
-// class template RealVectorTestUtil: for Sparse/Dense-RealVector
+// class template RealVectorTestUtil: for Sparse/Dense/Hybrid-RealVector
 //---------------------------------------------------------------------------
 
 template <class RealVector>
@@ -43,6 +45,15 @@ Construct(DenseRealVector* v) {
   v->push_back(30);
 }
 
+template <>
+inline void RealVectorTestUtil<HybridRealVector>::
+Construct(HybridRealVector* v) {
+  v->ResetSparse(3);
+  v->mutable_sparse()->set(0, 10);
+  v->mutable_sparse()->set(2, 30);
+  v->Adapt();
+}
+
 template <>
 inline void RealVectorTestUtil<SparseRealVector>::
 Check(const SparseRealVector& v) {
@@ -61,6 +72,15 @@ Check(const DenseRealVector& v) {
   EXPECT_EQ(v[2], 30);
 }
 
+template <>
+inline void RealVectorTestUtil<HybridRealVector>::
+Check(const HybridRealVector& v) {
+  EXPECT_EQ(v.dim(), 3);
+  EXPECT_EQ(v[0], 10);
+  EXPECT_EQ(v[1], 0);
+  EXPECT_EQ(v[2], 30);
+}
+
 template <>
 inline void RealVectorTestUtil<SparseRealVector>::
 CheckProtoBuf(const RealVectorPB& pb) {
@@ -81,6 +101,36 @@ CheckProtoBuf(const RealVectorPB& pb) {
   EXPECT_EQ(pb.element(1).value(), 30);
 }
 
+template <>
+inline void RealVectorTestUtil<HybridRealVector>::
+CheckProtoBuf(const RealVectorPB& pb) {
+  EXPECT_EQ(pb.dim(), 3);
+  EXPECT_EQ(pb.element_size(), 2);
+  EXPECT_EQ(pb.element(0).index(), 0);
+  EXPECT_EQ(pb.element(0).value(), 10);
+  EXPECT_EQ(pb.element(1).index(), 2);
+  EXPECT_EQ(pb.element(1).value(), 30);
+}
+
+// Makes |v| a HybridRealVector of |values| in the given representation.
+inline void AssignHybrid(const std::vector<double>& values, bool dense,
+                         HybridRealVector* v) {
+  v->ResetSparse(values.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    v->mutable_sparse()->append(i, values[i]);
+  }
+  if (dense) {
+    v->ToDense();
+  }
+}
+
+inline void ExpectHybridEq(const std::vector<double>& expected,
+                           const HybridRealVector& v) {
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(expected[i], v[i]) << "element " << i;
+  }
+}
+
 //---------------------------------------------------------------------------
 // class template RealVectorPtrDequeTestUtil
 //---------------------------------------------------------------------------
@@ -113,6 +163,45 @@ Check(const RealVectorPtrDeque<RealVector>& q) {
   u.Check(*v);
 }
 
+//---------------------------------------------------------------------------
+// class DenseVectorRingTestUtil
+//---------------------------------------------------------------------------
+
+class DenseVectorRingTestUtil {
+ public:
+  // Pushes 4 vectors into a ring of 3, so the first one is dropped.
+  void Construct(DenseVectorRing* ring) {
+    ring->SetCapacity(3, 3);
+    for (int i = 0; i < 4; ++i) {
+      double* v = ring->PushBack<double>();
+      v[0] = 10 * i;
+      v[1] = 0;
+      v[2] = 30 * i;
+    }
+  }
+
+  void Check(const DenseVectorRing& ring) {
+    EXPECT_EQ(3, ring.size());
+    EXPECT_EQ(3, ring.dim());
+    for (int i = 0; i < 3; ++i) {
+      EXPECT_EQ(10 * (i + 1), ring.Get(i, 0));
+      EXPECT_EQ(0, ring.Get(i, 1));
+      EXPECT_EQ(30 * (i + 1), ring.Get(i, 2));
+    }
+  }
+};
+
+// HistoryTestUtil<RealVector>::Type tests HistoryList<RealVector>::Type.
+template <class RealVector>
+struct HistoryTestUtil {
+  typedef RealVectorPtrDequeTestUtil<RealVector> Type;
+};
+
+template <>
+struct HistoryTestUtil<DenseRealVector> {
+  typedef DenseVectorRingTestUtil Type;
+};
+
 //---------------------------------------------------------------------------
 // class ImprovementFilterTestUtil
 //---------------------------------------------------------------------------
@@ -153,9 +242,9 @@ Construct(LearnerStates<RealVector>* states) {
   u.Construct(&states->new_grad_);
   u.Construct(&states->dir_);
 
-  RealVectorPtrDequeTestUtil<RealVector> ud;
-  ud.Construct(&states->s_list_);
-  ud.Construct(&states->y_list_);
+  typename HistoryTestUtil<RealVector>::Type uh;
+  uh.Construct(&states->s_list_);
+  uh.Construct(&states->y_list_);
 
   states->ro_list_.push_back(333);
   states->ro_list_.push_back(444);
@@ -168,6 +257,10 @@ Construct(LearnerStates<RealVector>* states) {
   states->memory_size_ = 999;
   states->l1weight_ = 1000;
 
+  states->sy_products_.push_back(1001);
+  states->sy_products_.push_back(1002);
+  states->yy_products_.push_back(1003);
+
   ImprovementFilterTestUtil ui;
   ui.Construct(&(states->improvement_filter_));
 }
@@ -182,9 +275,9 @@ Check(const LearnerStates<RealVector>& states) {
   u.Check(states.new_grad_);
   u.Check(states.dir_);
 
-  RealVectorPtrDequeTestUtil<RealVector> ud;
-  ud.Check(states.s_list_);
-  ud.Check(states.y_list_);
+  typename HistoryTestUtil<RealVector>::Type uh;
+  uh.Check(states.s_list_);
+  uh.Check(states.y_list_);
 
   EXPECT_EQ(2, states.ro_list_.size());
   EXPECT_EQ(333, states.ro_list_[0]);
@@ -199,6 +292,12 @@ Check(const LearnerStates<RealVector>& states) {
   EXPECT_EQ(999, states.memory_size_);
   EXPECT_EQ(1000, states.l1weight_);
 
+  EXPECT_EQ(2, states.sy_products_.size());
+  EXPECT_EQ(1001, states.sy_products_[0]);
+  EXPECT_EQ(1002, states.sy_products_[1]);
+  EXPECT_EQ(1, states.yy_products_.size());
+  EXPECT_EQ(1003, states.yy_products_[0]);
+
   ImprovementFilterTestUtil ui;
   ui.Check(states.improvement_filter_);
 }
@@ -5,9 +5,11 @@
 // LearnerStates<SparseRealVector> to implement a L1-regularized
 // logistic regression training algorithm.
 //
+#include <limits.h>
 #include <math.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <vector>
 #include <fstream>             // NOLINT. TODO(yiwang): use fopen API.
 #include <sstream>             // NOLINT. TODO(yiwang): use SplitString.
@@ -20,9 +22,12 @@
 
 #include "base/common.h"
 
+#include "mrml-lasso/csr_shard.h"
 #include "mrml-lasso/learner.h"
 #include "mrml-lasso/learner_sparse_impl.h"
 #include "mrml-lasso/learner_dense_impl.h"
+#include "mrml-lasso/map_input.h"
+#include "mrml-lasso/vector_thread_pool.h"
 #include "mrml-lasso/vector_types.h"
 
 using std::vector;
@@ -45,6 +50,9 @@ void ResizeRealVector(DenseRealVector* s, int size) {
 // label).  The feature vectors are SparseRealVector.  There are two
 // realizations of function template EvaluateObjective: one accepts
 // a sparse model, the other accepts a dense one.
+//
+// If the training data file is a CSR shard (c.f. csr_shard.h), it is
+// mmapped, rather than parsed into Instances.
 //---------------------------------------------------------------------------
 
 class TrainingData {
@@ -68,17 +76,32 @@ class TrainingData {
   int dim_;
   bool if_feature_binary_;
   vector<Instance> data_;
+  bool use_shard_;
+  CSRShard shard_;
 };
 
 
 void TrainingData::LoadTrainingData(const string& filename,
                                     const bool if_feature_binary) {
-  ifstream input(filename.c_str());
-  CHECK(input.is_open());
-
   data_.clear();
   dim_ = 0;
   if_feature_binary_ = if_feature_binary;
+  use_shard_ = CSRShard::IsCSRShard(filename);
+  if (use_shard_) {
+    CHECK(shard_.Open(filename));
+    // Dense vectors of the model are indexed by int.
+    if (shard_.dim() > INT_MAX) {
+      LOG(FATAL) << "The dim of " << filename << " (" << shard_.dim()
+                 << ") is too large for a dense model.";
+    }
+    dim_ = static_cast<int>(shard_.dim());
+    if_feature_binary_ = if_feature_binary || shard_.binary_features();
+    return;
+  }
+
+  ifstream input(filename.c_str());
+  CHECK(input.is_open());
+
   string line;
   while (getline(input, line)) {
     istringstream line_parser(line);
@@ -120,6 +143,26 @@ RegularizationFactor(const DenseLearnerStates& s) {
 // objective function.
 //---------------------------------------------------------------------------
 
+// Instances are evaluated in batches, as ComputeGradientMapper does
+// (c.f. map_input.h): margins of the instances of a batch are computed
+// first, then LogisticLossKernel computes their losses and gradient
+// coefficients at once, and finally features of each instance are
+// scaled by its coefficient into the gradient.  Instances without
+// labels are skipped, as by the mapper.
+
+// Appends features of an instance to |batch|.  |feature_values| is
+// ignored if |binary| is true.
+template <class FeatureName>
+static void AppendFeatures(const vector<FeatureName>& feature_names,
+                           const vector<float>& feature_values,
+                           bool binary,
+                           MapInputBatch* batch) {
+  for (size_t j = 0; j < feature_names.size(); ++j) {
+    batch->ids.push_back(feature_names[j]);
+    batch->values.push_back(binary ? 1.0 : feature_values[j]);
+  }
+}
+
 void EvaluateObjective(const TrainingData& data,
                        const LearnerStates<DenseRealVector>& states,
                        double* value,
@@ -128,76 +171,36 @@ void EvaluateObjective(const TrainingData& data,
   *value = 1.0;
 
   // Compute value and gradient of the logistic loss function.
-  for (int i = 0; i < data.data_.size(); ++i) {
-    double dot_feature_model = 0;
-    for (int j = 0; j < data.data_[i].feature_name_.size(); ++j) {
-      int32 feature_name = data.data_[i].feature_name_[j];
-      double feature_value = 1.0;
-      if (!data.if_feature_binary_)
-        feature_value = data.data_[i].feature_value_[j];
-      if (feature_name < states.new_x().size())
-        dot_feature_model += states.new_x()[feature_name] * feature_value;
-      else
-        break;
+  const DenseRealVector& x = states.new_x();
+  MapInputBatch batch;
+  size_t num_instances = data.use_shard_ ?
+      data.shard_.num_instances() : data.data_.size();
+  for (size_t i = 0; i < num_instances; ++i) {
+    size_t begin = batch.ids.size();
+    float num_positives;
+    float num_appearences;
+    if (data.use_shard_) {
+      if (data.shard_.num_positive(i) > data.shard_.num_appearance(i))
+        continue;
+      CSRRow* row = &batch.csr_row;
+      data.shard_.ReadRow(i, row);
+      AppendFeatures(row->ids, row->values, data.if_feature_binary_, &batch);
+      num_positives = row->num_positive;
+      num_appearences = row->num_appearance;
+    } else {
+      const TrainingData::Instance& instance = data.data_[i];
+      AppendFeatures(instance.feature_name_, instance.feature_value_,
+                     data.if_feature_binary_, &batch);
+      num_positives = instance.num_positives_;
+      num_appearences = instance.num_appearences_;
     }
-
-    float num_positives = data.data_[i].num_positives_;
-    float num_negatives = data.data_[i].num_appearences_
-                          - data.data_[i].num_positives_;
-    double score = dot_feature_model;
-    double insLoss, insProb;
-    // process the positives instances
-    if (num_positives > 0) {
-      if (score < -30) {
-        insLoss = -score;
-        insProb = 0;
-      } else if (score > 30) {
-        insLoss = 0;
-        insProb = 1;
-      } else {
-        double temp = 1.0 + exp(-score);
-        insLoss = log(temp);
-        insProb = 1.0/temp;
-      }
-      *value += insLoss * num_positives;
-      for (int k = 0; k < data.data_[i].feature_name_.size(); ++k) {
-        int32 feature_name = data.data_[i].feature_name_[k];
-        double feature_value = 1.0;
-        if (!data.if_feature_binary_)
-          feature_value = data.data_[i].feature_value_[k];
-        while (gradient->size() <= feature_name)
-          gradient->push_back(0);
-        (*gradient)[feature_name] +=
-            feature_value * (-1 * num_positives * (1.0 - insProb));
-      }
-    }
-
-    if (num_negatives > 0) {
-      score *= -1;
-      if (score < -30) {
-        insLoss = -score;
-        insProb = 0;
-      } else if (score > 30) {
-        insLoss = 0;
-        insProb = 1;
-      } else {
-        double temp = 1.0 + exp(-score);
-        insLoss = log(temp);
-        insProb = 1.0/temp;
-      }
-      *value += insLoss * num_negatives;
-      for (int k = 0; k < data.data_[i].feature_name_.size(); ++k) {
-        int32 feature_name = data.data_[i].feature_name_[k];
-        double feature_value = 1.0;
-        if (!data.if_feature_binary_)
-          feature_value = data.data_[i].feature_value_[k];
-        while (gradient->size() <= feature_name)
-          gradient->push_back(0);
-        (*gradient)[feature_name] +=
-            feature_value * num_negatives * (1.0 - insProb);
-      }
+    if (AddParsedInstance(x, num_positives, num_appearences, begin,
+                          &batch) &&
+        batch.size() == MapInputBatch::kMaxSize) {
+      EvaluateMapInputBatch(&batch, value, gradient);
     }
   }
+  EvaluateMapInputBatch(&batch, value, gradient);
   ResizeRealVector(gradient, data.dim());
   *value += RegularizationFactor(states);
 }
@@ -212,7 +215,8 @@ bool DoesFileExist(const char* filename) {
 }
 
 void Train(const TrainingData& training_data,
-           const DenseRealVector& initial_x, const double l1_weight) {
+           const DenseRealVector& initial_x, const double l1_weight,
+           bool single_precision_history) {
   static const char* kTerminationFlagFilename = "./tmp/term-lr";
 
   Learner<DenseRealVector> learner(initial_x,
@@ -222,6 +226,7 @@ void Train(const TrainingData& training_data,
                               120,  // int max_iterations,
                               1e-4,  // double convergence_tolerance
                               initial_x.size());
+  learner.SetSinglePrecisionHistory(single_precision_history);
 
   double value;
   DenseRealVector gradient;
@@ -269,6 +274,9 @@ int main(int argc, char** argv) {
       ("help", "Produce help message.")
       ("l1_weight", po::value<string>(), "l1_weight")
       ("if_feature_binary", po::value<bool>(), "if_feature_binary")
+      ("learner_threads", po::value<int>(), "learner_threads")
+      ("single_precision_history", po::value<bool>(),
+       "single_precision_history")
       ("input_data", po::value<string>(), "the training data file name");
   po::parsed_options parsed =
       po::command_line_parser(argc, argv).options(desc).allow_unregistered().
@@ -281,6 +289,9 @@ int main(int argc, char** argv) {
   CHECK(vm.count("l1_weight"));
 
   double l1_weight = atof((vm["l1_weight"].as<string>()).c_str());
+  if (vm.count("learner_threads")) {
+    logistic_regression::SetVectorThreads(vm["learner_threads"].as<int>());
+  }
   TrainingData training_data;
   if (vm["if_feature_binary"].as<bool>())
     training_data.LoadTrainingData(vm["input_data"].as<string>(), true);
@@ -288,7 +299,9 @@ int main(int argc, char** argv) {
     training_data.LoadTrainingData(vm["input_data"].as<string>(), false);
 
   DenseRealVector initial_x(training_data.dim(), 0);
-  Train(training_data, initial_x, l1_weight);
+  Train(training_data, initial_x, l1_weight,
+        vm.count("single_precision_history") &&
+        vm["single_precision_history"].as<bool>());
 
   return 0;
 }
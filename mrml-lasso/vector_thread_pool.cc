@@ -0,0 +1,130 @@
+
+
+//
+#include "mrml-lasso/vector_thread_pool.h"
+
+#include <algorithm>
+
+namespace logistic_regression {
+
+VectorThreadPool::VectorThreadPool(int num_threads)
+    : task_(NULL),
+      arg_(NULL),
+      num_blocks_(0),
+      next_block_(0),
+      pending_blocks_(0),
+      job_id_(0),
+      stopping_(false) {
+  CHECK_LT(0, num_threads);
+  workers_.resize(num_threads - 1);
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    if (pthread_create(&workers_[i], NULL, &WorkerThread, this) != 0) {
+      LOG(FATAL) << "Cannot create vector operation thread.";
+    }
+  }
+}
+
+VectorThreadPool::~VectorThreadPool() {
+  {
+    MutexLocker locker(&mutex_);
+    stopping_ = true;
+    job_ready_.Broadcast();
+  }
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    CHECK_EQ(pthread_join(workers_[i], NULL), 0);
+  }
+}
+
+void VectorThreadPool::Run(Task task, void* arg, int num_blocks) {
+  MutexLocker run_locker(&run_mutex_);
+  MutexLocker locker(&mutex_);
+  task_ = task;
+  arg_ = arg;
+  num_blocks_ = num_blocks;
+  next_block_ = 0;
+  pending_blocks_ = num_blocks;
+  ++job_id_;
+  job_ready_.Broadcast();
+
+  RunBlocks();
+  while (pending_blocks_ > 0) {
+    job_done_.Wait(&mutex_);
+  }
+}
+
+void VectorThreadPool::RunBlocks() {
+  while (next_block_ < num_blocks_) {
+    int block = next_block_++;
+    Task task = task_;
+    void* arg = arg_;
+    mutex_.Unlock();
+    task(arg, block);
+    mutex_.Lock();
+    if (--pending_blocks_ == 0) {
+      job_done_.Broadcast();
+    }
+  }
+}
+
+void* VectorThreadPool::WorkerThread(void* pool) {
+  VectorThreadPool* p = static_cast<VectorThreadPool*>(pool);
+  MutexLocker locker(&p->mutex_);
+  // A job started before this thread runs is completed by other
+  // threads, and RunBlocks finds no block left of it.
+  int last_job_id = 0;
+  while (true) {
+    while (!p->stopping_ && p->job_id_ == last_job_id) {
+      p->job_ready_.Wait(&p->mutex_);
+    }
+    if (p->stopping_) {
+      break;
+    }
+    last_job_id = p->job_id_;
+    p->RunBlocks();
+  }
+  return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// The process-wide pool
+//-----------------------------------------------------------------------------
+
+namespace {
+
+// NULL if vector operations run in a single thread.
+VectorThreadPool** Pool() {
+  static VectorThreadPool* pool = NULL;
+  return &pool;
+}
+
+}  // namespace
+
+void SetVectorThreads(int num_threads) {
+  num_threads = std::max(num_threads, 1);
+  if (num_threads == VectorThreads()) {
+    return;
+  }
+  delete *Pool();
+  *Pool() = (num_threads > 1) ? new VectorThreadPool(num_threads) : NULL;
+}
+
+int VectorThreads() {
+  return (*Pool() == NULL) ? 1 : (*Pool())->num_threads();
+}
+
+int NumVectorBlocks(size_t size) {
+  return std::max<size_t>(
+      1, std::min<size_t>(VectorThreads(), size / kMinVectorBlockSize));
+}
+
+void RunVectorBlocks(VectorThreadPool::Task task, void* arg, int num_blocks) {
+  if (num_blocks <= 1 || *Pool() == NULL) {
+    for (int b = 0; b < num_blocks; ++b) {
+      task(arg, b);
+    }
+    return;
+  }
+  (*Pool())->Run(task, arg, num_blocks);
+}
+
+}  // namespace logistic_regression
@@ -0,0 +1,100 @@
+
+
+//
+// VectorThreadPool runs operations on long vectors, like those of
+// L-BFGS, using multiple threads.  An operation is split into blocks
+// of contiguous elements, and each block is run by one thread.  The
+// split depends only on the vector length and the number of threads,
+// and reductions (e.g., dot-products) sum up the results of blocks in
+// the order of blocks, so an operation gives the same result in every
+// run with the same number of threads.
+//
+// Vector operations of DenseRealVector and SparseRealVector use a
+// process-wide pool of SetVectorThreads() threads.  By default, there
+// is only one thread, and no thread is ever created.
+//
+#ifndef MRML_LASSO_VECTOR_THREAD_POOL_H_
+#define MRML_LASSO_VECTOR_THREAD_POOL_H_
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include "base/common.h"
+#include "system/condition_variable.h"
+#include "system/mutex.h"
+
+namespace logistic_regression {
+
+// Vectors shorter than this many elements per thread are not worth
+// the synchronization, so fewer threads are used for them.
+static const size_t kMinVectorBlockSize = 64 * 1024;
+
+class VectorThreadPool {
+ public:
+  // A task runs block |block| of an operation described by |arg|.
+  typedef void (*Task)(void* arg, int block);
+
+  // Creates num_threads - 1 worker threads; the thread calling Run
+  // works as well.
+  explicit VectorThreadPool(int num_threads);
+  ~VectorThreadPool();
+
+  int num_threads() const { return workers_.size() + 1; }
+
+  // Runs task(arg, b) for b in [0, num_blocks), and returns after all
+  // of them complete.  Calls of Run from different threads are
+  // serialized.
+  void Run(Task task, void* arg, int num_blocks);
+
+ private:
+  static void* WorkerThread(void* pool);
+
+  // Runs blocks of the current job until none is left.  Expects
+  // mutex_ to be locked.
+  void RunBlocks();
+
+  Mutex run_mutex_;            // Serializes calls of Run.
+  Mutex mutex_;                // Protects the following states.
+  ConditionVariable job_ready_;
+  ConditionVariable job_done_;
+  Task task_;
+  void* arg_;
+  int num_blocks_;
+  int next_block_;             // The next block to be run.
+  int pending_blocks_;         // Blocks not completed yet.
+  int job_id_;                 // Increased by each call of Run.
+  bool stopping_;
+
+  std::vector<pthread_t> workers_;
+
+  DISALLOW_COPY_AND_ASSIGN(VectorThreadPool);
+};
+
+// Sets the number of threads running vector operations.  Values less
+// than 1 are treated as 1.
+void SetVectorThreads(int num_threads);
+int VectorThreads();
+
+// Returns the number of blocks to split a vector of |size| elements
+// into, which is 1 if the vector is too short to run in parallel.
+int NumVectorBlocks(size_t size);
+
+// Returns the first element of block |block| out of |num_blocks| of a
+// vector of |size| elements.  Blocks other than the last one start and
+// end at multiples of 8 elements, so that blocks do not share cache
+// lines and SIMD loops do not leave tails in the middle of a vector.
+inline size_t VectorBlockBegin(size_t size, int num_blocks, int block) {
+  if (block >= num_blocks) {
+    return size;
+  }
+  return (size * block / num_blocks) & ~static_cast<size_t>(7);
+}
+
+// Runs task(arg, b) for b in [0, num_blocks) by the vector thread pool.
+void RunVectorBlocks(VectorThreadPool::Task task, void* arg, int num_blocks);
+
+}  // namespace logistic_regression
+
+#endif  // MRML_LASSO_VECTOR_THREAD_POOL_H_
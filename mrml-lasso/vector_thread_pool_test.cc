@@ -0,0 +1,62 @@
+
+
+//
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/common.h"
+#include "mrml-lasso/vector_thread_pool.h"
+
+using logistic_regression::NumVectorBlocks;
+using logistic_regression::RunVectorBlocks;
+using logistic_regression::SetVectorThreads;
+using logistic_regression::VectorBlockBegin;
+using logistic_regression::VectorThreadPool;
+using logistic_regression::VectorThreads;
+using logistic_regression::kMinVectorBlockSize;
+using std::vector;
+
+static void CountBlock(void* counts, int block) {
+  ++(*static_cast<vector<int>*>(counts))[block];
+}
+
+TEST(VectorThreadPoolTest, RunsEachBlockOnce) {
+  VectorThreadPool pool(4);
+  EXPECT_EQ(4, pool.num_threads());
+  for (int num_blocks = 0; num_blocks < 20; ++num_blocks) {
+    vector<int> counts(num_blocks, 0);
+    pool.Run(&CountBlock, &counts, num_blocks);
+    for (int b = 0; b < num_blocks; ++b) {
+      EXPECT_EQ(1, counts[b]);
+    }
+  }
+}
+
+TEST(VectorThreadPoolTest, BlockBoundaries) {
+  EXPECT_EQ(0, VectorBlockBegin(100, 3, 0));
+  EXPECT_EQ(32, VectorBlockBegin(100, 3, 1));
+  EXPECT_EQ(64, VectorBlockBegin(100, 3, 2));
+  EXPECT_EQ(100, VectorBlockBegin(100, 3, 3));
+  EXPECT_EQ(0, VectorBlockBegin(5, 1, 0));
+  EXPECT_EQ(5, VectorBlockBegin(5, 1, 1));
+}
+
+TEST(VectorThreadPoolTest, ProcessWidePool) {
+  EXPECT_EQ(1, VectorThreads());
+  EXPECT_EQ(1, NumVectorBlocks(100 * kMinVectorBlockSize));
+
+  SetVectorThreads(3);
+  EXPECT_EQ(3, VectorThreads());
+  EXPECT_EQ(1, NumVectorBlocks(kMinVectorBlockSize));
+  EXPECT_EQ(2, NumVectorBlocks(2 * kMinVectorBlockSize));
+  EXPECT_EQ(3, NumVectorBlocks(100 * kMinVectorBlockSize));
+  vector<int> counts(3, 0);
+  RunVectorBlocks(&CountBlock, &counts, 3);
+  EXPECT_EQ(vector<int>(3, 1), counts);
+
+  SetVectorThreads(0);
+  EXPECT_EQ(1, VectorThreads());
+  RunVectorBlocks(&CountBlock, &counts, 3);
+  EXPECT_EQ(vector<int>(3, 2), counts);
+}
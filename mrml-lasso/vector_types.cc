@@ -1,6 +1,7 @@
 
 
 //
+#include <algorithm>
 #include <sstream>
 #include <string>
 #include "mrml-lasso/vector_types.h"
@@ -10,45 +11,41 @@ namespace logistic_regression {
 
 void SparseRealVector::SerializeToProtoBuf(RealVectorPB* pb) const {
   pb->Clear();
-  for (const_iterator iter = begin(); iter != end(); ++iter) {
+  for (size_t k = 0; k < size(); ++k) {
     RealVectorPB::Element* e = pb->add_element();
-    e->set_index(iter->first);
-    e->set_value(iter->second);
+    e->set_index(index(k));
+    e->set_value(value(k));
   }
 }
 
 void SparseRealVector::ParseFromProtoBuf(const RealVectorPB& pb) {
   clear();
+  reserve(pb.element_size());
   for (int i = 0; i < pb.element_size(); ++i) {
     const RealVectorPB::Element& e = pb.element(i);
-    this->set(e.index(), e.value());
+    this->append(e.index(), e.value());
   }
 }
 
 void SparseRealVector::SerializeToRecordIO(MRMLFS_File* file, 
                                            const std::string& key_base) const {
-  int32 vec_size = 0;
-  int32 vec_dim = 0;
-  for (const_iterator iter = begin(); iter != end(); ++iter) {
-    ++vec_size;
-    if (vec_dim < iter->first)
-      vec_dim = iter->first;
-  }
+  int32 vec_size = size();
+  int32 vec_dim = empty() ? 0 : index(size() - 1);
   Int32PB int_pb;
   int_pb.set_value(vec_dim);
   MRML_WriteRecord(file, key_base + ".dim", int_pb);
   int_pb.set_value(vec_size);
   MRML_WriteRecord(file, key_base + ".size", int_pb);
   
-  const_iterator iter = begin();
+  size_t k = 0;
   int fragment_num = vec_size/kMessageSize +
                      ((vec_size % kMessageSize == 0) ? 0 : 1);
   for (int i = 0; i < fragment_num; ++i) {
     RealVectorPB vec_pb;
-    for (int j = 0; iter != end() && j < kMessageSize; ++iter) {
+    for (int j = 0; k < size() && j < kMessageSize; ++k) {
       RealVectorPB::Element* e = vec_pb.add_element();
-      e->set_index(iter->first);
-      e->set_value(iter->second);
+      e->set_index(index(k));
+      e->set_value(value(k));
       ++j;
     }
     MRML_WriteRecord(file, key_base, vec_pb);
@@ -67,7 +64,8 @@ void SparseRealVector::ParseFromRecordIO(MRMLFS_File* file,
   CHECK_EQ(key, key_base + ".size");
   vec_size = int_pb.value();
   CHECK_LE(0, vec_size);
-  
+  reserve(vec_size);
+
   int fragment_num = vec_size/kMessageSize +
                      ((vec_size % kMessageSize == 0) ? 0 : 1);
   for (int i = 0; i < fragment_num; ++i) {
@@ -76,7 +74,7 @@ void SparseRealVector::ParseFromRecordIO(MRMLFS_File* file,
     CHECK_EQ(key, key_base);
     for (int j = 0; j < vec_pb.element_size(); ++j) {
       const RealVectorPB::Element& e = vec_pb.element(j);
-      this->set(e.index(), e.value());
+      this->append(e.index(), e.value());
     }
   }
 }
@@ -167,23 +165,279 @@ void DenseRealVector::ParseFromRecordIO(MRMLFS_File* file,
   
 double DotProduct(const SparseRealVector& sv, const DenseRealVector& dv) {
   double ret = 0;
-  for (SparseRealVector::const_iterator i = sv.begin(); i != sv.end(); ++i) {
-    if (i->first < dv.size()) {
-      ret += dv[i->first] * i->second;
-    } else {
-      break;
-    }
+  for (size_t k = 0; k < sv.size() && sv.index(k) < dv.size(); ++k) {
+    ret += dv[sv.index(k)] * sv.value(k);
   }
   return ret;
 }
 
 void AddScaled(DenseRealVector* dv, const SparseRealVector& sv, double f) {
-  for (SparseRealVector::const_iterator i = sv.begin(); i != sv.end(); ++i) {
-    while (dv->size() <= i->first) {
-      dv->push_back(0);
+  if (!sv.empty() && dv->size() <= sv.index(sv.size() - 1)) {
+    dv->resize(sv.index(sv.size() - 1) + 1, 0);
+  }
+  for (size_t k = 0; k < sv.size(); ++k) {
+    (*dv)[sv.index(k)] += sv.value(k) * f;
+  }
+}
+
+size_t HybridRealVector::NumNonZeros() const {
+  if (!is_dense_) {
+    return sparse_.size();
+  }
+  size_t nnz = 0;
+  for (size_t i = 0; i < dense_.size(); ++i) {
+    if (dense_[i] != 0) {
+      ++nnz;
+    }
+  }
+  return nnz;
+}
+
+SparseRealVector* HybridRealVector::ResetSparse(size_t dim) {
+  if (is_dense_) {
+    DenseRealVector().swap(dense_);
+    is_dense_ = false;
+  }
+  sparse_.clear();
+  dim_ = dim;
+  return &sparse_;
+}
+
+DenseRealVector* HybridRealVector::ResetDense(size_t dim) {
+  if (!is_dense_) {
+    SparseRealVector().swap(sparse_);
+    is_dense_ = true;
+  }
+  dense_.resize(dim);
+  dim_ = dim;
+  return &dense_;
+}
+
+void HybridRealVector::ToSparse() {
+  if (!is_dense_) {
+    return;
+  }
+  SparseRealVector sparse;
+  sparse.reserve(NumNonZeros());
+  for (size_t i = 0; i < dense_.size(); ++i) {
+    sparse.append(i, dense_[i]);
+  }
+  sparse_.swap(sparse);
+  DenseRealVector().swap(dense_);
+  is_dense_ = false;
+}
+
+void HybridRealVector::ToDense() {
+  if (is_dense_) {
+    return;
+  }
+  DenseRealVector dense(dim_, 0);
+  for (size_t k = 0; k < sparse_.size(); ++k) {
+    dense[sparse_.index(k)] = sparse_.value(k);
+  }
+  dense_.swap(dense);
+  SparseRealVector().swap(sparse_);
+  is_dense_ = true;
+}
+
+void HybridRealVector::Adapt() {
+  if (is_dense_) {
+    dim_ = std::max(dim_, dense_.size());
+    dense_.resize(dim_, 0);
+    if (NumNonZeros() * kSparseRatio < dim_) {
+      ToSparse();
+    }
+  } else {
+    if (!sparse_.empty()) {
+      dim_ = std::max<size_t>(dim_, sparse_.index(sparse_.size() - 1) + 1);
+    }
+    if (sparse_.size() * kDenseRatio > dim_) {
+      ToDense();
+    }
+  }
+}
+
+void HybridRealVector::resize(size_t dim) {
+  if (is_dense_) {
+    dense_.resize(dim, 0);
+  } else if (!sparse_.empty() && sparse_.index(sparse_.size() - 1) >= dim) {
+    SparseRealVector kept;
+    size_t size = sparse_.LowerBound(dim);
+    kept.reserve(size);
+    for (size_t k = 0; k < size; ++k) {
+      kept.append(sparse_.index(k), sparse_.value(k));
+    }
+    sparse_.swap(kept);
+  }
+  dim_ = dim;
+}
+
+void HybridRealVector::swap(HybridRealVector& other) {
+  sparse_.swap(other.sparse_);
+  dense_.swap(other.dense_);
+  std::swap(dim_, other.dim_);
+  std::swap(is_dense_, other.is_dense_);
+}
+
+void HybridRealVector::SerializeToProtoBuf(RealVectorPB* pb) const {
+  pb->Clear();
+  pb->set_dim(dim_);
+  for (Iterator it(*this); !it.Done(); it.Next()) {
+    RealVectorPB::Element* e = pb->add_element();
+    e->set_index(it.index());
+    e->set_value(it.value());
+  }
+}
+
+void HybridRealVector::ParseFromProtoBuf(const RealVectorPB& pb) {
+  SparseRealVector* sparse = ResetSparse(pb.dim());
+  sparse->reserve(pb.element_size());
+  for (int i = 0; i < pb.element_size(); ++i) {
+    const RealVectorPB::Element& e = pb.element(i);
+    sparse->append(e.index(), e.value());
+  }
+  Adapt();
+}
+
+// Writes the records of DenseRealVector::SerializeToRecordIO, where the
+// i-th fragment holds non-zero elements of indices in [i * kMessageSize,
+// (i + 1) * kMessageSize).
+void HybridRealVector::SerializeToRecordIO(MRMLFS_File* file,
+                                           const std::string& key_base) const {
+  Int32PB int_pb;
+  int_pb.set_value(dim_);
+  MRML_WriteRecord(file, key_base + ".dim", int_pb);
+  int_pb.set_value(NumNonZeros());
+  MRML_WriteRecord(file, key_base + ".size", int_pb);
+
+  int fragment_num = dim_/kMessageSize +
+                     ((dim_ % kMessageSize == 0) ? 0 : 1);
+  Iterator it(*this);
+  for (int i = 0; i < fragment_num; ++i) {
+    RealVectorPB vec_pb;
+    size_t end = static_cast<size_t>(i + 1) * kMessageSize;
+    for (; !it.Done() && it.index() < end; it.Next()) {
+      RealVectorPB::Element* e = vec_pb.add_element();
+      e->set_index(it.index());
+      e->set_value(it.value());
     }
-    (*dv)[i->first] += i->second * f;
+    MRML_WriteRecord(file, key_base, vec_pb);
+  }
+}
+
+void HybridRealVector::ParseFromRecordIO(MRMLFS_File* file,
+                                         const std::string& key_base,
+                                         int32& vec_size) {
+  std::string key;
+  Int32PB int_pb;
+  MRML_ReadRecord(file, &key, &int_pb);
+  CHECK_EQ(key, key_base + ".dim");
+  int32 dim = int_pb.value();
+  CHECK_LE(0, dim);
+
+  MRML_ReadRecord(file, &key, &int_pb);
+  CHECK_EQ(key, key_base + ".size");
+  vec_size = int_pb.value();
+  CHECK_LE(0, vec_size);
+
+  SparseRealVector* sparse = ResetSparse(dim);
+  sparse->reserve(vec_size);
+  int fragment_num = dim/kMessageSize +
+                     ((dim % kMessageSize == 0) ? 0 : 1);
+  for (int i = 0; i < fragment_num; ++i) {
+    RealVectorPB vec_pb;
+    MRML_ReadRecord(file, &key, &vec_pb);
+    CHECK_EQ(key, key_base);
+    for (int j = 0; j < vec_pb.element_size(); ++j) {
+      const RealVectorPB::Element& e = vec_pb.element(j);
+      sparse->append(e.index(), e.value());
+    }
+  }
+  Adapt();
+}
+
+double DotProduct(const HybridRealVector& u, const HybridRealVector& v) {
+  if (u.is_dense() && v.is_dense()) {
+    size_t n = std::min(u.dense().size(), v.dense().size());
+    return (n == 0) ? 0 : DotProductKernel(&u.dense()[0], &v.dense()[0], n);
+  } else if (u.is_dense()) {
+    return DotProduct(v.sparse(), u.dense());
+  } else if (v.is_dense()) {
+    return DotProduct(u.sparse(), v.dense());
+  }
+  return DotProduct(u.sparse(), v.sparse());
+}
+
+double DotProduct(const SparseRealVector& sv, const HybridRealVector& hv) {
+  if (hv.is_dense()) {
+    return DotProduct(sv, hv.dense());
+  }
+  return DotProduct(sv, hv.sparse());
+}
+
+void Scale(HybridRealVector* v, double c) {
+  if (c == 0) {
+    v->ResetSparse(v->dim());
+  } else if (v->is_dense()) {
+    Scale(v->mutable_dense(), c);
+  } else {
+    Scale(v->mutable_sparse(), c);
+  }
+}
+
+void ScaleInto(HybridRealVector* u, const HybridRealVector& v, double c) {
+  if (u->is_dense() && v.is_dense() && u->dim() == v.dim() && v.dim() > 0) {
+    ScaleInto(u->mutable_dense(), v.dense(), c);
+  } else {
+    *u = v;
+    Scale(u, c);
+  }
+}
+
+void AddScaled(HybridRealVector* u, const HybridRealVector& v, double c) {
+  if (!u->is_dense() && !v.is_dense()) {
+    u->mutable_sparse()->AddScaled(v.sparse(), c);
+    u->Adapt();
+    return;
+  }
+  // The sum is about as dense as the dense operand.
+  u->ToDense();
+  if (u->dim() < v.dim()) {
+    u->resize(v.dim());
+  }
+  if (!v.is_dense()) {
+    AddScaled(u->mutable_dense(), v.sparse(), c);
+  } else if (v.dim() > 0) {
+    AddScaledKernel(&(*u->mutable_dense())[0], &v.dense()[0], v.dim(), c);
+  }
+}
+
+void AddScaledInto(HybridRealVector* w,
+                   const HybridRealVector& u,
+                   const HybridRealVector& v,
+                   double c) {
+  CHECK(w != &u && w != &v);
+  if (u.is_dense() && v.is_dense() && u.dim() == v.dim() && u.dim() > 0) {
+    DenseRealVector* dense = w->ResetDense(u.dim());
+    AddScaledIntoKernel(&(*dense)[0], &u.dense()[0], &v.dense()[0], u.dim(),
+                        c);
+  } else if (!u.is_dense() && !v.is_dense()) {
+    AddScaledInto(w->ResetSparse(std::max(u.dim(), v.dim())),
+                  u.sparse(), v.sparse(), c);
+    w->Adapt();
+  } else {
+    *w = u;
+    AddScaled(w, v, c);
+  }
+}
+
+std::ostream& operator<<(std::ostream& output, const HybridRealVector& vec) {
+  output << "[ ";
+  for (HybridRealVector::Iterator it(vec); !it.Done(); it.Next()) {
+    output << it.index() << ":" << it.value() << " ";
   }
+  output << "]";
+  return output;
 }
 
 }  // namespace logistic_regression
@@ -1,18 +1,20 @@
 
 
 //
-// Here defines classes DenseRealVector and SparseRealVector, which
-// will be used in class templates: RealVectorPtrDeque and
-// LearnerStates.
+// Here defines classes DenseRealVector, SparseRealVector and
+// HybridRealVector, which will be used in class templates:
+// RealVectorPtrDeque and LearnerStates.
 //
-// Note that both classes serialize to the same protocol message
-// RealVectorPB; this allows LearnerStates<DenseRealVector> and
-// LearnerStates<SparseRealVector> share the same protocol message
-// LearnerStatesPB.
+// Note that all classes serialize to the same protocol message
+// RealVectorPB; this allows LearnerStates<DenseRealVector>,
+// LearnerStates<SparseRealVector> and LearnerStates<HybridRealVector>
+// share the same protocol message LearnerStatesPB.
 //
 #ifndef MRML_LASSO_VECTOR_TYPES_H_
 #define MRML_LASSO_VECTOR_TYPES_H_
 
+#include <algorithm>
+#include <ostream>
 #include <vector>
 
 #include "base/common.h"
@@ -51,12 +53,11 @@ class DenseRealVector : public DenseVectorTmpl<double> {
 };
 
 //---------------------------------------------------------------------------
-// SparseRealVector, a map<uint32, double> realization of SparseVectorTmpl.
+// SparseRealVector, a sorted-array <uint32, double> realization of
+// SparseVectorTmpl.
 //---------------------------------------------------------------------------
 class SparseRealVector : public SparseVectorTmpl<IndexType, double> {
  public:
-  typedef SparseVectorTmpl<uint32, double>::const_iterator const_iterator;
-  typedef SparseVectorTmpl<uint32, double>::iterator iterator;
   void SerializeToProtoBuf(RealVectorPB* pb) const;
   void SerializeToRecordIO(MRMLFS_File* file,
                            const std::string& key_base) const;
@@ -74,6 +75,219 @@ class SparseRealVector : public SparseVectorTmpl<IndexType, double> {
 double DotProduct(const SparseRealVector& sv, const DenseRealVector& dv);
 void AddScaled(DenseRealVector* dv, const SparseRealVector& sv, double f);
 
+//---------------------------------------------------------------------------
+// HybridRealVector keeps its elements in either a SparseRealVector or
+// a DenseRealVector, whichever suits its density.
+//
+// With L1 regularization, x is usually very sparse while the gradient
+// is dense, so neither DenseRealVector nor SparseRealVector suits all
+// vectors of the learner.  A HybridRealVector switches to the dense
+// representation once more than 1/kDenseRatio of its dim() elements
+// are non-zero, and back to the sparse one once fewer than
+// 1/kSparseRatio are; the gap keeps a vector whose density is near a
+// threshold from switching back and forth.
+//
+// Operations below accept operands in either representation.  Those
+// writing a dense result keep it dense, as counting its non-zero
+// elements takes one more pass over it; code that expects a result to
+// become sparse, like the learner after each step, calls Adapt().
+//
+// A HybridRealVector writes the same records as DenseRealVector.
+//---------------------------------------------------------------------------
+class HybridRealVector {
+ public:
+  static const size_t kDenseRatio = 4;
+  static const size_t kSparseRatio = 8;
+
+  HybridRealVector() : dim_(0), is_dense_(false) {}
+
+  // Elements of indices in [0, dim()) may be non-zero.
+  size_t dim() const { return dim_; }
+  bool is_dense() const { return is_dense_; }
+  size_t NumNonZeros() const;
+
+  double operator[](IndexType index) const {
+    if (is_dense_) {
+      return index < dense_.size() ? dense_[index] : 0;
+    }
+    return sparse_[index];
+  }
+
+  // The storage in use is dense() if is_dense(), or sparse() otherwise.
+  // Call Adapt() after changing it through mutable_sparse() or
+  // mutable_dense().
+  const SparseRealVector& sparse() const { return sparse_; }
+  const DenseRealVector& dense() const { return dense_; }
+  SparseRealVector* mutable_sparse() {
+    CHECK(!is_dense_);
+    return &sparse_;
+  }
+  DenseRealVector* mutable_dense() {
+    CHECK(is_dense_);
+    return &dense_;
+  }
+
+  // Switches to the sparse or the dense representation of |dim|
+  // elements, and returns the storage for the caller to fill in.  The
+  // sparse storage is empty, while values in the dense storage are
+  // unspecified, so the caller must write all of them.  Call Adapt()
+  // when done.
+  SparseRealVector* ResetSparse(size_t dim);
+  DenseRealVector* ResetDense(size_t dim);
+
+  void ToSparse();
+  void ToDense();
+
+  // Extends dim() to cover all elements in the storage, and switches
+  // the representation if the density calls for it.
+  void Adapt();
+
+  // Sets dim() to |dim|, dropping elements of larger indices.
+  void resize(size_t dim);
+  void clear() { ResetSparse(0); }
+  void swap(HybridRealVector& other);
+
+  void SerializeToProtoBuf(RealVectorPB* pb) const;
+  void SerializeToRecordIO(MRMLFS_File* file,
+                           const std::string& key_base) const;
+  void ParseFromProtoBuf(const RealVectorPB& pb);
+  void ParseFromRecordIO(MRMLFS_File* file,
+                         const std::string& key_base, int32& vec_size);
+
+  // Visits the non-zero elements in increasing order of indices.
+  class Iterator {
+   public:
+    explicit Iterator(const HybridRealVector& v) : v_(v), k_(0) {
+      SkipZeros();
+    }
+    bool Done() const {
+      return k_ == (v_.is_dense_ ? v_.dense_.size() : v_.sparse_.size());
+    }
+    IndexType index() const {
+      return v_.is_dense_ ? k_ : v_.sparse_.index(k_);
+    }
+    double value() const {
+      return v_.is_dense_ ? v_.dense_[k_] : v_.sparse_.value(k_);
+    }
+    void Next() {
+      ++k_;
+      SkipZeros();
+    }
+
+   private:
+    void SkipZeros() {
+      if (v_.is_dense_) {
+        while (k_ < v_.dense_.size() && v_.dense_[k_] == 0) {
+          ++k_;
+        }
+      }
+    }
+
+    const HybridRealVector& v_;
+    size_t k_;
+  };
+
+  // Looks up elements in increasing order of indices, which costs O(1)
+  // amortized per element in either representation.
+  class Reader {
+   public:
+    explicit Reader(const HybridRealVector& v) : v_(v), k_(0) {}
+
+    // Returns the element of |index|, which must not be less than that
+    // of the previous call.
+    double Get(IndexType index) {
+      if (v_.is_dense_) {
+        return index < v_.dense_.size() ? v_.dense_[index] : 0;
+      }
+      const SparseRealVector& sparse = v_.sparse_;
+      while (k_ < sparse.size() && sparse.index(k_) < index) {
+        ++k_;
+      }
+      if (k_ < sparse.size() && sparse.index(k_) == index) {
+        return sparse.value(k_);
+      }
+      return 0;
+    }
+
+   private:
+    const HybridRealVector& v_;
+    size_t k_;
+  };
+
+ private:
+  SparseRealVector sparse_;
+  DenseRealVector dense_;
+  size_t dim_;
+  bool is_dense_;
+};
+
+//---------------------------------------------------------------------------
+// Vector operations that accept HybridRealVectors in either
+// representation.  They run dense kernels if all operands are dense,
+// and otherwise the sparse or the mixed operations above.
+//---------------------------------------------------------------------------
+double DotProduct(const HybridRealVector& u, const HybridRealVector& v);
+double DotProduct(const SparseRealVector& sv, const HybridRealVector& hv);
+
+// v <- v * c
+void Scale(HybridRealVector* v, double c);
+
+// u <- v * c
+void ScaleInto(HybridRealVector* u, const HybridRealVector& v, double c);
+
+// u <- u + v * c
+void AddScaled(HybridRealVector* u, const HybridRealVector& v, double c);
+
+// w <- u + v * c, where w must not be u or v.
+void AddScaledInto(HybridRealVector* w,
+                   const HybridRealVector& u,
+                   const HybridRealVector& v,
+                   double c);
+
+// w[i] <- op(u[i], v[i]) for every i, where op(0, 0) must be 0, so only
+// elements non-zero in u or v are visited if both are sparse.  The
+// result is dense if u or v is dense, before it is adapted to its
+// density.  w must not be u or v.
+template <class Op>
+void TransformElements(const HybridRealVector& u,
+                       const HybridRealVector& v,
+                       const Op& op,
+                       HybridRealVector* w) {
+  CHECK(w != &u && w != &v);
+  size_t dim = std::max(u.dim(), v.dim());
+  if (u.is_dense() || v.is_dense()) {
+    DenseRealVector& out = *w->ResetDense(dim);
+    HybridRealVector::Reader u_reader(u);
+    HybridRealVector::Reader v_reader(v);
+    for (size_t i = 0; i < dim; ++i) {
+      out[i] = op(u_reader.Get(i), v_reader.Get(i));
+    }
+  } else {
+    SparseRealVector& out = *w->ResetSparse(dim);
+    const SparseRealVector& a = u.sparse();
+    const SparseRealVector& b = v.sparse();
+    out.reserve(a.size() + b.size());
+    size_t i = 0;
+    size_t j = 0;
+    while (i < a.size() || j < b.size()) {
+      if (j == b.size() || (i < a.size() && a.index(i) < b.index(j))) {
+        out.append(a.index(i), op(a.value(i), 0.0));
+        ++i;
+      } else if (i == a.size() || b.index(j) < a.index(i)) {
+        out.append(b.index(j), op(0.0, b.value(j)));
+        ++j;
+      } else {
+        out.append(a.index(i), op(a.value(i), b.value(j)));
+        ++i;
+        ++j;
+      }
+    }
+  }
+  w->Adapt();
+}
+
+std::ostream& operator<<(std::ostream& output, const HybridRealVector& vec);
+
 }  // namespace logistic_regression
 
 #endif  // MRML_LASSO_VECTOR_TYPES_H_
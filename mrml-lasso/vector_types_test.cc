@@ -1,12 +1,16 @@
 
 
 //
+#include "mrml/mrml_filesystem.h"
 #include "mrml-lasso/logistic_regression.pb.h"
 #include "mrml-lasso/test_utils.h"
 #include "mrml-lasso/vector_types.h"
 
+using logistic_regression::AssignHybrid;
+using logistic_regression::ExpectHybridEq;
 using logistic_regression::RealVectorTestUtil;
 using logistic_regression::DenseRealVector;
+using logistic_regression::HybridRealVector;
 using logistic_regression::SparseRealVector;
 using logistic_regression::RealVectorPB;
 
@@ -66,3 +70,156 @@ TEST(VectorTypesTest, HybridAddScaled) {
   EXPECT_EQ(30, dv[2]);
   EXPECT_EQ(60, dv[3]);
 }
+
+TEST(VectorTypesTest, HybridRealVectorSerialization) {
+  RealVectorTestUtil<HybridRealVector> u;
+  HybridRealVector v;
+  u.Construct(&v);
+  EXPECT_TRUE(v.is_dense());
+
+  RealVectorPB pb;
+  v.SerializeToProtoBuf(&pb);
+  u.CheckProtoBuf(pb);
+
+  v.clear();
+  v.ParseFromProtoBuf(pb);
+  u.Check(v);
+
+  v.ToSparse();
+  v.SerializeToProtoBuf(&pb);
+  u.CheckProtoBuf(pb);
+}
+
+TEST(VectorTypesTest, HybridRealVectorAdapt) {
+  const size_t kDim = 100;
+  DenseRealVector values(kDim, 0);
+  for (size_t i = 0; i < kDim; i += 10) {
+    values[i] = i + 1;
+  }
+  HybridRealVector v;
+  AssignHybrid(values, false, &v);
+  v.Adapt();
+  EXPECT_FALSE(v.is_dense());
+  EXPECT_EQ(kDim, v.dim());
+  EXPECT_EQ(10, v.NumNonZeros());
+
+  // More than a quarter of elements are non-zero.
+  for (size_t i = 0; i < kDim; i += 3) {
+    values[i] = i + 1;
+  }
+  AssignHybrid(values, false, &v);
+  v.Adapt();
+  EXPECT_TRUE(v.is_dense());
+  ExpectHybridEq(values, v);
+
+  // A dense vector remains dense until fewer than an eighth of elements
+  // are non-zero.
+  HybridRealVector u;
+  values.assign(kDim, 0);
+  for (size_t i = 0; i < kDim; i += 5) {
+    values[i] = i + 1;
+  }
+  AssignHybrid(values, true, &u);
+  u.Adapt();
+  EXPECT_TRUE(u.is_dense());
+  Scale(&u, 0);
+  EXPECT_FALSE(u.is_dense());
+  EXPECT_EQ(kDim, u.dim());
+  EXPECT_EQ(0, u.NumNonZeros());
+
+  // Adapt extends dim to cover new elements.
+  u.mutable_sparse()->set(kDim + 10, 1);
+  u.Adapt();
+  EXPECT_EQ(kDim + 11, u.dim());
+  u.resize(kDim);
+  EXPECT_EQ(0, u.NumNonZeros());
+}
+
+// Operations on operands in every combination of representations give
+// the same results as those on DenseRealVector.
+TEST(VectorTypesTest, HybridRealVectorOperations) {
+  const size_t kDim = 37;
+  DenseRealVector a(kDim, 0);
+  DenseRealVector b(kDim, 0);
+  for (size_t i = 0; i < kDim; ++i) {
+    if (i % 3 == 0) {
+      a[i] = 0.5 * i - 3;
+    }
+    if (i % 4 != 1) {
+      b[i] = 7 - 0.25 * i;
+    }
+  }
+  DenseRealVector a_plus_2b(kDim, 0);
+  AddScaledInto(&a_plus_2b, a, b, 2);
+  DenseRealVector minus_b(kDim, 0);
+  ScaleInto(&minus_b, b, -1);
+
+  for (int mask = 0; mask < 4; ++mask) {
+    HybridRealVector u;
+    HybridRealVector v;
+    AssignHybrid(a, mask & 1, &u);
+    AssignHybrid(b, mask & 2, &v);
+
+    EXPECT_DOUBLE_EQ(DotProduct(a, b), DotProduct(u, v));
+    EXPECT_DOUBLE_EQ(DotProduct(b, b), DotProduct(v, v));
+
+    HybridRealVector w;
+    AddScaledInto(&w, u, v, 2);
+    ExpectHybridEq(a_plus_2b, w);
+
+    ScaleInto(&w, v, -1);
+    ExpectHybridEq(minus_b, w);
+
+    AddScaled(&u, v, 2);
+    ExpectHybridEq(a_plus_2b, u);
+    EXPECT_EQ(kDim, u.dim());
+  }
+
+  SparseRealVector sv;
+  sv.set(3, 2);
+  sv.set(8, -1);
+  sv.set(kDim + 5, 100);
+  for (int dense = 0; dense < 2; ++dense) {
+    HybridRealVector v;
+    AssignHybrid(b, dense, &v);
+    EXPECT_DOUBLE_EQ(2 * b[3] - b[8], DotProduct(sv, v));
+  }
+}
+
+TEST(VectorTypesTest, HybridRealVectorRecordIO) {
+  static const char* kTempFile = "/tmp/HybridRealVectorRecordIO";
+  const size_t kDim = 50;
+  DenseRealVector values(kDim, 0);
+  values[3] = 3;
+  values[49] = -49;
+
+  for (int dense = 0; dense < 2; ++dense) {
+    {
+      HybridRealVector v;
+      AssignHybrid(values, dense, &v);
+      MRMLFS_File out(kTempFile, false);
+      CHECK(out.IsOpen());
+      v.SerializeToRecordIO(&out, "v");
+    }
+    {
+      HybridRealVector v;
+      int32 vec_size = 0;
+      MRMLFS_File in(kTempFile, true);
+      v.ParseFromRecordIO(&in, "v", vec_size);
+      EXPECT_EQ(2, vec_size);
+      EXPECT_EQ(kDim, v.dim());
+      EXPECT_FALSE(v.is_dense());
+      ExpectHybridEq(values, v);
+    }
+    {
+      // DenseRealVector reads the same records.
+      DenseRealVector v;
+      int32 vec_size = 0;
+      MRMLFS_File in(kTempFile, true);
+      v.ParseFromRecordIO(&in, "v", vec_size);
+      EXPECT_EQ(2, vec_size);
+      EXPECT_EQ(kDim, v.size());
+      EXPECT_EQ(-49, v[49]);
+    }
+  }
+}
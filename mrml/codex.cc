@@ -11,6 +11,8 @@
 /*
   codex --message_name=<a-message-name> \
         --protofile=<a-.proto-file>     \
+        [--first_record=<n>]            \
+        [--num_records=<m>]             \
         <one-or-more-data-files>
 */
 // Each file among the <one-or-more-data-files> should be a RecordIO
@@ -18,6 +20,11 @@
 // {message_size,KeyValuePair_message} pairs, and the value of
 // KeyValuePair is an serialized protobuf message <a-message-name>
 // defined in <a-.proto-file>.
+//
+// With --first_record and --num_records, codex prints only records
+// [n, n + m) of each file.  If a file has a record index (c.f.
+// mrml_record_index.h), codex seeks to record n directly; otherwise,
+// it reads through the records before n.
 
 #include <stdio.h>              // For FILE* fopen and fileno().
 
@@ -36,6 +43,7 @@
 #include "google/protobuf/io/zero_copy_stream_impl.h"
 
 #include "base/common.h"
+#include "mrml/mrml_record_index.h"
 #include "mrml/mrml_recordio.h"
 #include "mrml/mrml.pb.h"
 
@@ -50,6 +58,8 @@ using std::vector;
 void ParseCmdLine(int argc, char** argv,
                   string* proto_filename,
                   string* message_name,
+                  uint64* first_record,
+                  int64* num_records,
                   vector<string>* data_filenames) {
   namespace po = boost::program_options;
 
@@ -62,6 +72,12 @@ void ParseCmdLine(int argc, char** argv,
     ("message",
      po::value<string>(message_name),
      "the message defined in .proto file")
+    ("first_record",
+     po::value<uint64>(first_record)->default_value(0),
+     "the ordinal of the first record to be printed")
+    ("num_records",
+     po::value<int64>(num_records)->default_value(-1),
+     "the number of records to be printed, or all if negative")
     ("datafile",
      po::value<vector<string> >(data_filenames),
      "the data file to be dumped");
@@ -139,7 +155,9 @@ void GetMessageTypeFromProtoFile(const string& proto_filename,
 //-----------------------------------------------------------------------------
 void PrintDataFile(const string& data_filename,
                    const FileDescriptorProto& file_desc_proto,
-                   const string& message_name) {
+                   const string& message_name,
+                   uint64 first_record,
+                   int64 num_records) {
   FILE* input_stream = fopen(data_filename.c_str(), "r");
   if (input_stream == NULL) {
     LOG(FATAL) << "Cannot open data file: " << data_filename;
@@ -170,8 +188,26 @@ void PrintDataFile(const string& data_filename,
     LOG(FATAL) << "Failed in prototype_msg->New(); to create mutable message";
   }
 
+  MRML_RecordStreamReader reader(input_stream);
   string key, value;
-  while (MRML_ReadRecord(input_stream, &key, &value)) {
+  if (first_record > 0) {
+    MRML_RecordIndex index;
+    if (!index.Load(data_filename) ||
+        !reader.SeekToRecord(index, first_record)) {
+      // Skip from the beginning, where a failed seek may have left.
+      if (!reader.Rewind()) {
+        LOG(FATAL) << "Cannot rewind " << data_filename;
+      }
+      for (uint64 i = 0; i < first_record; ++i) {
+        if (!reader.Read(&key, &value)) {
+          break;
+        }
+      }
+    }
+  }
+  for (int64 i = 0;
+       (num_records < 0 || i < num_records) && reader.Read(&key, &value);
+       ++i) {
     if (!mutable_msg->ParseFromString(value)) {
       LOG(FATAL) << "Failed to parse value in KeyValuePair:" << value;
     }
@@ -185,14 +221,18 @@ void PrintDataFile(const string& data_filename,
 
 int main(int argc, char** argv) {
   string proto_filename, message_name;
+  uint64 first_record;
+  int64 num_records;
   vector<string> data_filenames;
   FileDescriptorProto file_desc_proto;
 
-  ParseCmdLine(argc, argv, &proto_filename, &message_name, &data_filenames);
+  ParseCmdLine(argc, argv, &proto_filename, &message_name,
+               &first_record, &num_records, &data_filenames);
   GetMessageTypeFromProtoFile(proto_filename, &file_desc_proto);
 
   for (int i = 0; i < data_filenames.size(); ++i) {
-    PrintDataFile(data_filenames[i], file_desc_proto, message_name);
+    PrintDataFile(data_filenames[i], file_desc_proto, message_name,
+                  first_record, num_records);
   }
 
   return 0;
@@ -39,6 +39,8 @@
 // MR_Mapper is exactly MRML_Mapper.
 typedef MRML_Mapper MR_Mapper;
 
+// Reducers that only parse or sum values can use values->value_view()
+// instead of values->value() to avoid copying each value.
 typedef sorted_buffer::SortedBufferIterator ReduceInputIterator;
 
 class MR_Reducer : public MRML_Reducer {
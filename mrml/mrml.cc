@@ -5,10 +5,12 @@
 #include <stdio.h>
 #include <sys/utsname.h>                // For uname
 
+#include <algorithm>
 #include <map>
 #include <new>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "boost/program_options/option.hpp"
 #include "boost/program_options/options_description.hpp"
@@ -21,18 +23,24 @@
 #include "base/common.h"
 #include "sorted_buffer/sorted_buffer.h"
 #include "sorted_buffer/sorted_buffer_iterator.h"
+#include "strutil/join_strings.h"
+#include "strutil/split_string.h"
 #include "strutil/stringprintf.h"
 
 #include "hash/simple_hash.h"
 #include "mrml/mr.h"
+#include "mrml/mrml_filesystem.h"
 #include "mrml/mrml_reader.h"
+#include "mrml/mrml_record_index.h"
 #include "mrml/mrml_recordio.h"
+#include "mrml/mrml_recordio_v2.h"
 #include "mrml/mrml.pb.h"
 
 using sorted_buffer::SortedBuffer;
 using sorted_buffer::SortedBufferIteratorImpl;
 using std::map;
 using std::string;
+using std::vector;
 
 typedef ::google::protobuf::Message ProtoMessage;
 
@@ -49,7 +57,6 @@ static const char* kForbidOutputToShardInMapOnlyMode =
 const int kMapOutputTag = 1;
 const int kDefaultMapOutputSize = 32 * 1024 * 1024;  // 32 MB
 const int kDefaultReduceInputBufferSize = 256;       // 256 MB
-const int kMaxInputLineLength = 16 * 1024;           // 16 KB
 //-----------------------------------------------------------------------------
 // MRML mapper and reducer creators
 //-----------------------------------------------------------------------------
@@ -75,6 +82,26 @@ MRML_ReducerRegisterer::MRML_ReducerRegisterer(const string& class_name,
   GetMRMLReducerCreators()[class_name] = creator;
 }
 
+typedef map<string, MRML_ReaderCreator> MRMLReaderCreatorRegistory;
+
+MRMLReaderCreatorRegistory& GetMRMLReaderCreators() {
+  static MRMLReaderCreatorRegistory creators;
+  return creators;
+}
+
+MRML_ReaderRegisterer::MRML_ReaderRegisterer(const string& format_name,
+                                             MRML_ReaderCreator creator) {
+  GetMRMLReaderCreators()[format_name] = creator;
+}
+
+MRML_Reader* MRML_CreateReader(const string& format_name,
+                               const string& filename) {
+  MRMLReaderCreatorRegistory::iterator iter =
+      GetMRMLReaderCreators().find(format_name);
+  return (iter == GetMRMLReaderCreators().end()) ? NULL :
+      (*(iter->second))(filename);
+}
+
 MRML_Mapper* MRML_CreateMapper(const string& mapper_name) {
   MRMLMapperCreatorRegistory::iterator iter =
       GetMRMLMapperCreators().find(mapper_name);
@@ -177,15 +204,54 @@ DEFINE_bool(mrml_batch_reduction, false,
             "keys, it is necessary to set this flag and use traditional batch "
             "reduction.");
 DEFINE_string(mrml_reduce_input_buffer_filebase, "",
-              "The filebase of disk swap files used in batch reduction.");
+              "The filebase of disk swap files used in batch reduction.  "
+              "A comma-separated list of filebases on different disks "
+              "stripes swap files over these disks.");
 DEFINE_int32(mrml_reduce_input_buffer_size, kDefaultReduceInputBufferSize,
              "The size of each reduce input buffer swap file in MB.");
+DEFINE_bool(mrml_compress_reduce_input_buffer, true,
+            "Compress blocks of reduce input buffer swap files using zlib.");
+DEFINE_int32(mrml_reduce_input_buffer_sort_threads, 1,
+             "The number of threads used to sort the reduce input buffer "
+             "before writing it into a swap file.");
+DEFINE_string(mrml_reduce_input_buffer_placement, "round_robin",
+              "How to place swap files if there are multiple reduce input "
+              "buffer filebases: round_robin or free_space (weighted by the "
+              "free space of disks).");
+DEFINE_int32(mrml_read_ahead_batches, 4,
+             "The number of batches of input records read ahead by a "
+             "background thread of each map worker.  0 disables read-ahead.");
+DEFINE_int32(mrml_read_ahead_batch_size, 1024,
+             "The number of input records in a read-ahead batch.");
+DEFINE_bool(mrml_write_recordio_v2, false,
+            "If true, write recordio outputs in RecordIO v2 format, which is "
+            "block-structured, checksummed and compressed.  Inputs of both "
+            "v1 and v2 are always readable.");
+DEFINE_bool(mrml_compress_recordio_v2, true,
+            "Whether to compress blocks of RecordIO v2 outputs using zlib.");
+DEFINE_int32(mrml_recordio_v2_block_size, kDefaultRecordIOV2BlockSize,
+             "The size of uncompressed blocks in RecordIO v2 outputs.");
+DEFINE_int32(mrml_record_index_interval, 0,
+             "If positive, a recordio output gets a sidecar index (named "
+             "<output>.idx) of the position of every this many records, "
+             "for seeking to records and counting them without scanning.");
+DEFINE_string(mrml_remote_file_cache_dir, "",
+              "If not empty, a local directory where remote (SFTP) files read "
+              "by mappers and reducers, e.g., model states, are downloaded "
+              "once per host and shared by workers on the host.  Cached files "
+              "are not removed, so use a directory living with the job.");
+DEFINE_bool(mrml_local_file_direct_write, false,
+            "If true, local files written through MRMLFS_File, e.g., model "
+            "states, bypass the page cache by O_DIRECT, so that large "
+            "outputs do not evict cached inputs.");
 
 //-----------------------------------------------------------------------------
 // Map-only output:
 //-----------------------------------------------------------------------------
 FILE* g_map_only_output;
 FILE* g_reduce_output;
+MRML_RecordWriter* g_map_only_record_writer = NULL;
+MRML_RecordWriter* g_reduce_record_writer = NULL;
 
 //-----------------------------------------------------------------------------
 // Map-output counter:
@@ -217,6 +283,7 @@ char* g_map_output_recieve_buffer = NULL;
 //-----------------------------------------------------------------------------
 
 void MRML_InitializeLogDestinations();
+bool MRML_ExistFilesWithPrefix(const string& filebase);
 
 //-----------------------------------------------------------------------------
 // MRML implementation:
@@ -233,6 +300,12 @@ bool MRML_Initialize(int argc, char** argv) {
   // Initialize log and set log destination file.
   MRML_InitializeLogDestinations();
 
+  if (!FLAGS_mrml_remote_file_cache_dir.empty()) {
+    boost::filesystem::create_directories(FLAGS_mrml_remote_file_cache_dir);
+    MRMLFS_File::SetCacheDirectory(FLAGS_mrml_remote_file_cache_dir);
+  }
+  MRMLFS_File::SetLocalDirectWrite(FLAGS_mrml_local_file_direct_write);
+
   // Collect unparsed options into g_cmdline_args, which may be parsed
   // by mappers and reducers for application-specific options.
   namespace po = boost::program_options;
@@ -282,20 +355,43 @@ bool MRML_Initialize(int argc, char** argv) {
   // Check flags related with batch reduction.
   if (FLAGS_mrml_batch_reduction && !FLAGS_mrml_map_only) {
     CHECK(!FLAGS_mrml_reduce_input_buffer_filebase.empty());
-    if (boost::filesystem::exists(SortedBuffer::SortedFilename(
-            FLAGS_mrml_reduce_input_buffer_filebase, 0))) {
-      LOG(FATAL) << "Please delete existing reduce input buffer files: "
-                 << FLAGS_mrml_reduce_input_buffer_filebase << "* ";
+    vector<string> filebases;
+    SplitStringUsing(FLAGS_mrml_reduce_input_buffer_filebase, ",", &filebases);
+    // An empty filebase, e.g., after a trailing comma, would be a
+    // prefix of every file in the working directory.
+    size_t num_commas = std::count(
+        FLAGS_mrml_reduce_input_buffer_filebase.begin(),
+        FLAGS_mrml_reduce_input_buffer_filebase.end(), ',');
+    bool has_empty_filebase = (filebases.size() != num_commas + 1);
+    for (int i = 0; i < filebases.size(); ++i) {
+      has_empty_filebase = has_empty_filebase || filebases[i].empty();
     }
+    if (has_empty_filebase) {
+      LOG(FATAL) << "Empty filebase in --mrml_reduce_input_buffer_filebase: \""
+                 << FLAGS_mrml_reduce_input_buffer_filebase << "\"";
+    }
+    for (int i = 0; i < filebases.size(); ++i) {
+      // Buffer files are named by MRML_ReduceInputBufferFilebase and
+      // SortedBuffer::SortedFilename, and striped over all filebases,
+      // so any file with the filebase as prefix may be a stale one.
+      if (MRML_ExistFilesWithPrefix(filebases[i])) {
+        LOG(FATAL) << "Please delete existing reduce input buffer files: "
+                   << filebases[i] << "* ";
+      }
+    }
+    CHECK(FLAGS_mrml_reduce_input_buffer_placement == "round_robin" ||
+          FLAGS_mrml_reduce_input_buffer_placement == "free_space");
     CHECK_LE(1, FLAGS_mrml_reduce_input_buffer_size);    // 1 MB at least
     CHECK_GE(2 * 1024 * 1024,
              FLAGS_mrml_reduce_input_buffer_size);       // 2TB at most
     FLAGS_mrml_reduce_input_buffer_size *= 1024 * 1024;  // unit in MB.
+    CHECK_LE(1, FLAGS_mrml_reduce_input_buffer_sort_threads);
   }
 
   // Set input file format.
   if (FLAGS_mrml_input_format != "text" &&
-      FLAGS_mrml_input_format != "recordio") {
+      FLAGS_mrml_input_format != "recordio" &&
+      GetMRMLReaderCreators().count(FLAGS_mrml_input_format) == 0) {
     FLAGS_mrml_input_format = "text";
     LOG(ERROR) << "Unknown input_format: " << FLAGS_mrml_input_format
                << ". Use the default format: text";
@@ -413,10 +509,33 @@ void MRML_InitializeLogDestinations() {
 
 string MRML_ReduceInputBufferFilebase() {
   CHECK(!MRML_AmIMapWorker());       // This must be a reduce worker.
-  return StringPrintf("%s-reducer-%05d-of-%05d",
-                      FLAGS_mrml_reduce_input_buffer_filebase.c_str(),
-                      MRML_ReduceWorkerId(),
-                      FLAGS_mrml_num_reduce_workers);
+  vector<string> filebases;
+  SplitStringUsing(FLAGS_mrml_reduce_input_buffer_filebase, ",", &filebases);
+  for (int i = 0; i < filebases.size(); ++i) {
+    filebases[i] = StringPrintf("%s-reducer-%05d-of-%05d",
+                                filebases[i].c_str(),
+                                MRML_ReduceWorkerId(),
+                                FLAGS_mrml_num_reduce_workers);
+  }
+  return JoinStrings(filebases, ",");
+}
+
+bool MRML_ExistFilesWithPrefix(const string& filebase) {
+  namespace fs = boost::filesystem;
+  fs::path dir = fs::path(filebase).parent_path();
+  if (dir.empty()) {
+    dir = ".";
+  }
+  string prefix = fs::path(filebase).filename().string();
+  if (!fs::is_directory(dir)) {
+    return false;
+  }
+  for (fs::directory_iterator i(dir); i != fs::directory_iterator(); ++i) {
+    if (i->path().filename().string().compare(0, prefix.size(), prefix) == 0) {
+      return true;
+    }
+  }
+  return false;
 }
 
 void MRML_MapWorkerNotifyFinished() {
@@ -455,7 +574,7 @@ void MRML_Mapper::Output(const string& key,
     if (FLAGS_mrml_output_format == "text") {
       MRML_WriteText(g_map_only_output, key, value);
     } else if (FLAGS_mrml_output_format == "recordio") {
-      MRML_WriteRecord(g_map_only_output, key, value);
+      g_map_only_record_writer->Write(key, value);
     }
   } else {
     MapOutput mo;
@@ -505,7 +624,7 @@ void MRML_Mapper::Output(const string& key,
     if (FLAGS_mrml_output_format == "text") {
       MRML_WriteText(g_map_only_output, key, value);
     } else if (FLAGS_mrml_output_format == "recordio") {
-      MRML_WriteRecord(g_map_only_output, key, value);
+      g_map_only_record_writer->Write(key, value);
     }
   } else {
     MapOutput mo;
@@ -586,6 +705,23 @@ void MRML_Mapper::OutputToAllShards(const string& key,
   g_count_map_output += GetNumReduceShards();
 }
 
+// Creates the writer of recordio outputs into |output|.  With text
+// outputs, the writer is never used and writes nothing.
+MRML_RecordWriter* MRML_NewOutputRecordWriter(FILE* output) {
+  MRML_RecordWriter* writer =
+      new MRML_RecordWriter(output,
+                            FLAGS_mrml_write_recordio_v2 &&
+                            FLAGS_mrml_output_format == "recordio",
+                            FLAGS_mrml_recordio_v2_block_size,
+                            FLAGS_mrml_compress_recordio_v2);
+  if (FLAGS_mrml_record_index_interval > 0 &&
+      FLAGS_mrml_output_format == "recordio") {
+    writer->BuildIndex(MRML_RecordIndexFilename(MRML_OutputFilename()),
+                       FLAGS_mrml_record_index_interval);
+  }
+  return writer;
+}
+
 void MRML_MapWork() {
   // In map-only mode, map workers take the responsibility to create
   // the output shard file.
@@ -597,6 +733,7 @@ void MRML_MapWork() {
       LOG(FATAL) << "Cannot open reduce output shard file: "
                  << MRML_OutputFilename();
     }
+    g_map_only_record_writer = MRML_NewOutputRecordWriter(g_map_only_output);
   }
 
   // Clear counters.
@@ -610,12 +747,22 @@ void MRML_MapWork() {
     g_mapper->Start();
 
     LOG(INFO) << "I read from " << MRML_InputFilename() << " in pass " << pass;
-    MRML_Reader* reader =
-        ((FLAGS_mrml_input_format == "text") ?
-         reinterpret_cast<MRML_Reader*>(
-             new MRML_TextReader(MRML_InputFilename(), kMaxInputLineLength)) :
-         reinterpret_cast<MRML_Reader*>(
-             new MRML_RecordReader(MRML_InputFilename())));
+    MRML_Reader* reader = NULL;
+    if (FLAGS_mrml_input_format == "text") {
+      reader = new MRML_TextReader(MRML_InputFilename(),
+                                   g_mapper->UsesInputKey());
+    } else if (FLAGS_mrml_input_format == "recordio") {
+      reader = new MRML_RecordReader(MRML_InputFilename());
+    } else {
+      reader = MRML_CreateReader(FLAGS_mrml_input_format,
+                                 MRML_InputFilename());
+      CHECK_NOTNULL(reader);
+    }
+    if (FLAGS_mrml_read_ahead_batches > 0) {
+      reader = new MRML_ReadAheadReader(reader,
+                                        FLAGS_mrml_read_ahead_batches,
+                                        FLAGS_mrml_read_ahead_batch_size);
+    }
     string key, value;
 
     while (true) {
@@ -641,6 +788,18 @@ void MRML_MapWork() {
             << " count_flush = " << count_flush << "\n"
             << " count_map_output = " << g_count_map_output;
 
+  if (g_map_only_record_writer != NULL) {
+    // ferror reports failed writes of text outputs, which fclose does not.
+    if (!g_map_only_record_writer->Close() || ferror(g_map_only_output) ||
+        fclose(g_map_only_output) != 0) {
+      LOG(FATAL) << "Failed in writing output shard file: "
+                 << MRML_OutputFilename();
+    }
+    delete g_map_only_record_writer;
+    g_map_only_record_writer = NULL;
+    g_map_only_output = NULL;
+  }
+
   // Important to tell reduce workers to terminate.
   MRML_MapWorkerNotifyFinished();
 }
@@ -656,6 +815,7 @@ void MRML_ReduceWork() {
     LOG(FATAL) << "Cannot open reduce output shard file: "
                << MRML_OutputFilename();
   }
+  g_reduce_record_writer = MRML_NewOutputRecordWriter(g_reduce_output);
 
   g_reducer->Start();
 
@@ -693,7 +853,12 @@ void MRML_ReduceWork() {
                 << FLAGS_mrml_reduce_input_buffer_size;
       reduce_input_buffer = new SortedBuffer(
           MRML_ReduceInputBufferFilebase(),
-          FLAGS_mrml_reduce_input_buffer_size);
+          FLAGS_mrml_reduce_input_buffer_size,
+          FLAGS_mrml_compress_reduce_input_buffer,
+          FLAGS_mrml_reduce_input_buffer_sort_threads,
+          FLAGS_mrml_reduce_input_buffer_placement == "free_space" ?
+          SortedBuffer::kFreeSpacePlacement :
+          SortedBuffer::kRoundRobinPlacement);
     } catch(const std::bad_alloc&) {
       LOG(FATAL) << "Insufficient memory for creating reduce input buffer.";
     }
@@ -792,11 +957,13 @@ void MRML_ReduceWork() {
     }
     LOG(INFO) << "Succeeded finalizing incremental reduction.";
   } else {
-    reduce_input_buffer->Flush();
-    LOG(INFO) << "Start batch reduction ...";
+    // The last run of reduce inputs is merged from memory, rather than
+    // being flushed to disk and read back.
+    LOG(INFO) << "Start batch reduction ... "
+              << reduce_input_buffer->NumFiles() << " buffer files on disk.";
     SortedBufferIteratorImpl* reduce_input_iterator =
         reinterpret_cast<SortedBufferIteratorImpl*>(
-            reduce_input_buffer->CreateIterator());
+            reduce_input_buffer->CreateInMemoryIterator());
     MR_Reducer* mr_reducer = reinterpret_cast<MR_Reducer*>(g_reducer);
     for (count_reduce = 0; !(reduce_input_iterator->FinishedAll());
          reduce_input_iterator->NextKey(), ++count_reduce) {
@@ -822,19 +989,29 @@ void MRML_ReduceWork() {
     LOG(INFO) << "Finished releasing_reduce_results.";
   } else {
     LOG(INFO) << "Removing reduce input files ...";
+    reduce_input_buffer->Clear();
     reduce_input_buffer->RemoveBufferFiles();
     delete reduce_input_buffer;
     LOG(INFO) << "Finished removing reduce input files.";
   }
 
   g_reducer->Flush();
+
+  if (!g_reduce_record_writer->Close() || ferror(g_reduce_output) ||
+      fclose(g_reduce_output) != 0) {
+    LOG(FATAL) << "Failed in writing output shard file: "
+               << MRML_OutputFilename();
+  }
+  delete g_reduce_record_writer;
+  g_reduce_record_writer = NULL;
+  g_reduce_output = NULL;
 }
 
 void MRML_Reducer::Output(const string& key, const string& value) {
   if (FLAGS_mrml_output_format == "text") {
     MRML_WriteText(g_reduce_output, key, value);
   } else if (FLAGS_mrml_output_format == "recordio") {
-    MRML_WriteRecord(g_reduce_output, key, value);
+    g_reduce_record_writer->Write(key, value);
   }
 }
 
@@ -863,7 +1040,16 @@ int MRML_Mapper::GetNumMapPasses() const {
 }
 
 MRML_FileFormat MRML_Mapper::GetInputFormat() const {
-  return FLAGS_mrml_input_format == "text" ? Text : RecordIO;
+  return FLAGS_mrml_input_format == "text" ? Text :
+      FLAGS_mrml_input_format == "recordio" ? RecordIO : UserDefined;
+}
+
+const string& MRML_Mapper::GetInputFormatName() const {
+  return FLAGS_mrml_input_format;
+}
+
+string MRML_Mapper::GetInputFilename() const {
+  return MRML_InputFilename();
 }
 
 MRML_FileFormat MRML_Mapper::GetOutputFormat() const {
@@ -23,7 +23,7 @@ class Message;
 // for more details with RecordIO format.
 //
 //-----------------------------------------------------------------------------
-enum MRML_FileFormat {Text, RecordIO};
+enum MRML_FileFormat {Text, RecordIO, UserDefined};
 
 //-----------------------------------------------------------------------------
 //
@@ -102,6 +102,10 @@ class MRML_Mapper {
   virtual void Flush() {}
   virtual int Shard(const string& key, int num_reduce_shards);
 
+  // Mappers who ignore the key passed to Map could override this to
+  // return false, so text input readers skip building keys.
+  virtual bool UsesInputKey() const { return true; }
+
  protected:
   virtual void Output(const string& key, const string& value);
   virtual void Output(const string& key,
@@ -118,6 +122,8 @@ class MRML_Mapper {
                                  const ::google::protobuf::Message& value_pb);
 
   MRML_FileFormat GetInputFormat() const;
+  const string& GetInputFormatName() const;
+  string GetInputFilename() const;       // The input shard of this worker.
   MRML_FileFormat GetOutputFormat() const;
   int GetNumMapPasses() const;
   int GetNumReduceShards() const;
@@ -272,6 +278,22 @@ class MRML_ReducerRegisterer {
   MRML_ReducerRegisterer(const string& class_name, MRML_ReducerCreator p);
 };
 
+// Besides text and recordio, user programs could define input formats,
+// by registering a function that creates an MRML_Reader of an input
+// file, e.g., REGISTER_READER("my_format", NewMyFormatReader); Then
+// --mrml_input_format=my_format selects it, and GetInputFormat()
+// returns UserDefined.
+class MRML_Reader;
+typedef MRML_Reader* (*MRML_ReaderCreator)(const string& filename);
+
+class MRML_ReaderRegisterer {
+ public:
+  MRML_ReaderRegisterer(const string& format_name, MRML_ReaderCreator p);
+};
+
+#define REGISTER_READER(format_name, creator)                           \
+  MRML_ReaderRegisterer g_reader_reg##creator(format_name, creator)
+
 #define REGISTER_MAPPER(mapper_name)                                    \
   MRML_Mapper* mapper_name##_creator() { return new mapper_name; }      \
   MRML_MapperRegisterer g_mapper_reg##mapper_name(#mapper_name,         \
@@ -2,21 +2,37 @@
 
 //
 #include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <pwd.h>
 #include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
+#include <algorithm>
+#include <map>
 #include <string>
 #include <vector>
 
 #include "boost/regex.hpp"
 
 #include "base/common.h"
+#include "hash/md5_hash.h"
 #include "strutil/split_string.h"
+#include "strutil/stringprintf.h"
+#include "system/mutex.h"
 #include "mrml/mrml_filesystem.h"
+#include "mrml/mrml_recordio.h"
 
+using std::map;
+using std::min;
 using std::string;
 using std::vector;
 
@@ -24,6 +40,23 @@ static const char* kFileProtocol = "file://";
 static const char* kSFTPProtocol = "sftp://";
 static const int   kDefaultSFTPPort = 22;
 
+// libssh2_sftp_read and libssh2_sftp_write split a large buffer into
+// many SFTP requests and send them without waiting for responses, so
+// a large buffer keeps the link busy during a transfer.
+static const size_t kSFTPBufferSize = 2 * 1024 * 1024;
+
+// A local file is read and written in large chunks, so that a system
+// call is amortized over many small records, and the disk sees long
+// sequential requests.
+static const size_t kLocalBufferSize = 4 * 1024 * 1024;
+
+// Buffers are aligned to pages, as O_DIRECT requires of both memory
+// and sizes of transfers.
+static const size_t kBufferAlignment = 4096;
+
+// The max number of idle sessions kept for each host.
+static const size_t kMaxIdleSFTPSessionsPerHost = 4;
+
 void MRMLFS_File::FilenameFields::Clear() {
   protocol.clear();
   username.clear();
@@ -115,21 +148,139 @@ static const char* GetHomeDir(const char* login_name) {
   return pwent.pw_dir;
 }
 
-MRMLFS_File::MRMLFS_File() {
-  local_file_ = NULL;
-  socket_fd_ = 0;
-  ssh2_session_ = NULL;
-  sftp_session_ = NULL;
-  sftp_handle_ = NULL;
+//-----------------------------------------------------------------------------
+// A pool of connected SSH and SFTP sessions, keyed by user, host and
+// port, so that opening many files on a host pays the TCP connection,
+// key exchange and authentication only once.
+//-----------------------------------------------------------------------------
+struct SFTPSession {
+  int              socket_fd;
+  LIBSSH2_SESSION* ssh2_session;
+  LIBSSH2_SFTP*    sftp_session;
+};
+
+static void DisconnectSession(const SFTPSession& session) {
+  if (session.sftp_session != NULL) {
+    libssh2_sftp_shutdown(session.sftp_session);
+  }
+  if (session.ssh2_session != NULL) {
+    libssh2_session_disconnect(session.ssh2_session, "shutdown");
+    libssh2_session_free(session.ssh2_session);
+  }
+  if (session.socket_fd > 0) {
+    close(session.socket_fd);
+  }
 }
 
-MRMLFS_File::MRMLFS_File(const string& filename, bool for_read) {
-  local_file_ = NULL;
+class SFTPSessionPool {
+ public:
+  SFTPSessionPool() {}
+  ~SFTPSessionPool() { Clear(); }
+
+  // Takes out an idle session of |key|.  Returns false if none.
+  bool Take(const string& key, SFTPSession* session) {
+    MutexLocker locker(&mutex_);
+    SessionMap::iterator iter = sessions_.find(key);
+    if (iter == sessions_.end() || iter->second.empty()) {
+      return false;
+    }
+    *session = iter->second.back();
+    iter->second.pop_back();
+    return true;
+  }
+
+  // Keeps |session| for reuse, or disconnects it if there have been
+  // enough idle sessions of |key|.
+  void Put(const string& key, const SFTPSession& session) {
+    {
+      MutexLocker locker(&mutex_);
+      vector<SFTPSession>& idle = sessions_[key];
+      if (idle.size() < kMaxIdleSFTPSessionsPerHost) {
+        idle.push_back(session);
+        return;
+      }
+    }
+    DisconnectSession(session);
+  }
+
+  void Clear() {
+    MutexLocker locker(&mutex_);
+    for (SessionMap::iterator i = sessions_.begin(); i != sessions_.end(); ++i) {
+      for (size_t j = 0; j < i->second.size(); ++j) {
+        DisconnectSession(i->second[j]);
+      }
+    }
+    sessions_.clear();
+  }
+
+ private:
+  typedef map<string, vector<SFTPSession> > SessionMap;
+  Mutex mutex_;
+  SessionMap sessions_;
+
+  DISALLOW_COPY_AND_ASSIGN(SFTPSessionPool);
+};
+
+static SFTPSessionPool* GetSFTPSessionPool() {
+  static SFTPSessionPool pool;
+  return &pool;
+}
+
+/*static*/
+void MRMLFS_File::CloseIdleSFTPSessions() {
+  GetSFTPSessionPool()->Clear();
+}
+
+static string* GetCacheDirectory() {
+  static string dir;
+  return &dir;
+}
+
+/*static*/
+void MRMLFS_File::SetCacheDirectory(const string& dir) {
+  *GetCacheDirectory() = dir;
+}
+
+static bool* GetLocalDirectWrite() {
+  static bool direct = false;
+  return &direct;
+}
+
+/*static*/
+void MRMLFS_File::SetLocalDirectWrite(bool direct) {
+  *GetLocalDirectWrite() = direct;
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of MRMLFS_File
+//-----------------------------------------------------------------------------
+void MRMLFS_File::Initialize() {
+  local_fd_ = -1;
+  direct_write_ = false;
+  local_offset_ = 0;
   socket_fd_ = 0;
   ssh2_session_ = NULL;
   sftp_session_ = NULL;
   sftp_handle_ = NULL;
+  for_read_ = true;
+  buffer_ = NULL;
+  buffer_size_ = 0;
+  buffer_begin_ = 0;
+  buffer_end_ = 0;
+  cached_ = false;
+  mapped_data_ = NULL;
+  mapped_size_ = 0;
+  mapped_offset_ = 0;
+  record_reader_ = NULL;
+  write_failed_ = false;
+}
+
+MRMLFS_File::MRMLFS_File() {
+  Initialize();
+}
 
+MRMLFS_File::MRMLFS_File(const string& filename, bool for_read) {
+  Initialize();
   if (!Open(filename, for_read)) {
     LOG(ERROR) << "Cannot open: " << filename;
   }
@@ -139,10 +290,18 @@ MRMLFS_File::~MRMLFS_File() {
   if (IsOpen()) {
     Close();
   }
+  delete record_reader_;
+}
+
+MRML_RecordStreamReader* MRMLFS_File::record_reader() {
+  if (record_reader_ == NULL) {
+    record_reader_ = new MRML_RecordStreamReader(this);
+  }
+  return record_reader_;
 }
 
 bool MRMLFS_File::IsOpen() const {
-  return local_file_ != NULL || sftp_handle_ != NULL;
+  return local_fd_ >= 0 || sftp_handle_ != NULL || cached_;
 }
 
 bool MRMLFS_File::Open(const std::string& filename, bool for_read) {
@@ -151,6 +310,9 @@ bool MRMLFS_File::Open(const std::string& filename, bool for_read) {
   if (fields.protocol == kFileProtocol) {
     return OpenLocalFile(fields, for_read);
   } else if (fields.protocol == kSFTPProtocol) {
+    if (for_read && !GetCacheDirectory()->empty()) {
+      return OpenCachedSFTPFile(fields);
+    }
     return OpenSFTPFile(fields, for_read);
   }
   LOG(ERROR) << "Unknown protocol: " << fields.protocol;
@@ -159,9 +321,34 @@ bool MRMLFS_File::Open(const std::string& filename, bool for_read) {
 
 bool MRMLFS_File::OpenLocalFile(const MRMLFS_File::FilenameFields& fields,
                                 bool for_read) {
-  CHECK(local_file_ == NULL);
-  local_file_ = fopen(fields.path.c_str(), for_read ? "r" : "w+");
-  return local_file_ != NULL;
+  CHECK_LT(local_fd_, 0);
+  const char* path = fields.path.c_str();
+  if (for_read) {
+    local_fd_ = open(path, O_RDONLY);
+  } else {
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    if (*GetLocalDirectWrite()) {
+      local_fd_ = open(path, flags | O_DIRECT, 0666);
+      direct_write_ = local_fd_ >= 0;
+    }
+    if (local_fd_ < 0) {
+      // Falls back to the page cache, e.g., on tmpfs.
+      local_fd_ = open(path, flags, 0666);
+    }
+  }
+  if (local_fd_ < 0) {
+    return false;
+  }
+  if (for_read) {
+    // Enlarges the readahead window of the kernel, and starts reading
+    // the first buffer.
+    posix_fadvise(local_fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(local_fd_, 0, kLocalBufferSize, POSIX_FADV_WILLNEED);
+  }
+  for_read_ = for_read;
+  local_offset_ = 0;
+  AllocateBuffer(kLocalBufferSize);
+  return true;
 }
 
 bool MRMLFS_File::OpenSFTPFile(const MRMLFS_File::FilenameFields& fields,
@@ -171,6 +358,60 @@ bool MRMLFS_File::OpenSFTPFile(const MRMLFS_File::FilenameFields& fields,
   CHECK(sftp_session_ == NULL);
   CHECK(sftp_handle_  == NULL);
 
+  const char* username =
+    fields.username.empty() ? GetUsername() : fields.username.c_str();
+  sftp_session_key_ = StringPrintf("%s@%s#%d", username,
+                                   fields.hostname.c_str(), fields.port);
+
+  // Try an idle session of the host first.  If it has been closed by
+  // the server, fall back to a new session.
+  bool reused = false;
+  for (int attempt = 0; attempt < 2 && sftp_handle_ == NULL; ++attempt) {
+    SFTPSession session;
+    if (attempt == 0 &&
+        GetSFTPSessionPool()->Take(sftp_session_key_, &session)) {
+      socket_fd_ = session.socket_fd;
+      ssh2_session_ = session.ssh2_session;
+      sftp_session_ = session.sftp_session;
+      reused = true;
+    } else if (attempt == 0 || reused) {
+      if (!ConnectSFTPSession(fields)) {
+        DisconnectSFTPSession();
+        return false;
+      }
+    } else {
+      break;
+    }
+
+    // Request a file via SFTP.
+    sftp_handle_ = libssh2_sftp_open(sftp_session_,
+                                     fields.path.c_str(),
+                                     (for_read ? LIBSSH2_FXF_READ :
+                                      (LIBSSH2_FXF_WRITE|
+                                       LIBSSH2_FXF_CREAT|
+                                       LIBSSH2_FXF_TRUNC)),
+                                     (for_read ? 0 :
+                                      (LIBSSH2_SFTP_S_IRUSR|
+                                       LIBSSH2_SFTP_S_IWUSR|
+                                       LIBSSH2_SFTP_S_IRGRP|
+                                       LIBSSH2_SFTP_S_IROTH)));
+    if (sftp_handle_ == NULL) {
+      DisconnectSFTPSession();
+    }
+  }
+
+  if (sftp_handle_ == NULL) {
+    LOG(ERROR) << "Unable to open SFTP file: " << fields.path
+               << (for_read ? " for read" : " for write");
+    return false;
+  }
+
+  for_read_ = for_read;
+  AllocateBuffer(kSFTPBufferSize);
+  return true;
+}
+
+bool MRMLFS_File::ConnectSFTPSession(const MRMLFS_File::FilenameFields& fields) {
   // Resolve hostname into sockaddr.
   addrinfo hints;
   memset(&hints, 0, sizeof(hints));
@@ -191,11 +432,15 @@ bool MRMLFS_File::OpenSFTPFile(const MRMLFS_File::FilenameFields& fields,
 
   sockaddr_in* in = reinterpret_cast<sockaddr_in*>(resolved_addrinfo->ai_addr);
   in->sin_port = htons(fields.port);
-  if (connect(socket_fd_,
-              resolved_addrinfo->ai_addr,
-              sizeof(struct sockaddr_in)) != 0) {
+  bool connected = connect(socket_fd_,
+                           resolved_addrinfo->ai_addr,
+                           sizeof(struct sockaddr_in)) == 0;
+  if (!connected) {
     LOG(ERROR) << "Socket API failed to connect to "
                << resolved_addrinfo->ai_canonname;
+  }
+  freeaddrinfo(resolved_addrinfo);
+  if (!connected) {
     return false;
   }
 
@@ -212,7 +457,7 @@ bool MRMLFS_File::OpenSFTPFile(const MRMLFS_File::FilenameFields& fields,
   // setup crypto, compression, and MAC layers
   if (libssh2_session_startup(ssh2_session_, socket_fd_) != 0) {
     LOG(ERROR) << "Failure establishing SSH session.";
-    return -1;
+    return false;
   }
 
   const char* username =
@@ -220,9 +465,12 @@ bool MRMLFS_File::OpenSFTPFile(const MRMLFS_File::FilenameFields& fields,
 
   if (fields.password.empty()) {
     // If no password specified, autheticate using public/private key pair.
-    string home_dir = GetHomeDir(username);
-    string public_keyfile =  home_dir + "/.ssh/id_rsa.pub";
-    string private_keyfile = home_dir + "/.ssh/id_rsa";
+    const char* home_dir = GetHomeDir(username);
+    if (home_dir == NULL) {
+      return false;
+    }
+    string public_keyfile =  string(home_dir) + "/.ssh/id_rsa.pub";
+    string private_keyfile = string(home_dir) + "/.ssh/id_rsa";
     if (libssh2_userauth_publickey_fromfile(ssh2_session_,
                                             username,
                                             public_keyfile.c_str(),
@@ -248,71 +496,426 @@ bool MRMLFS_File::OpenSFTPFile(const MRMLFS_File::FilenameFields& fields,
     LOG(ERROR) << "Unable to init SFTP session";
     return false;
   }
+  return true;
+}
 
-  // Request a file via SFTP.
-  if ((sftp_handle_ = libssh2_sftp_open(sftp_session_,
-                                        fields.path.c_str(),
-                                        (for_read ? LIBSSH2_FXF_READ :
-                                         (LIBSSH2_FXF_WRITE|
-                                          LIBSSH2_FXF_CREAT|
-                                          LIBSSH2_FXF_TRUNC)),
-                                        (for_read ? 0 :
-                                         (LIBSSH2_SFTP_S_IRUSR|
-                                          LIBSSH2_SFTP_S_IWUSR|
-                                          LIBSSH2_SFTP_S_IRGRP|
-                                          LIBSSH2_SFTP_S_IROTH)))) == NULL) {
-    LOG(ERROR) << "Unable to open SFTP file: " << fields.path
-               << (for_read ? " for read" : " for write");
+void MRMLFS_File::DisconnectSFTPSession() {
+  SFTPSession session = { socket_fd_, ssh2_session_, sftp_session_ };
+  DisconnectSession(session);
+  socket_fd_    = 0;
+  ssh2_session_ = NULL;
+  sftp_session_ = NULL;
+}
+
+bool MRMLFS_File::OpenCachedSFTPFile(const FilenameFields& fields) {
+  if (!OpenSFTPFile(fields, true)) {
     return false;
   }
 
-  freeaddrinfo(resolved_addrinfo);
+  // Name the cached copy by the remote file and its version.  If the
+  // server does not report the version, read the file without cache.
+  LIBSSH2_SFTP_ATTRIBUTES attrs;
+  if (libssh2_sftp_fstat(sftp_handle_, &attrs) != 0 ||
+      (attrs.flags & LIBSSH2_SFTP_ATTR_SIZE) == 0 ||
+      (attrs.flags & LIBSSH2_SFTP_ATTR_ACMODTIME) == 0) {
+    LOG(WARNING) << "Cannot stat " << fields.path << ", read without cache.";
+    return true;
+  }
+  string cache_filename = StringPrintf(
+      "%s/%016llx-%llu-%lu", GetCacheDirectory()->c_str(),
+      static_cast<unsigned long long>(                          // NOLINT
+          MD5Hash(sftp_session_key_ + ":" + fields.path)),
+      static_cast<unsigned long long>(attrs.filesize),          // NOLINT
+      attrs.mtime);
+
+  bool cached = access(cache_filename.c_str(), F_OK) == 0;
+  if (!cached) {
+    // The lock serializes processes on this host; the holder downloads
+    // the file and the others find it cached after the lock.
+    string lock_filename = cache_filename + ".lock";
+    int lock_fd = open(lock_filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (lock_fd < 0 || flock(lock_fd, LOCK_EX) != 0) {
+      LOG(ERROR) << "Cannot lock " << lock_filename;
+    } else {
+      cached = access(cache_filename.c_str(), F_OK) == 0 ||
+               DownloadSFTPFile(cache_filename, attrs.filesize);
+    }
+    if (lock_fd >= 0) {
+      close(lock_fd);  // Releases the lock.
+    }
+  }
+
+  Close();
+  if (!cached) {
+    LOG(ERROR) << "Cannot cache " << fields.path << " in " << cache_filename;
+    return false;
+  }
+  return MapCachedFile(cache_filename);
+}
+
+bool MRMLFS_File::DownloadSFTPFile(const string& filename,
+                                   uint64_t file_size) {
+  // Download into a temporary file, which is renamed after complete,
+  // so that a cached copy is never partial.
+  string temp_filename = StringPrintf("%s.%d", filename.c_str(), getpid());
+  FILE* output = fopen(temp_filename.c_str(), "w");
+  if (output == NULL) {
+    LOG(ERROR) << "Cannot create " << temp_filename;
+    return false;
+  }
+  // Read by RawRead, rather than Read, which tells errors from the end
+  // of file.  A download ending early is incomplete as well.
+  vector<char> buffer(kSFTPBufferSize);
+  uint64_t downloaded = 0;
+  ssize_t ret;
+  bool succeeded = true;
+  while ((ret = RawRead(&buffer[0], buffer.size())) > 0) {
+    if (fwrite(&buffer[0], 1, ret, output) != static_cast<size_t>(ret)) {
+      succeeded = false;
+      break;
+    }
+    downloaded += ret;
+  }
+  if (succeeded && (ret < 0 || downloaded != file_size)) {
+    LOG(ERROR) << "Downloaded " << downloaded << " of " << file_size
+               << " bytes into " << temp_filename;
+    succeeded = false;
+  }
+  succeeded = fclose(output) == 0 && succeeded;
+  if (!succeeded || rename(temp_filename.c_str(), filename.c_str()) != 0) {
+    LOG(ERROR) << "Failed writing " << temp_filename;
+    unlink(temp_filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool MRMLFS_File::MapCachedFile(const string& filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG(ERROR) << "Cannot open " << filename;
+    return false;
+  }
+  struct stat st;
+  bool succeeded = fstat(fd, &st) == 0;
+  mapped_size_ = succeeded ? st.st_size : 0;
+  if (mapped_size_ > 0) {
+    void* mapped = mmap(NULL, mapped_size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+      succeeded = false;
+    } else {
+      mapped_data_ = reinterpret_cast<char*>(mapped);
+      madvise(mapped_data_, mapped_size_, MADV_SEQUENTIAL);
+    }
+  }
+  close(fd);
+  if (!succeeded) {
+    LOG(ERROR) << "Cannot map " << filename;
+    mapped_size_ = 0;
+    return false;
+  }
+  cached_ = true;
+  mapped_offset_ = 0;
   return true;
 }
 
-void MRMLFS_File::Close() {
-  if (local_file_ != NULL) {
-    fclose(local_file_);
-    local_file_ = NULL;
+bool MRMLFS_File::Close() {
+  delete record_reader_;
+  record_reader_ = NULL;
+
+  // A failed Write fails Close as well, even if the rest is written.
+  bool succeeded = !write_failed_;
+  write_failed_ = false;
+  if (local_fd_ >= 0) {
+    if (!for_read_) {
+      if (direct_write_ && buffer_end_ % kBufferAlignment != 0) {
+        // O_DIRECT cannot write the unaligned tail of the file.
+        fcntl(local_fd_, F_SETFL, fcntl(local_fd_, F_GETFL) & ~O_DIRECT);
+      }
+      // RawWrite has logged the reason of a failure.
+      succeeded = FlushWriteBuffer() && succeeded;
+    }
+    if (close(local_fd_) != 0) {
+      LOG(ERROR) << "Failed in closing local file: " << strerror(errno);
+      succeeded = false;
+    }
+    local_fd_ = -1;
+    direct_write_ = false;
+    FreeBuffer();
+  } else if (cached_) {
+    if (mapped_data_ != NULL) {
+      munmap(mapped_data_, mapped_size_);
+    }
+    cached_ = false;
+    mapped_data_ = NULL;
+    mapped_size_ = 0;
+    mapped_offset_ = 0;
   } else if (sftp_handle_ != NULL) {
     CHECK_NE(socket_fd_, 0);
     CHECK(sftp_session_ != NULL);
     CHECK(ssh2_session_ != NULL);
 
-    libssh2_sftp_close(sftp_handle_);
-    libssh2_sftp_shutdown(sftp_session_);
-    libssh2_session_disconnect(ssh2_session_, "shutdown");
-    libssh2_session_free(ssh2_session_);
-    close(socket_fd_);
-
-    socket_fd_    = 0;
-    ssh2_session_ = NULL;
-    sftp_session_ = NULL;
+    bool healthy = for_read_ || FlushWriteBuffer();
+    healthy = libssh2_sftp_close(sftp_handle_) == 0 && healthy;
     sftp_handle_  = NULL;
+    succeeded = healthy && succeeded;
+
+    // Only a session without errors is safe to be reused.
+    if (healthy) {
+      SFTPSession session = { socket_fd_, ssh2_session_, sftp_session_ };
+      GetSFTPSessionPool()->Put(sftp_session_key_, session);
+      socket_fd_    = 0;
+      ssh2_session_ = NULL;
+      sftp_session_ = NULL;
+    } else {
+      DisconnectSFTPSession();
+    }
+    FreeBuffer();
   } else {
     LOG(ERROR) << "No file opened yet.";
+    succeeded = false;
+  }
+  return succeeded;
+}
+
+void MRMLFS_File::AllocateBuffer(size_t size) {
+  CHECK(buffer_ == NULL);
+  void* buffer = NULL;
+  CHECK_EQ(posix_memalign(&buffer, kBufferAlignment, size), 0);
+  buffer_ = static_cast<char*>(buffer);
+  buffer_size_ = size;
+  buffer_begin_ = 0;
+  buffer_end_ = 0;
+}
+
+void MRMLFS_File::FreeBuffer() {
+  free(buffer_);
+  buffer_ = NULL;
+  buffer_size_ = 0;
+  buffer_begin_ = 0;
+  buffer_end_ = 0;
+}
+
+ssize_t MRMLFS_File::RawRead(char* buffer, size_t size) {
+  if (local_fd_ >= 0) {
+    ssize_t ret;
+    do {
+      ret = read(local_fd_, buffer, size);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+      LOG(ERROR) << "read failed: " << strerror(errno);
+    } else {
+      local_offset_ += ret;
+    }
+    return ret;
+  }
+  ssize_t ret = libssh2_sftp_read(sftp_handle_, buffer, size);
+  if (ret < 0) {
+    LOG(ERROR) << "libssh2_sftp_read failed: " << ret;
+  }
+  return ret;
+}
+
+ssize_t MRMLFS_File::RawWrite(const char* buffer, size_t size) {
+  if (local_fd_ >= 0) {
+    ssize_t ret;
+    do {
+      ret = write(local_fd_, buffer, size);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+      LOG(ERROR) << "write failed: " << strerror(errno);
+    } else {
+      local_offset_ += ret;
+    }
+    return ret;
+  }
+  ssize_t ret = libssh2_sftp_write(sftp_handle_, buffer, size);
+  if (ret < 0) {
+    LOG(ERROR) << "libssh2_sftp_write failed: " << ret;
   }
+  return ret;
+}
+
+bool MRMLFS_File::WriteFully(const char* buffer, size_t size) {
+  size_t written = 0;
+  while (written < size) {
+    ssize_t ret = RawWrite(buffer + written, size - written);
+    if (ret <= 0) {
+      return false;
+    }
+    written += ret;
+  }
+  return true;
+}
+
+bool MRMLFS_File::WritevLocal(const char* buffer, size_t size) {
+  struct iovec iov[2];
+  iov[0].iov_base = buffer_ + buffer_begin_;
+  iov[0].iov_len = buffer_end_ - buffer_begin_;
+  iov[1].iov_base = const_cast<char*>(buffer);
+  iov[1].iov_len = size;
+  struct iovec* next = iov;
+  int count = 2;
+  while (count > 0) {
+    if (next->iov_len == 0) {
+      ++next;
+      --count;
+      continue;
+    }
+    ssize_t ret = writev(local_fd_, next, count);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      LOG(ERROR) << "writev failed: " << strerror(errno);
+      return false;
+    }
+    local_offset_ += ret;
+    // Skips what has been written, which may end in the middle of a
+    // vector element.
+    while (ret > 0) {
+      size_t n = min(static_cast<size_t>(ret), next->iov_len);
+      next->iov_base = static_cast<char*>(next->iov_base) + n;
+      next->iov_len -= n;
+      ret -= n;
+      if (next->iov_len == 0) {
+        ++next;
+        --count;
+      }
+    }
+  }
+  buffer_begin_ = 0;
+  buffer_end_ = 0;
+  return true;
+}
+
+bool MRMLFS_File::FillReadBuffer() {
+  buffer_begin_ = 0;
+  buffer_end_ = 0;
+  ssize_t ret = RawRead(buffer_, buffer_size_);
+  if (ret <= 0) {
+    return false;
+  }
+  buffer_end_ = ret;
+  if (local_fd_ >= 0) {
+    // Reads the next buffer ahead while this one is consumed.
+    posix_fadvise(local_fd_, local_offset_, buffer_size_,
+                  POSIX_FADV_WILLNEED);
+  }
+  return true;
+}
+
+bool MRMLFS_File::FlushWriteBuffer() {
+  bool succeeded = WriteFully(buffer_ + buffer_begin_,
+                              buffer_end_ - buffer_begin_);
+  buffer_begin_ = 0;
+  buffer_end_ = 0;
+  return succeeded;
 }
 
 size_t MRMLFS_File::Read(char* buffer, size_t size) {
-  if (local_file_ != NULL) {
-    return fread(buffer, sizeof(buffer[0]), size, local_file_);
-  } else if (sftp_handle_ != NULL) {
-    return libssh2_sftp_read(sftp_handle_, buffer, size);
+  if (cached_) {
+    size = min(size, mapped_size_ - mapped_offset_);
+    if (size > 0) {
+      memcpy(buffer, mapped_data_ + mapped_offset_, size);
+      mapped_offset_ += size;
+    }
+    return size;
+  } else if (local_fd_ >= 0 || sftp_handle_ != NULL) {
+    CHECK(for_read_);
+    size_t copied = 0;
+    while (copied < size) {
+      if (buffer_begin_ == buffer_end_) {
+        if (size - copied >= buffer_size_) {
+          // A large read goes to the caller's buffer directly.
+          ssize_t ret = RawRead(buffer + copied, size - copied);
+          if (ret <= 0) {
+            break;
+          }
+          copied += ret;
+          continue;
+        }
+        if (!FillReadBuffer()) {
+          break;
+        }
+      }
+      size_t n = min(size - copied, buffer_end_ - buffer_begin_);
+      memcpy(buffer + copied, buffer_ + buffer_begin_, n);
+      buffer_begin_ += n;
+      copied += n;
+    }
+    return copied;
   } else {
     LOG(ERROR) << "File has not been opened yet.";
     return -1;
   }
 }
 
-size_t MRMLFS_File::Write(const char* buffer, size_t size) {
-  if (local_file_ != NULL) {
-    return fwrite(buffer, sizeof(buffer[0]), size, local_file_);
-  } else if (sftp_handle_ != NULL) {
-    return libssh2_sftp_write(sftp_handle_, buffer, size);
+bool MRMLFS_File::Seek(uint64_t offset) {
+  if (cached_) {
+    if (offset > mapped_size_) {
+      return false;
+    }
+    mapped_offset_ = offset;
+    return true;
+  } else if (local_fd_ >= 0 || sftp_handle_ != NULL) {
+    if (!for_read_) {
+      LOG(ERROR) << "Cannot seek a file opened for write.";
+      return false;
+    }
+    if (local_fd_ >= 0) {
+      if (lseek(local_fd_, offset, SEEK_SET) < 0) {
+        return false;
+      }
+      local_offset_ = offset;
+    } else {
+      libssh2_sftp_seek64(sftp_handle_, offset);
+    }
+    buffer_begin_ = 0;
+    buffer_end_ = 0;
+    return true;
   } else {
     LOG(ERROR) << "File has not been opened yet.";
-    return -1;
+    return false;
   }
 }
 
+size_t MRMLFS_File::Write(const char* buffer, size_t size) {
+  if (local_fd_ < 0 && sftp_handle_ == NULL) {
+    LOG(ERROR) << "File has not been opened yet.";
+    return -1;
+  }
+  CHECK(!for_read_);
+  size_t written = 0;
+  while (buffer_end_ + size - written > buffer_size_) {
+    if (local_fd_ >= 0 && !direct_write_) {
+      // Sends the buffered data and the rest of |buffer| by one writev.
+      if (!WritevLocal(buffer + written, size - written)) {
+        write_failed_ = true;
+        return 0;
+      }
+      return size;
+    }
+    if (buffer_end_ == 0 && !direct_write_) {
+      // A large write goes from the caller's buffer directly.
+      if (!WriteFully(buffer + written, size - written)) {
+        write_failed_ = true;
+        return 0;
+      }
+      return size;
+    }
+    // Fills up the buffer before sending it, so that O_DIRECT writes
+    // aligned sizes only.
+    size_t n = buffer_size_ - buffer_end_;
+    memcpy(buffer_ + buffer_end_, buffer + written, n);
+    buffer_end_ += n;
+    written += n;
+    if (!FlushWriteBuffer()) {
+      write_failed_ = true;
+      return 0;
+    }
+  }
+  memcpy(buffer_ + buffer_end_, buffer + written, size - written);
+  buffer_end_ += size - written;
+  return size;
+}
@@ -4,16 +4,40 @@
 // This file provides MRMLFS_File, an interface to remote file access
 // through SFTP protocol.
 //
+// SFTP files are read and written through a large buffer, so that
+// libssh2 keeps many read or write requests of the buffer in flight,
+// rather than waiting for a round trip per small Read or Write.  SSH
+// and SFTP sessions are kept in a per-host pool after Close, and are
+// reused by later Opens of files on the same host.
+//
+// If a cache directory is set by SetCacheDirectory, an SFTP file
+// opened for read is downloaded once into the directory, named by
+// its host, path, size and modification time, and read from an mmap
+// of the local copy.  Processes on a host share the directory: the
+// first one downloads the file, holding a lock file, and others wait
+// for the lock and map the same copy.
+//
+// Local files are accessed by read and write system calls through a
+// large page-aligned buffer as well.  Sequential reads are announced
+// to the kernel by posix_fadvise, and the next buffer is read ahead
+// while the current one is consumed.  A large Write following small
+// buffered ones is sent together with them by one writev.  If
+// SetLocalDirectWrite(true), local files are written with O_DIRECT,
+// bypassing the page cache, which keeps huge outputs from evicting
+// input data cached in memory.
+//
 #ifndef MRML_MRML_FILESYSTEM_H_
 #define MRML_MRML_FILESYSTEM_H_
 
 #include <libssh2.h>
 #include <libssh2_sftp.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 
 #include <string>
 
+class MRML_RecordStreamReader;
 
 class MRMLFS_File {
   friend class MRMLFS_FileTest;
@@ -46,19 +70,45 @@ class MRMLFS_File {
   bool IsOpen() const;
 
   // Generally, this function returns the total number of bytes
-  // successfully read.  Particularly, for SFTP file, it invokes
-  // libssh2_sftp_read directly, and for local file, it invokes fread
-  // directly.
+  // successfully read, which is less than |size| only at the end of
+  // file or on errors.  Particularly, for SFTP and local files, it
+  // reads through the read buffer, except for reads larger than the
+  // buffer, which go to |buffer| directly.
   size_t Read(char* buffer, size_t size);
 
   // Generally, this function returns the actual number of bytes
   // written or negative on failure. If this number differs from the
   // count parameter, it indicates an error.  Particularly, for SFTP
-  // file, it invokes libssh2_sftp_write directly, and for local file,
-  // it invokes fwrite directly.
+  // and local files, it writes into the write buffer, which is sent
+  // when full or on Close.
   size_t Write(const char* buffer, size_t size);
 
-  void Close();
+  // Moves the read position of a file opened for read to |offset|
+  // from the beginning.  Returns false on failure.
+  bool Seek(uint64_t offset);
+
+  // Writes the rest of the write buffer of a file opened for write,
+  // and closes the file.  Returns false if any Write or the closing
+  // has failed, in which case the file may be incomplete.
+  bool Close();
+
+  // Returns the reader by which MRML_ReadRecord reads records of this
+  // file, which keeps the state of reading a RecordIO v2 file.  It is
+  // created by the first call, and deleted by Close.
+  MRML_RecordStreamReader* record_reader();
+
+  // Disconnects SFTP sessions kept in the pool for reuse.
+  static void CloseIdleSFTPSessions();
+
+  // Sets the local directory caching SFTP files opened for read.  An
+  // empty |dir|, the default, disables caching.  Cached copies are
+  // never removed, so |dir| should live no longer than a job.
+  static void SetCacheDirectory(const std::string& dir);
+
+  // Sets whether local files opened for write later bypass the page
+  // cache by O_DIRECT.  Defaults to false.  Ignored by filesystems not
+  // supporting O_DIRECT, e.g., tmpfs.
+  static void SetLocalDirectWrite(bool direct);
 
  protected:
   // Fields consisting of a filename.
@@ -76,17 +126,50 @@ class MRMLFS_File {
   };
 
   // Fields for accessing a local file:
-  FILE*                local_file_;
+  int                  local_fd_;           // -1 if not a local file.
+  bool                 direct_write_;       // local_fd_ has O_DIRECT.
+  uint64_t             local_offset_;       // Of the next read or write.
 
   // Fields for accessing a SFTP file:
   int                  socket_fd_;
   LIBSSH2_SESSION*     ssh2_session_;
   LIBSSH2_SFTP*        sftp_session_;
   LIBSSH2_SFTP_HANDLE* sftp_handle_;
+  std::string          sftp_session_key_;   // Identifies the pool of host.
+
+  // Fields for buffering a local or SFTP file:
+  bool                 for_read_;
+  char*                buffer_;             // Page-aligned.
+  size_t               buffer_size_;
+  size_t               buffer_begin_;       // Unread data in buffer_ is
+  size_t               buffer_end_;         // [buffer_begin_, buffer_end_).
+
+  // Fields for accessing a cached copy of a SFTP file:
+  bool                 cached_;
+  char*                mapped_data_;        // NULL if the file is empty.
+  size_t               mapped_size_;
+  size_t               mapped_offset_;
+
+  MRML_RecordStreamReader* record_reader_;  // NULL until record_reader().
+  bool                 write_failed_;       // Since Open, reported by Close.
 
+  void Initialize();
   static bool ParseFilename(const std::string& filename, FilenameFields* f);
   bool OpenLocalFile(const FilenameFields& f, bool for_read);
   bool OpenSFTPFile(const FilenameFields& f, bool for_read);
+  bool OpenCachedSFTPFile(const FilenameFields& f);
+  bool DownloadSFTPFile(const std::string& filename, uint64_t file_size);
+  bool MapCachedFile(const std::string& filename);
+  bool ConnectSFTPSession(const FilenameFields& f);
+  void DisconnectSFTPSession();
+  void AllocateBuffer(size_t size);
+  void FreeBuffer();
+  ssize_t RawRead(char* buffer, size_t size);
+  ssize_t RawWrite(const char* buffer, size_t size);
+  bool WriteFully(const char* buffer, size_t size);
+  bool FillReadBuffer();
+  bool FlushWriteBuffer();
+  bool WritevLocal(const char* buffer, size_t size);
 };
 
 #endif  // MRML_MRML_FILESYSTEM_H_
@@ -1,6 +1,9 @@
 
 
 //
+#include <sys/stat.h>
+
+#include <algorithm>
 #include <string>
 
 #include "gtest/gtest.h"
@@ -19,7 +22,11 @@ class MRMLFS_FileTest : public ::testing::Test {
   static void ParseSFTPFile();
   static void ParseLocalSFTPFile();
   static void CreateAndReadLocalFile();
+  static void CloseReportsWriteFailure();
   static void CreateAndReadSFTPFile();
+  static void ReadAndWriteLargeSFTPFile();
+  static void ReadAndWriteLargeLocalFile();
+  static void ReadCachedSFTPFile();
 };
 
 void MRMLFS_FileTest::ParseLocalFile() {
@@ -82,7 +89,7 @@ void MRMLFS_FileTest::CreateAndReadLocalFile() {
   MRMLFS_File file;
   CHECK(file.Open(kFilename, false));
   file.Write(kContent, sizeof(kContent));
-  file.Close();
+  EXPECT_TRUE(file.Close());
 
   CHECK(file.Open(kFilename, true));
   char buffer[sizeof(kContent) + 1];
@@ -91,6 +98,25 @@ void MRMLFS_FileTest::CreateAndReadLocalFile() {
   file.Close();
 }
 
+// Writes to /dev/full fail with ENOSPC, when the write buffer is sent
+// by Close, or by a Write larger than the buffer.
+void MRMLFS_FileTest::CloseReportsWriteFailure() {
+  static const char* kFilename = "/dev/full";
+  static const char kContent[] = "apple";
+
+  MRMLFS_File file;
+  if (!file.Open(kFilename, false)) {
+    return;
+  }
+  EXPECT_EQ(sizeof(kContent), file.Write(kContent, sizeof(kContent)));
+  EXPECT_FALSE(file.Close());
+
+  CHECK(file.Open(kFilename, false));
+  string large_content(file.buffer_size_ + 1, 'a');
+  EXPECT_EQ(0, file.Write(large_content.data(), large_content.size()));
+  EXPECT_FALSE(file.Close());
+}
+
 void MRMLFS_FileTest::CreateAndReadSFTPFile() {
   CHECK(!FLAGS_remote_path.empty());
 
@@ -108,6 +134,119 @@ void MRMLFS_FileTest::CreateAndReadSFTPFile() {
   file.Close();
 }
 
+// Writes and reads a file larger than the SFTP buffer in pieces of
+// various sizes, opening the file several times to reuse the session.
+void MRMLFS_FileTest::ReadAndWriteLargeSFTPFile() {
+  CHECK(!FLAGS_remote_path.empty());
+
+  string content(5 * 1024 * 1024 + 17, ' ');
+  for (size_t i = 0; i < content.size(); ++i) {
+    content[i] = 'a' + i % 26;
+  }
+  static const size_t kPieceSizes[] = { 1, 100, 4096, 3 * 1024 * 1024 };
+  static const size_t kNumPieceSizes = sizeof(kPieceSizes) / sizeof(size_t);
+
+  MRMLFS_File file;
+  CHECK(file.Open(FLAGS_remote_path, false));
+  size_t written = 0;
+  for (int i = 0; written < content.size(); ++i) {
+    size_t size = std::min(kPieceSizes[i % kNumPieceSizes],
+                           content.size() - written);
+    EXPECT_EQ(size, file.Write(content.data() + written, size));
+    written += size;
+  }
+  file.Close();
+
+  for (size_t k = 0; k < kNumPieceSizes; ++k) {
+    CHECK(file.Open(FLAGS_remote_path, true));
+    string buffer(kPieceSizes[k], ' ');
+    string read;
+    size_t size;
+    while ((size = file.Read(&buffer[0], buffer.size())) > 0) {
+      read.append(buffer.data(), size);
+    }
+    EXPECT_TRUE(read == content);
+    file.Close();
+  }
+  MRMLFS_File::CloseIdleSFTPSessions();
+}
+
+// Writes a file larger than the local buffer in pieces of various
+// sizes, with and without O_DIRECT, and reads it back in pieces and
+// after seeks.
+void MRMLFS_FileTest::ReadAndWriteLargeLocalFile() {
+  static const char* kFilename = "/tmp/testReadAndWriteLargeLocalFile";
+  string content(9 * 1024 * 1024 + 17, ' ');
+  for (size_t i = 0; i < content.size(); ++i) {
+    content[i] = 'a' + i % 26;
+  }
+  static const size_t kPieceSizes[] = { 1, 100, 4096, 5 * 1024 * 1024 };
+  static const size_t kNumPieceSizes = sizeof(kPieceSizes) / sizeof(size_t);
+
+  for (int direct = 0; direct < 2; ++direct) {
+    MRMLFS_File::SetLocalDirectWrite(direct);
+    MRMLFS_File file;
+    CHECK(file.Open(kFilename, false));
+    size_t written = 0;
+    for (int i = 0; written < content.size(); ++i) {
+      size_t size = std::min(kPieceSizes[i % kNumPieceSizes],
+                             content.size() - written);
+      EXPECT_EQ(size, file.Write(content.data() + written, size));
+      written += size;
+    }
+    file.Close();
+
+    for (size_t k = 0; k < kNumPieceSizes; ++k) {
+      CHECK(file.Open(kFilename, true));
+      string buffer(kPieceSizes[k], ' ');
+      string read;
+      size_t size;
+      while ((size = file.Read(&buffer[0], buffer.size())) > 0) {
+        read.append(buffer.data(), size);
+      }
+      EXPECT_TRUE(read == content);
+      file.Close();
+    }
+
+    CHECK(file.Open(kFilename, true));
+    static const size_t kOffsets[] = { 7 * 1024 * 1024, 3, content.size() };
+    for (size_t k = 0; k < sizeof(kOffsets) / sizeof(size_t); ++k) {
+      ASSERT_TRUE(file.Seek(kOffsets[k]));
+      char buffer[10];
+      size_t size = file.Read(buffer, sizeof(buffer));
+      EXPECT_EQ(std::min(sizeof(buffer), content.size() - kOffsets[k]), size);
+      EXPECT_EQ(content.substr(kOffsets[k], size), string(buffer, size));
+    }
+    file.Close();
+  }
+  MRMLFS_File::SetLocalDirectWrite(false);
+}
+
+// Reads a SFTP file twice through the cache, where the second read
+// maps the copy downloaded by the first one.
+void MRMLFS_FileTest::ReadCachedSFTPFile() {
+  CHECK(!FLAGS_remote_path.empty());
+  static const char* kCacheDir = "/tmp/testMRMLFSCache";
+  static const char kContent[] = "apple";
+
+  MRMLFS_File file;
+  CHECK(file.Open(FLAGS_remote_path, false));
+  file.Write(kContent, sizeof(kContent));
+  file.Close();
+
+  mkdir(kCacheDir, 0755);
+  MRMLFS_File::SetCacheDirectory(kCacheDir);
+  for (int i = 0; i < 2; ++i) {
+    CHECK(file.Open(FLAGS_remote_path, true));
+    char buffer[sizeof(kContent) + 1];
+    EXPECT_EQ(sizeof(kContent), file.Read(buffer, sizeof(buffer)));
+    EXPECT_EQ(string(kContent), buffer);
+    EXPECT_EQ(0, file.Read(buffer, sizeof(buffer)));
+    file.Close();
+  }
+  MRMLFS_File::SetCacheDirectory("");
+}
+
 TEST_F(MRMLFS_FileTest, ParseLocalFile) {
   MRMLFS_FileTest::ParseLocalFile();
 }
@@ -124,6 +263,22 @@ TEST_F(MRMLFS_FileTest, CreateAndReadLocalFile) {
   MRMLFS_FileTest::CreateAndReadLocalFile();
 }
 
+TEST_F(MRMLFS_FileTest, CloseReportsWriteFailure) {
+  MRMLFS_FileTest::CloseReportsWriteFailure();
+}
+
 TEST_F(MRMLFS_FileTest, CreateAndReadSFTPFile) {
   MRMLFS_FileTest::CreateAndReadSFTPFile();
 }
+
+TEST_F(MRMLFS_FileTest, ReadAndWriteLargeSFTPFile) {
+  MRMLFS_FileTest::ReadAndWriteLargeSFTPFile();
+}
+
+TEST_F(MRMLFS_FileTest, ReadAndWriteLargeLocalFile) {
+  MRMLFS_FileTest::ReadAndWriteLargeLocalFile();
+}
+
+TEST_F(MRMLFS_FileTest, ReadCachedSFTPFile) {
+  MRMLFS_FileTest::ReadCachedSFTPFile();
+}
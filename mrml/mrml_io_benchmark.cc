@@ -0,0 +1,382 @@
+
+
+//
+// A microbenchmark of the I/O paths of MRML: reading inputs with
+// MRML_TextReader and MRML_RecordReader, writing outputs with
+// MRML_WriteRecord, and buffering, flushing and merging intermediate
+// results with SortedBuffer and SortedBufferIteratorImpl.
+//
+// Synthetic data is generated for each combination of record size,
+// key distribution and file size given by flags, and each benchmark
+// writes a CSV line of its throughput into --output:
+//
+//   benchmark,key_distribution,record_size,file_size_mb,repetition,
+//   records,bytes,seconds,mb_per_s,records_per_s
+//
+// which can be saved and compared across revisions to catch
+// regressions.  Note that inputs are read right after they are
+// written, i.e., mostly from the page cache.
+//
+// Usage:
+/*
+  mrml_io_benchmark --record_sizes=16,256,4096 \
+                    --key_distributions=sequential,uniform,zipf \
+                    --file_sizes_mb=64 --output=results.csv
+*/
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+
+#include "base/common.h"
+#include "base/random.h"
+#include "mrml/mrml_reader.h"
+#include "mrml/mrml_recordio.h"
+#include "sorted_buffer/sorted_buffer.h"
+#include "sorted_buffer/sorted_buffer_iterator.h"
+#include "strutil/split_string.h"
+#include "strutil/stringprintf.h"
+
+using sorted_buffer::SortedBuffer;
+using sorted_buffer::SortedBufferIteratorImpl;
+using std::string;
+using std::vector;
+
+DEFINE_string(benchmark_dir, "/tmp",
+              "The directory of files generated by the benchmark.");
+DEFINE_string(benchmarks,
+              "write_record,record_reader,text_reader,"
+              "sorted_buffer_insert,sorted_buffer_flush,sorted_buffer_merge",
+              "Comma-separated benchmarks to run.");
+DEFINE_string(record_sizes, "16,256,4096",
+              "Comma-separated sizes of values in bytes.");
+DEFINE_string(key_distributions, "sequential,uniform,zipf",
+              "Comma-separated distributions of keys: sequential, uniform "
+              "(random keys, mostly unique) or zipf (skewed over "
+              "--num_zipf_keys keys).");
+DEFINE_string(file_sizes_mb, "64",
+              "Comma-separated sizes of generated data in MB.");
+DEFINE_int32(num_zipf_keys, 100000,
+             "The number of distinct keys of the zipf distribution.");
+DEFINE_int32(sorted_buffer_mb, 16,
+             "The in-memory size of SortedBuffer in sorted_buffer_merge, "
+             "which determines the number of merged files.");
+DEFINE_int32(repetitions, 1, "The number of runs of each benchmark.");
+DEFINE_string(output, "",
+              "The CSV file of results.  If empty, results are printed to "
+              "stdout, mixed with INFO logs.");
+
+static FILE* g_output = stdout;
+
+//-----------------------------------------------------------------------------
+// Synthetic data
+//-----------------------------------------------------------------------------
+
+// Generates keys of a distribution, and values of a size.
+class RecordGenerator {
+ public:
+  RecordGenerator(const string& key_distribution, int record_size)
+      : key_distribution_(key_distribution),
+        record_size_(record_size),
+        num_generated_(0) {
+    CHECK(key_distribution == "sequential" ||
+          key_distribution == "uniform" ||
+          key_distribution == "zipf");
+    rng_.SeedRNG(0);
+    if (key_distribution == "zipf") {
+      double sum = 0;
+      zipf_cdf_.resize(FLAGS_num_zipf_keys);
+      for (int i = 0; i < FLAGS_num_zipf_keys; ++i) {
+        sum += 1.0 / (i + 1);
+        zipf_cdf_[i] = sum;
+      }
+      for (int i = 0; i < FLAGS_num_zipf_keys; ++i) {
+        zipf_cdf_[i] /= sum;
+      }
+    }
+    // Values are slices of a random text, which has no new lines.
+    text_.resize(record_size + 4096);
+    for (size_t i = 0; i < text_.size(); ++i) {
+      text_[i] = 'a' + rng_.RandInt(26);
+    }
+  }
+
+  void Next(string* key, string* value) {
+    int id;
+    if (key_distribution_ == "sequential") {
+      id = num_generated_;
+    } else if (key_distribution_ == "uniform") {
+      id = rng_.RandInt(1 << 30);
+    } else {
+      id = std::lower_bound(zipf_cdf_.begin(), zipf_cdf_.end(),
+                            rng_.RandDouble()) - zipf_cdf_.begin();
+    }
+    SStringPrintf(key, "key-%010d", id);
+    value->assign(text_, rng_.RandInt(4096), record_size_);
+    ++num_generated_;
+  }
+
+ private:
+  string key_distribution_;
+  int record_size_;
+  int num_generated_;
+  MTRandom rng_;
+  vector<double> zipf_cdf_;
+  string text_;
+};
+
+//-----------------------------------------------------------------------------
+// Measurement
+//-----------------------------------------------------------------------------
+
+static double Now() {
+  struct timeval t;
+  gettimeofday(&t, NULL);
+  return t.tv_sec + t.tv_usec * 1e-6;
+}
+
+struct BenchmarkSetting {
+  string key_distribution;
+  int record_size;
+  int file_size_mb;
+  int repetition;
+  int num_records;
+  string recordio_filename;
+  string text_filename;
+  string sorted_buffer_filebase;
+};
+
+static void PrintResult(const string& benchmark,
+                        const BenchmarkSetting& setting,
+                        int64 records, int64 bytes, double seconds) {
+  seconds = std::max(seconds, 1e-9);
+  fprintf(g_output, "%s,%s,%d,%d,%d,%lld,%lld,%.6f,%.2f,%.0f\n",
+          benchmark.c_str(), setting.key_distribution.c_str(),
+          setting.record_size, setting.file_size_mb, setting.repetition,
+          static_cast<long long>(records),                        // NOLINT
+          static_cast<long long>(bytes),                          // NOLINT
+          seconds, bytes / seconds / (1024 * 1024), records / seconds);
+  fflush(g_output);
+}
+
+static int64 FileSize(const string& filename) {
+  FILE* file = fopen(filename.c_str(), "r");
+  CHECK(file != NULL);
+  fseeko(file, 0, SEEK_END);
+  int64 size = ftello(file);
+  fclose(file);
+  return size;
+}
+
+//-----------------------------------------------------------------------------
+// Benchmarks
+//-----------------------------------------------------------------------------
+
+// Records generated before benchmarks, so that generation is not
+// measured.
+struct SyntheticData {
+  vector<string> keys;
+  vector<string> values;
+  int64 bytes;                  // Total size of keys and values.
+};
+
+static void GenerateData(const BenchmarkSetting& setting,
+                         SyntheticData* data) {
+  RecordGenerator generator(setting.key_distribution, setting.record_size);
+  data->keys.resize(setting.num_records);
+  data->values.resize(setting.num_records);
+  data->bytes = 0;
+  for (int i = 0; i < setting.num_records; ++i) {
+    generator.Next(&data->keys[i], &data->values[i]);
+    data->bytes += data->keys[i].size() + data->values[i].size();
+  }
+}
+
+// Writes the RecordIO input of record_reader, and the text input of
+// text_reader, in which a line is a key, a tab and a value.
+static void WriteRecord(const BenchmarkSetting& setting,
+                        const SyntheticData& data, bool print) {
+  FILE* output = fopen(setting.recordio_filename.c_str(), "w");
+  CHECK(output != NULL);
+  double start = Now();
+  for (int i = 0; i < setting.num_records; ++i) {
+    CHECK(MRML_WriteRecord(output, data.keys[i], data.values[i]));
+  }
+  fclose(output);
+  double seconds = Now() - start;
+  if (print) {
+    PrintResult("write_record", setting, setting.num_records,
+                FileSize(setting.recordio_filename), seconds);
+  }
+
+  output = fopen(setting.text_filename.c_str(), "w");
+  CHECK(output != NULL);
+  for (int i = 0; i < setting.num_records; ++i) {
+    fprintf(output, "%s\t%s\n", data.keys[i].c_str(), data.values[i].c_str());
+  }
+  fclose(output);
+}
+
+static void ReadAll(const string& benchmark, const BenchmarkSetting& setting,
+                    const string& filename, MRML_Reader* reader) {
+  string key, value;
+  int64 records = 0;
+  double start = Now();
+  while (reader->Read(&key, &value)) {
+    ++records;
+  }
+  double seconds = Now() - start;
+  delete reader;
+  CHECK_EQ(records, setting.num_records);
+  PrintResult(benchmark, setting, records, FileSize(filename), seconds);
+}
+
+// Inserts all records into a SortedBuffer large enough to hold them,
+// and flushes them into a file.
+static void InsertAndFlush(const BenchmarkSetting& setting,
+                           const SyntheticData& data,
+                           bool print_insert, bool print_flush) {
+  // The pool holds the data, and the sizes of pieces.  SortedBuffer
+  // takes the size of its pool in an int.
+  int64 pool_size = data.bytes * 2 + 16 * 1024 * 1024;
+  CHECK_GE(static_cast<int64>(INT_MAX), pool_size);
+  SortedBuffer buffer(setting.sorted_buffer_filebase,
+                      static_cast<int>(pool_size));
+  double start = Now();
+  for (int i = 0; i < setting.num_records; ++i) {
+    buffer.Insert(data.keys[i], data.values[i]);
+  }
+  double inserted = Now();
+  buffer.Flush();
+  double flushed = Now();
+  CHECK_EQ(1, buffer.NumFiles());
+  buffer.RemoveBufferFiles();
+
+  if (print_insert) {
+    PrintResult("sorted_buffer_insert", setting, setting.num_records,
+                data.bytes, inserted - start);
+  }
+  if (print_flush) {
+    PrintResult("sorted_buffer_flush", setting, setting.num_records,
+                data.bytes, flushed - inserted);
+  }
+}
+
+// Merges the files flushed by a SortedBuffer of --sorted_buffer_mb.
+static void Merge(const BenchmarkSetting& setting, const SyntheticData& data) {
+  CHECK_LT(0, FLAGS_sorted_buffer_mb);
+  CHECK_GT(INT_MAX / (1024 * 1024), FLAGS_sorted_buffer_mb);
+  SortedBuffer buffer(setting.sorted_buffer_filebase,
+                      FLAGS_sorted_buffer_mb * 1024 * 1024);
+  for (int i = 0; i < setting.num_records; ++i) {
+    buffer.Insert(data.keys[i], data.values[i]);
+  }
+  buffer.Flush();
+  LOG(INFO) << "Merging " << buffer.NumFiles() << " files.";
+
+  int64 records = 0, bytes = 0;
+  double start = Now();
+  SortedBufferIteratorImpl* iter =
+      static_cast<SortedBufferIteratorImpl*>(buffer.CreateIterator());
+  for (; !iter->FinishedAll(); iter->NextKey()) {
+    for (; !iter->Done(); iter->Next()) {
+      bytes += iter->key_view().size() + iter->value_view().size();
+      ++records;
+    }
+  }
+  delete iter;
+  double seconds = Now() - start;
+  buffer.RemoveBufferFiles();
+  CHECK_EQ(records, setting.num_records);
+  PrintResult("sorted_buffer_merge", setting, records, bytes, seconds);
+}
+
+static void RunBenchmarks(const vector<string>& benchmarks,
+                          const BenchmarkSetting& setting) {
+  bool run[6] = { false };
+  static const char* kNames[] = {
+    "write_record", "record_reader", "text_reader",
+    "sorted_buffer_insert", "sorted_buffer_flush", "sorted_buffer_merge" };
+  for (size_t i = 0; i < benchmarks.size(); ++i) {
+    size_t j = std::find(kNames, kNames + 6, benchmarks[i]) - kNames;
+    if (j == 6) {
+      LOG(FATAL) << "Unknown benchmark: " << benchmarks[i];
+    }
+    run[j] = true;
+  }
+
+  SyntheticData data;
+  GenerateData(setting, &data);
+  if (run[0] || run[1] || run[2]) {
+    WriteRecord(setting, data, run[0]);
+  }
+  if (run[1]) {
+    ReadAll("record_reader", setting, setting.recordio_filename,
+            new MRML_RecordReader(setting.recordio_filename));
+  }
+  if (run[2]) {
+    ReadAll("text_reader", setting, setting.text_filename,
+            new MRML_TextReader(setting.text_filename, true));
+  }
+  if (run[3] || run[4]) {
+    InsertAndFlush(setting, data, run[3], run[4]);
+  }
+  if (run[5]) {
+    Merge(setting, data);
+  }
+  unlink(setting.recordio_filename.c_str());
+  unlink(setting.text_filename.c_str());
+}
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  vector<string> benchmarks, record_sizes, key_distributions, file_sizes;
+  SplitStringUsing(FLAGS_benchmarks, ",", &benchmarks);
+  SplitStringUsing(FLAGS_record_sizes, ",", &record_sizes);
+  SplitStringUsing(FLAGS_key_distributions, ",", &key_distributions);
+  SplitStringUsing(FLAGS_file_sizes_mb, ",", &file_sizes);
+
+  if (!FLAGS_output.empty()) {
+    g_output = fopen(FLAGS_output.c_str(), "w");
+    CHECK(g_output != NULL);
+  }
+  fprintf(g_output,
+          "benchmark,key_distribution,record_size,file_size_mb,repetition,"
+          "records,bytes,seconds,mb_per_s,records_per_s\n");
+  for (size_t f = 0; f < file_sizes.size(); ++f) {
+    for (size_t r = 0; r < record_sizes.size(); ++r) {
+      for (size_t k = 0; k < key_distributions.size(); ++k) {
+        BenchmarkSetting setting;
+        setting.key_distribution = key_distributions[k];
+        setting.record_size = atoi(record_sizes[r].c_str());
+        setting.file_size_mb = atoi(file_sizes[f].c_str());
+        CHECK_LT(0, setting.record_size);
+        CHECK_LT(0, setting.file_size_mb);
+        // A key is 14 bytes, and a record has a few bytes of framing.
+        setting.num_records = static_cast<int64>(setting.file_size_mb) *
+                              1024 * 1024 / (setting.record_size + 20);
+        string base = StringPrintf("%s/mrml_io_benchmark-%d",
+                                   FLAGS_benchmark_dir.c_str(), getpid());
+        setting.recordio_filename = base + ".recordio";
+        setting.text_filename = base + ".txt";
+        setting.sorted_buffer_filebase = base + "-sorted_buffer";
+        for (int i = 0; i < FLAGS_repetitions; ++i) {
+          setting.repetition = i;
+          RunBenchmarks(benchmarks, setting);
+        }
+      }
+    }
+  }
+  if (g_output != stdout) {
+    fclose(g_output);
+  }
+  return 0;
+}
@@ -3,7 +3,15 @@
 //
 #include "mrml/mrml_reader.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
 
 #include "base/common.h"
 #include "base/logging.h"
@@ -17,69 +25,141 @@ static void OpenFileOrDie(const std::string& filename, FILE** input_stream) {
   }
 }
 
+// Tells the kernel to read ahead aggressively.  Failures are harmless.
+static void AdviseSequentialRead(int fd) {
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
 //-----------------------------------------------------------------------------
 // Implementation of MRML_TextReader
 //-----------------------------------------------------------------------------
 
+static const size_t kTextReadBlockSize = 4 * 1024 * 1024;  // 4 MB
+
 MRML_TextReader::MRML_TextReader(const std::string& filename,
-                                 int max_line_length)
-    : max_line_length_(max_line_length),
-      line_num_(0),
-      reading_a_long_line_(false),
-      input_filename_(filename) {
-  OpenFileOrDie(filename, &input_stream_);
-  try {
-    CHECK_LT(1, max_line_length_);  // At least 1 for '\0' appended by fgets.
-    line_ = new char[max_line_length_];
-  } catch(std::bad_alloc&) {
-    line_ = NULL;
-    LOG(FATAL) << "Cannot allocate line input buffer.";
+                                 bool build_keys)
+    : input_filename_(filename),
+      build_keys_(build_keys),
+      mapped_(NULL),
+      mapped_size_(0),
+      data_(NULL),
+      data_size_(0),
+      position_(0),
+      scanned_(0),
+      data_offset_(0),
+      end_of_file_(false) {
+  input_fd_ = open(filename.c_str(), O_RDONLY);
+  if (input_fd_ < 0) {
+    LOG(FATAL) << "Cannot open file: " << filename;
   }
+  AdviseSequentialRead(input_fd_);
+
+  struct stat file_stat;
+  if (fstat(input_fd_, &file_stat) == 0 && S_ISREG(file_stat.st_mode)) {
+    if (file_stat.st_size == 0) {
+      end_of_file_ = true;
+      return;
+    }
+    void* mapped = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE,
+                        input_fd_, 0);
+    if (mapped != MAP_FAILED) {
+      madvise(mapped, file_stat.st_size, MADV_SEQUENTIAL);
+      mapped_ = static_cast<char*>(mapped);
+      mapped_size_ = file_stat.st_size;
+      data_ = mapped_;
+      data_size_ = mapped_size_;
+      end_of_file_ = true;
+      return;
+    }
+    LOG(INFO) << "Cannot mmap " << filename << ".  Read it in blocks.";
+  }
+  buffer_.resize(kTextReadBlockSize);
+  data_ = buffer_.data();
 }
 
 MRML_TextReader::~MRML_TextReader() {
-  if (input_stream_ != NULL) {
-    fclose(input_stream_);
-    input_stream_ = NULL;
+  if (mapped_ != NULL) {
+    munmap(mapped_, mapped_size_);
+    mapped_ = NULL;
   }
-  if (line_ != NULL) {
-    delete [] line_;
-    line_ = NULL;
+  if (input_fd_ >= 0) {
+    close(input_fd_);
+    input_fd_ = -1;
   }
 }
 
 bool MRML_TextReader::Read(std::string* key, std::string* value) {
-  SStringPrintf(key, "%s-%010lld",
-                input_filename_.c_str(), ftell(input_stream_));
-  value->clear();
-
-  if (fgets(line_, max_line_length_, input_stream_) == NULL) {
-    return false;  // Either ferror or feof. Anyway, returns false to
-                   // notify the caller no further reading operations.
-  }
-
-  int read_size = strlen(line_);
-  if (line_[read_size - 1] != '\n') {
-    LOG(ERROR) << "Encountered a too-long line (line_num = " << line_num_
-               << ").  May return one or more empty values while skipping "
-               << " this long line.";
-    reading_a_long_line_ = true;
-    return true;  // Skip the current part of a long line.
+  StringPiece line;
+  int64 offset;
+  if (!ReadLine(&line, &offset)) {
+    key->clear();
+    value->clear();
+    return false;
+  }
+  if (build_keys_) {
+    SStringPrintf(key, "%s-%010lld", input_filename_.c_str(),
+                  static_cast<long long>(offset));  // NOLINT
   } else {
-    ++line_num_;
-    if (reading_a_long_line_) {
-      reading_a_long_line_ = false;
-      return true;  // Skip the last part of a long line.
+    key->clear();
+  }
+  value->assign(line.data(), line.size());
+  return true;
+}
+
+bool MRML_TextReader::ReadLine(StringPiece* line, int64* offset) {
+  while (true) {
+    const char* newline = static_cast<const char*>(
+        memchr(data_ + scanned_, '\n', data_size_ - scanned_));
+    size_t end;
+    if (newline != NULL) {
+      end = newline - data_;
+    } else if (end_of_file_ || !FillBuffer()) {
+      if (position_ >= data_size_) {
+        return false;
+      }
+      end = data_size_;  // The last line has no '\n'.
+    } else {
+      continue;
+    }
+
+    size_t line_size = end - position_;
+    if (line_size > 0 && data_[end - 1] == '\r') {  // DOS text format.
+      --line_size;
     }
+    line->set(data_ + position_, line_size);
+    *offset = data_offset_ + position_;
+    position_ = scanned_ = std::min(end + 1, data_size_);
+    return true;
+  }
+}
+
+bool MRML_TextReader::FillBuffer() {
+  // Move the incomplete line to the front, and make room for a block.
+  size_t rest = data_size_ - position_;
+  if (position_ > 0) {
+    memmove(&buffer_[0], &buffer_[position_], rest);
+    data_offset_ += position_;
+    position_ = 0;
+  }
+  if (buffer_.size() < rest + kTextReadBlockSize) {
+    buffer_.resize(rest + kTextReadBlockSize);
   }
+  data_ = buffer_.data();
+  data_size_ = rest;
+  scanned_ = rest;
 
-  if (line_[read_size - 1] == '\n') {
-    line_[read_size - 1] = '\0';
-    if (line_[read_size - 2] == '\r') {  // Handle DOS text format.
-      line_[read_size - 2] = '\0';
+  ssize_t read_size;
+  do {
+    read_size = read(input_fd_, &buffer_[rest], kTextReadBlockSize);
+  } while (read_size < 0 && errno == EINTR);
+  if (read_size <= 0) {
+    if (read_size < 0) {
+      LOG(ERROR) << "Failed reading " << input_filename_;
     }
+    end_of_file_ = true;
+    return false;
   }
-  value->assign(line_);
+  data_size_ += read_size;
   return true;
 }
 
@@ -90,9 +170,12 @@ bool MRML_TextReader::Read(std::string* key, std::string* value) {
 MRML_RecordReader::MRML_RecordReader(const std::string& filename)
     : input_filename_(filename) {
   OpenFileOrDie(filename, &input_stream_);
+  AdviseSequentialRead(fileno(input_stream_));
+  record_reader_.reset(new MRML_RecordStreamReader(input_stream_));
 }
 
 MRML_RecordReader::~MRML_RecordReader() {
+  record_reader_.reset();
   if (input_stream_ != NULL) {
     fclose(input_stream_);
     input_stream_ = NULL;
@@ -100,5 +183,112 @@ MRML_RecordReader::~MRML_RecordReader() {
 }
 
 bool MRML_RecordReader::Read(std::string* key, std::string* value) {
-  return MRML_ReadRecord(input_stream_, key, value);
+  return record_reader_->Read(key, value);
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of MRML_ReadAheadReader
+//-----------------------------------------------------------------------------
+
+MRML_ReadAheadReader::MRML_ReadAheadReader(MRML_Reader* reader,
+                                           int num_batches,
+                                           int batch_size)
+    : reader_(reader),
+      batch_size_(batch_size),
+      consume_(0),
+      num_full_(0),
+      stop_(false),
+      current_(NULL),
+      position_(0),
+      finished_(false) {
+  CHECK_NOTNULL(reader);
+  CHECK_LT(0, num_batches);
+  CHECK_LT(0, batch_size);
+  batches_.resize(num_batches);
+  for (int i = 0; i < num_batches; ++i) {
+    batches_[i].keys.resize(batch_size);
+    batches_[i].values.resize(batch_size);
+    batches_[i].num_records = 0;
+    batches_[i].last = false;
+  }
+  if (pthread_create(&read_ahead_thread_, NULL, &ReadAheadThread, this) != 0) {
+    LOG(FATAL) << "Cannot create read-ahead thread.";
+  }
+}
+
+MRML_ReadAheadReader::~MRML_ReadAheadReader() {
+  {
+    MutexLocker locker(&mutex_);
+    stop_ = true;
+    ring_changed_.Signal();
+  }
+  CHECK_EQ(pthread_join(read_ahead_thread_, NULL), 0);
+}
+
+bool MRML_ReadAheadReader::Read(std::string* key, std::string* value) {
+  while (true) {
+    if (current_ != NULL) {
+      if (position_ < current_->num_records) {
+        // Swapping, rather than copying, also hands the buffers of
+        // |key| and |value| to the read-ahead thread for reuse.
+        key->swap(current_->keys[position_]);
+        value->swap(current_->values[position_]);
+        ++position_;
+        return true;
+      }
+      finished_ = current_->last;
+      ReleaseCurrentBatch();
+    }
+    if (finished_) {
+      return false;
+    }
+
+    MutexLocker locker(&mutex_);
+    while (num_full_ == 0) {
+      ring_changed_.Wait(&mutex_);
+    }
+    current_ = &batches_[consume_];
+    position_ = 0;
+  }
+}
+
+void MRML_ReadAheadReader::ReleaseCurrentBatch() {
+  MutexLocker locker(&mutex_);
+  consume_ = (consume_ + 1) % batches_.size();
+  --num_full_;
+  current_ = NULL;
+  ring_changed_.Signal();
+}
+
+/*static*/
+void* MRML_ReadAheadReader::ReadAheadThread(void* reader) {
+  MRML_ReadAheadReader* r = static_cast<MRML_ReadAheadReader*>(reader);
+  int fill = 0;
+  bool last = false;
+  while (!last) {
+    {
+      MutexLocker locker(&r->mutex_);
+      while (r->num_full_ == r->batches_.size() && !r->stop_) {
+        r->ring_changed_.Wait(&r->mutex_);
+      }
+      if (r->stop_) {
+        break;
+      }
+    }
+    // The batch is not full, so Read does not touch it.
+    Batch* batch = &r->batches_[fill];
+    batch->num_records = 0;
+    while (batch->num_records < r->batch_size_ &&
+           r->reader_->Read(&batch->keys[batch->num_records],
+                            &batch->values[batch->num_records])) {
+      ++batch->num_records;
+    }
+    last = batch->last = batch->num_records < r->batch_size_;
+    fill = (fill + 1) % r->batches_.size();
+
+    MutexLocker locker(&r->mutex_);
+    ++r->num_full_;
+    r->ring_changed_.Signal();
+  }
+  return NULL;
 }
@@ -7,9 +7,19 @@
 #ifndef MRML_MRML_READER_H_
 #define MRML_MRML_READER_H_
 
+#include <pthread.h>
 #include <stdio.h>
 
 #include <string>
+#include <vector>
+
+#include "base/common.h"
+#include "boost/scoped_ptr.hpp"
+#include "strutil/string_piece.h"
+#include "system/condition_variable.h"
+#include "system/mutex.h"
+
+class MRML_RecordStreamReader;
 
 // The interface implemented by ``real'' readers.
 class MRML_Reader {
@@ -24,29 +34,45 @@ class MRML_Reader {
   FILE* input_stream_;
 };
 
-// Read from a text file, using stdio.h API.
+// Read from a text file, which is mmapped if possible, or read in large
+// blocks otherwise.  Lines are split using memchr.
 // - The key returned by Read() is "filename-offset", the value
-//   returned by Read is the content of a line.
-// - The value might be empty if it is reading a too long line.
+//   returned by Read is the content of a line.  If |build_keys| is
+//   false, keys are left empty, which saves formatting a key per line
+//   for mappers who do not use input keys.
+// - Lines can be arbitrarily long.
 // - The '\r' (if there is any) and '\n' at the end of a line are
 //   removed.
 class MRML_TextReader : public MRML_Reader {
  public:
-  explicit MRML_TextReader(const std::string& filename,
-                           int max_line_length);
+  MRML_TextReader(const std::string& filename, bool build_keys);
   virtual ~MRML_TextReader();
   virtual bool Read(std::string* key, std::string* value);
 
+  // Points |line| to the next line in the mmapped file or the read
+  // buffer, without copying, and returns in |offset| the offset of the
+  // line in the file.  |line| is valid until the next read.
+  bool ReadLine(StringPiece* line, int64* offset);
+
  private:
-  int max_line_length_;
-  char* line_;                   // input line buffer
-  int line_num_;                 // count line number
-  bool reading_a_long_line_;     // is reading a lone line
   std::string input_filename_;
-  FILE* input_stream_;
+  bool build_keys_;
+  int input_fd_;
+  char* mapped_;                 // The whole file if mmapped, or NULL.
+  size_t mapped_size_;
+  std::string buffer_;           // The read buffer if not mmapped.
+  const char* data_;             // Either mapped_ or buffer_.
+  size_t data_size_;
+  size_t position_;              // Beginning of the next line in data_.
+  size_t scanned_;               // data_[position_, scanned_) has no '\n'.
+  int64 data_offset_;            // Offset of data_ in the file.
+  bool end_of_file_;
+
+  // Reads more data into buffer_, keeping data_[position_, data_size_).
+  bool FillBuffer();
 };
 
-// Read from a MRML RecordIO file, using MRML_RecordIO API.
+// Read from a MRML RecordIO file, using MRML_RecordStreamReader.
 class MRML_RecordReader : public MRML_Reader {
  public:
   explicit MRML_RecordReader(const std::string& filename);
@@ -56,6 +82,49 @@ class MRML_RecordReader : public MRML_Reader {
  private:
   std::string input_filename_;
   FILE* input_stream_;
+  boost::scoped_ptr<MRML_RecordStreamReader> record_reader_;
+};
+
+// Wraps any MRML_Reader, and reads from it in a background thread.
+// Records are read into a ring of |num_batches| batches, each of
+// |batch_size| records, so that reading and decoding overlaps with the
+// processing of records returned by Read.
+class MRML_ReadAheadReader : public MRML_Reader {
+ public:
+  // Takes the ownership of |reader|.
+  MRML_ReadAheadReader(MRML_Reader* reader, int num_batches, int batch_size);
+  virtual ~MRML_ReadAheadReader();
+  virtual bool Read(std::string* key, std::string* value);
+
+ private:
+  struct Batch {
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    int num_records;
+    bool last;                   // The wrapped reader reached the end.
+  };
+
+  boost::scoped_ptr<MRML_Reader> reader_;
+  int batch_size_;
+  std::vector<Batch> batches_;
+
+  // Batches [consume_, consume_ + num_full_) in the ring are filled by
+  // the read-ahead thread and are to be consumed by Read.  The others
+  // are owned by the read-ahead thread.
+  Mutex mutex_;
+  ConditionVariable ring_changed_;
+  int consume_;
+  int num_full_;
+  bool stop_;
+  pthread_t read_ahead_thread_;
+
+  // States of Read, which are accessed only by the consuming thread.
+  Batch* current_;               // The batch being consumed, or NULL.
+  int position_;                 // The next record in current_.
+  bool finished_;
+
+  static void* ReadAheadThread(void* reader);
+  void ReleaseCurrentBatch();
 };
 
 #endif  // MRML_MRML_READER_H_
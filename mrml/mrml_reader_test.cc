@@ -0,0 +1,164 @@
+
+
+//
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/common.h"
+#include "strutil/stringprintf.h"
+#include "mrml/mrml_reader.h"
+
+using std::string;
+using std::vector;
+
+static const char* kTextFilename = "/tmp/testMRMLTextReader";
+
+// Lines of various lengths, including a DOS line, an empty line, and
+// lines longer than a read block of MRML_TextReader.
+static void GenerateLines(vector<string>* lines) {
+  lines->clear();
+  lines->push_back("first line");
+  lines->push_back("");
+  lines->push_back(string(5 * 1024 * 1024, 'a'));
+  lines->push_back("dos line\r");
+  for (int i = 0; i < 10000; ++i) {
+    lines->push_back(StringPrintf("line %d", i));
+  }
+  lines->push_back(string(9 * 1024 * 1024, 'b'));
+  lines->push_back("last line without newline");
+}
+
+static string JoinLines(const vector<string>& lines) {
+  string content;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    content += lines[i];
+    if (i + 1 < lines.size()) {
+      content += '\n';
+    }
+  }
+  return content;
+}
+
+static void WriteTextFile(const string& content) {
+  FILE* output = fopen(kTextFilename, "w");
+  CHECK(output != NULL);
+  fwrite(content.data(), 1, content.size(), output);
+  fclose(output);
+}
+
+static void CheckReadLines(const string& filename, const vector<string>& lines,
+                           bool build_keys) {
+  MRML_TextReader reader(filename, build_keys);
+  string key, value;
+  int64 offset = 0;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    // Keys are set, or cleared, whatever the caller passes in.
+    key = "stale key";
+    ASSERT_TRUE(reader.Read(&key, &value));
+    string expected = lines[i];
+    if (!expected.empty() && expected[expected.size() - 1] == '\r') {
+      expected.resize(expected.size() - 1);
+    }
+    EXPECT_EQ(expected, value);
+    if (build_keys) {
+      EXPECT_EQ(StringPrintf("%s-%010lld", filename.c_str(),
+                             static_cast<long long>(offset)),  // NOLINT
+                key);
+    } else {
+      EXPECT_TRUE(key.empty());
+    }
+    offset += lines[i].size() + 1;
+  }
+  EXPECT_FALSE(reader.Read(&key, &value));
+}
+
+TEST(MRMLTextReaderTest, ReadMappedFile) {
+  vector<string> lines;
+  GenerateLines(&lines);
+  WriteTextFile(JoinLines(lines));
+
+  CheckReadLines(kTextFilename, lines, true);
+  CheckReadLines(kTextFilename, lines, false);
+}
+
+struct PipeWriterArgs {
+  int fd;
+  const string* content;
+};
+
+static void* WritePipe(void* args) {
+  PipeWriterArgs* a = reinterpret_cast<PipeWriterArgs*>(args);
+  size_t written = 0;
+  while (written < a->content->size()) {
+    ssize_t n = write(a->fd, a->content->data() + written,
+                      a->content->size() - written);
+    CHECK_LT(0, n);
+    written += n;
+  }
+  close(a->fd);
+  return NULL;
+}
+
+TEST(MRMLTextReaderTest, ReadPipeInBlocks) {
+  vector<string> lines;
+  GenerateLines(&lines);
+  string content = JoinLines(lines);
+
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  PipeWriterArgs args = { fds[1], &content };
+  pthread_t writer;
+  ASSERT_EQ(0, pthread_create(&writer, NULL, WritePipe, &args));
+
+  // A pipe cannot be mmapped, so the reader reads it in blocks.
+  CheckReadLines(StringPrintf("/dev/fd/%d", fds[0]), lines, true);
+
+  pthread_join(writer, NULL);
+  close(fds[0]);
+}
+
+TEST(MRMLTextReaderTest, ReadEmptyFile) {
+  WriteTextFile("");
+  MRML_TextReader reader(kTextFilename, true);
+  string key, value;
+  EXPECT_FALSE(reader.Read(&key, &value));
+}
+
+TEST(MRMLReadAheadReaderTest, ReadAllRecords) {
+  vector<string> lines;
+  GenerateLines(&lines);
+  WriteTextFile(JoinLines(lines));
+
+  // Batch sizes that do and do not divide the number of lines.
+  for (int batch_size = 1; batch_size <= lines.size(); batch_size *= 7) {
+    MRML_ReadAheadReader reader(new MRML_TextReader(kTextFilename, false),
+                                3, batch_size);
+    string key, value;
+    for (size_t i = 0; i < lines.size(); ++i) {
+      ASSERT_TRUE(reader.Read(&key, &value));
+      if (lines[i] != "dos line\r") {
+        EXPECT_EQ(lines[i], value);
+      }
+    }
+    EXPECT_FALSE(reader.Read(&key, &value));
+    EXPECT_FALSE(reader.Read(&key, &value));
+  }
+}
+
+TEST(MRMLReadAheadReaderTest, DestroyBeforeEnd) {
+  vector<string> lines;
+  GenerateLines(&lines);
+  WriteTextFile(JoinLines(lines));
+
+  MRML_ReadAheadReader reader(new MRML_TextReader(kTextFilename, false),
+                              2, 16);
+  string key, value;
+  ASSERT_TRUE(reader.Read(&key, &value));
+  EXPECT_EQ(lines[0], value);
+}
@@ -0,0 +1,245 @@
+
+
+//
+#include "mrml/mrml_record_index.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base/common.h"
+#include "hash/crc32c.h"
+#include "mrml/mrml_recordio.h"
+#include "strutil/string_piece.h"
+
+using std::string;
+using std::vector;
+
+string MRML_RecordIndexFilename(const string& filename) {
+  return filename + ".idx";
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of MRML_RecordIndexBuilder
+//-----------------------------------------------------------------------------
+
+MRML_RecordIndexBuilder::MRML_RecordIndexBuilder(int interval,
+                                                 bool recordio_v2)
+    : interval_(interval), recordio_v2_(recordio_v2), num_records_(0) {
+  CHECK_LT(0, interval);
+}
+
+void MRML_RecordIndexBuilder::Add(uint64 offset, uint32 skip) {
+  if (num_records_ % interval_ == 0) {
+    MRML_RecordPosition position;
+    position.offset = offset;
+    position.skip = skip;
+    entries_.push_back(position);
+  }
+  ++num_records_;
+}
+
+void MRML_RecordIndexBuilder::AddBytes(const char* data, size_t size) {
+  if (head_.size() < kRecordIndexEdgeSize) {
+    head_.append(data, std::min(size, kRecordIndexEdgeSize - head_.size()));
+  }
+  if (size >= kRecordIndexEdgeSize) {
+    tail_.assign(data + size - kRecordIndexEdgeSize, kRecordIndexEdgeSize);
+    return;
+  }
+  // Trims the tail only when it doubles, so that appending small records
+  // costs constant time on average.
+  tail_.append(data, size);
+  if (tail_.size() >= 2 * kRecordIndexEdgeSize) {
+    tail_.erase(0, tail_.size() - kRecordIndexEdgeSize);
+  }
+}
+
+// Returns the CRC32C of the first and the last kRecordIndexEdgeSize
+// bytes of a file, which overlap if the file is small.
+static uint32 EdgeChecksum(const StringPiece& head, const StringPiece& tail) {
+  return CRC32CExtend(CRC32C(head.data(), head.size()),
+                      tail.data(), tail.size());
+}
+
+bool MRML_RecordIndexBuilder::WriteToFile(const string& index_filename,
+                                          uint64 file_size) const {
+  size_t tail_size = std::min(tail_.size(), kRecordIndexEdgeSize);
+  uint32 edge_checksum = EdgeChecksum(
+      head_, StringPiece(tail_.data() + tail_.size() - tail_size, tail_size));
+  FILE* output = fopen(index_filename.c_str(), "w");
+  if (output == NULL) {
+    LOG(ERROR) << "Cannot open index file: " << index_filename;
+    return false;
+  }
+  uint32 interval = interval_;
+  uint32 flags = recordio_v2_ ? kRecordIndexOfV2 : 0;
+  uint64 num_entries = entries_.size();
+  bool succeeded =
+      fwrite(&kRecordIndexMagic, sizeof(kRecordIndexMagic), 1, output) == 1 &&
+      fwrite(&interval, sizeof(interval), 1, output) == 1 &&
+      fwrite(&flags, sizeof(flags), 1, output) == 1;
+  for (size_t i = 0; succeeded && i < entries_.size(); ++i) {
+    succeeded =
+        fwrite(&entries_[i].offset, sizeof(entries_[i].offset), 1,
+               output) == 1 &&
+        fwrite(&entries_[i].skip, sizeof(entries_[i].skip), 1, output) == 1;
+  }
+  succeeded = succeeded &&
+      fwrite(&num_entries, sizeof(num_entries), 1, output) == 1 &&
+      fwrite(&num_records_, sizeof(num_records_), 1, output) == 1 &&
+      fwrite(&file_size, sizeof(file_size), 1, output) == 1 &&
+      fwrite(&edge_checksum, sizeof(edge_checksum), 1, output) == 1 &&
+      fwrite(&kRecordIndexMagic, sizeof(kRecordIndexMagic), 1, output) == 1;
+  succeeded = fclose(output) == 0 && succeeded;
+  if (!succeeded) {
+    LOG(ERROR) << "Failed in writing index file: " << index_filename;
+  }
+  return succeeded;
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of MRML_RecordIndex
+//-----------------------------------------------------------------------------
+
+MRML_RecordIndex::MRML_RecordIndex()
+    : interval_(1), recordio_v2_(false), num_records_(0), file_size_(0) {}
+
+// Copies a value of type T from |*p| and advances |*p|.
+template <class T>
+static T ReadValue(const char** p) {
+  T value;
+  memcpy(&value, *p, sizeof(value));
+  *p += sizeof(value);
+  return value;
+}
+
+// Returns the EdgeChecksum of local file |filename| of |file_size|
+// bytes, or 0 if the file cannot be read.
+static uint32 ReadEdgeChecksum(const string& filename, uint64 file_size) {
+  size_t edge_size = std::min(file_size,
+                              static_cast<uint64>(kRecordIndexEdgeSize));
+  string head(edge_size, '\0'), tail(edge_size, '\0');
+  FILE* input = fopen(filename.c_str(), "r");
+  if (input == NULL) {
+    return 0;
+  }
+  bool succeeded = edge_size == 0 ||
+      (fread(&head[0], 1, edge_size, input) == edge_size &&
+       fseeko(input, file_size - edge_size, SEEK_SET) == 0 &&
+       fread(&tail[0], 1, edge_size, input) == edge_size);
+  fclose(input);
+  return succeeded ? EdgeChecksum(head, tail) : 0;
+}
+
+bool MRML_RecordIndex::Load(const string& filename) {
+  entries_.clear();
+  num_records_ = 0;
+
+  struct stat file_stat;
+  if (stat(filename.c_str(), &file_stat) != 0) {
+    return false;
+  }
+  FILE* input = fopen(MRML_RecordIndexFilename(filename).c_str(), "r");
+  if (input == NULL) {
+    return false;
+  }
+  string content;
+  char buffer[64 * 1024];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), input)) > 0) {
+    content.append(buffer, size);
+  }
+  fclose(input);
+
+  static const size_t kHeaderSize = sizeof(uint32) * 3;
+  static const size_t kEntrySize = sizeof(uint64) + sizeof(uint32);
+  static const size_t kFooterSize = sizeof(uint64) * 3 + sizeof(uint32) * 2;
+  if (content.size() < kHeaderSize + kFooterSize) {
+    LOG(ERROR) << "Ignoring corrupted index of " << filename;
+    return false;
+  }
+  const char* header = content.data();
+  const char* footer = content.data() + content.size() - kFooterSize;
+  uint32 magic = ReadValue<uint32>(&header);
+  uint32 interval = ReadValue<uint32>(&header);
+  uint32 flags = ReadValue<uint32>(&header);
+  uint64 num_entries = ReadValue<uint64>(&footer);
+  uint64 num_records = ReadValue<uint64>(&footer);
+  uint64 file_size = ReadValue<uint64>(&footer);
+  uint32 edge_checksum = ReadValue<uint32>(&footer);
+  uint32 footer_magic = ReadValue<uint32>(&footer);
+  if (magic != kRecordIndexMagic || footer_magic != kRecordIndexMagic ||
+      interval == 0 ||
+      content.size() != kHeaderSize + num_entries * kEntrySize + kFooterSize ||
+      num_entries != (num_records + interval - 1) / interval) {
+    LOG(ERROR) << "Ignoring corrupted index of " << filename;
+    return false;
+  }
+  // A file rewritten to the same size is told by its edges.
+  if (file_size != static_cast<uint64>(file_stat.st_size) ||
+      edge_checksum != ReadEdgeChecksum(filename, file_size)) {
+    LOG(ERROR) << "Ignoring stale index of " << filename;
+    return false;
+  }
+
+  entries_.resize(num_entries);
+  for (size_t i = 0; i < num_entries; ++i) {
+    entries_[i].offset = ReadValue<uint64>(&header);
+    entries_[i].skip = ReadValue<uint32>(&header);
+  }
+  interval_ = interval;
+  recordio_v2_ = (flags & kRecordIndexOfV2) != 0;
+  num_records_ = num_records;
+  file_size_ = file_size;
+  return true;
+}
+
+MRML_RecordPosition MRML_RecordIndex::Locate(uint64 ordinal,
+                                             uint64* skip) const {
+  CHECK_LT(ordinal, num_records_);
+  const MRML_RecordPosition& position = entries_[ordinal / interval_];
+  *skip = position.skip + ordinal % interval_;
+  return position;
+}
+
+void MRML_RecordIndex::PlanSplits(int num_splits,
+                                  vector<uint64>* split_begins) const {
+  CHECK_LT(0, num_splits);
+  split_begins->clear();
+  size_t entry = 0;
+  for (int i = 0; i < num_splits; ++i) {
+    uint64 target = file_size_ / num_splits * i;
+    while (entry < entries_.size() && entries_[entry].offset < target) {
+      ++entry;
+    }
+    split_begins->push_back(
+        std::min(static_cast<uint64>(entry) * interval_, num_records_));
+  }
+}
+
+bool MRML_CountRecords(const string& filename, uint64* num_records) {
+  MRML_RecordIndex index;
+  if (index.Load(filename)) {
+    *num_records = index.NumRecords();
+    return true;
+  }
+
+  FILE* input = fopen(filename.c_str(), "r");
+  if (input == NULL) {
+    LOG(ERROR) << "Cannot open " << filename;
+    return false;
+  }
+  MRML_RecordStreamReader reader(input);
+  StringPiece key, value;
+  *num_records = 0;
+  while (reader.Read(&key, &value)) {
+    ++*num_records;
+  }
+  fclose(input);
+  return true;
+}
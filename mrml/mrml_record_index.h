@@ -0,0 +1,113 @@
+
+
+//
+// A record index is a sidecar file of a RecordIO file, of either v1 or
+// v2, named by MRML_RecordIndexFilename.  It samples the position of
+// every |interval|-th record, so that a reader can seek to any record
+// by reading at most |interval| - 1 records after the sampled one (and
+// those before it in a v2 block), and the number of records and
+// balanced splits of a file can be known without scanning the file.
+//
+// An index file consists of
+//
+//   header:   uint32 kRecordIndexMagic, uint32 interval, uint32 flags
+//   entries:  for records 0, interval, 2 * interval, ..., each as
+//               uint64 offset  -- of the record in a v1 file, or of the
+//                                 block containing the record in a v2
+//                                 file
+//               uint32 skip    -- records before it in the v2 block
+//   footer:   uint64 num_entries, uint64 num_records,
+//             uint64 file_size, uint32 edge_checksum,
+//             uint32 kRecordIndexMagic
+//
+// where file_size, the size of the indexed file, and edge_checksum, the
+// CRC32C of its first and last kRecordIndexEdgeSize bytes, tell if the
+// index is stale.  flags has kRecordIndexOfV2 set if the indexed file is
+// v2.
+//
+#ifndef MRML_MRML_RECORD_INDEX_H_
+#define MRML_MRML_RECORD_INDEX_H_
+
+#include <string>
+#include <vector>
+
+#include "base/common.h"
+
+static const uint32 kRecordIndexMagic = 0x58444952;  // "RIDX"
+static const uint32 kRecordIndexOfV2 = 0x1;
+static const size_t kRecordIndexEdgeSize = 4096;
+
+struct MRML_RecordPosition {
+  uint64 offset;
+  uint32 skip;
+};
+
+// Returns the name of the index file of RecordIO file |filename|.
+std::string MRML_RecordIndexFilename(const std::string& filename);
+
+// Collects positions of records in the order they are written.
+class MRML_RecordIndexBuilder {
+ public:
+  MRML_RecordIndexBuilder(int interval, bool recordio_v2);
+
+  // Adds the position of the next record.
+  void Add(uint64 offset, uint32 skip);
+
+  // Appends bytes written into the indexed file, of which the builder
+  // keeps the first and last kRecordIndexEdgeSize bytes.
+  void AddBytes(const char* data, size_t size);
+
+  // Writes the index of a file of |file_size| bytes.
+  bool WriteToFile(const std::string& index_filename, uint64 file_size) const;
+
+  uint64 NumRecords() const { return num_records_; }
+
+ private:
+  int interval_;
+  bool recordio_v2_;
+  uint64 num_records_;
+  std::vector<MRML_RecordPosition> entries_;
+  std::string head_;            // The first kRecordIndexEdgeSize bytes.
+  std::string tail_;            // Ends with the last kRecordIndexEdgeSize.
+
+  DISALLOW_COPY_AND_ASSIGN(MRML_RecordIndexBuilder);
+};
+
+class MRML_RecordIndex {
+ public:
+  MRML_RecordIndex();
+
+  // Loads the index of local RecordIO file |filename|.  Returns false
+  // if there is no index, or the index is corrupted or stale.
+  bool Load(const std::string& filename);
+
+  uint64 NumRecords() const { return num_records_; }
+  bool IsOfRecordIOV2() const { return recordio_v2_; }
+
+  // Returns the sampled position to start reading for record
+  // |ordinal|, which must be less than NumRecords(), and in |skip|
+  // the number of records to be skipped from the position.
+  MRML_RecordPosition Locate(uint64 ordinal, uint64* skip) const;
+
+  // Divides records into |num_splits| ranges of about the same number
+  // of bytes, at sampled records.  (*split_begins)[i] is the ordinal of
+  // the first record of split i, and split i ends where split i + 1
+  // begins, or at NumRecords().  Splits may be empty if there are too
+  // few sampled records.
+  void PlanSplits(int num_splits, std::vector<uint64>* split_begins) const;
+
+ private:
+  int interval_;
+  bool recordio_v2_;
+  uint64 num_records_;
+  uint64 file_size_;
+  std::vector<MRML_RecordPosition> entries_;
+
+  DISALLOW_COPY_AND_ASSIGN(MRML_RecordIndex);
+};
+
+// Counts the records of local RecordIO file |filename|, using its
+// index if valid, or by reading through the file otherwise.
+bool MRML_CountRecords(const std::string& filename, uint64* num_records);
+
+#endif  // MRML_MRML_RECORD_INDEX_H_
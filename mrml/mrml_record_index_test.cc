@@ -0,0 +1,145 @@
+
+
+//
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/common.h"
+#include "strutil/stringprintf.h"
+#include "mrml/mrml_filesystem.h"
+#include "mrml/mrml_record_index.h"
+#include "mrml/mrml_recordio.h"
+
+using std::string;
+using std::vector;
+
+static const char* kFilename = "/tmp/testMRMLRecordIndex";
+static const int kNumRecords = 1000;
+static const int kInterval = 7;
+
+static void WriteRecords(bool recordio_v2) {
+  FILE* output = fopen(kFilename, "w");
+  CHECK(output != NULL);
+  MRML_RecordWriter writer(output, recordio_v2, 256, true);
+  writer.BuildIndex(MRML_RecordIndexFilename(kFilename), kInterval);
+  for (int i = 0; i < kNumRecords; ++i) {
+    CHECK(writer.Write(StringPrintf("key-%d", i), string(i % 50, 'v')));
+  }
+  CHECK(writer.Close());
+  fclose(output);
+}
+
+TEST(MRMLRecordIndexTest, SeekToRecord) {
+  for (int v2 = 0; v2 < 2; ++v2) {
+    WriteRecords(v2);
+    MRML_RecordIndex index;
+    ASSERT_TRUE(index.Load(kFilename));
+    EXPECT_EQ(kNumRecords, index.NumRecords());
+    EXPECT_EQ(v2 != 0, index.IsOfRecordIOV2());
+
+    FILE* input = fopen(kFilename, "r");
+    ASSERT_TRUE(input != NULL);
+    MRML_RecordStreamReader reader(input);
+    static const int kOrdinals[] = { 500, 0, 1, 6, 7, 8, 999, 13 };
+    for (int i = 0; i < sizeof(kOrdinals) / sizeof(kOrdinals[0]); ++i) {
+      ASSERT_TRUE(reader.SeekToRecord(index, kOrdinals[i]));
+      string key, value;
+      ASSERT_TRUE(reader.Read(&key, &value));
+      EXPECT_EQ(StringPrintf("key-%d", kOrdinals[i]), key);
+      EXPECT_EQ(string(kOrdinals[i] % 50, 'v'), value);
+      if (kOrdinals[i] + 1 < kNumRecords) {
+        ASSERT_TRUE(reader.Read(&key, &value));
+        EXPECT_EQ(StringPrintf("key-%d", kOrdinals[i] + 1), key);
+      } else {
+        EXPECT_FALSE(reader.Read(&key, &value));
+      }
+    }
+    EXPECT_FALSE(reader.SeekToRecord(index, kNumRecords));
+    fclose(input);
+
+    // Seek through an MRMLFS_File.
+    MRMLFS_File file(kFilename, true);
+    MRML_RecordStreamReader file_reader(&file);
+    ASSERT_TRUE(file_reader.SeekToRecord(index, 123));
+    string key, value;
+    ASSERT_TRUE(file_reader.Read(&key, &value));
+    EXPECT_EQ("key-123", key);
+  }
+}
+
+TEST(MRMLRecordIndexTest, CountRecordsAndPlanSplits) {
+  for (int v2 = 0; v2 < 2; ++v2) {
+    WriteRecords(v2);
+    uint64 num_records = 0;
+    ASSERT_TRUE(MRML_CountRecords(kFilename, &num_records));
+    EXPECT_EQ(kNumRecords, num_records);
+
+    MRML_RecordIndex index;
+    ASSERT_TRUE(index.Load(kFilename));
+    vector<uint64> split_begins;
+    index.PlanSplits(4, &split_begins);
+    ASSERT_EQ(4, split_begins.size());
+    EXPECT_EQ(0, split_begins[0]);
+    for (int i = 1; i < 4; ++i) {
+      // Records are of about the same size, so are the splits.
+      EXPECT_LT(split_begins[i - 1], split_begins[i]);
+      EXPECT_NEAR(kNumRecords / 4 * i, split_begins[i], kNumRecords / 10);
+    }
+  }
+}
+
+TEST(MRMLRecordIndexTest, IgnoreStaleIndex) {
+  WriteRecords(false);
+  FILE* output = fopen(kFilename, "a");
+  ASSERT_TRUE(output != NULL);
+  MRML_WriteRecord(output, "key", "value");
+  fclose(output);
+
+  MRML_RecordIndex index;
+  EXPECT_FALSE(index.Load(kFilename));
+  uint64 num_records = 0;
+  ASSERT_TRUE(MRML_CountRecords(kFilename, &num_records));
+  EXPECT_EQ(kNumRecords + 1, num_records);
+}
+
+TEST(MRMLRecordIndexTest, IgnoreIndexOfRewrittenFile) {
+  for (int v2 = 0; v2 < 2; ++v2) {
+    // Rewrite the last byte, keeping the size of the file.
+    WriteRecords(v2);
+    FILE* output = fopen(kFilename, "r+");
+    ASSERT_TRUE(output != NULL);
+    ASSERT_EQ(0, fseek(output, -1, SEEK_END));
+    int last = fgetc(output);
+    ASSERT_EQ(0, fseek(output, -1, SEEK_END));
+    fputc(last ^ 0xff, output);
+    fclose(output);
+
+    MRML_RecordIndex index;
+    EXPECT_FALSE(index.Load(kFilename));
+  }
+}
+
+TEST(MRMLRecordIndexTest, RewindAfterSeek) {
+  for (int v2 = 0; v2 < 2; ++v2) {
+    WriteRecords(v2);
+    MRML_RecordIndex index;
+    ASSERT_TRUE(index.Load(kFilename));
+
+    FILE* input = fopen(kFilename, "r");
+    ASSERT_TRUE(input != NULL);
+    MRML_RecordStreamReader reader(input);
+    ASSERT_TRUE(reader.SeekToRecord(index, 500));
+    ASSERT_TRUE(reader.Rewind());
+    string key, value;
+    for (int i = 0; i < kNumRecords; ++i) {
+      ASSERT_TRUE(reader.Read(&key, &value));
+      EXPECT_EQ(StringPrintf("key-%d", i), key);
+    }
+    EXPECT_FALSE(reader.Read(&key, &value));
+    fclose(input);
+  }
+}
@@ -6,9 +6,15 @@
 #include <string>
 
 #include "base/common.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/wire_format_lite.h"
 #include "mrml/mrml.pb.h"
 #include "mrml/mrml_filesystem.h"
+#include "mrml/mrml_record_index.h"
+#include "mrml/mrml_recordio_v2.h"
 
+using google::protobuf::internal::WireFormatLite;
+using google::protobuf::io::CodedInputStream;
 using std::string;
 
 typedef ::google::protobuf::Message ProtoMessage;
@@ -60,17 +66,98 @@ bool IOStreamAdaptor<MRMLFS_File>::Write(char* buffer, size_t size) {
 template <class ValueType>
 class SaveValue {
  public:
-  SaveValue(KeyValuePair* pair, ValueType* value);
+  SaveValue(const StringPiece& encoded_value, ValueType* value);
 };
 
 template <>
-SaveValue<string>::SaveValue(KeyValuePair* pair, string* value) {
-  value->swap(*pair->mutable_value());
+SaveValue<string>::SaveValue(const StringPiece& encoded_value, string* value) {
+  value->assign(encoded_value.data(), encoded_value.size());
 }
 
 template <>
-SaveValue<ProtoMessage>::SaveValue(KeyValuePair* pair, ProtoMessage* msg) {
-  msg->ParseFromString(pair->value());
+SaveValue<ProtoMessage>::SaveValue(const StringPiece& encoded_value,
+                                   ProtoMessage* msg) {
+  msg->ParseFromArray(encoded_value.data(), encoded_value.size());
+}
+
+//-----------------------------------------------------------------------------
+// Rather than parsing an encoded KeyValuePair into a message, which
+// copies the key and the value, and then parsing the value again, we
+// scan the wire format for the key and the value in place.
+//-----------------------------------------------------------------------------
+static bool DecodeKeyValuePair(const StringPiece& encoded_pair,
+                               StringPiece* key,
+                               StringPiece* value) {
+  const uint8* data = reinterpret_cast<const uint8*>(encoded_pair.data());
+  CodedInputStream input(data, encoded_pair.size());
+  key->set(NULL, 0);
+  value->set(NULL, 0);
+  uint32 tag;
+  while ((tag = input.ReadTag()) != 0) {
+    int field = WireFormatLite::GetTagFieldNumber(tag);
+    if ((field == KeyValuePair::kKeyFieldNumber ||
+         field == KeyValuePair::kValueFieldNumber) &&
+        WireFormatLite::GetTagWireType(tag) ==
+        WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      uint32 size;
+      if (!input.ReadVarint32(&size)) {
+        return false;
+      }
+      int position = input.CurrentPosition();
+      if (!input.Skip(size)) {
+        return false;
+      }
+      (field == KeyValuePair::kKeyFieldNumber ? key : value)->set(
+          encoded_pair.data() + position, size);
+    } else if (!WireFormatLite::SkipField(&input, tag)) {
+      return false;
+    }
+  }
+  return input.ConsumedEntireMessage();
+}
+
+template <class ValueType>
+void SaveRecord(const StringPiece& encoded_pair,
+                string* key,
+                ValueType* value) {
+  StringPiece key_piece, value_piece;
+  CHECK(DecodeKeyValuePair(encoded_pair, &key_piece, &value_piece));
+  key->assign(key_piece.data(), key_piece.size());
+  SaveValue<ValueType>(value_piece, value);
+}
+
+//-----------------------------------------------------------------------------
+// RecordIOV2Reader reads through an MRML_ByteSource, which is adapted
+// from either kind of input streams.
+//-----------------------------------------------------------------------------
+template <class StreamType>
+class ByteSourceAdaptor : public MRML_ByteSource {
+ public:
+  explicit ByteSourceAdaptor(StreamType* is) : is_(is) {}
+  virtual size_t Read(char* buffer, size_t size);
+  virtual bool Seek(uint64 offset);
+ private:
+  StreamType* is_;
+};
+
+template <>
+size_t ByteSourceAdaptor<FILE>::Read(char* buffer, size_t size) {
+  return fread(buffer, 1, size, is_);
+}
+
+template <>
+size_t ByteSourceAdaptor<MRMLFS_File>::Read(char* buffer, size_t size) {
+  return is_->Read(buffer, size);
+}
+
+template <>
+bool ByteSourceAdaptor<FILE>::Seek(uint64 offset) {
+  return fseeko(is_, offset, SEEK_SET) == 0;
+}
+
+template <>
+bool ByteSourceAdaptor<MRMLFS_File>::Seek(uint64 offset) {
+  return is_->Seek(offset);
 }
 
 //-----------------------------------------------------------------------------
@@ -93,6 +180,14 @@ bool ReadRecord(StreamType* input_stream,
     return false;
   }
 
+  // No v1 record can be as large as kRecordIOV2Magic, so this is the
+  // beginning of a v2 stream, whose reading state a FILE* cannot keep.
+  if (encoded_msg_size == kRecordIOV2Magic) {
+    LOG(ERROR) << "Cannot read RecordIO v2 from a FILE* by MRML_ReadRecord. "
+               << "Use MRML_RecordStreamReader instead.";
+    return false;
+  }
+
   if (encoded_msg_size > kMRMLRecordIOMaxRecordSize) {
     LOG(FATAL) << "Failed to read a proto message with size = "
                << encoded_msg_size
@@ -102,16 +197,13 @@ bool ReadRecord(StreamType* input_stream,
                << __FILE__;
   }
 
-  static char buffer[kMRMLRecordIOMaxRecordSize];
-  if (!is.Read(buffer, encoded_msg_size)) {
+  string buffer(encoded_msg_size, '\0');
+  if (encoded_msg_size > 0 && !is.Read(&buffer[0], encoded_msg_size)) {
     LOG(ERROR) << "Failed in reading a protocol buffer message.";
     return false;
   }
 
-  KeyValuePair pair;
-  CHECK(pair.ParseFromArray(buffer, encoded_msg_size));
-  key->swap(*pair.mutable_key());
-  SaveValue<ValueType>(&pair, value);
+  SaveRecord<ValueType>(StringPiece(buffer), key, value);
   return true;
 }
 
@@ -128,12 +220,136 @@ bool MRML_ReadRecord(FILE* input, string* key, ProtoMessage* value) {
   return ReadRecord<FILE, ProtoMessage>(input, key, value);
 }
 
+// An MRMLFS_File keeps the state of reading its records, which is
+// released when the file is closed.
 bool MRML_ReadRecord(MRMLFS_File* input, string* key, string* value) {
-  return ReadRecord<MRMLFS_File, string>(input, key, value);
+  return input->record_reader()->Read(key, value);
 }
 
 bool MRML_ReadRecord(MRMLFS_File* input, string* key, ProtoMessage* value) {
-  return ReadRecord<MRMLFS_File, ProtoMessage>(input, key, value);
+  return input->record_reader()->Read(key, value);
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of MRML_RecordStreamReader
+//-----------------------------------------------------------------------------
+
+MRML_RecordStreamReader::MRML_RecordStreamReader(FILE* input)
+    : source_(new ByteSourceAdaptor<FILE>(input)),
+      format_detected_(false) {
+  CHECK_NOTNULL(input);
+}
+
+MRML_RecordStreamReader::MRML_RecordStreamReader(MRMLFS_File* input)
+    : source_(new ByteSourceAdaptor<MRMLFS_File>(input)),
+      format_detected_(false) {
+  CHECK_NOTNULL(input);
+}
+
+MRML_RecordStreamReader::~MRML_RecordStreamReader() {}
+
+bool MRML_RecordStreamReader::Read(StringPiece* key, StringPiece* value) {
+  StringPiece encoded_pair;
+  if (!ReadEncodedPair(&encoded_pair)) {
+    return false;
+  }
+  CHECK(DecodeKeyValuePair(encoded_pair, key, value));
+  return true;
+}
+
+bool MRML_RecordStreamReader::Read(string* key, string* value) {
+  StringPiece encoded_pair;
+  if (!ReadEncodedPair(&encoded_pair)) {
+    return false;
+  }
+  SaveRecord<string>(encoded_pair, key, value);
+  return true;
+}
+
+bool MRML_RecordStreamReader::Read(string* key, ProtoMessage* value) {
+  StringPiece encoded_pair;
+  if (!ReadEncodedPair(&encoded_pair)) {
+    return false;
+  }
+  SaveRecord<ProtoMessage>(encoded_pair, key, value);
+  return true;
+}
+
+bool MRML_RecordStreamReader::Rewind() {
+  v2_reader_.reset();
+  format_detected_ = false;
+  return source_->Seek(0);
+}
+
+bool MRML_RecordStreamReader::SeekToRecord(const MRML_RecordIndex& index,
+                                           uint64 ordinal) {
+  if (ordinal >= index.NumRecords()) {
+    return false;
+  }
+  // A v2 reader reads the file header before seeking to a block.
+  if (index.IsOfRecordIOV2() && v2_reader_.get() == NULL) {
+    if (!source_->Seek(0)) {
+      return false;
+    }
+    v2_reader_.reset(new RecordIOV2Reader(source_.get(), false));
+  }
+  format_detected_ = true;
+
+  uint64 skip;
+  MRML_RecordPosition position = index.Locate(ordinal, &skip);
+  if (!source_->Seek(position.offset)) {
+    return false;
+  }
+  if (v2_reader_.get() != NULL) {
+    v2_reader_->Restart();
+  }
+  StringPiece encoded_pair;
+  for (uint64 i = 0; i < skip; ++i) {
+    if (!ReadEncodedPair(&encoded_pair)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool MRML_RecordStreamReader::ReadEncodedPair(StringPiece* encoded_pair) {
+  if (v2_reader_.get() != NULL) {
+    return v2_reader_->Next(encoded_pair);
+  }
+
+  uint32 encoded_msg_size;
+  if (source_->Read(reinterpret_cast<char*>(&encoded_msg_size),
+                    sizeof(encoded_msg_size)) != sizeof(encoded_msg_size)) {
+    return false;
+  }
+
+  if (!format_detected_) {
+    format_detected_ = true;
+    if (encoded_msg_size == kRecordIOV2Magic) {
+      v2_reader_.reset(new RecordIOV2Reader(source_.get(), true));
+      return v2_reader_->Next(encoded_pair);
+    }
+  }
+
+  if (encoded_msg_size > kMRMLRecordIOMaxRecordSize) {
+    LOG(FATAL) << "Failed to read a proto message with size = "
+               << encoded_msg_size
+               << ", which is larger than kMRMLRecordIOMaxRecordSize ("
+               << kMRMLRecordIOMaxRecordSize << ").";
+  }
+
+  // The buffer only grows, so reading records of similar sizes does
+  // not allocate memory.
+  if (buffer_.size() < encoded_msg_size) {
+    buffer_.resize(encoded_msg_size);
+  }
+  if (encoded_msg_size > 0 &&
+      source_->Read(&buffer_[0], encoded_msg_size) != encoded_msg_size) {
+    LOG(ERROR) << "Failed in reading a protocol buffer message.";
+    return false;
+  }
+  encoded_pair->set(buffer_.data(), encoded_msg_size);
+  return true;
 }
 
 //-----------------------------------------------------------------------------
@@ -220,3 +436,110 @@ bool MRML_WriteRecord(MRMLFS_File* output,
   return WriteRecord<MRMLFS_File, ProtoMessage>(output, key, value);
 }
 
+
+//-----------------------------------------------------------------------------
+// Implementation of MRML_RecordWriter
+//-----------------------------------------------------------------------------
+
+MRML_RecordWriter::MRML_RecordWriter(FILE* output, bool recordio_v2,
+                                     int block_size, bool compress)
+    : file_(output), mrmlfs_file_(NULL) {
+  CHECK_NOTNULL(output);
+  Initialize(recordio_v2, block_size, compress);
+}
+
+MRML_RecordWriter::MRML_RecordWriter(MRMLFS_File* output, bool recordio_v2,
+                                     int block_size, bool compress)
+    : file_(NULL), mrmlfs_file_(output) {
+  CHECK_NOTNULL(output);
+  Initialize(recordio_v2, block_size, compress);
+}
+
+MRML_RecordWriter::~MRML_RecordWriter() {
+  if (!closed_) {
+    Close();
+  }
+}
+
+void MRML_RecordWriter::Initialize(bool recordio_v2, int block_size,
+                                   bool compress) {
+  closed_ = false;
+  bytes_written_ = 0;
+  if (recordio_v2) {
+    v2_writer_.reset(new RecordIOV2Writer(block_size, compress));
+    v2_writer_->Start(&pending_output_);
+  }
+}
+
+bool MRML_RecordWriter::Write(const string& key, const string& value) {
+  EncodeKeyValuePair<string>(key, value, &encoded_pair_);
+  return WriteEncodedPair();
+}
+
+bool MRML_RecordWriter::Write(const string& key, const ProtoMessage& value) {
+  EncodeKeyValuePair<ProtoMessage>(key, value, &encoded_pair_);
+  return WriteEncodedPair();
+}
+
+void MRML_RecordWriter::BuildIndex(const string& index_filename,
+                                   int interval) {
+  CHECK_EQ(bytes_written_, 0);
+  index_filename_ = index_filename;
+  index_builder_.reset(new MRML_RecordIndexBuilder(interval,
+                                                   v2_writer_.get() != NULL));
+}
+
+bool MRML_RecordWriter::WriteEncodedPair() {
+  CHECK(!closed_);
+  if (index_builder_.get() != NULL) {
+    if (v2_writer_.get() == NULL) {
+      index_builder_->Add(bytes_written_, 0);
+    } else {
+      uint32 skip;
+      uint64 offset = v2_writer_->NextRecordPosition(&skip);
+      index_builder_->Add(offset, skip);
+    }
+  }
+  if (v2_writer_.get() == NULL) {
+    uint32 msg_size = encoded_pair_.size();
+    pending_output_.assign(reinterpret_cast<char*>(&msg_size),
+                           sizeof(msg_size));
+    pending_output_.append(encoded_pair_);
+  } else {
+    v2_writer_->Append(StringPiece(encoded_pair_), &pending_output_);
+  }
+  return WritePendingOutput();
+}
+
+bool MRML_RecordWriter::Close() {
+  CHECK(!closed_);
+  closed_ = true;
+  if (v2_writer_.get() != NULL) {
+    v2_writer_->Finish(&pending_output_);
+  }
+  bool succeeded = WritePendingOutput();
+  if (succeeded && index_builder_.get() != NULL) {
+    succeeded = index_builder_->WriteToFile(index_filename_, bytes_written_);
+  }
+  return succeeded;
+}
+
+bool MRML_RecordWriter::WritePendingOutput() {
+  if (pending_output_.empty()) {
+    return true;
+  }
+  bool succeeded = (file_ != NULL) ?
+      IOStreamAdaptor<FILE>(file_).Write(&pending_output_[0],
+                                         pending_output_.size()) :
+      IOStreamAdaptor<MRMLFS_File>(mrmlfs_file_).Write(&pending_output_[0],
+                                                       pending_output_.size());
+  if (index_builder_.get() != NULL) {
+    index_builder_->AddBytes(pending_output_.data(), pending_output_.size());
+  }
+  bytes_written_ += pending_output_.size();
+  pending_output_.clear();
+  if (!succeeded) {
+    LOG(ERROR) << "Failed in writing records.";
+  }
+  return succeeded;
+}
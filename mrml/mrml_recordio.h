@@ -2,6 +2,14 @@
 //
 // The interface to accessing MRML RecordIO files.
 //
+// MRML_ReadRecord reads both RecordIO v1 files and the block-structured
+// RecordIO v2 files (c.f. mrml_recordio_v2.h) from an MRMLFS_File,
+// which keeps the state of reading until it is closed.  The format of a
+// file is detected by its first read.  From a FILE*, MRML_ReadRecord
+// reads RecordIO v1 only; MRML_RecordStreamReader reads both.
+// MRML_WriteRecord writes RecordIO v1; to write RecordIO v2, use
+// MRML_RecordWriter.
+//
 #ifndef MRML_MRML_RECORDIO_H_
 #define MRML_MRML_RECORDIO_H_
 
@@ -9,13 +17,22 @@
 
 #include <string>
 
+#include "base/common.h"
+#include "boost/scoped_ptr.hpp"
+#include "strutil/string_piece.h"
+
 namespace google {
   namespace protobuf {
     class Message;
   }
 }
 
+class MRML_ByteSource;
+class MRML_RecordIndex;
+class MRML_RecordIndexBuilder;
 class MRMLFS_File;
+class RecordIOV2Reader;
+class RecordIOV2Writer;
 
 bool MRML_ReadRecord(FILE* input,
                      std::string* key,
@@ -43,4 +60,90 @@ bool MRML_WriteRecord(MRMLFS_File* output,
                       const std::string& key,
                       const ::google::protobuf::Message& value);
 
+// Reads records from a FILE* or an MRMLFS_File, of either format.
+// Unlike MRML_ReadRecord, the reader keeps its states in itself, so
+// readers of different streams can work in parallel.  It reads records
+// into a buffer that it owns and reuses, and decodes keys and values
+// in place from the buffer, without an intermediate KeyValuePair.  The
+// reader does not take the ownership of the input stream, nor close it.
+class MRML_RecordStreamReader {
+ public:
+  explicit MRML_RecordStreamReader(FILE* input);
+  explicit MRML_RecordStreamReader(MRMLFS_File* input);
+  ~MRML_RecordStreamReader();
+
+  // All return false at the end of records.
+  bool Read(std::string* key, std::string* value);
+  bool Read(std::string* key, ::google::protobuf::Message* value);
+
+  // Points |key| and |value| into the buffer of the reader, without
+  // copying.  They are valid until the next read.
+  bool Read(StringPiece* key, StringPiece* value);
+
+  // Positions the reader so that the next read returns record
+  // |ordinal|, given |index| of the input (c.f. mrml_record_index.h).
+  // Returns false if there is no such record or the input is not
+  // seekable.  A failed seek may leave the reader anywhere in the
+  // input; use Rewind before reading the records again.
+  bool SeekToRecord(const MRML_RecordIndex& index, uint64 ordinal);
+
+  // Positions the reader at the beginning of the input, so that the
+  // format is detected again.  Returns false if the input is not
+  // seekable.
+  bool Rewind();
+
+ private:
+  boost::scoped_ptr<MRML_ByteSource> source_;
+  boost::scoped_ptr<RecordIOV2Reader> v2_reader_;
+  bool format_detected_;
+  std::string buffer_;           // The v1 record being read.
+
+  bool ReadEncodedPair(StringPiece* encoded_pair);
+
+  DISALLOW_COPY_AND_ASSIGN(MRML_RecordStreamReader);
+};
+
+// Writes records into a FILE* or an MRMLFS_File, in RecordIO v2 if
+// |recordio_v2| is true, or RecordIO v1 otherwise.  A v2 file is not
+// complete until Close is invoked.  The writer does not take the
+// ownership of the output stream, nor close it.
+class MRML_RecordWriter {
+ public:
+  MRML_RecordWriter(FILE* output, bool recordio_v2,
+                    int block_size, bool compress);
+  MRML_RecordWriter(MRMLFS_File* output, bool recordio_v2,
+                    int block_size, bool compress);
+  ~MRML_RecordWriter();
+
+  bool Write(const std::string& key, const std::string& value);
+  bool Write(const std::string& key,
+             const ::google::protobuf::Message& value);
+
+  // Samples positions of every |interval|-th record written, and
+  // writes them into |index_filename| on Close.  The output stream
+  // must be at its beginning.
+  void BuildIndex(const std::string& index_filename, int interval);
+
+  // Writes the last block and the index of a v2 file, and the record
+  // index if BuildIndex has been invoked.
+  bool Close();
+
+ private:
+  FILE* file_;
+  MRMLFS_File* mrmlfs_file_;
+  boost::scoped_ptr<RecordIOV2Writer> v2_writer_;
+  boost::scoped_ptr<MRML_RecordIndexBuilder> index_builder_;
+  std::string index_filename_;
+  uint64 bytes_written_;
+  std::string encoded_pair_;
+  std::string pending_output_;   // Encoded v2 blocks to be written.
+  bool closed_;
+
+  void Initialize(bool recordio_v2, int block_size, bool compress);
+  bool WriteEncodedPair();
+  bool WritePendingOutput();
+
+  DISALLOW_COPY_AND_ASSIGN(MRML_RecordWriter);
+};
+
 #endif  // MRML_MRML_RECORDIO_H_
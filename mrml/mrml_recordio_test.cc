@@ -51,6 +51,42 @@ TEST(MRMLRecordIOTest, LocalRecordIO) {
   CheckWriteReadConsistency(kFilename);
 }
 
+TEST(MRMLRecordIOTest, LocalRecordStreamReader) {
+  static const char* kFilename = "/tmp/testLocalRecordStreamReader";
+  KeyValuePair pair;
+  pair.set_key(kTestKey);
+  pair.set_value(kTestValue);
+
+  FILE* output = fopen(kFilename, "w");
+  CHECK(output != NULL);
+  MRML_WriteRecord(output, kTestKey, kTestValue);
+  MRML_WriteRecord(output, kTestKey, pair);
+  MRML_WriteRecord(output, "", "");
+  fclose(output);
+
+  FILE* input = fopen(kFilename, "r");
+  CHECK(input != NULL);
+  MRML_RecordStreamReader reader(input);
+  string key, value;
+  CHECK(reader.Read(&key, &value));
+  EXPECT_EQ(key, kTestKey);
+  EXPECT_EQ(value, kTestValue);
+
+  pair.Clear();
+  CHECK(reader.Read(&key, &pair));
+  EXPECT_EQ(key, kTestKey);
+  EXPECT_EQ(pair.key(), kTestKey);
+  EXPECT_EQ(pair.value(), kTestValue);
+
+  StringPiece key_view("x", 1), value_view("y", 1);
+  CHECK(reader.Read(&key_view, &value_view));
+  EXPECT_TRUE(key_view.empty());
+  EXPECT_TRUE(value_view.empty());
+
+  EXPECT_TRUE(!reader.Read(&key, &value));
+  fclose(input);
+}
+
 TEST(MRMLRecordIOTest, SFTPRecordIO) {
   CHECK(!FLAGS_username.empty());
   CHECK(!FLAGS_password.empty());
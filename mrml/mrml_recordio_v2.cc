@@ -0,0 +1,288 @@
+
+
+//
+#include "mrml/mrml_recordio_v2.h"
+
+#include <string.h>
+#include <zlib.h>
+
+#include "base/varint32.h"
+#include "hash/crc32c.h"
+
+// Sizes of fields in a block header, excluding the sync marker.
+static const int kBlockHeaderSize =
+    sizeof(uint32) * 3 + sizeof(uint8) + sizeof(uint32);
+
+//-----------------------------------------------------------------------------
+// Implementation of RecordIOV2Writer
+//-----------------------------------------------------------------------------
+
+RecordIOV2Writer::RecordIOV2Writer(int block_size, bool compress)
+    : block_size_(block_size),
+      compress_(compress),
+      block_num_records_(0),
+      offset_(0),
+      num_records_(0) {
+  CHECK_LT(0, block_size);
+  block_.reserve(block_size + block_size / 8);
+}
+
+void RecordIOV2Writer::Start(std::string* output) {
+  CHECK_EQ(offset_, 0);
+  uint32 block_size = block_size_;
+  AppendBytes(reinterpret_cast<const char*>(&kRecordIOV2Magic),
+              sizeof(kRecordIOV2Magic), output);
+  AppendBytes(reinterpret_cast<const char*>(&block_size),
+              sizeof(block_size), output);
+}
+
+void RecordIOV2Writer::Append(const StringPiece& encoded_pair,
+                              std::string* output) {
+  CHECK_LT(0, offset_);  // Start must be invoked before Append.
+  char varint[kMaxVarint32Bytes];
+  block_.append(varint, EncodeVarint32(encoded_pair.size(), varint));
+  block_.append(encoded_pair.data(), encoded_pair.size());
+  ++block_num_records_;
+  ++num_records_;
+  if (block_.size() >= block_size_) {
+    AppendBlock(output);
+  }
+}
+
+void RecordIOV2Writer::Finish(std::string* output) {
+  AppendBlock(output);
+
+  uint64 index_offset = offset_;
+  uint32 num_blocks = index_.size();
+  AppendBytes(kRecordIOV2IndexMarker, kRecordIOV2MarkerSize, output);
+  AppendBytes(reinterpret_cast<const char*>(&num_blocks),
+              sizeof(num_blocks), output);
+  for (size_t i = 0; i < index_.size(); ++i) {
+    AppendBytes(reinterpret_cast<const char*>(&index_[i].offset),
+                sizeof(index_[i].offset), output);
+    AppendBytes(reinterpret_cast<const char*>(&index_[i].num_records),
+                sizeof(index_[i].num_records), output);
+  }
+  AppendBytes(reinterpret_cast<const char*>(&index_offset),
+              sizeof(index_offset), output);
+  AppendBytes(reinterpret_cast<const char*>(&kRecordIOV2Magic),
+              sizeof(kRecordIOV2Magic), output);
+}
+
+void RecordIOV2Writer::AppendBlock(std::string* output) {
+  if (block_num_records_ == 0) {
+    return;
+  }
+
+  const std::string* stored = &block_;
+  uint8 codec = kRawRecordBlock;
+  if (compress_) {
+    uLongf compressed_size = compressBound(block_.size());
+    compressed_.resize(compressed_size);
+    if (compress2(reinterpret_cast<Bytef*>(&compressed_[0]), &compressed_size,
+                  reinterpret_cast<const Bytef*>(block_.data()),
+                  block_.size(), Z_BEST_SPEED) == Z_OK &&
+        compressed_size < block_.size()) {
+      compressed_.resize(compressed_size);
+      stored = &compressed_;
+      codec = kZlibRecordBlock;
+    }
+  }
+
+  BlockIndexEntry entry;
+  entry.offset = offset_;
+  entry.num_records = block_num_records_;
+  index_.push_back(entry);
+
+  uint32 raw_size = block_.size();
+  uint32 stored_size = stored->size();
+  uint32 data_crc = CRC32C(*stored);
+  std::string header;
+  header.append(reinterpret_cast<const char*>(&block_num_records_),
+                sizeof(block_num_records_));
+  header.append(reinterpret_cast<const char*>(&raw_size), sizeof(raw_size));
+  header.append(reinterpret_cast<const char*>(&stored_size),
+                sizeof(stored_size));
+  header.append(reinterpret_cast<const char*>(&codec), sizeof(codec));
+  header.append(reinterpret_cast<const char*>(&data_crc), sizeof(data_crc));
+  uint32 header_crc = CRC32C(header);
+
+  AppendBytes(kRecordIOV2SyncMarker, kRecordIOV2MarkerSize, output);
+  AppendBytes(header.data(), header.size(), output);
+  AppendBytes(reinterpret_cast<const char*>(&header_crc),
+              sizeof(header_crc), output);
+  AppendBytes(stored->data(), stored->size(), output);
+
+  block_.clear();
+  block_num_records_ = 0;
+}
+
+void RecordIOV2Writer::AppendBytes(const char* data, size_t size,
+                                   std::string* output) {
+  output->append(data, size);
+  offset_ += size;
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of RecordIOV2Reader
+//-----------------------------------------------------------------------------
+
+RecordIOV2Reader::RecordIOV2Reader(MRML_ByteSource* source,
+                                   bool magic_consumed)
+    : source_(source),
+      position_(0),
+      rest_records_(0),
+      finished_(false),
+      num_corrupted_blocks_(0) {
+  CHECK_NOTNULL(source);
+  uint32 magic = kRecordIOV2Magic;
+  uint32 block_size;
+  if ((!magic_consumed && !ReadBytes(reinterpret_cast<char*>(&magic),
+                                     sizeof(magic))) ||
+      magic != kRecordIOV2Magic ||
+      !ReadBytes(reinterpret_cast<char*>(&block_size), sizeof(block_size))) {
+    LOG(ERROR) << "Not a RecordIO v2 file.";
+    finished_ = true;
+  }
+}
+
+bool RecordIOV2Reader::Next(StringPiece* encoded_pair) {
+  while (true) {
+    while (rest_records_ == 0) {
+      if (!LoadNextBlock()) {
+        return false;
+      }
+    }
+
+    const char* p = block_.data() + position_;
+    const char* limit = block_.data() + block_.size();
+    uint32 size;
+    if (!DecodeVarint32(&p, limit, &size) || size > limit - p) {
+      LOG(ERROR) << "Skipping corrupted records in a block.";
+      ++num_corrupted_blocks_;
+      rest_records_ = 0;
+      continue;
+    }
+    encoded_pair->set(p, size);
+    position_ = p + size - block_.data();
+    --rest_records_;
+    return true;
+  }
+}
+
+void RecordIOV2Reader::Restart() {
+  position_ = 0;
+  rest_records_ = 0;
+  finished_ = false;
+}
+
+bool RecordIOV2Reader::LoadNextBlock() {
+  if (finished_) {
+    return false;
+  }
+
+  char marker[kRecordIOV2MarkerSize];
+  bool synced = false;
+  if (ReadBytes(marker, sizeof(marker))) {
+    if (memcmp(marker, kRecordIOV2IndexMarker, sizeof(marker)) == 0) {
+      finished_ = true;
+      return false;
+    }
+    synced = memcmp(marker, kRecordIOV2SyncMarker, sizeof(marker)) == 0;
+    if (!synced) {
+      LOG(ERROR) << "Missing sync marker.  Skipping to the next block.";
+      ++num_corrupted_blocks_;
+      synced = SkipToNextMarker();
+    }
+  } else {
+    LOG(ERROR) << "RecordIO v2 file ends without index.";
+  }
+
+  while (synced) {
+    if (ReadBlock()) {
+      return true;
+    }
+    LOG(ERROR) << "Skipping a corrupted block.";
+    ++num_corrupted_blocks_;
+    synced = SkipToNextMarker();
+  }
+  finished_ = true;
+  return false;
+}
+
+bool RecordIOV2Reader::ReadBlock() {
+  char header[kBlockHeaderSize];
+  uint32 header_crc;
+  if (!ReadBytes(header, sizeof(header)) ||
+      !ReadBytes(reinterpret_cast<char*>(&header_crc), sizeof(header_crc)) ||
+      CRC32C(header, sizeof(header)) != header_crc) {
+    return false;
+  }
+
+  uint32 num_records, raw_size, stored_size, data_crc;
+  uint8 codec;
+  const char* p = header;
+  memcpy(&num_records, p, sizeof(num_records));
+  p += sizeof(num_records);
+  memcpy(&raw_size, p, sizeof(raw_size));
+  p += sizeof(raw_size);
+  memcpy(&stored_size, p, sizeof(stored_size));
+  p += sizeof(stored_size);
+  memcpy(&codec, p, sizeof(codec));
+  p += sizeof(codec);
+  memcpy(&data_crc, p, sizeof(data_crc));
+
+  stored_.resize(stored_size);
+  if (stored_size > 0 && !ReadBytes(&stored_[0], stored_size)) {
+    return false;
+  }
+  if (CRC32C(stored_) != data_crc) {
+    return false;
+  }
+
+  if (codec == kZlibRecordBlock) {
+    block_.resize(raw_size);
+    uLongf uncompressed_size = raw_size;
+    if (uncompress(reinterpret_cast<Bytef*>(&block_[0]), &uncompressed_size,
+                   reinterpret_cast<const Bytef*>(stored_.data()),
+                   stored_.size()) != Z_OK ||
+        uncompressed_size != raw_size) {
+      return false;
+    }
+  } else if (codec == kRawRecordBlock && raw_size == stored_size) {
+    block_.swap(stored_);
+  } else {
+    return false;
+  }
+
+  position_ = 0;
+  rest_records_ = num_records;
+  return true;
+}
+
+bool RecordIOV2Reader::SkipToNextMarker() {
+  char window[kRecordIOV2MarkerSize];
+  size_t filled = 0;
+  char c;
+  while (ReadBytes(&c, 1)) {
+    if (filled < sizeof(window)) {
+      window[filled++] = c;
+    } else {
+      memmove(window, window + 1, sizeof(window) - 1);
+      window[sizeof(window) - 1] = c;
+    }
+    if (filled == sizeof(window)) {
+      if (memcmp(window, kRecordIOV2SyncMarker, sizeof(window)) == 0) {
+        return true;
+      }
+      if (memcmp(window, kRecordIOV2IndexMarker, sizeof(window)) == 0) {
+        return false;
+      }
+    }
+  }
+  return false;
+}
+
+bool RecordIOV2Reader::ReadBytes(char* buffer, size_t size) {
+  return source_->Read(buffer, size) == size;
+}
@@ -0,0 +1,155 @@
+
+
+//
+// RecordIO v2 is a block-structured container of records.  Compared
+// with RecordIO v1, which is a plain sequence of [uint32 size][encoded
+// KeyValuePair], it is checksummed, optionally compressed, and can be
+// split or resumed at block boundaries.  A v2 file consists of
+//
+//   file header:   uint32 kRecordIOV2Magic, uint32 block_size
+//   blocks:        each starts with
+//                    char[8] kRecordIOV2SyncMarker
+//                    uint32  num_records
+//                    uint32  raw_size     -- size of uncompressed records
+//                    uint32  stored_size  -- size of the block data
+//                    uint8   codec        -- kRawRecordBlock or
+//                                            kZlibRecordBlock
+//                    uint32  CRC32C of the stored data
+//                    uint32  CRC32C of the above header fields
+//                  followed by stored_size bytes of block data, which
+//                  uncompress into records, each as [varint32 size]
+//                  [encoded KeyValuePair].
+//   index:         char[8] kRecordIOV2IndexMarker, uint32 num_blocks,
+//                  and for each block, uint64 offset, uint32 num_records
+//   footer:        uint64 index_offset, uint32 kRecordIOV2Magic
+//
+// Blocks are cut at record boundaries once they reach block_size, so a
+// record larger than block_size makes a block by itself.  Since
+// kRecordIOV2Magic is larger than the max size of a v1 record, the
+// first four bytes of a file tell its format.
+//
+#ifndef MRML_MRML_RECORDIO_V2_H_
+#define MRML_MRML_RECORDIO_V2_H_
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "base/common.h"
+#include "strutil/string_piece.h"
+
+static const uint32 kRecordIOV2Magic = 0x324f4952;  // "RIO2"
+static const int kRecordIOV2MarkerSize = 8;
+static const char kRecordIOV2SyncMarker[kRecordIOV2MarkerSize] = {
+  '\x9c', '\x1d', '\x6a', '\xe2', '\x4f', '\x83', '\xb7', '\x05' };
+static const char kRecordIOV2IndexMarker[kRecordIOV2MarkerSize] = {
+  '\x9c', '\x1d', '\x6a', '\xe2', '\x49', '\x44', '\x58', '\x00' };
+static const int kDefaultRecordIOV2BlockSize = 64 * 1024;  // 64 KB
+
+enum RecordBlockCodec { kRawRecordBlock = 0, kZlibRecordBlock = 1 };
+
+// The source of bytes read by RecordIOV2Reader, e.g., a FILE* or an
+// MRMLFS_File.
+class MRML_ByteSource {
+ public:
+  virtual ~MRML_ByteSource() {}
+  // Returns the number of bytes read, which is less than |size| only
+  // at the end of the source or on errors.
+  virtual size_t Read(char* buffer, size_t size) = 0;
+  // Moves the read position to |offset| from the beginning.  Returns
+  // false if the source is not seekable.
+  virtual bool Seek(uint64 offset) { return false; }
+};
+
+// Encodes records into RecordIO v2 blocks.  The writer does not do
+// I/O; instead, it appends encoded bytes to |output| of each method,
+// and the caller writes them.
+class RecordIOV2Writer {
+ public:
+  RecordIOV2Writer(int block_size, bool compress);
+
+  // Appends the file header.  Must be invoked before others.
+  void Start(std::string* output);
+
+  // Appends |encoded_pair| to the current block.  Appends the block to
+  // |output| if it is full.
+  void Append(const StringPiece& encoded_pair, std::string* output);
+
+  // Appends the last block, the index and the footer.
+  void Finish(std::string* output);
+
+  uint64 NumRecords() const { return num_records_; }
+
+  // Returns the offset of the block that the next appended record
+  // will be in, and in |skip| the number of records before it in the
+  // block.
+  uint64 NextRecordPosition(uint32* skip) const {
+    *skip = block_num_records_;
+    return offset_;
+  }
+
+ private:
+  struct BlockIndexEntry {
+    uint64 offset;
+    uint32 num_records;
+  };
+
+  int block_size_;
+  bool compress_;
+  std::string block_;             // Uncompressed records of current block.
+  std::string compressed_;        // Reused compression buffer.
+  uint32 block_num_records_;
+  uint64 offset_;                 // Number of bytes appended to outputs.
+  uint64 num_records_;
+  std::vector<BlockIndexEntry> index_;
+
+  void AppendBlock(std::string* output);
+  void AppendBytes(const char* data, size_t size, std::string* output);
+
+  DISALLOW_COPY_AND_ASSIGN(RecordIOV2Writer);
+};
+
+// Decodes records from RecordIO v2 blocks.  A corrupted block is
+// skipped with an error log, by searching for the next sync marker.
+class RecordIOV2Reader {
+ public:
+  // |source| must be positioned at the beginning of the file, or right
+  // after kRecordIOV2Magic if |magic_consumed| is true.  The reader
+  // does not take the ownership of |source|.
+  RecordIOV2Reader(MRML_ByteSource* source, bool magic_consumed);
+
+  // Points |encoded_pair| to the next record in the block buffer,
+  // which is valid until the next invocation.  Returns false at the
+  // end of records.
+  bool Next(StringPiece* encoded_pair);
+
+  // Discards the current block, after the source has been moved to
+  // the beginning of a block.
+  void Restart();
+
+  uint64 NumCorruptedBlocks() const { return num_corrupted_blocks_; }
+
+ private:
+  MRML_ByteSource* source_;
+  std::string block_;             // Uncompressed records of current block.
+  std::string stored_;            // Reused buffer of stored block data.
+  size_t position_;               // Read position in block_.
+  uint32 rest_records_;           // Records left in block_.
+  bool finished_;
+  uint64 num_corrupted_blocks_;
+
+  // Reads the next block into block_.  Returns false at the index.
+  bool LoadNextBlock();
+  // Reads the header and data of a block whose sync marker has been
+  // read.  Returns false if the block is corrupted.
+  bool ReadBlock();
+  // Reads up to and including the next sync or index marker.  Returns
+  // true if a sync marker is found.
+  bool SkipToNextMarker();
+  bool ReadBytes(char* buffer, size_t size);
+
+  DISALLOW_COPY_AND_ASSIGN(RecordIOV2Reader);
+};
+
+#endif  // MRML_MRML_RECORDIO_V2_H_
@@ -0,0 +1,189 @@
+
+
+//
+#include <stdio.h>
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "base/common.h"
+#include "strutil/stringprintf.h"
+#include "mrml/mrml_filesystem.h"
+#include "mrml/mrml_recordio.h"
+#include "mrml/mrml_recordio_v2.h"
+#include "mrml/mrml.pb.h"
+
+using std::string;
+
+static const int kNumRecords = 1000;
+static const int kSmallBlockSize = 1024;
+
+class StringByteSource : public MRML_ByteSource {
+ public:
+  explicit StringByteSource(const string& data) : data_(data), position_(0) {}
+  virtual size_t Read(char* buffer, size_t size) {
+    size_t n = std::min(size, data_.size() - position_);
+    memcpy(buffer, data_.data() + position_, n);
+    position_ += n;
+    return n;
+  }
+ private:
+  const string& data_;
+  size_t position_;
+};
+
+static string RecordKey(int i) {
+  return StringPrintf("key-%05d", i);
+}
+
+static string RecordValue(int i) {
+  return StringPrintf("value-%d-of-many-repeated-records", i);
+}
+
+static void EncodeRecords(bool compress, string* file) {
+  RecordIOV2Writer writer(kSmallBlockSize, compress);
+  writer.Start(file);
+  for (int i = 0; i < kNumRecords; ++i) {
+    KeyValuePair pair;
+    pair.set_key(RecordKey(i));
+    pair.set_value(RecordValue(i));
+    writer.Append(pair.SerializeAsString(), file);
+  }
+  writer.Finish(file);
+  EXPECT_EQ(kNumRecords, writer.NumRecords());
+}
+
+// Decodes records of |file| and returns the number of them.  Records
+// must be a subsequence of those generated by EncodeRecords.
+static int DecodeRecords(const string& file, uint64* num_corrupted_blocks) {
+  StringByteSource source(file);
+  RecordIOV2Reader reader(&source, false);
+  StringPiece encoded_pair;
+  int count = 0;
+  int last = -1;
+  while (reader.Next(&encoded_pair)) {
+    KeyValuePair pair;
+    EXPECT_TRUE(pair.ParseFromArray(encoded_pair.data(), encoded_pair.size()));
+    int i = atoi(pair.key().c_str() + strlen("key-"));
+    EXPECT_LT(last, i);
+    EXPECT_EQ(RecordKey(i), pair.key());
+    EXPECT_EQ(RecordValue(i), pair.value());
+    last = i;
+    ++count;
+  }
+  *num_corrupted_blocks = reader.NumCorruptedBlocks();
+  return count;
+}
+
+TEST(RecordIOV2Test, EncodeAndDecode) {
+  for (int compress = 0; compress < 2; ++compress) {
+    string file;
+    EncodeRecords(compress, &file);
+    uint64 num_corrupted_blocks;
+    EXPECT_EQ(kNumRecords, DecodeRecords(file, &num_corrupted_blocks));
+    EXPECT_EQ(0, num_corrupted_blocks);
+  }
+}
+
+TEST(RecordIOV2Test, CompressedIsSmaller) {
+  string raw, compressed;
+  EncodeRecords(false, &raw);
+  EncodeRecords(true, &compressed);
+  EXPECT_LT(compressed.size(), raw.size());
+}
+
+TEST(RecordIOV2Test, SkipCorruptedBlock) {
+  string file;
+  EncodeRecords(true, &file);
+  // Flip a byte in the middle of the file, which must be within a block.
+  file[file.size() / 2] ^= 0x5a;
+  uint64 num_corrupted_blocks;
+  int count = DecodeRecords(file, &num_corrupted_blocks);
+  EXPECT_EQ(1, num_corrupted_blocks);
+  EXPECT_LT(0, count);
+  EXPECT_GT(kNumRecords, count);
+}
+
+TEST(RecordIOV2Test, ReadRecordDetectsFormat) {
+  static const char* kFilename = "/tmp/testRecordIOV2Local";
+  for (int v2 = 0; v2 < 2; ++v2) {
+    FILE* output = fopen(kFilename, "w");
+    ASSERT_TRUE(output != NULL);
+    MRML_RecordWriter writer(output, v2, kSmallBlockSize, true);
+    for (int i = 0; i < kNumRecords; ++i) {
+      EXPECT_TRUE(writer.Write(RecordKey(i), RecordValue(i)));
+    }
+    EXPECT_TRUE(writer.Close());
+    fclose(output);
+
+    // Read through FILE*, which MRML_ReadRecord reads v1 from only.
+    FILE* input = fopen(kFilename, "r");
+    ASSERT_TRUE(input != NULL);
+    string key, value;
+    if (v2) {
+      EXPECT_FALSE(MRML_ReadRecord(input, &key, &value));
+      rewind(input);
+    }
+    MRML_RecordStreamReader reader(input);
+    for (int i = 0; i < kNumRecords; ++i) {
+      if (v2) {
+        ASSERT_TRUE(reader.Read(&key, &value));
+      } else {
+        ASSERT_TRUE(MRML_ReadRecord(input, &key, &value));
+      }
+      EXPECT_EQ(RecordKey(i), key);
+      EXPECT_EQ(RecordValue(i), value);
+    }
+    EXPECT_FALSE(v2 ? reader.Read(&key, &value) :
+                 MRML_ReadRecord(input, &key, &value));
+    fclose(input);
+
+    // Read through MRMLFS_File.
+    MRMLFS_File file(kFilename, true);
+    ASSERT_TRUE(file.IsOpen());
+    KeyValuePair pair;
+    for (int i = 0; i < kNumRecords; ++i) {
+      ASSERT_TRUE(MRML_ReadRecord(&file, &key, &value));
+      EXPECT_EQ(RecordKey(i), key);
+      EXPECT_EQ(RecordValue(i), value);
+    }
+    EXPECT_FALSE(MRML_ReadRecord(&file, &key, &value));
+    file.Close();
+  }
+}
+
+// The state of reading a v2 file is released by Close, and does not
+// outlive the file into the next one opened by the same MRMLFS_File.
+TEST(RecordIOV2Test, ReadRecordStateEndsWithFile) {
+  static const char* kV2Filename = "/tmp/testRecordIOV2LocalV2";
+  static const char* kV1Filename = "/tmp/testRecordIOV2LocalV1";
+  for (int v2 = 0; v2 < 2; ++v2) {
+    FILE* output = fopen(v2 ? kV2Filename : kV1Filename, "w");
+    ASSERT_TRUE(output != NULL);
+    MRML_RecordWriter writer(output, v2, kSmallBlockSize, true);
+    for (int i = 0; i < kNumRecords; ++i) {
+      EXPECT_TRUE(writer.Write(RecordKey(i), RecordValue(i)));
+    }
+    EXPECT_TRUE(writer.Close());
+    fclose(output);
+  }
+
+  MRMLFS_File file;
+  string key, value;
+  ASSERT_TRUE(file.Open(kV2Filename, true));
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_TRUE(MRML_ReadRecord(&file, &key, &value));
+    EXPECT_EQ(RecordKey(i), key);
+  }
+  file.Close();
+
+  ASSERT_TRUE(file.Open(kV1Filename, true));
+  for (int i = 0; i < kNumRecords; ++i) {
+    ASSERT_TRUE(MRML_ReadRecord(&file, &key, &value));
+    EXPECT_EQ(RecordKey(i), key);
+    EXPECT_EQ(RecordValue(i), value);
+  }
+  EXPECT_FALSE(MRML_ReadRecord(&file, &key, &value));
+  file.Close();
+}
@@ -0,0 +1,390 @@
+
+
+//
+#include "sorted_buffer/block_file.h"
+
+#include <string.h>
+#include <zlib.h>
+
+#include "base/varint32.h"
+
+namespace sorted_buffer {
+
+static const int kFooterSize = sizeof(uint64) + sizeof(uint32);
+
+//-----------------------------------------------------------------------------
+// Implementation of BlockFileWriter
+//-----------------------------------------------------------------------------
+
+BlockFileWriter::BlockFileWriter(FILE* output, int block_size, bool compress)
+    : output_(output),
+      block_size_(block_size),
+      compress_(compress),
+      closed_(false),
+      failed_(false),
+      rest_values_(0),
+      block_rest_values_(0),
+      offset_(0),
+      raw_bytes_(0),
+      stored_bytes_(0) {
+  CHECK_NOTNULL(output);
+  CHECK_LT(0, block_size);
+  block_.reserve(block_size + block_size / 8);
+}
+
+BlockFileWriter::~BlockFileWriter() {
+  if (!closed_) {
+    Close();
+  }
+}
+
+bool BlockFileWriter::WriteKey(const MemoryPiece& key, uint32 num_values) {
+  CHECK(!closed_);
+  CHECK_EQ(rest_values_, 0);
+  CHECK_LT(0, num_values);
+  current_key_ = key;
+  rest_values_ = num_values;
+  if (block_.empty()) {
+    block_first_key_.assign(key.Data(), key.Size());
+    block_rest_values_ = 0;
+  }
+  AppendPiece(key);
+  AppendVarint32(num_values);
+  return WriteBlockIfFull() && !failed_;
+}
+
+bool BlockFileWriter::WriteValue(const MemoryPiece& value) {
+  CHECK(!closed_);
+  CHECK_LT(0, rest_values_);
+  if (block_.empty()) {
+    block_first_key_.assign(current_key_.Data(), current_key_.Size());
+    block_rest_values_ = rest_values_;
+  }
+  AppendPiece(value);
+  --rest_values_;
+  return WriteBlockIfFull() && !failed_;
+}
+
+bool BlockFileWriter::Close() {
+  CHECK(!closed_);
+  closed_ = true;
+  if (!block_.empty() && !WriteBlock()) {
+    return false;
+  }
+
+  uint64 index_offset = offset_;
+  std::string index;
+  char varint[kMaxVarint32Bytes];
+  index.append(varint, EncodeVarint32(index_.size(), varint));
+  for (size_t i = 0; i < index_.size(); ++i) {
+    index.append(reinterpret_cast<const char*>(&index_[i].offset),
+                 sizeof(index_[i].offset));
+    index.append(varint, EncodeVarint32(index_[i].first_key.size(), varint));
+    index.append(index_[i].first_key);
+  }
+  index.append(reinterpret_cast<const char*>(&index_offset),
+               sizeof(index_offset));
+  index.append(reinterpret_cast<const char*>(&kBlockFileMagic),
+               sizeof(kBlockFileMagic));
+  return WriteBytes(index.data(), index.size()) && !failed_;
+}
+
+void BlockFileWriter::AppendPiece(const MemoryPiece& piece) {
+  AppendVarint32(piece.Size());
+  block_.append(piece.Data(), piece.Size());
+}
+
+void BlockFileWriter::AppendVarint32(uint32 value) {
+  char varint[kMaxVarint32Bytes];
+  block_.append(varint, EncodeVarint32(value, varint));
+}
+
+bool BlockFileWriter::WriteBlockIfFull() {
+  return block_.size() < block_size_ || WriteBlock();
+}
+
+bool BlockFileWriter::WriteBlock() {
+  const std::string* stored = &block_;
+  uint8 codec = kRawBlock;
+  if (compress_) {
+    uLongf compressed_size = compressBound(block_.size());
+    compressed_.resize(compressed_size);
+    if (compress2(reinterpret_cast<Bytef*>(&compressed_[0]), &compressed_size,
+                  reinterpret_cast<const Bytef*>(block_.data()),
+                  block_.size(), Z_BEST_SPEED) == Z_OK &&
+        compressed_size < block_.size()) {
+      compressed_.resize(compressed_size);
+      stored = &compressed_;
+      codec = kZlibBlock;
+    }
+  }
+  uint32 checksum = crc32(0L, reinterpret_cast<const Bytef*>(stored->data()),
+                          stored->size());
+
+  BlockIndexEntry entry;
+  entry.offset = offset_;
+  entry.first_key = block_first_key_;
+  index_.push_back(entry);
+
+  std::string header;
+  char varint[kMaxVarint32Bytes];
+  header.append(varint, EncodeVarint32(block_first_key_.size(), varint));
+  header.append(block_first_key_);
+  header.append(varint, EncodeVarint32(block_rest_values_, varint));
+  header.append(varint, EncodeVarint32(block_.size(), varint));
+  header.append(varint, EncodeVarint32(stored->size(), varint));
+  header.append(reinterpret_cast<const char*>(&codec), sizeof(codec));
+  header.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+
+  raw_bytes_ += block_.size();
+  stored_bytes_ += stored->size();
+  bool succeeded = WriteBytes(header.data(), header.size()) &&
+                   WriteBytes(stored->data(), stored->size());
+  block_.clear();
+  return succeeded;
+}
+
+bool BlockFileWriter::WriteBytes(const char* data, size_t size) {
+  offset_ += size;
+  if (size != 0 && fwrite(data, 1, size, output_) != size) {
+    failed_ = true;
+  }
+  return !failed_;
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of BlockFileReader
+//-----------------------------------------------------------------------------
+
+BlockFileReader::BlockFileReader(FILE* input, bool prefetch)
+    : input_(input),
+      index_offset_(0),
+      position_(0),
+      prefetch_(prefetch),
+      slot_full_(false),
+      prefetched_valid_(false),
+      stop_prefetch_(false),
+      end_of_file_(false) {
+  CHECK_NOTNULL(input);
+  ReadIndex();
+  if (prefetch_) {
+    StartPrefetch();
+  }
+}
+
+BlockFileReader::~BlockFileReader() {
+  if (prefetch_) {
+    StopPrefetch();
+  }
+}
+
+void BlockFileReader::ReadIndex() {
+  uint32 magic = 0;
+  if (fseek(input_, -kFooterSize, SEEK_END) != 0 ||
+      fread(&index_offset_, sizeof(index_offset_), 1, input_) != 1 ||
+      fread(&magic, sizeof(magic), 1, input_) != 1 ||
+      magic != kBlockFileMagic) {
+    LOG(FATAL) << "Not a sorted block file, or the file was truncated.";
+  }
+
+  std::string index(ftell(input_) - kFooterSize - index_offset_, '\0');
+  if (fseek(input_, index_offset_, SEEK_SET) != 0 ||
+      fread(&index[0], 1, index.size(), input_) != index.size()) {
+    LOG(FATAL) << "Cannot read the block index.";
+  }
+
+  const char* p = index.data();
+  const char* limit = p + index.size();
+  uint32 num_blocks = 0;
+  CHECK(DecodeVarint32(&p, limit, &num_blocks));
+  index_.resize(num_blocks);
+  for (uint32 i = 0; i < num_blocks; ++i) {
+    uint32 key_size = 0;
+    CHECK_LE(p + sizeof(index_[i].offset), limit);
+    memcpy(&index_[i].offset, p, sizeof(index_[i].offset));
+    p += sizeof(index_[i].offset);
+    CHECK(DecodeVarint32(&p, limit, &key_size));
+    CHECK_LE(p + key_size, limit);
+    index_[i].first_key.assign(p, key_size);
+    p += key_size;
+  }
+
+  CHECK_EQ(fseek(input_, 0, SEEK_SET), 0);
+}
+
+bool BlockFileReader::ReadBlock(std::string* key, uint32* rest_values,
+                                std::string* block) {
+  block->clear();
+  if (ftell(input_) >= index_offset_) {
+    return false;
+  }
+
+  std::string first_key;
+  uint32 first_rest_values, raw_size, stored_size, checksum;
+  uint8 codec;
+  if (!::sorted_buffer::ReadMemoryPiece(input_, &first_key) ||
+      !::ReadVarint32(input_, &first_rest_values) ||
+      !::ReadVarint32(input_, &raw_size) ||
+      !::ReadVarint32(input_, &stored_size) ||
+      fread(&codec, sizeof(codec), 1, input_) != 1 ||
+      fread(&checksum, sizeof(checksum), 1, input_) != 1) {
+    LOG(FATAL) << "Cannot read block header at offset " << ftell(input_);
+  }
+
+  stored_.resize(stored_size);
+  if (stored_size > 0 &&
+      fread(&stored_[0], 1, stored_size, input_) != stored_size) {
+    LOG(FATAL) << "Cannot read block of " << stored_size << " bytes.";
+  }
+  if (crc32(0L, reinterpret_cast<const Bytef*>(stored_.data()),
+            stored_.size()) != checksum) {
+    LOG(FATAL) << "Checksum mismatch of block with first key " << first_key;
+  }
+
+  if (codec == kZlibBlock) {
+    block->resize(raw_size);
+    uLongf uncompressed_size = raw_size;
+    if (uncompress(reinterpret_cast<Bytef*>(&(*block)[0]), &uncompressed_size,
+                   reinterpret_cast<const Bytef*>(stored_.data()),
+                   stored_.size()) != Z_OK ||
+        uncompressed_size != raw_size) {
+      LOG(FATAL) << "Cannot uncompress block with first key " << first_key;
+    }
+  } else if (codec == kRawBlock) {
+    CHECK_EQ(raw_size, stored_size);
+    block->swap(stored_);
+  } else {
+    LOG(FATAL) << "Unknown block codec: " << static_cast<int>(codec);
+  }
+
+  if (key != NULL) {
+    key->swap(first_key);
+  }
+  if (rest_values != NULL) {
+    *rest_values = first_rest_values;
+  }
+  return true;
+}
+
+bool BlockFileReader::LoadNextBlock() {
+  position_ = 0;
+  if (!prefetch_) {
+    return ReadBlock(NULL, NULL, &block_);
+  }
+
+  block_.clear();
+  if (end_of_file_) {
+    return false;
+  }
+  MutexLocker locker(&mutex_);
+  while (!slot_full_) {
+    slot_changed_.Wait(&mutex_);
+  }
+  block_.swap(prefetched_);
+  end_of_file_ = !prefetched_valid_;
+  slot_full_ = false;
+  slot_changed_.Signal();
+  return !end_of_file_;
+}
+
+/*static*/
+void* BlockFileReader::PrefetchThread(void* reader) {
+  BlockFileReader* r = static_cast<BlockFileReader*>(reader);
+  bool valid = true;
+  while (valid) {
+    {
+      MutexLocker locker(&r->mutex_);
+      while (r->slot_full_ && !r->stop_prefetch_) {
+        r->slot_changed_.Wait(&r->mutex_);
+      }
+      if (r->stop_prefetch_) {
+        break;
+      }
+    }
+    // The slot is empty, so LoadNextBlock does not touch prefetched_.
+    valid = r->ReadBlock(NULL, NULL, &r->prefetched_);
+    MutexLocker locker(&r->mutex_);
+    r->prefetched_valid_ = valid;
+    r->slot_full_ = true;
+    r->slot_changed_.Signal();
+  }
+  return NULL;
+}
+
+void BlockFileReader::StartPrefetch() {
+  slot_full_ = false;
+  stop_prefetch_ = false;
+  end_of_file_ = false;
+  if (pthread_create(&prefetch_thread_, NULL, &PrefetchThread, this) != 0) {
+    LOG(FATAL) << "Cannot create prefetching thread.";
+  }
+}
+
+void BlockFileReader::StopPrefetch() {
+  {
+    MutexLocker locker(&mutex_);
+    stop_prefetch_ = true;
+    slot_changed_.Signal();
+  }
+  CHECK_EQ(pthread_join(prefetch_thread_, NULL), 0);
+}
+
+bool BlockFileReader::EnsureData() {
+  while (position_ >= block_.size()) {
+    if (!LoadNextBlock()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool BlockFileReader::ReadVarint32(uint32* value) {
+  if (!EnsureData()) {
+    return false;
+  }
+  const char* p = block_.data() + position_;
+  if (!DecodeVarint32(&p, block_.data() + block_.size(), value)) {
+    LOG(FATAL) << "Corrupted varint32 in block.";
+  }
+  position_ = p - block_.data();
+  return true;
+}
+
+bool BlockFileReader::ReadMemoryPiece(StringPiece* piece) {
+  uint32 size;
+  if (!ReadVarint32(&size)) {
+    return false;
+  }
+  if (position_ + size > block_.size()) {
+    LOG(FATAL) << "A piece of " << size << " bytes crosses block boundary.";
+  }
+  piece->set(block_.data() + position_, size);
+  position_ += size;
+  return true;
+}
+
+bool BlockFileReader::ReadMemoryPiece(std::string* piece) {
+  StringPiece view;
+  if (!ReadMemoryPiece(&view)) {
+    return false;
+  }
+  view.CopyToString(piece);
+  return true;
+}
+
+void BlockFileReader::SeekToBlock(int block, std::string* key,
+                                  uint32* rest_values) {
+  CHECK_LE(0, block);
+  CHECK_LT(block, NumBlocks());
+  if (prefetch_) {
+    StopPrefetch();
+  }
+  CHECK_EQ(fseek(input_, index_[block].offset, SEEK_SET), 0);
+  CHECK(ReadBlock(key, rest_values, &block_));
+  position_ = 0;
+  if (prefetch_) {
+    StartPrefetch();
+  }
+}
+
+}  // namespace sorted_buffer
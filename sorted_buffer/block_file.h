@@ -0,0 +1,185 @@
+
+
+//
+// BlockFileWriter and BlockFileReader implement the on-disk format of
+// the sorted files generated by SortedBuffer::Flush.
+//
+// A sorted file is a sequence of pieces, exactly as those written by
+// WriteMemoryPiece and WriteVarint32: for each key, the key, the
+// number of values, and the values.  Rather than writing these pieces
+// to disk directly, BlockFileWriter packs them into blocks of about
+// |block_size| bytes, compresses each block using zlib, and prepends
+// each block with a header:
+//
+//   varint32 first_key_size, first_key  -- key of the first value in block
+//   varint32 rest_values   -- number of values of first_key stored in
+//                             this and following blocks, or 0 if the
+//                             block starts with a key
+//   varint32 raw_size      -- size of the uncompressed block
+//   varint32 stored_size   -- size of the block as stored on disk
+//   uint8    codec         -- kRawBlock or kZlibBlock
+//   uint32   checksum      -- CRC32 of the stored block
+//
+// After the last block comes the index, which lists the offset and the
+// first key of each block, and a fixed size footer:
+//
+//   uint64 index_offset, uint32 kBlockFileMagic
+//
+// Blocks are cut only at piece boundaries, so a reader can start
+// reading from any block given the first_key and rest_values in its
+// header.  BlockFileReader hides blocks from its users and provides
+// the same ReadMemoryPiece/ReadVarint32 API as a plain FILE*.
+//
+#ifndef SORTED_BUFFER_BLOCK_FILE_H_
+#define SORTED_BUFFER_BLOCK_FILE_H_
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "base/common.h"
+#include "sorted_buffer/memory_piece.h"
+#include "sorted_buffer/sorted_run_reader.h"
+#include "strutil/string_piece.h"
+#include "system/condition_variable.h"
+#include "system/mutex.h"
+
+namespace sorted_buffer {
+
+static const uint32 kBlockFileMagic = 0x4b4c4253;   // "SBLK"
+static const int kDefaultBlockSize = 64 * 1024;      // 64 KB
+
+enum BlockCodec { kRawBlock = 0, kZlibBlock = 1 };
+
+class BlockFileWriter {
+ public:
+  // The writer does not take the ownership of |output|.
+  BlockFileWriter(FILE* output, int block_size, bool compress);
+  ~BlockFileWriter();
+
+  // Starts a key with |num_values| values, which must be written by
+  // successive invocations of WriteValue.  The content of |key| must
+  // be kept valid until the next invocation of WriteKey.
+  //
+  // Failures are sticky: once a write to |output| fails, all following
+  // invocations, including Close, return false.
+  bool WriteKey(const MemoryPiece& key, uint32 num_values);
+  bool WriteValue(const MemoryPiece& value);
+
+  // Writes the last block, the index and the footer.  Returns false if
+  // any write to |output| has failed.
+  bool Close();
+
+  int64 RawBytes() const { return raw_bytes_; }
+  int64 StoredBytes() const { return stored_bytes_; }
+
+ private:
+  struct BlockIndexEntry {
+    uint64 offset;
+    std::string first_key;
+  };
+
+  FILE* output_;
+  int block_size_;
+  bool compress_;
+  bool closed_;
+  bool failed_;                 // A write to output_ has failed.
+
+  std::string block_;           // The uncompressed content of current block.
+  std::string compressed_;      // Reused compression buffer.
+  MemoryPiece current_key_;     // Must be valid until the next WriteKey.
+  uint32 rest_values_;          // Values of current_key_ to be written.
+  std::string block_first_key_;
+  uint32 block_rest_values_;
+
+  uint64 offset_;               // Number of bytes written into output_.
+  std::vector<BlockIndexEntry> index_;
+  int64 raw_bytes_;
+  int64 stored_bytes_;
+
+  void AppendPiece(const MemoryPiece& piece);
+  void AppendVarint32(uint32 value);
+  bool WriteBlockIfFull();
+  bool WriteBlock();
+  bool WriteBytes(const char* data, size_t size);
+
+  DISALLOW_COPY_AND_ASSIGN(BlockFileWriter);
+};
+
+// If |prefetch| is true, a background thread reads and decodes the
+// next block while the current one is being consumed.  This overlaps
+// disk reads and decompression of many readers, e.g., those of runs
+// striped over several disks and merged by SortedBufferIteratorImpl.
+class BlockFileReader : public SortedRunReader {
+ public:
+  // The reader does not take the ownership of |input|.  It dies if
+  // |input| is not a block file.
+  explicit BlockFileReader(FILE* input, bool prefetch = false);
+  virtual ~BlockFileReader();
+
+  // All return false at the end of file.  A corrupted block is fatal.
+  bool ReadMemoryPiece(std::string* piece);
+  virtual bool ReadVarint32(uint32* value);
+
+  // Points |piece| to the data in the block buffer, without copying.
+  // |piece| is valid until the next read or seek.
+  virtual bool ReadMemoryPiece(StringPiece* piece);
+
+  int NumBlocks() const { return index_.size(); }
+  const std::string& BlockFirstKey(int block) const {
+    return index_[block].first_key;
+  }
+
+  // Continues reading from the beginning of |block|.  Returns in
+  // |key| the key of the first value in the block and in
+  // |rest_values| the number of values of |key| left to read.  If
+  // |rest_values| is 0, the block starts with a key.
+  void SeekToBlock(int block, std::string* key, uint32* rest_values);
+
+ private:
+  struct BlockIndexEntry {
+    uint64 offset;
+    std::string first_key;
+  };
+
+  FILE* input_;
+  uint64 index_offset_;
+  std::vector<BlockIndexEntry> index_;
+
+  std::string block_;           // The uncompressed content of current block.
+  std::string stored_;          // Reused buffer of the stored block.
+  size_t position_;             // Read position in block_.
+
+  // Prefetching states.  prefetched_ is written by the prefetching
+  // thread if slot_full_ is false, and read by LoadNextBlock otherwise.
+  bool prefetch_;
+  pthread_t prefetch_thread_;
+  Mutex mutex_;
+  ConditionVariable slot_changed_;
+  bool slot_full_;
+  bool prefetched_valid_;       // false if prefetching reached the end.
+  bool stop_prefetch_;
+  bool end_of_file_;
+  std::string prefetched_;
+
+  void ReadIndex();
+  // Reads and decodes the block at the current position of input_
+  // into |block|, and returns the first key and rest values in its
+  // header if |key| and |rest_values| are not NULL.  Returns false at
+  // the end of blocks.
+  bool ReadBlock(std::string* key, uint32* rest_values, std::string* block);
+  bool LoadNextBlock();
+  bool EnsureData();
+
+  static void* PrefetchThread(void* reader);
+  void StartPrefetch();
+  void StopPrefetch();
+
+  DISALLOW_COPY_AND_ASSIGN(BlockFileReader);
+};
+
+}  // namespace sorted_buffer
+
+#endif  // SORTED_BUFFER_BLOCK_FILE_H_
@@ -0,0 +1,169 @@
+
+
+//
+#include "sorted_buffer/block_file.h"
+
+#include <stdio.h>
+
+#include <string>
+
+#include "base/common.h"
+#include "gtest/gtest.h"
+#include "strutil/stringprintf.h"
+
+namespace sorted_buffer {
+
+static const char* kTmpFilename = "/tmp/testBlockFile";
+static const int kNumKeys = 100;
+static const int kBlockSize = 64;   // Small blocks to get many of them.
+
+// Key i has i % 7 + 1 values.
+static void WriteTestFile(bool compress) {
+  FILE* output = fopen(kTmpFilename, "w");
+  CHECK(output != NULL);
+  BlockFileWriter writer(output, kBlockSize, compress);
+  for (int i = 0; i < kNumKeys; ++i) {
+    std::string key = StringPrintf("key%05d", i);
+    int num_values = i % 7 + 1;
+    EXPECT_TRUE(writer.WriteKey(MemoryPiece(&key), num_values));
+    for (int v = 0; v < num_values; ++v) {
+      std::string value = StringPrintf("value-of-key%05d", i);
+      EXPECT_TRUE(writer.WriteValue(MemoryPiece(&value)));
+    }
+  }
+  EXPECT_TRUE(writer.Close());
+  if (compress) {
+    EXPECT_LT(writer.StoredBytes(), writer.RawBytes());
+  } else {
+    EXPECT_EQ(writer.StoredBytes(), writer.RawBytes());
+  }
+  fclose(output);
+}
+
+static void CheckTestFile() {
+  FILE* input = fopen(kTmpFilename, "r");
+  CHECK(input != NULL);
+  BlockFileReader reader(input);
+  EXPECT_LT(1, reader.NumBlocks());
+
+  std::string piece;
+  uint32 num_values;
+  for (int i = 0; i < kNumKeys; ++i) {
+    ASSERT_TRUE(reader.ReadMemoryPiece(&piece));
+    EXPECT_EQ(StringPrintf("key%05d", i), piece);
+    ASSERT_TRUE(reader.ReadVarint32(&num_values));
+    EXPECT_EQ(i % 7 + 1, num_values);
+    for (int v = 0; v < num_values; ++v) {
+      ASSERT_TRUE(reader.ReadMemoryPiece(&piece));
+      EXPECT_EQ(StringPrintf("value-of-key%05d", i), piece);
+    }
+  }
+  EXPECT_FALSE(reader.ReadMemoryPiece(&piece));
+  EXPECT_FALSE(reader.ReadVarint32(&num_values));
+  fclose(input);
+}
+
+TEST(BlockFileTest, ReadWriteRawBlocks) {
+  WriteTestFile(false);
+  CheckTestFile();
+}
+
+TEST(BlockFileTest, ReadWriteCompressedBlocks) {
+  WriteTestFile(true);
+  CheckTestFile();
+}
+
+TEST(BlockFileTest, SeekToBlock) {
+  WriteTestFile(true);
+  FILE* input = fopen(kTmpFilename, "r");
+  CHECK(input != NULL);
+  BlockFileReader reader(input);
+
+  // Reading from any block, and skipping the rest values of the first
+  // key, gets all keys after the first key of the block.
+  for (int b = 0; b < reader.NumBlocks(); ++b) {
+    std::string key, piece;
+    uint32 rest_values;
+    reader.SeekToBlock(b, &key, &rest_values);
+    EXPECT_EQ(reader.BlockFirstKey(b), key);
+    int i;
+    ASSERT_EQ(1, sscanf(key.c_str(), "key%05d", &i));
+    for (uint32 v = 0; v < rest_values; ++v) {
+      ASSERT_TRUE(reader.ReadMemoryPiece(&piece));
+      EXPECT_EQ("value-of-" + key, piece);
+    }
+    uint32 num_values;
+    for (i = (rest_values > 0) ? i + 1 : i; i < kNumKeys; ++i) {
+      ASSERT_TRUE(reader.ReadMemoryPiece(&piece));
+      EXPECT_EQ(StringPrintf("key%05d", i), piece);
+      ASSERT_TRUE(reader.ReadVarint32(&num_values));
+      for (uint32 v = 0; v < num_values; ++v) {
+        ASSERT_TRUE(reader.ReadMemoryPiece(&piece));
+      }
+    }
+    EXPECT_FALSE(reader.ReadMemoryPiece(&piece));
+  }
+  fclose(input);
+}
+
+// Reads keys from |first| to the end of file.
+static void CheckKeysFrom(BlockFileReader* reader, int first) {
+  std::string piece;
+  uint32 num_values;
+  for (int i = first; i < kNumKeys; ++i) {
+    ASSERT_TRUE(reader->ReadMemoryPiece(&piece));
+    EXPECT_EQ(StringPrintf("key%05d", i), piece);
+    ASSERT_TRUE(reader->ReadVarint32(&num_values));
+    for (uint32 v = 0; v < num_values; ++v) {
+      ASSERT_TRUE(reader->ReadMemoryPiece(&piece));
+    }
+  }
+  EXPECT_FALSE(reader->ReadMemoryPiece(&piece));
+}
+
+TEST(BlockFileTest, Prefetch) {
+  WriteTestFile(true);
+  FILE* input = fopen(kTmpFilename, "r");
+  CHECK(input != NULL);
+  {
+    BlockFileReader reader(input, true);
+    CheckKeysFrom(&reader, 0);
+
+    std::string key;
+    uint32 rest_values;
+    reader.SeekToBlock(0, &key, &rest_values);  // Restarts prefetching.
+    EXPECT_EQ("key00000", key);
+    EXPECT_EQ(0, rest_values);
+    CheckKeysFrom(&reader, 0);
+
+    // Seeks while the prefetching thread is running.
+    reader.SeekToBlock(reader.NumBlocks() / 2, &key, &rest_values);
+    reader.SeekToBlock(0, &key, &rest_values);
+    std::string piece;
+    ASSERT_TRUE(reader.ReadMemoryPiece(&piece));
+    EXPECT_EQ("key00000", piece);
+  }  // Stops the prefetching thread before reaching the end.
+  fclose(input);
+}
+
+// Writes to /dev/full fail with ENOSPC.  Once a write fails, the
+// failure is reported by every following call, including Close.
+TEST(BlockFileTest, FailuresAreSticky) {
+  FILE* output = fopen("/dev/full", "w");
+  if (output == NULL) {
+    return;
+  }
+  setvbuf(output, NULL, _IONBF, 0);  // Fails at the first block.
+  BlockFileWriter writer(output, kBlockSize, false);
+  std::string key = "key";
+  std::string value(kBlockSize, 'v');
+  EXPECT_TRUE(writer.WriteKey(MemoryPiece(&key), 3));
+  EXPECT_FALSE(writer.WriteValue(MemoryPiece(&value)));
+  std::string small_value = "v";
+  EXPECT_FALSE(writer.WriteValue(MemoryPiece(&small_value)));
+  EXPECT_FALSE(writer.WriteValue(MemoryPiece(&small_value)));
+  EXPECT_FALSE(writer.Close());
+  fclose(output);
+}
+
+}  // namespace sorted_buffer
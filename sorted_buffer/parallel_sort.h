@@ -0,0 +1,148 @@
+
+
+//
+// ParallelSort sorts a random access range using multiple threads.
+// The range is partitioned into |num_threads| chunks, each of which is
+// sorted by std::sort in its own thread.  Then sorted chunks are merged
+// pairwise, in rounds, and merges of each round run in parallel.  The
+// result is the same as std::sort with the same comparator; as
+// std::sort, ParallelSort is not stable.
+//
+// ParallelSort falls back to std::sort if |num_threads| <= 1 or if the
+// range is too small to benefit from threading.
+//
+#ifndef SORTED_BUFFER_PARALLEL_SORT_H_
+#define SORTED_BUFFER_PARALLEL_SORT_H_
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#include "base/common.h"
+
+namespace sorted_buffer {
+
+// Ranges shorter than this are sorted by a single thread.
+static const int kMinParallelSortChunkSize = 16 * 1024;
+
+namespace parallel_sort_internal {
+
+template <class Iterator, class Compare>
+struct SortTask {
+  Iterator begin;
+  Iterator end;
+  Compare less;
+
+  static void* Run(void* task) {
+    SortTask* t = static_cast<SortTask*>(task);
+    std::sort(t->begin, t->end, t->less);
+    return NULL;
+  }
+};
+
+// Merges [begin, middle) and [middle, end) into output.
+template <class Iterator, class OutputIterator, class Compare>
+struct MergeTask {
+  Iterator begin;
+  Iterator middle;
+  Iterator end;
+  OutputIterator output;
+  Compare less;
+
+  static void* Run(void* task) {
+    MergeTask* t = static_cast<MergeTask*>(task);
+    std::merge(t->begin, t->middle, t->middle, t->end, t->output, t->less);
+    return NULL;
+  }
+};
+
+// Runs Task::Run on each of |tasks| in its own thread, and waits for
+// all of them.  The last task runs in the calling thread.
+template <class Task>
+void RunTasks(std::vector<Task>* tasks) {
+  std::vector<pthread_t> threads(tasks->size());
+  for (size_t i = 0; i + 1 < tasks->size(); ++i) {
+    if (pthread_create(&threads[i], NULL, &Task::Run, &(*tasks)[i]) != 0) {
+      LOG(FATAL) << "Cannot create sorting thread.";
+    }
+  }
+  if (!tasks->empty()) {
+    Task::Run(&tasks->back());
+  }
+  for (size_t i = 0; i + 1 < tasks->size(); ++i) {
+    CHECK_EQ(pthread_join(threads[i], NULL), 0);
+  }
+}
+
+// Merges adjacent pairs of sorted chunks of |input| into |output|,
+// where chunks are delimited by |bounds|.  Updates |bounds| to
+// delimit merged chunks.
+template <class Iterator, class OutputIterator, class Compare>
+void MergeRound(Iterator input, OutputIterator output, Compare less,
+                std::vector<size_t>* bounds) {
+  std::vector<MergeTask<Iterator, OutputIterator, Compare> > tasks;
+  std::vector<size_t> merged_bounds;
+  merged_bounds.push_back(0);
+  for (size_t c = 0; c + 1 < bounds->size(); c += 2) {
+    MergeTask<Iterator, OutputIterator, Compare> task;
+    task.begin = input + (*bounds)[c];
+    task.middle = input + (*bounds)[c + 1];
+    task.end = input + (*bounds)[std::min(c + 2, bounds->size() - 1)];
+    task.output = output + (*bounds)[c];
+    task.less = less;
+    tasks.push_back(task);
+    merged_bounds.push_back(task.end - input);
+  }
+  RunTasks(&tasks);
+  bounds->swap(merged_bounds);
+}
+
+}  // namespace parallel_sort_internal
+
+template <class Iterator, class Compare>
+void ParallelSort(Iterator begin, Iterator end, Compare less,
+                  int num_threads) {
+  using namespace parallel_sort_internal;
+  typedef typename std::iterator_traits<Iterator>::value_type Value;
+
+  size_t size = end - begin;
+  num_threads = std::min<size_t>(num_threads,
+                                 size / kMinParallelSortChunkSize);
+  if (num_threads <= 1) {
+    std::sort(begin, end, less);
+    return;
+  }
+
+  // Sort chunks in parallel.
+  std::vector<size_t> bounds;
+  std::vector<SortTask<Iterator, Compare> > sort_tasks(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    bounds.push_back(size * i / num_threads);
+    sort_tasks[i].begin = begin + bounds.back();
+    sort_tasks[i].end = begin + size * (i + 1) / num_threads;
+    sort_tasks[i].less = less;
+  }
+  bounds.push_back(size);
+  RunTasks(&sort_tasks);
+
+  // Merge chunks pairwise, in rounds, between the range and a buffer.
+  std::vector<Value> buffer(begin, end);
+  bool in_buffer = false;
+  while (bounds.size() > 2) {
+    if (in_buffer) {
+      MergeRound(buffer.begin(), begin, less, &bounds);
+    } else {
+      MergeRound(begin, buffer.begin(), less, &bounds);
+    }
+    in_buffer = !in_buffer;
+  }
+  if (in_buffer) {
+    std::copy(buffer.begin(), buffer.end(), begin);
+  }
+}
+
+}  // namespace sorted_buffer
+
+#endif  // SORTED_BUFFER_PARALLEL_SORT_H_
@@ -0,0 +1,65 @@
+
+
+//
+#include "sorted_buffer/parallel_sort.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace sorted_buffer {
+
+// Sorts pairs by the first element only, so the test also checks
+// that elements are moved as a whole.
+static bool FirstLessThan(const std::pair<int, int>& x,
+                          const std::pair<int, int>& y) {
+  return x.first < y.first;
+}
+
+static void CheckParallelSort(int size, int num_threads) {
+  std::vector<std::pair<int, int> > data;
+  srand(size);
+  for (int i = 0; i < size; ++i) {
+    int key = rand() % (size / 4 + 1);
+    data.push_back(std::make_pair(key, key * 7));
+  }
+  std::vector<std::pair<int, int> > expected(data);
+  std::sort(expected.begin(), expected.end());
+
+  ParallelSort(data.begin(), data.end(), FirstLessThan, num_threads);
+  ASSERT_EQ(expected.size(), data.size());
+  for (int i = 0; i < size; ++i) {
+    EXPECT_EQ(expected[i].first, data[i].first);
+    EXPECT_EQ(data[i].first * 7, data[i].second);
+  }
+}
+
+TEST(ParallelSortTest, SmallRange) {
+  CheckParallelSort(0, 4);
+  CheckParallelSort(1, 4);
+  CheckParallelSort(100, 4);
+}
+
+TEST(ParallelSortTest, VariousNumbersOfThreads) {
+  for (int num_threads = 1; num_threads <= 7; ++num_threads) {
+    CheckParallelSort(kMinParallelSortChunkSize * 8 + 3, num_threads);
+  }
+}
+
+TEST(ParallelSortTest, FunctionObject) {
+  std::vector<int> data;
+  for (int i = 0; i < kMinParallelSortChunkSize * 4; ++i) {
+    data.push_back(i);
+  }
+  std::random_shuffle(data.begin(), data.end());
+  ParallelSort(data.begin(), data.end(), std::greater<int>(), 4);
+  for (int i = 0; i < data.size(); ++i) {
+    EXPECT_EQ(static_cast<int>(data.size()) - 1 - i, data[i]);
+  }
+}
+
+}  // namespace sorted_buffer
@@ -5,15 +5,71 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <sys/statvfs.h>
 #include <algorithm>
 
 #include "base/common.h"
 #include "base/varint32.h"
+#include "strutil/split_string.h"
 #include "strutil/stringprintf.h"
+#include "sorted_buffer/block_file.h"
+#include "sorted_buffer/parallel_sort.h"
 #include "sorted_buffer/sorted_buffer_iterator.h"
 
 namespace sorted_buffer {
 
+// Reads the sorted key_value_list_ of a SortedBuffer as a sorted run.
+class SortedBuffer::InMemoryRunReader : public SortedRunReader {
+ public:
+  explicit InMemoryRunReader(const KeyValueList* list)
+      : list_(list), current_(0), group_end_(0), next_(kKey) {}
+
+  virtual bool ReadMemoryPiece(StringPiece* piece) {
+    if (next_ == kKey) {
+      if (current_ >= list_->size()) {
+        return false;
+      }
+      group_end_ = current_ + 1;
+      while (group_end_ < list_->size() &&
+             KeyValuePairEqual((*list_)[current_], (*list_)[group_end_])) {
+        ++group_end_;
+      }
+      const MemoryPiece& key = (*list_)[current_].key;
+      piece->set(key.Data(), key.Size());
+      next_ = kNumValues;
+      return true;
+    }
+    CHECK_EQ(next_, kValue);
+    const MemoryPiece& value = (*list_)[current_].value;
+    piece->set(value.Data(), value.Size());
+    if (++current_ == group_end_) {
+      next_ = kKey;
+    }
+    return true;
+  }
+
+  virtual bool ReadVarint32(uint32* value) {
+    if (next_ == kKey && current_ >= list_->size()) {
+      return false;
+    }
+    CHECK_EQ(next_, kNumValues);
+    CHECK_LT(group_end_ - current_, kInt32Max);
+    *value = group_end_ - current_;
+    next_ = kValue;
+    return true;
+  }
+
+ private:
+  enum Piece { kKey, kNumValues, kValue };
+
+  const KeyValueList* list_;
+  size_t current_;      // Index of the next key or value.
+  size_t group_end_;    // End of values of the current key.
+  Piece next_;          // The type of the next piece.
+
+  DISALLOW_COPY_AND_ASSIGN(InMemoryRunReader);
+};
+
 /*static*/
 std::string SortedBuffer::SortedFilename(const std::string filebase,
                                          int index) {
@@ -21,11 +77,19 @@ std::string SortedBuffer::SortedFilename(const std::string filebase,
 }
 
 SortedBuffer::SortedBuffer(const std::string& filebase,
-                                     int in_memory_buffer_size)
-    : filebase_(filebase),
-      allocator_(new NaiveMemoryAllocator(in_memory_buffer_size)),
-      count_files_(0) {
+                                     int in_memory_buffer_size,
+                                     bool compress_files,
+                                     int num_sort_threads,
+                                     Placement placement)
+    : allocator_(new NaiveMemoryAllocator(in_memory_buffer_size)),
+      compress_files_(compress_files),
+      num_sort_threads_(num_sort_threads),
+      placement_(placement) {
   CHECK(allocator_->IsInitialized());  // Ensure the memory pool is allocated.
+  CHECK_LE(1, num_sort_threads);
+  SplitStringUsing(filebase, ",", &filebases_);
+  CHECK(!filebases_.empty());
+  placement_credits_.resize(filebases_.size(), 0);
 }
 
 SortedBuffer::~SortedBuffer() {
@@ -69,17 +133,18 @@ void SortedBuffer::Flush() {
   if (!allocator_->IsInitialized() || allocator_->AllocatedSize() == 0)
     return;
 
-  FILE* output = fopen(SortedFilename(filebase_, count_files_).c_str(), "w+");
+  const std::string filename =
+      SortedFilename(filebases_[ChooseFilebase()], filenames_.size());
+  FILE* output = fopen(filename.c_str(), "w+");
   if (output == NULL) {
-    LOG(FATAL) << "Cannot open disk swap file: "
-               << SortedFilename(filebase_, count_files_);
+    LOG(FATAL) << "Cannot open disk swap file: " << filename;
   }
 
-  ++count_files_;
+  filenames_.push_back(filename);
 
-  std::sort(key_value_list_.begin(), key_value_list_.end(),
-            KeyValuePairLessThan);
+  Sort();
 
+  BlockFileWriter writer(output, kDefaultBlockSize, compress_files_);
   uint32 current_index = 0;
   while (current_index < key_value_list_.size()) {
     uint32 next_index = current_index + 1;
@@ -89,16 +154,68 @@ void SortedBuffer::Flush() {
       ++next_index;
     }
 
-    WriteMemoryPiece(output, key_value_list_[current_index].key);  // key
     CHECK_LT(next_index - current_index, kInt32Max);
-    WriteVarint32(output, next_index - current_index);
-    while (current_index < next_index) {  // values
-      WriteMemoryPiece(output, key_value_list_[current_index].value);
+    bool succeeded = writer.WriteKey(key_value_list_[current_index].key,
+                                     next_index - current_index);
+    while (succeeded && current_index < next_index) {  // values
+      succeeded = writer.WriteValue(key_value_list_[current_index].value);
       ++current_index;
     }
+    if (!succeeded) {
+      LOG(FATAL) << "Failed writing disk swap file: " << filename;
+    }
   }
 
-  fclose(output);
+  if (!writer.Close() || fclose(output) != 0) {
+    LOG(FATAL) << "Failed writing disk swap file: " << filename;
+  }
+  Clear();
+}
+
+// Returns the available space in bytes of the filesystem holding
+// |filebase|, or 0 if it is unknown.
+static double FreeSpace(const std::string& filebase) {
+  size_t slash = filebase.rfind('/');
+  std::string dir = (slash == std::string::npos) ? std::string(".") :
+      filebase.substr(0, std::max<size_t>(slash, 1));
+  struct statvfs stat;
+  if (statvfs(dir.c_str(), &stat) != 0) {
+    LOG(WARNING) << "Cannot get free space of " << dir;
+    return 0;
+  }
+  return static_cast<double>(stat.f_bavail) * stat.f_frsize;
+}
+
+int SortedBuffer::ChooseFilebase() {
+  if (placement_ == kRoundRobinPlacement || filebases_.size() == 1) {
+    return filenames_.size() % filebases_.size();
+  }
+
+  // Smooth weighted round-robin: every filebase earns its free space
+  // as credits, the richest one is chosen and pays the total.
+  double total = 0;
+  int chosen = 0;
+  for (size_t i = 0; i < filebases_.size(); ++i) {
+    double free_space = FreeSpace(filebases_[i]);
+    placement_credits_[i] += free_space;
+    total += free_space;
+    if (placement_credits_[i] > placement_credits_[chosen]) {
+      chosen = i;
+    }
+  }
+  if (total <= 0) {
+    return filenames_.size() % filebases_.size();
+  }
+  placement_credits_[chosen] -= total;
+  return chosen;
+}
+
+void SortedBuffer::Sort() {
+  ParallelSort(key_value_list_.begin(), key_value_list_.end(),
+               KeyValuePairLessThan, num_sort_threads_);
+}
+
+void SortedBuffer::Clear() {
   key_value_list_.clear();
   allocator_->Reset();
 }
@@ -107,15 +224,25 @@ SortedBufferIterator* SortedBuffer::CreateIterator() const {
   if (allocator_->AllocatedSize() > 0) {
     LOG(FATAL) << "You must invoke Flush before CreateIterator.";
   }
-  return new SortedBufferIteratorImpl(filebase_, count_files_);
+  return new SortedBufferIteratorImpl(filenames_, NULL, true);
+}
+
+SortedBufferIterator* SortedBuffer::CreateInMemoryIterator() {
+  if (key_value_list_.empty()) {
+    return new SortedBufferIteratorImpl(filenames_, NULL, true);
+  }
+  Sort();
+  return new SortedBufferIteratorImpl(filenames_,
+                                      new InMemoryRunReader(&key_value_list_),
+                                      true);
 }
 
 void SortedBuffer::RemoveBufferFiles() const {
   if (allocator_->AllocatedSize() > 0) {
     LOG(FATAL) << "You must invoke Flush before RemoveBufferFiles.";
   }
-  for (int i = 0; i < count_files_; ++i) {
-    std::string filename = SortedFilename(filebase_, i);
+  for (size_t i = 0; i < filenames_.size(); ++i) {
+    const std::string& filename = filenames_[i];
     LOG(INFO) << "Removing : " << filename;
     if (remove(filename.c_str()) < 0) {
       LOG(ERROR) << "Cannot remove file: " << filename;
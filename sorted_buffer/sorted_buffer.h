@@ -24,10 +24,27 @@ class SortedBufferIterator;
 // a disk file and the buffer is cleared.  This ensures that key-value
 // pairs in each file are sorted.  This gives SortedBufferIterator the
 // chance to traverse all files for sorted map outputs.
+//
+// Disk files are written in the block format defined in block_file.h.
+// If |compress_files| is true, blocks are compressed using zlib.
+// Flush sorts the buffer using |num_sort_threads| threads.
+//
+// |disk_file_base| might be a comma-separated list of filebases,
+// usually on different disks.  Each disk file is placed under one of
+// them, as specified by |placement|, and iterators read all disk files
+// concurrently.
 class SortedBuffer {
  public:
+  enum Placement {
+    kRoundRobinPlacement,       // Filebases in turn.
+    kFreeSpacePlacement,        // Weighted by free space of filebases.
+  };
+
   SortedBuffer(const std::string& disk_file_base,
-                    int in_memory_buffer_size);
+                    int in_memory_buffer_size,
+                    bool compress_files = true,
+                    int num_sort_threads = 1,
+                    Placement placement = kRoundRobinPlacement);
   ~SortedBuffer();
 
   void Insert(const std::string& key, const std::string& value);
@@ -37,13 +54,24 @@ class SortedBuffer {
   // The caller is responsible to delete the iterator.
   SortedBufferIterator* CreateIterator() const;
 
+  // Sorts the in-memory content and returns an iterator that merges it
+  // with the flushed files, without writing it to disk.  The buffer
+  // must not be changed before the iterator is deleted.  Call Clear()
+  // afterwards to drop the in-memory content.  The caller is
+  // responsible to delete the iterator.
+  SortedBufferIterator* CreateInMemoryIterator();
+
+  // Drops the in-memory content without writing it to disk.
+  void Clear();
+
   // Remove buffer files generated by Flush().
   void RemoveBufferFiles() const;
 
   static std::string SortedFilename(const std::string filebase, int index);
 
   NaiveMemoryAllocator* Allocator() { return allocator_.get(); }
-  int NumFiles() { return count_files_; }
+  int NumFiles() { return filenames_.size(); }
+  const std::vector<std::string>& Filenames() const { return filenames_; }
 
  private:
   struct KeyValuePair {
@@ -55,15 +83,27 @@ class SortedBuffer {
   };
   typedef std::vector<KeyValuePair> KeyValueList;
 
+  class InMemoryRunReader;
+
+  // Sorts key_value_list_ by key.
+  void Sort();
+
+  // Returns the index of the filebase of the next disk file.
+  int ChooseFilebase();
+
   static bool KeyValuePairLessThan(const KeyValuePair& x,
                                    const KeyValuePair& y);
   static bool KeyValuePairEqual(const KeyValuePair& x,
                                 const KeyValuePair& y);
 
   KeyValueList key_value_list_;
-  std::string filebase_;
+  std::vector<std::string> filebases_;
+  std::vector<std::string> filenames_;  // Disk files in order of Flush.
   boost::scoped_ptr<NaiveMemoryAllocator> allocator_;
-  int count_files_;
+  bool compress_files_;
+  int num_sort_threads_;
+  Placement placement_;
+  std::vector<double> placement_credits_;  // Used by kFreeSpacePlacement.
 
   DISALLOW_COPY_AND_ASSIGN(SortedBuffer);
 };
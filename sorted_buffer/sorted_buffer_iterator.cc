@@ -3,7 +3,7 @@
 //
 #include "sorted_buffer/sorted_buffer_iterator.h"
 
-#include "base/varint32.h"
+#include "sorted_buffer/block_file.h"
 #include "sorted_buffer/memory_piece.h"
 #include "sorted_buffer/sorted_buffer.h"
 
@@ -11,31 +11,54 @@ namespace sorted_buffer {
 
 SortedBufferIteratorImpl::SortedBufferIteratorImpl(const std::string& filebase,
                                                    int num_files) {
-  Initialize(filebase, num_files);
+  CHECK_LE(0, num_files);
+  std::vector<std::string> filenames;
+  for (int i = 0; i < num_files; ++i) {
+    filenames.push_back(SortedBuffer::SortedFilename(filebase, i));
+  }
+  Initialize(filenames, NULL, false);
+}
+
+SortedBufferIteratorImpl::SortedBufferIteratorImpl(
+    const std::vector<std::string>& filenames,
+    SortedRunReader* in_memory_run,
+    bool prefetch) {
+  Initialize(filenames, in_memory_run, prefetch);
 }
 
 SortedBufferIteratorImpl::~SortedBufferIteratorImpl() {
   Clear();
 }
 
-void SortedBufferIteratorImpl::Initialize(const std::string& filebase,
-                                          int num_files) {
-  CHECK_LE(0, num_files);
-  filebase_ = filebase;
-
-  for (int i = 0; i < num_files; ++i) {
+void SortedBufferIteratorImpl::Initialize(
+    const std::vector<std::string>& filenames,
+    SortedRunReader* in_memory_run,
+    bool prefetch) {
+  for (size_t i = 0; i < filenames.size(); ++i) {
     SortedStringFile* file = new SortedStringFile;
     files_.push_back(file);
 
-    file->index = i;
-    file->input =
-        fopen(SortedBuffer::SortedFilename(filebase, i).c_str(), "r");
+    file->filename = filenames[i];
+    file->input = fopen(filenames[i].c_str(), "r");
     if (file->input == NULL) {
-      LOG(FATAL) << "Cannot open file: "
-                 << SortedBuffer::SortedFilename(filebase, i);
+      LOG(FATAL) << "Cannot open file: " << filenames[i];
     }
-    CHECK(LoadKey(file));
-    CHECK(LoadValue(file));
+    file->reader = new BlockFileReader(file->input, prefetch);
+  }
+
+  if (in_memory_run != NULL) {
+    SortedStringFile* file = new SortedStringFile;
+    files_.push_back(file);
+    file->filename = "in-memory run";
+    file->input = NULL;
+    file->reader = in_memory_run;
+  }
+
+  // Load after all readers are created, so prefetching threads of all
+  // files read their first blocks concurrently.
+  for (SSFileList::iterator i = files_.begin(); i != files_.end(); ++i) {
+    CHECK(LoadKey(*i));
+    CHECK(LoadValue(*i));
   }
 
   RelocateMergeSource();
@@ -46,6 +69,15 @@ const std::string& SortedBufferIteratorImpl::key() const {
 }
 
 const std::string& SortedBufferIteratorImpl::value() const {
+  merge_source_->top_value.CopyToString(&current_value_);
+  return current_value_;
+}
+
+StringPiece SortedBufferIteratorImpl::key_view() const {
+  return current_key_;
+}
+
+StringPiece SortedBufferIteratorImpl::value_view() const {
   return merge_source_->top_value;
 }
 
@@ -89,10 +121,10 @@ bool SortedBufferIteratorImpl::FinishedAll() const {
 bool SortedBufferIteratorImpl::LoadValue(SortedStringFile* file) {
   if (file->num_rest_values > 0) {
     --(file->num_rest_values);
-    if (!ReadMemoryPiece(file->input, &(file->top_value))) {
+    if (!file->reader->ReadMemoryPiece(&(file->top_value))) {
       LOG(FATAL) << "Error loading value for "
                  << "key = " << file->top_key << " file = "
-                 << SortedBuffer::SortedFilename(filebase_, file->index);
+                 << file->filename;
     }
     return true;
   }
@@ -100,18 +132,18 @@ bool SortedBufferIteratorImpl::LoadValue(SortedStringFile* file) {
 }
 
 bool SortedBufferIteratorImpl::LoadKey(SortedStringFile* file) {
-  if (!ReadMemoryPiece(file->input, &(file->top_key))) {
+  StringPiece key;
+  if (!file->reader->ReadMemoryPiece(&key)) {
     --(file->num_rest_values);  // Negative value means "end-of-sorted_buffer".
     return false;
   }
-  if (!ReadVarint32(file->input,
-                    reinterpret_cast<uint32*>(&(file->num_rest_values)))) {
-    LOG(FATAL) << "Error load num_rest_values from: "
-               << SortedBuffer::SortedFilename(filebase_, file->index);
+  key.CopyToString(&(file->top_key));
+  if (!file->reader->ReadVarint32(
+          reinterpret_cast<uint32*>(&(file->num_rest_values)))) {
+    LOG(FATAL) << "Error load num_rest_values from: " << file->filename;
   }
   if (file->num_rest_values <= 0) {
-    LOG(FATAL) << "Zero num_rest_values loaded from "
-               << SortedBuffer::SortedFilename(filebase_, file->index);
+    LOG(FATAL) << "Zero num_rest_values loaded from " << file->filename;
   }
   return true;
 }
@@ -145,7 +177,10 @@ SortedBufferIteratorImpl::FindNextMergeSourceWithEqualKey() {
 
 void SortedBufferIteratorImpl::Clear() {
   for (SSFileList::iterator i = files_.begin(); i != files_.end(); ++i) {
-    fclose((*i)->input);
+    delete (*i)->reader;
+    if ((*i)->input != NULL) {
+      fclose((*i)->input);
+    }
     delete *i;
   }
   files_.clear();
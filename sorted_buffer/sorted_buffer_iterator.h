@@ -6,18 +6,27 @@
 
 #include <list>
 #include <string>
+#include <vector>
 
 #include "base/common.h"
 #include "sorted_buffer/memory_piece.h"
+#include "sorted_buffer/sorted_run_reader.h"
+#include "strutil/string_piece.h"
 
 namespace sorted_buffer {
 
 // The interface of iterator.
+//
+// key_view() and value_view() refer to the data without copying it,
+// and are valid until the next invocation of Next().  key() and
+// value() copy the data into strings.
 class SortedBufferIterator {
  public:
   virtual ~SortedBufferIterator() {}
   virtual const std::string& key() const = 0;
   virtual const std::string& value() const = 0;
+  virtual StringPiece key_view() const { return key(); }
+  virtual StringPiece value_view() const { return value(); }
   virtual bool Done() const = 0;          // Done with values of current key.
   virtual void Next() = 0;                // Jump to the next value
   virtual void DiscardRestValues() = 0;   // Jump until all values are skipped.
@@ -27,12 +36,23 @@ class SortedBufferIterator {
 // Traverse disk files generated by SortedBuffer for sorted map outputs.
 class SortedBufferIteratorImpl : public SortedBufferIterator {
  public:
+  // Merges files SortedBuffer::SortedFilename(filebase, 0..num_files-1).
   SortedBufferIteratorImpl(const std::string& filebase,
                            int num_files);
+
+  // Merges |filenames|, in this order.  If |in_memory_run| is not
+  // NULL, it is merged as the last run, and the iterator takes its
+  // ownership.  If |prefetch| is true, each file is read by a
+  // background thread.
+  SortedBufferIteratorImpl(const std::vector<std::string>& filenames,
+                           SortedRunReader* in_memory_run,
+                           bool prefetch);
   virtual ~SortedBufferIteratorImpl();
 
   virtual const std::string& key() const;
   virtual const std::string& value() const;
+  virtual StringPiece key_view() const;
+  virtual StringPiece value_view() const;
   virtual bool Done() const;          // Done with values of current key.
   virtual void Next();                // Jump to the next value of current key
   virtual void DiscardRestValues();   // Jump skip all values of current key.
@@ -42,10 +62,11 @@ class SortedBufferIteratorImpl : public SortedBufferIterator {
 
  private:
   struct SortedStringFile {
-    FILE* input;
-    int index;
+    FILE* input;              // NULL for the in-memory run.
+    SortedRunReader* reader;
+    std::string filename;
     std::string top_key;
-    std::string top_value;
+    StringPiece top_value;  // Refers to the block buffer of reader.
     int32 num_rest_values;  // number of values of top_key left in current
                             // file. 0 means no value for the key on disk
                             // but might be one in top_key.  Negative
@@ -55,15 +76,17 @@ class SortedBufferIteratorImpl : public SortedBufferIterator {
   typedef std::list<SortedStringFile*> SSFileList;
 
   std::string current_key_;
-  std::string filebase_;
+  mutable std::string current_value_;  // Copied from the view by value().
   SSFileList files_;
   SortedStringFile* merge_source_;  // The file with the minimum top_key.
                                     // merge_source_==NULL means no file is
                                     // valid and Finished() should be true.
 
-  // Invoked by ctor. Open all block files (specified by filebase and
-  // num_files).  Requires that each file contains at least one key-value pair.
-  void Initialize(const std::string& filebase, int num_files);
+  // Invoked by ctor. Open all block files.  Requires that each file
+  // contains at least one key-value pair.
+  void Initialize(const std::vector<std::string>& filenames,
+                  SortedRunReader* in_memory_run,
+                  bool prefetch);
 
   // Invoked by dtor.
   void Clear();
@@ -39,4 +39,34 @@ TEST(SortedBufferIteratorTest, SortedBufferIterator) {
   }
 }
 
+TEST(SortedBufferIteratorTest, KeyAndValueViews) {
+  static const std::string kTmpFilebase("/tmp/testSortedBufferIteratorViews");
+  static const int kInMemBufferSize = 40;  // Can hold two key-value pairs
+  static const std::string kSomeStrings[] = {
+    "applee", "banana", "applee", "papaya", "banana" };
+  static const int kNumStrings = sizeof(kSomeStrings)/sizeof(kSomeStrings[0]);
+  int num_files = 0;
+  {
+    SortedBuffer buffer(kTmpFilebase, kInMemBufferSize);
+    for (int k = 0; k < kNumStrings; ++k) {
+      buffer.Insert(kSomeStrings[k], kSomeStrings[k] + "-value");
+    }
+    buffer.Flush();
+    num_files = buffer.NumFiles();
+  }
+
+  int count = 0;
+  for (SortedBufferIteratorImpl iter(kTmpFilebase, num_files);
+       !iter.FinishedAll(); iter.NextKey()) {
+    for (; !iter.Done(); iter.Next()) {
+      EXPECT_EQ(iter.key(), iter.key_view().as_string());
+      EXPECT_EQ(iter.key_view().as_string() + "-value",
+                iter.value_view().as_string());
+      EXPECT_TRUE(iter.value_view() == StringPiece(iter.value()));
+      ++count;
+    }
+  }
+  EXPECT_EQ(kNumStrings, count);
+}
+
 }  // namespace sorted_buffer
@@ -3,9 +3,15 @@
 //
 #include "sorted_buffer/sorted_buffer.h"
 
+#include <algorithm>
+#include <map>
+#include <vector>
+
 #include "base/common.h"
-#include "base/varint32.h"
 #include "gtest/gtest.h"
+#include "sorted_buffer/block_file.h"
+#include "sorted_buffer/sorted_buffer_iterator.h"
+#include "strutil/stringprintf.h"
 
 namespace sorted_buffer {
 
@@ -32,20 +38,22 @@ TEST_F(SortedBufferTest, OneFlushFile) {
   std::string filename = kTmpFilebase + "-0000000000";
   FILE* input = fopen(filename.c_str(), "r");
   CHECK(input != NULL);
+  BlockFileReader reader(input);
 
   std::string piece;
   uint32 num_values;
   for (int k = 0; k < sizeof(kSomeStrings)/sizeof(kSomeStrings[0]); ++k) {
-    EXPECT_TRUE(ReadMemoryPiece(input, &piece)) << "k = " << k;
+    EXPECT_TRUE(reader.ReadMemoryPiece(&piece)) << "k = " << k;
     EXPECT_EQ(piece, kSomeStrings[k]);
-    EXPECT_TRUE(ReadVarint32(input, &num_values));
+    EXPECT_TRUE(reader.ReadVarint32(&num_values));
     EXPECT_EQ(num_values, k + 1);
 
     for (int v = 0; v <= k; ++v) {
-      EXPECT_TRUE(ReadMemoryPiece(input, &piece));
+      EXPECT_TRUE(reader.ReadMemoryPiece(&piece));
       EXPECT_EQ(piece, kSomeStrings[v]);
     }
   }
+  EXPECT_FALSE(reader.ReadMemoryPiece(&piece));
 
   fclose(input);
 }
@@ -67,4 +75,92 @@ TEST_F(SortedBufferTest, MultipleFlushFiles) {
   }
 }
 
+// Inserts key-value pairs into a buffer which can hold
+// |kInMemBufferSize| bytes, and checks that CreateInMemoryIterator
+// returns all of them, in order, without writing the in-memory run.
+static void CheckInMemoryIterator(int kInMemBufferSize,
+                                  int expected_num_files) {
+  static const std::string kTmpFilebase("/tmp/testInMemoryIterator");
+  static const std::string kSomeStrings[] = {
+    "papaya", "applee", "orange", "applee", "banana", "papaya", "applee" };
+  static const int kNumStrings = sizeof(kSomeStrings)/sizeof(kSomeStrings[0]);
+
+  std::map<std::string, std::vector<std::string> > expected;
+  SortedBuffer buffer(kTmpFilebase, kInMemBufferSize);
+  for (int k = 0; k < kNumStrings; ++k) {
+    std::string value = StringPrintf("%06d", k);
+    buffer.Insert(kSomeStrings[k], value);
+    expected[kSomeStrings[k]].push_back(value);
+  }
+  EXPECT_EQ(expected_num_files, buffer.NumFiles());
+
+  std::map<std::string, std::vector<std::string> > actual;
+  SortedBufferIteratorImpl* iter = reinterpret_cast<SortedBufferIteratorImpl*>(
+      buffer.CreateInMemoryIterator());
+  std::string previous_key;
+  for (; !iter->FinishedAll(); iter->NextKey()) {
+    EXPECT_LT(previous_key, iter->key());
+    previous_key = iter->key();
+    for (; !iter->Done(); iter->Next()) {
+      actual[iter->key()].push_back(iter->value());
+    }
+  }
+  delete iter;
+
+  EXPECT_EQ(expected_num_files, buffer.NumFiles());
+  EXPECT_EQ(expected.size(), actual.size());
+  for (std::map<std::string, std::vector<std::string> >::iterator
+           i = expected.begin(); i != expected.end(); ++i) {
+    std::sort(i->second.begin(), i->second.end());
+    std::sort(actual[i->first].begin(), actual[i->first].end());
+    EXPECT_TRUE(i->second == actual[i->first]) << "key = " << i->first;
+  }
+
+  buffer.Clear();
+  buffer.RemoveBufferFiles();
+}
+
+TEST_F(SortedBufferTest, InMemoryIteratorWithoutFiles) {
+  CheckInMemoryIterator(1024, 0);
+}
+
+TEST_F(SortedBufferTest, InMemoryIteratorWithFiles) {
+  CheckInMemoryIterator(60, 2);  // Can hold three key-value pairs
+}
+
+TEST_F(SortedBufferTest, StripedFlushFiles) {
+  static const std::string kTmpFilebases("/tmp/testStriped0,/tmp/testStriped1");
+  static const int kInMemBufferSize = 50;  // Can hold two key-value pairs
+  static const std::string kValue("123456");
+
+  for (int placement = SortedBuffer::kRoundRobinPlacement;
+       placement <= SortedBuffer::kFreeSpacePlacement; ++placement) {
+    SortedBuffer buffer(kTmpFilebases, kInMemBufferSize, true, 1,
+                        static_cast<SortedBuffer::Placement>(placement));
+    for (int k = 0; k < 8; ++k) {
+      buffer.Insert(StringPrintf("key%06d", 7 - k), kValue);
+    }
+    buffer.Flush();
+    ASSERT_EQ(4, buffer.NumFiles());
+    if (placement == SortedBuffer::kRoundRobinPlacement) {
+      for (int i = 0; i < buffer.NumFiles(); ++i) {
+        EXPECT_EQ(SortedBuffer::SortedFilename(
+                      StringPrintf("/tmp/testStriped%d", i % 2), i),
+                  buffer.Filenames()[i]);
+      }
+    }
+
+    SortedBufferIteratorImpl* iter =
+        reinterpret_cast<SortedBufferIteratorImpl*>(buffer.CreateIterator());
+    int k = 0;
+    for (; !iter->FinishedAll(); iter->NextKey(), ++k) {
+      EXPECT_EQ(StringPrintf("key%06d", k), iter->key());
+      EXPECT_EQ(kValue, iter->value());
+    }
+    EXPECT_EQ(8, k);
+    delete iter;
+    buffer.RemoveBufferFiles();
+  }
+}
+
 }  // namespace sorted_buffer
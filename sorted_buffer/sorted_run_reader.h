@@ -0,0 +1,30 @@
+
+
+//
+// SortedRunReader is the interface of reading a sorted run of
+// key-value pairs, as a sequence of pieces: for each key, the key,
+// the number of values, and the values.  SortedBufferIteratorImpl
+// merges sorted runs, which are either disk files (BlockFileReader) or
+// the in-memory content of a SortedBuffer.
+//
+#ifndef SORTED_BUFFER_SORTED_RUN_READER_H_
+#define SORTED_BUFFER_SORTED_RUN_READER_H_
+
+#include "base/common.h"
+#include "strutil/string_piece.h"
+
+namespace sorted_buffer {
+
+class SortedRunReader {
+ public:
+  virtual ~SortedRunReader() {}
+
+  // Both return false at the end of the run.  |piece| is valid until
+  // the next read.
+  virtual bool ReadMemoryPiece(StringPiece* piece) = 0;
+  virtual bool ReadVarint32(uint32* value) = 0;
+};
+
+}  // namespace sorted_buffer
+
+#endif  // SORTED_BUFFER_SORTED_RUN_READER_H_
@@ -0,0 +1,70 @@
+
+
+//
+// StringPiece refers to a range of characters owned by someone else,
+// e.g., a std::string or a buffer of a reader.  It is cheap to copy
+// and does not copy the referred characters.  The user must make sure
+// that the referred characters outlive the StringPiece.
+//
+#ifndef STRUTIL_STRING_PIECE_H_
+#define STRUTIL_STRING_PIECE_H_
+
+#include <string.h>
+
+#include <algorithm>
+#include <ostream>
+#include <string>
+
+class StringPiece {
+ public:
+  StringPiece() : data_(NULL), size_(0) {}
+  StringPiece(const char* data, size_t size) : data_(data), size_(size) {}
+  StringPiece(const std::string& s) : data_(s.data()), size_(s.size()) {}
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  void set(const char* data, size_t size) {
+    data_ = data;
+    size_ = size;
+  }
+
+  char operator[](size_t i) const { return data_[i]; }
+
+  std::string as_string() const { return std::string(data_, size_); }
+  void CopyToString(std::string* target) const {
+    target->assign(data_, size_);
+  }
+
+  // Returns <0, 0 or >0 as memcmp, comparing in lexical order.
+  int compare(const StringPiece& x) const {
+    int r = memcmp(data_, x.data_, std::min(size_, x.size_));
+    if (r == 0) {
+      r = (size_ < x.size_) ? -1 : ((size_ > x.size_) ? 1 : 0);
+    }
+    return r;
+  }
+
+ private:
+  const char* data_;
+  size_t size_;
+};
+
+inline bool operator==(const StringPiece& x, const StringPiece& y) {
+  return x.size() == y.size() && memcmp(x.data(), y.data(), x.size()) == 0;
+}
+
+inline bool operator!=(const StringPiece& x, const StringPiece& y) {
+  return !(x == y);
+}
+
+inline bool operator<(const StringPiece& x, const StringPiece& y) {
+  return x.compare(y) < 0;
+}
+
+inline std::ostream& operator<<(std::ostream& o, const StringPiece& piece) {
+  return o.write(piece.data(), piece.size());
+}
+
+#endif  // STRUTIL_STRING_PIECE_H_
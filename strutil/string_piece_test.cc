@@ -0,0 +1,38 @@
+
+
+//
+#include "strutil/string_piece.h"
+
+#include <sstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+TEST(StringPieceTest, RefersToString) {
+  std::string s("hello");
+  StringPiece p(s);
+  EXPECT_EQ(s.data(), p.data());
+  EXPECT_EQ(5, p.size());
+  EXPECT_EQ('e', p[1]);
+  EXPECT_EQ(s, p.as_string());
+
+  std::string copy;
+  p.CopyToString(&copy);
+  EXPECT_EQ(s, copy);
+
+  std::ostringstream o;
+  o << p;
+  EXPECT_EQ(s, o.str());
+
+  EXPECT_TRUE(StringPiece().empty());
+}
+
+TEST(StringPieceTest, Compare) {
+  EXPECT_TRUE(StringPiece("abc", 3) == StringPiece(std::string("abc")));
+  EXPECT_TRUE(StringPiece("abc", 3) != StringPiece("abd", 3));
+  EXPECT_TRUE(StringPiece("ab", 2) < StringPiece("abc", 3));
+  EXPECT_TRUE(StringPiece("abc", 3) < StringPiece("abd", 3));
+  EXPECT_FALSE(StringPiece("abc", 3) < StringPiece("abc", 3));
+  EXPECT_TRUE(StringPiece() < StringPiece("a", 1));
+  EXPECT_EQ(0, StringPiece().compare(StringPiece("", 0)));
+}